@@ -0,0 +1,106 @@
+/**
+ * In-node key search for the tlx B+ tree variants under ds/.
+ *
+ * find_lower / find_upper scan small nodes linearly. For long long keys under
+ * std::less the scan is replaced with a compare-and-count kernel over the raw
+ * key array, picked at compile time: AVX2 (4 keys per step) if the build
+ * enables it (e.g., -mavx2 or -march=native), otherwise SSE4.2 (2 keys per
+ * step), otherwise a branch-free scalar loop. Other key types keep the plain
+ * comparator loop.
+ *
+ * Keys are read with a fixed byte stride so the same kernel serves inner nodes
+ * (a plain key array) and leaves (an array of key/value pairs). A 16 byte
+ * stride is handled by unpacking the key lanes of two pair loads; counting
+ * does not care that this visits keys out of order.
+ */
+#ifndef BTREE_SEARCH_H
+#define BTREE_SEARCH_H
+
+#include <cstddef>
+#include <functional>
+#include <type_traits>
+#if defined(__AVX2__) || defined(__SSE4_2__)
+#include <immintrin.h>
+#endif
+
+namespace tlx {
+
+//! Returns the number of keys among the n keys starting at keys (Stride bytes
+//! apart) that are less than key, or less or equal to key if Inclusive. For a
+//! sorted node this is the slot find_lower (Inclusive = false) or find_upper
+//! (Inclusive = true) returns.
+template <bool Inclusive, size_t Stride, typename Key, typename Compare>
+struct key_search {
+    static unsigned short count(const Key* keys, unsigned short n,
+                                const Key& key, const Compare& less) {
+        const char* p = (const char*)keys;
+        unsigned short lo = 0;
+        while (lo < n) {
+            const Key& k = *(const Key*)(p + (size_t)lo * Stride);
+            if (Inclusive ? less(key, k) : !less(k, key)) break;
+            ++lo;
+        }
+        return lo;
+    }
+};
+
+template <bool Inclusive, size_t Stride>
+struct key_search<Inclusive, Stride, long long, std::less<long long> > {
+    static unsigned short count(const long long* keys, unsigned short n,
+                                const long long& key,
+                                const std::less<long long>&) {
+        const char* p = (const char*)keys;
+        unsigned short lo = 0;
+#if defined(__AVX2__)
+        if (Stride == sizeof(long long) || Stride == 2 * sizeof(long long)) {
+            const __m256i kv = _mm256_set1_epi64x(key);
+            for (; lo + 4 <= n; lo += 4) {
+                const char* q = p + (size_t)lo * Stride;
+                __m256i v;
+                if (Stride == sizeof(long long)) {
+                    v = _mm256_loadu_si256((const __m256i*)q);
+                }
+                else {
+                    v = _mm256_unpacklo_epi64(
+                        _mm256_loadu_si256((const __m256i*)q),
+                        _mm256_loadu_si256((const __m256i*)(q + 2 * Stride)));
+                }
+                int less = Inclusive
+                    ? ~_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(v, kv))) & 0xF
+                    : _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(kv, v)));
+                if (less != 0xF) return lo + __builtin_popcount(less);
+            }
+        }
+#elif defined(__SSE4_2__)
+        if (Stride == sizeof(long long) || Stride == 2 * sizeof(long long)) {
+            const __m128i kv = _mm_set1_epi64x(key);
+            for (; lo + 2 <= n; lo += 2) {
+                const char* q = p + (size_t)lo * Stride;
+                __m128i v;
+                if (Stride == sizeof(long long)) {
+                    v = _mm_loadu_si128((const __m128i*)q);
+                }
+                else {
+                    v = _mm_unpacklo_epi64(
+                        _mm_loadu_si128((const __m128i*)q),
+                        _mm_loadu_si128((const __m128i*)(q + Stride)));
+                }
+                int less = Inclusive
+                    ? ~_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(v, kv))) & 0x3
+                    : _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(kv, v)));
+                if (less != 0x3) return lo + __builtin_popcount(less);
+            }
+        }
+#endif
+        unsigned short c = lo;
+        for (; lo < n; ++lo) {
+            long long k = *(const long long*)(p + (size_t)lo * Stride);
+            c += Inclusive ? (k <= key) : (k < key);
+        }
+        return c;
+    }
+};
+
+} // namespace tlx
+
+#endif /* BTREE_SEARCH_H */
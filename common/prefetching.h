@@ -1,13 +1,37 @@
 #ifndef _LINUX_PREFETCH_H
 #define _LINUX_PREFETCH_H
 
+#include <cstddef>
+#include <cstdint>
+
+#ifndef PREFETCH_LINE_SIZE
+#define PREFETCH_LINE_SIZE 64
+#endif
+
+/**
+ * Prefetches (for reading) every cache line overlapping [addr, addr+len),
+ * whether or not USE_PREFETCHING is defined. For code whose whole point is
+ * to overlap misses, e.g. the batched lookups of the btree variants.
+ */
+static inline void prefetch_lines(void *addr, size_t len)
+{
+    char * cachelineAddr = (char *) ((uintptr_t) addr & ~(uintptr_t) (PREFETCH_LINE_SIZE - 1));
+    char * end = (char *) addr + len;
+    for (; cachelineAddr < end; cachelineAddr += PREFETCH_LINE_SIZE) {
+        __builtin_prefetch(cachelineAddr, 0);
+    }
+}
+
+/**
+ * Like prefetch_lines, but compiled to nothing unless USE_PREFETCHING is
+ * defined, so data structures can call it unconditionally on their descent
+ * paths. Prefetching a null or stale pointer is harmless.
+ */
 static inline void prefetch_range(void *addr, size_t len)
 {
-//    char * cachelineAddr = (char *) addr;
-//    char * end = cachelineAddr + len;
-//    for (; cachelineAddr < end; cachelineAddr += 4*64) {
-//        __builtin_prefetch(cachelineAddr, 1);
-//    }
+#ifdef USE_PREFETCHING
+    prefetch_lines(addr, len);
+#endif
 }
 
 #endif
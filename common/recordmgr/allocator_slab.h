@@ -0,0 +1,277 @@
+/**
+ * Thread caching slab allocator.
+ *
+ * Each thread carves records of type T out of its own slabs. A slab is a
+ * SLAB_MIN_BYTES (or larger) chunk, aligned to its size, whose first cache
+ * line records the thread that owns it, so the owner of any record is found
+ * by masking its address. Since every record type gets its own allocator
+ * (see rebind), each of inner_node, leaf_node, rb_node, ... is served from a
+ * size class of its own, rounded up to whole cache lines.
+ *
+ * A record freed by its owner goes on the owner's free list. With DEBRA the
+ * thread that retires a node also frees it, which is usually not the thread
+ * that allocated it. Such remote frees are collected per owner by the
+ * freeing thread, and each batch of SLAB_REMOTE_BATCH records is pushed onto
+ * the owner's remote free stack with one CAS. The owner takes its whole
+ * remote stack with one exchange when its free list runs dry. Partial
+ * batches are pushed at the end of deallocateAndClear() and in
+ * deinitThread().
+ *
+ * With SLAB_HUGEPAGES, slabs are carved out of per-thread regions of
+ * SLAB_REGION_BYTES that are mapped with explicit 2MB pages (MAP_HUGETLB) if
+ * the system has them reserved, and otherwise aligned to 2MB and advised with
+ * MADV_HUGEPAGE so transparent huge pages back them. Nodes then share a few
+ * TLB entries instead of needing one per 4KB page.
+ *
+ * Memory is returned to the system only when the allocator is destroyed.
+ */
+
+#ifndef ALLOC_SLAB_H
+#define	ALLOC_SLAB_H
+
+#include "plaf.h"
+#include "globals.h"
+#include "errors.h"
+#include "allocator_interface.h"
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <vector>
+#ifdef SLAB_HUGEPAGES
+#include <sys/mman.h>
+#endif
+
+#ifndef SLAB_MIN_BYTES
+#define SLAB_MIN_BYTES (1<<16)
+#endif
+#ifndef SLAB_REMOTE_BATCH
+#define SLAB_REMOTE_BATCH 32
+#endif
+#ifdef SLAB_HUGEPAGES
+#define SLAB_HUGE_PAGE_BYTES (1<<21)
+#ifndef SLAB_REGION_BYTES
+#define SLAB_REGION_BYTES (32<<20)
+#endif
+#endif
+
+template<typename T = void>
+class allocator_slab : public allocator_interface<T> {
+private:
+    PAD; // post padding for allocator_interface
+
+    struct free_record {
+        free_record * next;
+    };
+    struct remote_batch {
+        free_record * head;
+        free_record * tail;
+        int size;
+    };
+    struct thread_data {
+        PAD;
+        free_record * freeList;
+        char * bump;                    // next unused record in the newest slab
+        char * bumpEnd;
+        std::vector<void *> * slabs;    // slabs (or regions) to free when this allocator is destroyed
+#ifdef SLAB_HUGEPAGES
+        char * regionNext;              // next unused slab in the newest region
+        char * regionEnd;
+#endif
+        remote_batch * batches;         // batches[owner] = records this thread freed for owner
+        PAD;
+        std::atomic<free_record *> remoteFree; // records other threads freed for this thread
+        PAD;
+    };
+
+    const size_t stride;                // bytes per record, a multiple of the cache line size
+    const size_t slabBytes;             // a power of two
+#ifdef SLAB_HUGEPAGES
+    size_t regionBytes;                 // a multiple of regionAlign
+    size_t regionAlign;                 // the larger of slabBytes and the huge page size
+#endif
+    thread_data * threads;
+    PAD;
+
+    static size_t computeSlabBytes(const size_t stride) {
+        size_t bytes = SLAB_MIN_BYTES;
+        while (bytes < BYTES_IN_CACHE_LINE + 64*stride) bytes <<= 1;
+        return bytes;
+    }
+
+    inline int ownerOf(T * const p) {
+        return *(int *) (((uintptr_t) p) & ~(uintptr_t) (slabBytes-1));
+    }
+
+#ifdef SLAB_HUGEPAGES
+    void newRegion(const int tid) {
+        char * region = (char *) mmap(NULL, regionBytes, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (region != MAP_FAILED && ((uintptr_t) region % regionAlign)) {
+            munmap(region, regionBytes);
+            region = (char *) MAP_FAILED;
+        }
+        if (region == MAP_FAILED) {
+            // no reserved huge pages: map extra to align the region, trim the
+            // ends, and ask for transparent huge pages
+            char * mem = (char *) mmap(NULL, regionBytes + regionAlign, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (mem == MAP_FAILED) {
+                setbench_error("allocator_slab could not map a region of "<<regionBytes<<" bytes");
+            }
+            region = (char *) (((uintptr_t) mem + regionAlign - 1) & ~(uintptr_t) (regionAlign - 1));
+            if (region > mem) munmap(mem, region - mem);
+            munmap(region + regionBytes, (mem + regionBytes + regionAlign) - (region + regionBytes));
+            madvise(region, regionBytes, MADV_HUGEPAGE);
+        }
+        threads[tid].slabs->push_back(region);
+        threads[tid].regionNext = region;
+        threads[tid].regionEnd = region + regionBytes;
+    }
+#endif
+
+    void newSlab(const int tid) {
+        void * slab;
+#ifdef SLAB_HUGEPAGES
+        if (threads[tid].regionNext == threads[tid].regionEnd) newRegion(tid);
+        slab = threads[tid].regionNext;
+        threads[tid].regionNext += slabBytes;
+#else
+        if (posix_memalign(&slab, slabBytes, slabBytes)) {
+            setbench_error("allocator_slab could not allocate a slab of "<<slabBytes<<" bytes");
+        }
+        threads[tid].slabs->push_back(slab);
+#endif
+        *(int *) slab = tid;
+        size_t n = (slabBytes - BYTES_IN_CACHE_LINE) / stride;
+        threads[tid].bump = ((char *) slab) + BYTES_IN_CACHE_LINE;
+        threads[tid].bumpEnd = threads[tid].bump + n*stride;
+    }
+
+    void flush(const int tid, const int owner) {
+        remote_batch & b = threads[tid].batches[owner];
+        if (!b.size) return;
+        std::atomic<free_record *> & stack = threads[owner].remoteFree;
+        free_record * old = stack.load(std::memory_order_relaxed);
+        do {
+            b.tail->next = old;
+        } while (!stack.compare_exchange_weak(old, b.head, std::memory_order_release, std::memory_order_relaxed));
+        b.head = b.tail = NULL;
+        b.size = 0;
+    }
+
+    void flushAll(const int tid) {
+        for (int owner=0;owner<this->NUM_PROCESSES;++owner) {
+            flush(tid, owner);
+        }
+    }
+
+public:
+    template<typename _Tp1>
+    struct rebind {
+        typedef allocator_slab<_Tp1> other;
+    };
+
+    // reserve space for ONE object of type T
+    T* allocate(const int tid) {
+        MEMORY_STATS {
+            this->debug->addAllocated(tid, 1);
+        }
+        thread_data & td = threads[tid];
+        if (td.freeList == NULL) {
+            td.freeList = td.remoteFree.exchange(NULL, std::memory_order_acquire);
+        }
+        void * p;
+        if (td.freeList) {
+            p = td.freeList;
+            td.freeList = td.freeList->next;
+        } else {
+            if (td.bump == td.bumpEnd) newSlab(tid);
+            p = td.bump;
+            td.bump += stride;
+        }
+        return new (p) T;
+    }
+    void deallocate(const int tid, T * const p) {
+        MEMORY_STATS {
+            this->debug->addDeallocated(tid, 1);
+        }
+#if !defined NO_FREE
+        p->~T();
+        free_record * r = (free_record *) p;
+        const int owner = ownerOf(p);
+        if (owner == tid) {
+            r->next = threads[tid].freeList;
+            threads[tid].freeList = r;
+            return;
+        }
+        remote_batch & b = threads[tid].batches[owner];
+        r->next = b.head;
+        b.head = r;
+        if (b.tail == NULL) b.tail = r;
+        if (++b.size == SLAB_REMOTE_BATCH) flush(tid, owner);
+#endif
+    }
+    void deallocateAndClear(const int tid, blockbag<T> * const bag) {
+#ifdef NO_FREE
+        bag->clearWithoutFreeingElements();
+#else
+        while (!bag->isEmpty()) {
+            T* ptr = bag->remove();
+            deallocate(tid, ptr);
+        }
+        flushAll(tid);
+#endif
+    }
+
+    void debugPrintStatus(const int tid) {}
+
+    void initThread(const int tid) {}
+    void deinitThread(const int tid) {
+        flushAll(tid);
+    }
+
+    allocator_slab(const int numProcesses, debugInfo * const _debug)
+            : allocator_interface<T>(numProcesses, _debug)
+            , stride((sizeof(T)+(BYTES_IN_CACHE_LINE-1))/BYTES_IN_CACHE_LINE*BYTES_IN_CACHE_LINE)
+            , slabBytes(computeSlabBytes(stride)) {
+        VERBOSE DEBUG COUTATOMIC("constructor allocator_slab"<<std::endl);
+#ifdef SLAB_HUGEPAGES
+        regionAlign = (slabBytes > SLAB_HUGE_PAGE_BYTES) ? slabBytes : SLAB_HUGE_PAGE_BYTES;
+        regionBytes = (SLAB_REGION_BYTES + regionAlign - 1) & ~(regionAlign - 1);
+#endif
+        threads = new thread_data[numProcesses];
+        for (int tid=0;tid<numProcesses;++tid) {
+            threads[tid].freeList = NULL;
+            threads[tid].bump = NULL;
+            threads[tid].bumpEnd = NULL;
+            threads[tid].slabs = new std::vector<void *>();
+#ifdef SLAB_HUGEPAGES
+            threads[tid].regionNext = NULL;
+            threads[tid].regionEnd = NULL;
+#endif
+            threads[tid].batches = new remote_batch[numProcesses]();
+            threads[tid].remoteFree.store(NULL, std::memory_order_relaxed);
+        }
+    }
+    ~allocator_slab() {
+        VERBOSE COUTATOMIC("destructor allocator_slab"<<std::endl);
+        // free all slabs (records still in use are not destructed, as in allocator_bump)
+        for (int tid=0;tid<this->NUM_PROCESSES;++tid) {
+            for (void * slab : *threads[tid].slabs) {
+#ifdef SLAB_HUGEPAGES
+                munmap(slab, regionBytes);
+#else
+                free(slab);
+#endif
+            }
+            delete threads[tid].slabs;
+            delete[] threads[tid].batches;
+        }
+        delete[] threads;
+    }
+};
+
+#endif	/* ALLOC_SLAB_H */
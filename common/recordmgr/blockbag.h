@@ -8,7 +8,9 @@
 #ifndef BLOCKLIST_H
 #define	BLOCKLIST_H
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <iostream>
 #include "blockpool.h"
 #include "plaf.h"
@@ -61,6 +63,16 @@ class block;
                 SOFTWARE_BARRIER;
                 size = sz+1;
             }
+            // pushes as many of the n objects in objs as fit,
+            // and returns how many that was
+            int pushBatch(T * const * const objs, const int n) {
+                const int sz = size;
+                const int k = std::min(n, (int) (BLOCK_SIZE - sz));
+                memcpy(data + sz, objs, k * sizeof(T*));
+                SOFTWARE_BARRIER;
+                size = sz+k;
+                return k;
+            }
             // precondition: !isEmpty()
             T* pop() {
                 assert(size > 0);
@@ -377,6 +389,25 @@ class block;
             DEBUG2 validate();
         }
         
+        // adds the n objects in objs, copying them into each block at once
+        // instead of pushing them one by one
+        void addBatch(T * const * const objs, const int n) {
+            DEBUG2 validate();
+            int oldsize; DEBUG2 oldsize = computeSize();
+            int i = 0;
+            while (i < n) {
+                i += head->pushBatch(objs + i, n - i);
+                if (head->isFull()) {
+                    block<T> *newblock = pool->allocateBlock(head);
+                    ++sizeInBlocks;
+                    SOFTWARE_BARRIER;
+                    head = newblock;
+                }
+            }
+            DEBUG2 assert(oldsize + n == computeSize());
+            DEBUG2 validate();
+        }
+        
         template <typename Alloc>
         void add(const int tid, T * const obj, lockfreeblockbag<T> * const sharedBag, const int thresh, Alloc * const alloc) {
             DEBUG2 validate();
@@ -665,6 +696,11 @@ class block;
         int getSizeInBlocks() {
             return sizeInBlocks;
         }
+        // constant time version of computeSize(),
+        // which relies on every block except the head being full
+        int getSize() {
+            return head->computeSize() + (sizeInBlocks-1)*BLOCK_SIZE;
+        }
         // this function is occasionally useful if, for instance,
         // you use a bump allocator, which hands out objects from
         // a huge slab of memory.
@@ -19,6 +19,9 @@ struct _memrecl_counters {
     long given; // how many blocks have been moved from this pool to a shared pool
     long taken; // how many blocks have been moved from a shared pool to this pool
     long retired; // how many objects have been retired
+    long freed; // how many retired objects the reclaimer has handed back to the pool
+    long obtained; // how many objects the data structure has taken from the record manager
+    long released; // how many objects the data structure has given back without retiring them
     PAD;
 };
 
@@ -38,6 +41,9 @@ public:
             c[tid].given = 0;
             c[tid].taken = 0;
             c[tid].retired = 0;
+            c[tid].freed = 0;
+            c[tid].obtained = 0;
+            c[tid].released = 0;
         }
     }
     void addAllocated(const int tid, const int val) {
@@ -61,6 +67,15 @@ public:
     void addRetired(const int tid, const int val) {
         c[tid].retired += val;
     }
+    void addFreed(const int tid, const int val) {
+        c[tid].freed += val;
+    }
+    void addObtained(const int tid, const int val) {
+        c[tid].obtained += val;
+    }
+    void addReleased(const int tid, const int val) {
+        c[tid].released += val;
+    }
     long getAllocated(const int tid) {
         return c[tid].allocated;
     }
@@ -82,6 +97,15 @@ public:
     long getRetired(const int tid) {
         return c[tid].retired;
     }
+    long getFreed(const int tid) {
+        return c[tid].freed;
+    }
+    long getObtained(const int tid) {
+        return c[tid].obtained;
+    }
+    long getReleased(const int tid) {
+        return c[tid].released;
+    }
     long getTotalAllocated() {
         long result = 0;
         for (int tid=0;tid<NUM_PROCESSES;++tid) {
@@ -131,6 +155,27 @@ public:
         }
         return result;
     }
+    long getTotalFreed() {
+        long result = 0;
+        for (int tid=0;tid<NUM_PROCESSES;++tid) {
+            result += getFreed(tid);
+        }
+        return result;
+    }
+    long getTotalObtained() {
+        long result = 0;
+        for (int tid=0;tid<NUM_PROCESSES;++tid) {
+            result += getObtained(tid);
+        }
+        return result;
+    }
+    long getTotalReleased() {
+        long result = 0;
+        for (int tid=0;tid<NUM_PROCESSES;++tid) {
+            result += getReleased(tid);
+        }
+        return result;
+    }
     debugInfo(int numProcesses) : NUM_PROCESSES(numProcesses) {
 //        c = new _memrecl_counters[numProcesses];
         clear();
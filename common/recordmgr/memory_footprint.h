@@ -0,0 +1,114 @@
+/**
+ * Memory footprint of every record manager that currently exists, in bytes.
+ *
+ * Each record_manager_single_type registers its debugInfo here, together with
+ * the size of its record type. The counters in debugInfo split the records
+ * the allocator has handed out (and not freed) into three parts:
+ *
+ *   live   = obtained - released - retired    (reachable from the data structure)
+ *   limbo  = retired - freed                  (retired, waiting for a grace period)
+ *   pooled = (allocated - deallocated)
+ *          - (obtained - released - freed)    (free, but cached by a pool or arena)
+ *
+ * Counting is done under MEMORY_STATS. Only reclaimer_debra and reclaimer_ibr
+ * count retired and freed records, so with other reclaimers a retired record
+ * still shows up as live. The counters are per-thread and are read without
+ * synchronization, so a sample taken while threads run is only approximately
+ * consistent.
+ *
+ * getMemoryFootprint() sums all sources. Passing it one source gives the
+ * footprint of that record type alone, labelled by the source's name (the
+ * demangled name of the type, see memoryFootprintName()).
+ */
+
+#ifndef MEMORY_FOOTPRINT_H
+#define	MEMORY_FOOTPRINT_H
+
+#include <cctype>
+#include <cstddef>
+#include <cstdlib>
+#include <cxxabi.h>
+#include <string>
+#include <typeinfo>
+#include <vector>
+#include "debug_info.h"
+
+struct memory_footprint_source {
+    const char * name;
+    size_t recordBytes;
+    debugInfo * info;
+};
+
+struct memory_footprint {
+    long long liveBytes;
+    long long limboBytes;
+    long long pooledBytes;
+};
+
+// demangled name of type t, or its typeid name if that fails. it is printed as
+// one token of key=value output, so spaces are dropped, except between two
+// words (as in "long long"), where they become '_'
+inline std::string memoryFootprintName(const std::type_info & t) {
+    int status;
+    char * const demangled = abi::__cxa_demangle(t.name(), NULL, NULL, &status);
+    const std::string full = (status == 0 && demangled) ? demangled : t.name();
+    free(demangled);
+
+    std::string result;
+    for (size_t i=0;i<full.size();++i) {
+        if (full[i] != ' ') {
+            result += full[i];
+        } else if (!result.empty() && i+1 < full.size()
+                && (isalnum(result.back()) || result.back() == '_')
+                && (isalnum(full[i+1]) || full[i+1] == '_')) {
+            result += '_';
+        }
+    }
+    return result;
+}
+
+inline std::vector<memory_footprint_source> & memoryFootprintSources() {
+    static std::vector<memory_footprint_source> sources;
+    return sources;
+}
+
+inline void registerMemoryFootprint(const char * name, const size_t recordBytes, debugInfo * const info) {
+    memoryFootprintSources().push_back({name, recordBytes, info});
+}
+
+inline void unregisterMemoryFootprint(debugInfo * const info) {
+    std::vector<memory_footprint_source> & sources = memoryFootprintSources();
+    for (size_t i=0;i<sources.size();++i) {
+        if (sources[i].info == info) {
+            sources.erase(sources.begin() + i);
+            return;
+        }
+    }
+}
+
+// footprint of the records of one type (or size class)
+inline memory_footprint getMemoryFootprint(const memory_footprint_source & s) {
+    const long long allocated = s.info->getTotalAllocated() - s.info->getTotalDeallocated();
+    const long long held = s.info->getTotalObtained() - s.info->getTotalReleased();
+    const long long retired = s.info->getTotalRetired();
+    const long long freed = s.info->getTotalFreed();
+    memory_footprint result;
+    result.liveBytes = (held - retired) * (long long) s.recordBytes;
+    result.limboBytes = (retired - freed) * (long long) s.recordBytes;
+    result.pooledBytes = (allocated - (held - freed)) * (long long) s.recordBytes;
+    return result;
+}
+
+// footprint of all record types together
+inline memory_footprint getMemoryFootprint() {
+    memory_footprint result = {0, 0, 0};
+    for (memory_footprint_source & s : memoryFootprintSources()) {
+        const memory_footprint m = getMemoryFootprint(s);
+        result.liveBytes += m.liveBytes;
+        result.limboBytes += m.limboBytes;
+        result.pooledBytes += m.pooledBytes;
+    }
+    return result;
+}
+
+#endif	/* MEMORY_FOOTPRINT_H */
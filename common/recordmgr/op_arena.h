@@ -0,0 +1,111 @@
+/**
+ * Per-thread arena for records that an operation allocates speculatively.
+ *
+ * Duplication and path copying allocate a copy of every node they write, and
+ * throw all of them away when the operation fails to commit. The arena keeps
+ * a per-thread array of records that were already taken from the pool and
+ * hands them out by bumping an index (like allocator_bump does with bytes).
+ * abort() rewinds the index to where the operation started, in O(1), so the
+ * next attempt reuses the same records. commit() adopts the records handed
+ * out since then: they now belong to the data structure, and are retired and
+ * freed through the record manager like any other record.
+ *
+ * Records are taken from the pool OP_ARENA_RECORDS at a time, whenever the
+ * array runs out. The records still in the array are returned to the pool in
+ * deinitThread().
+ */
+
+#ifndef OP_ARENA_H
+#define	OP_ARENA_H
+
+#include "plaf.h"
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+#ifndef OP_ARENA_RECORDS
+#define OP_ARENA_RECORDS 64
+#endif
+
+template <typename T, class Pool>
+class op_arena {
+private:
+    struct thread_arena {
+        PAD;
+        T ** recs;      // recs[0..mark) are adopted, recs[mark..top) belong to the
+                        // running operation, recs[top..size) are ready
+        int mark;
+        int top;
+        int size;
+        int capacity;
+        PAD;
+    };
+
+    Pool * const pool;
+    const int NUM_PROCESSES;
+    thread_arena * arenas;
+
+    // drops the adopted records from the front of the array and takes
+    // OP_ARENA_RECORDS more records from the pool
+    void refill(const int tid) {
+        thread_arena & a = arenas[tid];
+        int live = a.size - a.mark;
+        std::memmove(a.recs, a.recs + a.mark, live * sizeof(T *));
+        a.top -= a.mark;
+        a.size = live;
+        a.mark = 0;
+        if (a.size + OP_ARENA_RECORDS > a.capacity) {
+            a.capacity = 2 * (a.size + OP_ARENA_RECORDS);
+            a.recs = (T **) realloc(a.recs, a.capacity * sizeof(T *));
+        }
+        for (int i=0;i<OP_ARENA_RECORDS;++i) {
+            a.recs[a.size++] = pool->get(tid);
+        }
+    }
+
+public:
+    op_arena(const int numProcesses, Pool * const _pool)
+            : pool(_pool), NUM_PROCESSES(numProcesses) {
+        arenas = new thread_arena[numProcesses];
+        for (int tid=0;tid<numProcesses;++tid) {
+            arenas[tid].recs = NULL;
+            arenas[tid].mark = 0;
+            arenas[tid].top = 0;
+            arenas[tid].size = 0;
+            arenas[tid].capacity = 0;
+        }
+    }
+    ~op_arena() {
+        for (int tid=0;tid<NUM_PROCESSES;++tid) {
+            deinitThread(tid);
+            free(arenas[tid].recs);
+        }
+        delete[] arenas;
+    }
+
+    inline T * allocate(const int tid) {
+        thread_arena & a = arenas[tid];
+        if (a.top == a.size) refill(tid);
+        return a.recs[a.top++];
+    }
+    inline void commit(const int tid) {
+        arenas[tid].mark = arenas[tid].top;
+    }
+    // returns how many records the aborted operation gave back
+    inline int abort(const int tid) {
+        const int n = arenas[tid].top - arenas[tid].mark;
+        arenas[tid].top = arenas[tid].mark;
+        return n;
+    }
+
+    void deinitThread(const int tid) {
+        thread_arena & a = arenas[tid];
+        assert(a.mark == a.top);
+        for (int i=a.top;i<a.size;++i) {
+            pool->add(tid, a.recs[i]);
+        }
+        a.mark = a.top = a.size = 0;
+    }
+};
+
+#endif
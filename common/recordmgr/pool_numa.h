@@ -1,6 +1,11 @@
                                                                                                                                             /**
  * NUMA aware bounded object pool
  * 
+ * Records that a thread's reclaimer frees are sent back to the pool of the
+ * NUMA node whose memory holds them (looked up one block at a time with
+ * move_pages), so the records a thread gets from its cpu and node pools, and
+ * the nodes it copies into them, are local to the thread.
+ * 
  * Copyright (C) 2019 Trevor Brown
  *
  */
@@ -9,6 +14,7 @@
 #define	POOL_NUMA_H
 
 #include <cassert>
+#include <cstdint>
 #include <iostream>
 #include <sstream>
 #include "blockbag.h"
@@ -34,6 +40,10 @@ private:
     lfbstack<T> * globalPool;
     lfbstack<T> ** nodePools;
     blockbag<T> ** cpuPools;
+    blockbag<T> ** sortBags;    // full blocks waiting to be sent home, per thread
+    blockbag<T> ** homeBags;    // homeBags[tid*numNodes+node] = records this thread gathered for node
+    int numNodes;
+    long pageBytes;
     PAD;
 
     // possible optimization: have low and high thresholds,
@@ -84,6 +94,46 @@ private:
         }
     }
     
+    // empties bag into the pools of the nodes that hold its records: the
+    // records local to this thread go to its cpu pool, the others are gathered
+    // per node and handed to that node's pool a full block at a time
+    void sendHome(const int tid, blockbag<T> * const bag) {
+        const int node = __numa.get_node_periodic();
+        T * recs[BLOCK_SIZE];
+        void * pages[BLOCK_SIZE];
+        int homes[BLOCK_SIZE];
+        while (!bag->isEmpty()) {
+            int n = 0;
+            while (n < BLOCK_SIZE && !bag->isEmpty()) {
+                recs[n] = bag->remove();
+                pages[n] = (void *) (((uintptr_t) recs[n]) & ~(uintptr_t) (pageBytes-1));
+                ++n;
+            }
+            if (numa_move_pages(0, n, pages, NULL, homes, 0)) {
+                for (int i=0;i<n;++i) homes[i] = node; // unknown: keep them here
+            }
+            int remote = 0;
+            for (int i=0;i<n;++i) {
+                const int home = homes[i];
+                if (home < 0 || home >= numNodes || home == node) {
+                    cpuPools[tid]->add(recs[i]);
+                    continue;
+                }
+                blockbag<T> * const hb = homeBags[tid*numNodes + home];
+                hb->add(recs[i]);
+                block<T> * b;
+                while ((b = hb->removeFullBlock())) {
+                    nodePools[home]->addBlock(b);
+                }
+                ++remote;
+            }
+#ifdef USE_GSTATS
+            GSTATS_ADD(tid, pool_numa_home_local, n - remote);
+            GSTATS_ADD(tid, pool_numa_home_remote, remote);
+#endif
+        }
+    }
+
     void pullBlock(const int tid) {
         // check if we already have a non-empty block
         if (!cpuPools[tid]->isEmpty()) return;
@@ -103,11 +153,17 @@ private:
         // try global pool
         b = globalPool->getBlock();
         if (b) {
-            cpuPools[tid]->addFullBlock(b);
+            if (numNodes > 1) {
+                // the global pool mixes nodes: keep the local records only
+                sortBags[tid]->addFullBlock(b);
+                sendHome(tid, sortBags[tid]);
+            } else {
+                cpuPools[tid]->addFullBlock(b);
+            }
 #ifdef USE_GSTATS
             GSTATS_ADD(tid, move_block_global_to_cpu, 1);
 #endif
-            return;
+            if (!cpuPools[tid]->isEmpty()) return;
         }
         
         // TODO: currently there is no movement of blocks from global pools down to node pools. only directly to cpu pools.
@@ -162,12 +218,19 @@ public:
         // OLD COMMENT (unclear why this would be true... at any rate it's only for debugging output): WARNING: THE FOLLOWING DEBUG COMPUTATION GETS THE WRONG NUMBER OF BLOCKS.
         //MEMORY_STATS2 this->debug->addToPool(tid, (bag->getSizeInBlocks()-1)*BLOCK_SIZE);
 
-        auto sizeBefore = cpuPools[tid]->getSizeInBlocks();
-        cpuPools[tid]->appendMoveFullBlocks(bag);
-        auto sizeAfter = cpuPools[tid]->getSizeInBlocks();
+        if (numNodes > 1) {
+            // sendHome() counts the records it keeps here and the ones it
+            // sends to other nodes (pool_numa_home_local/remote)
+            sortBags[tid]->appendMoveFullBlocks(bag);
+            sendHome(tid, sortBags[tid]);
+        } else {
+            auto sizeBefore = cpuPools[tid]->getSizeInBlocks();
+            cpuPools[tid]->appendMoveFullBlocks(bag);
+            auto sizeAfter = cpuPools[tid]->getSizeInBlocks();
 #ifdef USE_GSTATS
-        GSTATS_ADD(tid, move_block_reclaimer_to_cpu, sizeAfter - sizeBefore);
+            GSTATS_ADD(tid, move_block_reclaimer_to_cpu, sizeAfter - sizeBefore);
 #endif
+        }
 
         tryPushBlocks(tid);
     }
@@ -206,6 +269,17 @@ public:
         for (int tid=0;tid<numProcesses;++tid) {
             cpuPools[tid] = new blockbag<T>(tid, this->blockpools[tid]);
         }
+
+        numNodes = __numa.get_num_nodes();
+        pageBytes = numa_pagesize();
+        sortBags = new blockbag<T> * [numProcesses];
+        homeBags = new blockbag<T> * [numProcesses*numNodes];
+        for (int tid=0;tid<numProcesses;++tid) {
+            sortBags[tid] = new blockbag<T>(tid, this->blockpools[tid]);
+            for (int node=0;node<numNodes;++node) {
+                homeBags[tid*numNodes + node] = new blockbag<T>(tid, this->blockpools[tid]);
+            }
+        }
     }
     ~pool_numa() {
         VERBOSE DEBUG COUTATOMIC("destructor pool_numa"<<std::endl);
@@ -236,6 +310,19 @@ public:
         }
         delete[] nodePools;
         
+        // clean up records that were on their way home
+        for (int tid=0;tid<this->NUM_PROCESSES;++tid) {
+            this->alloc->deallocateAndClear(tid, sortBags[tid]);
+            delete sortBags[tid];
+            for (int node=0;node<numNodes;++node) {
+                auto p = homeBags[tid*numNodes + node];
+                this->alloc->deallocateAndClear(tid, p);
+                delete p;
+            }
+        }
+        delete[] sortBags;
+        delete[] homeBags;
+
         // clean up free bags
         for (int tid=0;tid<this->NUM_PROCESSES;++tid) {
             auto p = cpuPools[tid];
@@ -0,0 +1,130 @@
+/**
+ * Per-thread recycling pool
+ *
+ * Records that a thread's reclaimer frees are kept in that thread's free bag,
+ * a whole block at a time, and its next allocations pop them from there. A
+ * data structure that allocates about as many records as it retires (like the
+ * copying trees, which replace every node they change) thus reaches a steady
+ * state where allocation never reaches the allocator. Nothing is shared
+ * between threads: a thread that retires more than it allocates returns the
+ * surplus to the allocator once its free bag holds more than
+ * POOL_RECYCLE_MAX_BLOCKS blocks.
+ *
+ */
+
+#ifndef POOL_RECYCLE_H
+#define	POOL_RECYCLE_H
+
+#include <cassert>
+#include <iostream>
+#include <sstream>
+#include "blockbag.h"
+#include "blockpool.h"
+#include "pool_interface.h"
+#include "plaf.h"
+
+// upper bound on the size of each thread's free bag, in blocks of BLOCK_SIZE records
+#ifndef POOL_RECYCLE_MAX_BLOCKS
+#define POOL_RECYCLE_MAX_BLOCKS 256
+#endif
+
+template <typename T = void, class Alloc = allocator_interface<T> >
+class pool_recycle : public pool_interface<T, Alloc> {
+private:
+    //PAD; // not needed after superclass layout
+    blockbag<T> ** freeBag;     // freeBag[tid] = records that thread tid can reuse
+    PAD;
+
+    // hand full blocks back to the allocator until the free bag is small enough
+    inline void trim(const int tid) {
+        if (freeBag[tid]->getSizeInBlocks() <= POOL_RECYCLE_MAX_BLOCKS) return; // common case
+        block<T> * b;
+        while (freeBag[tid]->getSizeInBlocks() > POOL_RECYCLE_MAX_BLOCKS
+                && (b = freeBag[tid]->removeFullBlock())) {
+            while (!b->isEmpty()) {
+                this->alloc->deallocate(tid, b->pop());
+            }
+            this->blockpools[tid]->deallocateBlock(b);
+        }
+    }
+public:
+    template <typename _Tp1>
+    struct rebindAlloc {
+        typedef typename Alloc::template rebind<_Tp1>::other other;
+    };
+    template<typename _Tp1>
+    struct rebind {
+        typedef pool_recycle<_Tp1, Alloc> other;
+    };
+    template<typename _Tp1, typename _Tp2>
+    struct rebind2 {
+        typedef pool_recycle<_Tp1, _Tp2> other;
+    };
+
+    std::string getSizeString() {
+        std::stringstream ss;
+        long long infreebags = 0;
+        for (int tid=0;tid<this->NUM_PROCESSES;++tid) {
+            infreebags += freeBag[tid]->getSize();
+        }
+        ss<<infreebags<<" in free bags";
+        return ss.str();
+    }
+
+    /**
+     * if the freebag contains any object, then remove one from the freebag
+     * and return a pointer to it.
+     * if not, then retrieve a new object from Alloc
+     */
+    inline T* get(const int tid) {
+        MEMORY_STATS2 this->alloc->debug->addFromPool(tid, 1);
+        if (freeBag[tid]->isEmpty()) return this->alloc->allocate(tid);
+        return freeBag[tid]->remove();
+    }
+    inline void add(const int tid, T* ptr) {
+        MEMORY_STATS2 this->debug->addToPool(tid, 1);
+        freeBag[tid]->add(ptr);
+        trim(tid);
+    }
+    inline void addMoveFullBlocks(const int tid, blockbag<T> *bag, block<T> * const predecessor) {
+        freeBag[tid]->appendMoveFullBlocks(bag, predecessor);
+        trim(tid);
+    }
+    inline void addMoveFullBlocks(const int tid, blockbag<T> *bag) {
+        MEMORY_STATS2 this->debug->addToPool(tid, (bag->getSizeInBlocks()-1)*BLOCK_SIZE);
+        freeBag[tid]->appendMoveFullBlocks(bag);
+        trim(tid);
+    }
+    inline void addMoveAll(const int tid, blockbag<T> *bag) {
+        MEMORY_STATS2 this->debug->addToPool(tid, bag->getSize());
+        freeBag[tid]->appendMoveAll(bag);
+        trim(tid);
+    }
+    inline int computeSize(const int tid) {
+        return freeBag[tid]->getSize();
+    }
+
+    void debugPrintStatus(const int tid) {}
+
+    void initThread(const int tid) {}
+    void deinitThread(const int tid) {}
+
+    pool_recycle(const int numProcesses, Alloc * const _alloc, debugInfo * const _debug)
+            : pool_interface<T, Alloc>(numProcesses, _alloc, _debug) {
+        VERBOSE DEBUG COUTATOMIC("constructor pool_recycle"<<std::endl);
+        freeBag = new blockbag<T> * [numProcesses];
+        for (int tid=0;tid<numProcesses;++tid) {
+            freeBag[tid] = new blockbag<T>(tid, this->blockpools[tid]);
+        }
+    }
+    ~pool_recycle() {
+        VERBOSE DEBUG COUTATOMIC("destructor pool_recycle"<<std::endl);
+        for (int tid=0;tid<this->NUM_PROCESSES;++tid) {
+            this->alloc->deallocateAndClear(tid, freeBag[tid]);
+            delete freeBag[tid];
+        }
+        delete[] freeBag;
+    }
+};
+
+#endif
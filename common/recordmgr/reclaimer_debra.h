@@ -39,6 +39,15 @@ protected:
 //#define MIN_OPS_BEFORE_CAS_EPOCH 100
 #endif
 
+// with DEBRA_ADAPTIVE_SCAN, a thread whose current epoch bags (over all record
+// types) hold at least DEBRA_ADAPTIVE_SCAN_BYTES does not wait for
+// MIN_OPS_BEFORE_READ operations: it checks the announcements of all threads
+// it has not checked yet, in every operation, until the epoch advances.
+// threads that retire little (e.g., read-mostly threads) keep the usual pace.
+#ifndef DEBRA_ADAPTIVE_SCAN_BYTES
+#define DEBRA_ADAPTIVE_SCAN_BYTES (64*1024)
+#endif
+
 #define NUMBER_OF_EPOCH_BAGS 3 // 9 for range query support
 #define NUMBER_OF_ALWAYS_EMPTY_EPOCH_BAGS 0 // 3 for range query support
 
@@ -163,7 +172,9 @@ public:
         DURATION_START(tid);
 #endif
 
+        const int limboSize = freeable->getSize();
         this->pool->addMoveFullBlocks(tid, freeable); // moves any full blocks (may leave a non-full block behind)
+        MEMORY_STATS this->debug->addFreed(tid, limboSize - freeable->getSize());
         SOFTWARE_BARRIER;
         
 #ifdef USE_GSTATS
@@ -195,6 +206,31 @@ public:
         }
     };
 
+    inline long currentBagBytes(const int tid) {
+        return threadData[tid].currentBag->getSize() * (long) sizeof(T);
+    }
+
+    template <typename... Rest>
+    class BagSizer {
+    public:
+        BagSizer() {}
+        inline long currentBagBytes(const int tid, void * const * const reclaimers, const int i) {
+            return 0;
+        }
+    };
+
+    template <typename First, typename... Rest>
+    class BagSizer<First, Rest...> : public BagSizer<Rest...> {
+    public:
+        inline long currentBagBytes(const int tid, void * const * const reclaimers, const int i) {
+            typedef typename Pool::template rebindAlloc<First>::other classAlloc;
+            typedef typename Pool::template rebind2<First, classAlloc>::other classPool;
+
+            return ((reclaimer_debra<First, classPool> * const) reclaimers[i])->currentBagBytes(tid)
+                    + ((BagSizer<Rest...> *) this)->currentBagBytes(tid, reclaimers, 1+i);
+        }
+    };
+
     // objects reclaimed by this epoch manager.
     // returns true if the call rotated the epoch bags for thread tid
     // (and reclaimed any objects retired two epochs ago).
@@ -238,11 +274,19 @@ public:
         if (!readOnly) {
 #endif
             // incrementally scan the announced epochs of all threads
+#ifdef DEBRA_ADAPTIVE_SCAN
+            BagSizer<First, Rest...> sizer;
+            const bool scanAll = (sizer.currentBagBytes(tid, reclaimers, 0) >= DEBRA_ADAPTIVE_SCAN_BYTES);
+            if (++threadData[tid].opsSinceRead >= MIN_OPS_BEFORE_READ || scanAll) {
+#else
+            const bool scanAll = false;
             if (++threadData[tid].opsSinceRead == MIN_OPS_BEFORE_READ) {
+#endif
                 threadData[tid].opsSinceRead = 0;
-                int otherTid = threadData[tid].checked;
-                long otherAnnounce = threadData[otherTid].announcedEpoch.load(std::memory_order_relaxed);
-                if (BITS_EPOCH(otherAnnounce) == readEpoch || QUIESCENT(otherAnnounce)) {
+                while (true) {
+                    int otherTid = threadData[tid].checked;
+                    long otherAnnounce = threadData[otherTid].announcedEpoch.load(std::memory_order_relaxed);
+                    if (!(BITS_EPOCH(otherAnnounce) == readEpoch || QUIESCENT(otherAnnounce))) break;
                     const int c = ++threadData[tid].checked;
                     if (c >= this->NUM_PROCESSES /*&& c > MIN_OPS_BEFORE_CAS_EPOCH*/) {
                         if (__sync_bool_compare_and_swap(&epoch, readEpoch, readEpoch+EPOCH_INCREMENT)) {
@@ -250,7 +294,9 @@ public:
                             GSTATS_SET_IX(tid, num_prop_epoch_latency, GSTATS_TIMER_SPLIT(tid, timersplit_epoch), readEpoch+EPOCH_INCREMENT);
 #endif
                         }
+                        break;
                     }
+                    if (!scanAll) break;
                 }
             }
 #ifndef DEBRA_DISABLE_READONLY_OPT
@@ -266,7 +312,11 @@ public:
     // for all schemes except reference counting
     inline void retire(const int tid, T* p) {
         threadData[tid].currentBag->add(p);
-        DEBUG2 this->debug->addRetired(tid, 1);
+        MEMORY_STATS this->debug->addRetired(tid, 1);
+    }
+    inline void retire_batch(const int tid, T * const * const ps, const int n) {
+        threadData[tid].currentBag->addBatch(ps, n);
+        MEMORY_STATS this->debug->addRetired(tid, n);
     }
     
     void debugPrintStatus(const int tid) {
@@ -293,6 +343,7 @@ public:
         // the data structure and are now quiescent!!
         for (int i=0;i<NUMBER_OF_EPOCH_BAGS;++i) {
             if (threadData[tid].epochbags[i]) {
+                MEMORY_STATS this->debug->addFreed(tid, threadData[tid].epochbags[i]->getSize());
                 this->pool->addMoveAll(tid, threadData[tid].epochbags[i]);
                 delete threadData[tid].epochbags[i];
                 threadData[tid].epochbags[i] = NULL;
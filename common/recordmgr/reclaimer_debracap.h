@@ -218,6 +218,13 @@ public:
         threadData[tid].announcedEpoch.store(GET_WITH_QUIESCENT(threadData[tid].localvar_announcedEpoch), std::memory_order_relaxed);
     }
     
+    // retire() checks the size of the bag after each object
+    inline void retire_batch(const int tid, T * const * const ps, const int n) {
+        for (int i=0;i<n;++i) {
+            retire(tid, ps[i]);
+        }
+    }
+
     // for all schemes except reference counting
     inline void retire(const int tid, T* p) {
         threadData[tid].currentBag->add(p);
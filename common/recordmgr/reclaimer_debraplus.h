@@ -318,6 +318,11 @@ public:
         currentBag[tid*PREFETCH_SIZE_WORDS]->add(p);
         DEBUG2 this->debug->addRetired(tid, 1);
     }
+    inline void retire_batch(const int tid, T * const * const ps, const int n) {
+        assert(isQuiescent(tid));
+        currentBag[tid*PREFETCH_SIZE_WORDS]->addBatch(ps, n);
+        DEBUG2 this->debug->addRetired(tid, n);
+    }
     
     void initThread(const int tid) {}
     void deinitThread(const int tid) {}
@@ -199,6 +199,10 @@ public:
         threadData[tid].curr->add(p);
         DEBUG2 this->debug->addRetired(tid, 1);
     }
+    inline void retire_batch(const int tid, T * const * const ps, const int n) {
+        threadData[tid].curr->addBatch(ps, n);
+        DEBUG2 this->debug->addRetired(tid, n);
+    }
     
     void debugPrintStatus(const int tid) {
 //        if (tid == 0) {
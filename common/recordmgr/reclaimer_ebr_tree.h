@@ -375,6 +375,10 @@ public:
 //            __sync_bool_compare_and_swap(&epoch, readEpoch, readEpoch+EPOCH_INCREMENT);
 //        }
     }
+    inline void retire_batch(const int tid, T * const * const ps, const int n) {
+        thread_data[tid].currentBag->addBatch(ps, n);
+        DEBUG2 this->debug->addRetired(tid, n);
+    }
     
     void debugPrintStatus(const int tid) {
         if (tid == 0) {
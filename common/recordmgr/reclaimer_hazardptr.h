@@ -140,6 +140,13 @@ public:
         return os.str();
     }
     
+    // retire() may scan the hazard pointers after each object
+    inline void retire_batch(const int tid, T * const * const ps, const int n) {
+        for (int i=0;i<n;++i) {
+            retire(tid, ps[i]);
+        }
+    }
+
     inline void retire(const int tid, T* p) {
         TRACE std::cout<<"reclaimer_hazardptr::retire(tid="<<tid<<", "<<debugPointerOutput(p)<<")"<<std::endl;
         DEBUG2 this->debug->addRetired(tid, 1);
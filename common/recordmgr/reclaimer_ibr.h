@@ -0,0 +1,295 @@
+/**
+ * Interval-based reclamation (IBR) with two global eras, after
+ * "Interval-Based Memory Reclamation" (Wen et al., PPoPP 2018).
+ *
+ * A record carries its birth era and, once retired, its retire era. A thread
+ * reserves an interval of eras [lower, upper]: lower is the era when its
+ * operation started, and upper grows to the current era whenever the thread
+ * reads a pointer after the era has changed (see ibr_read_barrier()). A
+ * retired record is freed as soon as its [birth, retire] interval misses the
+ * reservations of all threads. Unlike with DEBRA, a stalled thread only keeps
+ * the records that were alive during its reservation, rather than everything
+ * retired after it stalled.
+ *
+ * The birth era lives in the record: a record type that declares a member
+ * birth_era, and sets it with ibr_birth_era_now() when it is allocated, gets
+ * the bounded behaviour above. Such a data structure must also call
+ * ibr_read_barrier() after every pointer it loads from shared memory. Any
+ * other record is treated as born in era 0, which is always safe and makes
+ * IBR behave like an epoch based scheme. The Makefile defines RECLAIM_IBR
+ * when building with reclaim_ibr, so data structures can compile these hooks
+ * in only when they are needed.
+ *
+ * A data structure that links a new record into a record other threads may
+ * already hold must also keep readers off records that were replaced: such a
+ * record keeps its old pointers while later operations retire their targets,
+ * and one born after a reader's reservation may be freed already. The
+ * duplication trees mark a record as replaced before they link its copy, and
+ * a reader that finds the mark on the record it just read a pointer from
+ * starts over from the root.
+ *
+ * Eras and reservations are shared by all record types (and all instances),
+ * so startOp() only needs to be called for the first record type.
+ */
+
+#ifndef RECLAIM_IBR_H
+#define	RECLAIM_IBR_H
+
+#include <atomic>
+#include <cassert>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <limits.h>
+#include "plaf.h"
+#include "allocator_interface.h"
+#include "reclaimer_interface.h"
+
+// the era advances whenever a thread has retired this many records
+#ifndef IBR_ERA_FREQ
+#define IBR_ERA_FREQ 128
+#endif
+// a thread scans the reservations once it holds this many retired records
+#ifndef IBR_EMPTY_FREQ
+#define IBR_EMPTY_FREQ 512
+#endif
+
+struct ibr_reservation {
+    PAD;
+    std::atomic_long lower;
+    std::atomic_long upper;
+    PAD;
+};
+
+struct ibr_state {
+    PAD;
+    std::atomic_long era;
+    PAD;
+    ibr_reservation reservations[MAX_THREADS_POW2];
+
+    ibr_state() {
+        era.store(1, std::memory_order_relaxed);
+        for (int tid=0;tid<MAX_THREADS_POW2;++tid) {
+            reservations[tid].lower.store(LONG_MAX, std::memory_order_relaxed);
+            reservations[tid].upper.store(LONG_MIN, std::memory_order_relaxed);
+        }
+    }
+};
+
+inline ibr_state & ibrState() {
+    static ibr_state state;
+    return state;
+}
+
+// reservation of the calling thread, set by startOp()
+inline ibr_reservation *& ibrThreadReservation() {
+    static thread_local ibr_reservation * reservation = NULL;
+    return reservation;
+}
+
+inline long ibr_birth_era_now() {
+    return ibrState().era.load(std::memory_order_relaxed);
+}
+
+// must follow every load of a pointer to a record with a birth era: if the
+// era has changed since the last call, the thread extends its reservation to
+// the current era and returns true, and the caller must load the pointer again
+inline bool ibr_read_barrier() {
+    ibr_reservation * const r = ibrThreadReservation();
+    const long era = ibrState().era.load(std::memory_order_acquire);
+    if (r == NULL || r->upper.load(std::memory_order_relaxed) == era) return false;
+    r->upper.store(era, std::memory_order_seq_cst);
+    return true;
+}
+
+// the birth era of p, or 0 if T does not declare one (record_manager.h adds
+// the overload for size_class records)
+template <typename T>
+inline auto ibr_birth_era(T * const p, int) -> decltype((long) p->birth_era) {
+    return p->birth_era;
+}
+template <typename T>
+inline long ibr_birth_era(T * const p, long) {
+    return 0;
+}
+
+template <typename T = void, class Pool = pool_interface<T> >
+class reclaimer_ibr : public reclaimer_interface<T, Pool> {
+protected:
+    struct retired_record {
+        T * p;
+        long birth;
+        long retire;
+    };
+
+    class ThreadData {
+    private:
+        PAD;
+    public:
+        std::vector<retired_record> retired;
+        int retiresSinceEra;
+        ThreadData() {}
+    private:
+        PAD;
+    };
+
+    PAD;
+    ThreadData threadData[MAX_THREADS_POW2];
+    PAD;
+
+    // hand every retired record of thread tid whose lifetime misses all
+    // reservations to the pool
+    void empty(const int tid) {
+        ibr_state & state = ibrState();
+        long lowers[MAX_THREADS_POW2];
+        long uppers[MAX_THREADS_POW2];
+        for (int otherTid=0;otherTid<this->NUM_PROCESSES;++otherTid) {
+            lowers[otherTid] = state.reservations[otherTid].lower.load(std::memory_order_acquire);
+            uppers[otherTid] = state.reservations[otherTid].upper.load(std::memory_order_acquire);
+        }
+        std::vector<retired_record> & retired = threadData[tid].retired;
+        size_t kept = 0;
+        for (size_t i=0;i<retired.size();++i) {
+            bool reserved = false;
+            for (int otherTid=0;otherTid<this->NUM_PROCESSES;++otherTid) {
+                if (retired[i].birth <= uppers[otherTid] && lowers[otherTid] <= retired[i].retire) {
+                    reserved = true;
+                    break;
+                }
+            }
+            if (reserved) {
+                retired[kept++] = retired[i];
+            } else {
+                this->pool->add(tid, retired[i].p);
+            }
+        }
+        MEMORY_STATS this->debug->addFreed(tid, retired.size() - kept);
+        retired.resize(kept);
+    }
+
+    inline void advanceEra(const int tid, const int n) {
+        threadData[tid].retiresSinceEra += n;
+        if (threadData[tid].retiresSinceEra >= IBR_ERA_FREQ) {
+            threadData[tid].retiresSinceEra = 0;
+            ibrState().era.fetch_add(1);
+        }
+    }
+
+public:
+    template<typename _Tp1>
+    struct rebind {
+        typedef reclaimer_ibr<_Tp1, Pool> other;
+    };
+    template<typename _Tp1, typename _Tp2>
+    struct rebind2 {
+        typedef reclaimer_ibr<_Tp1, _Tp2> other;
+    };
+
+    long long getSizeInNodes() {
+        long long sum = 0;
+        for (int tid=0;tid<this->NUM_PROCESSES;++tid) {
+            sum += threadData[tid].retired.size();
+        }
+        return sum;
+    }
+    std::string getSizeString() {
+        std::stringstream ss;
+        ss<<getSizeInNodes();
+        return ss.str();
+    }
+    std::string getDetailsString() {
+        std::stringstream ss;
+        ss<<"era="<<ibrState().era.load();
+        return ss.str();
+    }
+
+    inline static bool quiescenceIsPerRecordType() { return false; }
+
+    inline bool isQuiescent(const int tid) {
+        return ibrState().reservations[tid].lower.load(std::memory_order_relaxed) == LONG_MAX;
+    }
+
+    inline static bool isProtected(const int tid, T * const obj) {
+        return true;
+    }
+    inline static bool isQProtected(const int tid, T * const obj) {
+        return false;
+    }
+    inline static bool protect(const int tid, T * const obj, CallbackType notRetiredCallback, CallbackArg callbackArg, bool memoryBarrier = true) {
+        return true;
+    }
+    inline static void unprotect(const int tid, T * const obj) {}
+    inline static bool qProtect(const int tid, T * const obj, CallbackType notRetiredCallback, CallbackArg callbackArg, bool memoryBarrier = true) {
+        return true;
+    }
+    inline static void qUnprotectAll(const int tid) {}
+
+    inline static bool shouldHelp() { return true; }
+
+    inline void endOp(const int tid) {
+        ibr_reservation & r = ibrState().reservations[tid];
+        r.upper.store(LONG_MIN, std::memory_order_relaxed);
+        r.lower.store(LONG_MAX, std::memory_order_release);
+    }
+
+    // reserve the current era. the caller (record_manager) issues a full
+    // barrier afterwards, before the operation reads any record.
+    template <typename First, typename... Rest>
+    inline bool startOp(const int tid, void * const * const reclaimers, const int numReclaimers, const bool readOnly = false) {
+        ibr_reservation & r = ibrState().reservations[tid];
+        const long era = ibrState().era.load(std::memory_order_acquire);
+        r.lower.store(era, std::memory_order_relaxed);
+        r.upper.store(era, std::memory_order_relaxed);
+        ibrThreadReservation() = &r;
+        return false;
+    }
+    inline static void rotateEpochBags(const int tid) {}
+
+    inline void retire(const int tid, T* p) {
+        const long era = ibrState().era.load(std::memory_order_acquire);
+        threadData[tid].retired.push_back({p, ibr_birth_era(p, 0), era});
+        MEMORY_STATS this->debug->addRetired(tid, 1);
+        advanceEra(tid, 1);
+        if (threadData[tid].retired.size() >= IBR_EMPTY_FREQ) empty(tid);
+    }
+    inline void retire_batch(const int tid, T * const * const ps, const int n) {
+        const long era = ibrState().era.load(std::memory_order_acquire);
+        for (int i=0;i<n;++i) {
+            threadData[tid].retired.push_back({ps[i], ibr_birth_era(ps[i], 0), era});
+        }
+        MEMORY_STATS this->debug->addRetired(tid, n);
+        advanceEra(tid, n);
+        if (threadData[tid].retired.size() >= IBR_EMPTY_FREQ) empty(tid);
+    }
+
+    void debugPrintStatus(const int tid) {}
+
+    void initThread(const int tid) {
+        threadData[tid].retired.reserve(2*IBR_EMPTY_FREQ);
+        threadData[tid].retiresSinceEra = 0;
+    }
+
+    void deinitThread(const int tid) {
+        // WARNING: this moves objects to the pool immediately,
+        // which is only safe if this thread is deinitializing specifically
+        // because *ALL THREADS* have already finished accessing
+        // the data structure and are now quiescent!!
+        std::vector<retired_record> & retired = threadData[tid].retired;
+        for (size_t i=0;i<retired.size();++i) {
+            this->pool->add(tid, retired[i].p);
+        }
+        MEMORY_STATS this->debug->addFreed(tid, retired.size());
+        retired.clear();
+    }
+
+    reclaimer_ibr(const int numProcesses, Pool *_pool, debugInfo * const _debug, RecoveryMgr<void *> * const _recoveryMgr = NULL)
+            : reclaimer_interface<T, Pool>(numProcesses, _pool, _debug, _recoveryMgr) {
+        VERBOSE std::cout<<"constructor reclaimer_ibr"<<std::endl;
+        for (int tid=0;tid<numProcesses;++tid) {
+            threadData[tid].retiresSinceEra = 0;
+        }
+    }
+    ~reclaimer_ibr() {}
+};
+
+#endif
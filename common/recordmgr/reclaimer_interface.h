@@ -75,6 +75,7 @@ public:
 
     // for all schemes except reference counting
     inline void retire(const int tid, T* p);
+    inline void retire_batch(const int tid, T * const * const ps, const int n);
     
     inline void initThread(const int tid);
     inline void deinitThread(const int tid);
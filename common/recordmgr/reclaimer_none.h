@@ -72,6 +72,8 @@ public:
     // for all schemes except reference counting
     inline static void retire(const int tid, T* p) {
     }
+    inline static void retire_batch(const int tid, T * const * const ps, const int n) {
+    }
 
     void debugPrintStatus(const int tid) {
     }
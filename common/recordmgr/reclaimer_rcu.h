@@ -173,6 +173,13 @@ public:
         }
     }
     
+    // each object is handed to call_rcu() on its own
+    inline void retire_batch(const int tid, T * const * const ps, const int n) {
+        for (int i=0;i<n;++i) {
+            retire(tid, ps[i]);
+        }
+    }
+
     // for all schemes except reference counting
     inline void retire(const int tid, T* p) {
 //        call_rcu(&p->rcuHeadField, rcuCallback<T>);
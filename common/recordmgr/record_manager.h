@@ -17,6 +17,7 @@
 #include <exception>
 #include <stdexcept>
 #include <typeinfo>
+#include <type_traits>
 
 inline CallbackReturn callbackReturnTrue(CallbackArg arg) {
     return true;
@@ -33,6 +34,83 @@ void check_duplicates(void) {
     check_duplicates<T, Rest...>();
 }
 
+template <typename... Types> struct max_sizeof;
+template <typename T>
+struct max_sizeof<T> : std::integral_constant<size_t, sizeof(T)> {};
+template <typename T, typename... Rest>
+struct max_sizeof<T, Rest...> : std::integral_constant<size_t,
+        (sizeof(T) > max_sizeof<Rest...>::value ? sizeof(T) : max_sizeof<Rest...>::value)> {};
+
+template <typename T, typename... Types> struct contains_type : std::false_type {};
+template <typename T, typename First, typename... Rest>
+struct contains_type<T, First, Rest...> : std::integral_constant<bool,
+        std::is_same<T, First>::value || contains_type<T, Rest...>::value> {};
+
+template <typename... Types> struct all_trivially_destructible : std::true_type {};
+template <typename First, typename... Rest>
+struct all_trivially_destructible<First, Rest...> : std::integral_constant<bool,
+        std::is_trivially_destructible<First>::value && all_trivially_destructible<Rest...>::value> {};
+
+// the class that declares T::birth_era (see reclaimer_ibr.h), or void
+template <typename M> struct member_class { typedef void type; };
+template <typename C, typename M>
+struct member_class<M C::*> { typedef C type; };
+template <typename T, typename = void>
+struct birth_era_owner { typedef void type; };
+template <typename T>
+struct birth_era_owner<T, decltype((void) &T::birth_era)> {
+    typedef typename member_class<decltype(&T::birth_era)>::type type;
+};
+
+template <typename... Types> struct same_birth_era_owner : std::true_type {};
+template <typename First, typename Second, typename... Rest>
+struct same_birth_era_owner<First, Second, Rest...> : std::integral_constant<bool,
+        std::is_same<typename birth_era_owner<First>::type, typename birth_era_owner<Second>::type>::value
+        && same_birth_era_owner<Second, Rest...>::value> {};
+
+// a record type that stands in for several record types of similar size.
+// listing size_class<A, B> among the record types of a record_manager gives A
+// and B one allocator, pool and reclaimer (and so one limbo bag), so records
+// freed as A can be reused as B and vice versa. the data structure keeps
+// allocating, retiring and freeing A and B as before.
+// the record manager only constructs and destroys the size_class itself, so A
+// and B must be trivially destructible and must be initialized after they are
+// allocated, not by their constructors. for reclaim_ibr, A and B either both
+// inherit birth_era from one base class, which has to be their first base,
+// or neither declares it (then their records are born in era 0).
+template <typename... Types>
+struct size_class {
+    static_assert(all_trivially_destructible<Types...>::value, "size_class records are freed without running destructors");
+    static_assert(same_birth_era_owner<Types...>::value, "the records of a size_class must all inherit birth_era from one base class, or none may declare it");
+    alignas(Types...) char bytes[max_sizeof<Types...>::value];
+};
+
+// the birth era of the record stored in a size_class, read through the first
+// type: the base class that declares birth_era is at the start of all of them.
+// reclaimer_ibr finds this overload of ibr_birth_era() by argument dependent
+// lookup when it is instantiated
+template <typename First, typename... Rest>
+inline auto ibr_birth_era(size_class<First, Rest...> * const p, int)
+        -> decltype((long) static_cast<typename birth_era_owner<First>::type *>((First *) p)->birth_era) {
+    return static_cast<typename birth_era_owner<First>::type *>((First *) p)->birth_era;
+}
+
+// the record type among Entries that manages records of type T: T itself, or
+// the size_class that lists T. if there is none, T (so get() fails as usual)
+template <typename T, typename Entry>
+struct manages_type : std::is_same<T, Entry> {};
+template <typename T, typename... Types>
+struct manages_type<T, size_class<Types...> > : std::integral_constant<bool,
+        std::is_same<T, size_class<Types...> >::value || contains_type<T, Types...>::value> {};
+
+template <typename T, typename... Entries>
+struct managed_record { typedef T type; };
+template <typename T, typename First, typename... Rest>
+struct managed_record<T, First, Rest...> {
+    typedef typename std::conditional<manages_type<T, First>::value,
+            First, typename managed_record<T, Rest...>::type>::type type;
+};
+
 // base case: empty template
 // this is a compile time check for invalid arguments
 template <class Reclaim, class Alloc, class Pool, typename... Rest>
@@ -54,6 +132,8 @@ public:
     inline void endOp(const int tid) {}
     inline void leaveQuiescentStateForEach(const int tid, const bool readOnly = false) {}
     inline void startOp(const int tid, const bool callForEach, const bool readOnly = false) {}
+    inline void arena_commit(const int tid) {}
+    inline void arena_abort(const int tid) {}
 };
 
 // "recursive" case
@@ -130,6 +210,14 @@ public:
             __sync_synchronize(); // memory barrier needed (only) for epoch based schemes at the moment...
         }
     }
+    inline void arena_commit(const int tid) {
+        mgr->arena_commit(tid);
+        ((RecordManagerSet<Reclaim, Alloc, Pool, Rest...> *) this)->arena_commit(tid);
+    }
+    inline void arena_abort(const int tid) {
+        mgr->arena_abort(tid);
+        ((RecordManagerSet<Reclaim, Alloc, Pool, Rest...> *) this)->arena_abort(tid);
+    }
 };
 
 template <class Reclaim, class Alloc, class Pool, typename First, typename... Rest>
@@ -145,6 +233,9 @@ template <class Reclaim, class Alloc, class Pool, typename RecordTypesFirst, typ
 class record_manager {
 protected:
     typedef record_manager<Reclaim,Alloc,Pool,RecordTypesFirst,RecordTypesRest...> SelfType;
+    // the record type whose manager handles records of type T (see size_class)
+    template <typename T>
+    using Managed = typename managed_record<T, RecordTypesFirst, RecordTypesRest...>::type;
     PAD;
     RecordManagerSetPostPadded<Reclaim,Alloc,Pool,RecordTypesFirst,RecordTypesRest...> * rmset;
     
@@ -188,28 +279,28 @@ public:
     }
     template <typename T>
     debugInfo * getDebugInfo(T * const recordType) {
-        return &rmset->get((T *) NULL)->debugInfoRecord;
+        return &rmset->get((Managed<T> *) NULL)->debugInfoRecord;
     }
     template <typename T>
-    inline record_manager_single_type<T, Reclaim, Alloc, Pool> * get(T * const recordType) {
-        return rmset->get((T *) NULL);
+    inline record_manager_single_type<Managed<T>, Reclaim, Alloc, Pool> * get(T * const recordType) {
+        return rmset->get((Managed<T> *) NULL);
     }
     
     // for hazard pointers
 
     template <typename T>
     inline bool isProtected(const int tid, T * const obj) {
-        return rmset->get((T *) NULL)->isProtected(tid, obj);
+        return rmset->get((Managed<T> *) NULL)->isProtected(tid, (Managed<T> *) obj);
     }
     
     template <typename T>
     inline bool protect(const int tid, T * const obj, CallbackType notRetiredCallback, CallbackArg callbackArg, bool hintMemoryBarrier = true) {
-        return rmset->get((T *) NULL)->protect(tid, obj, notRetiredCallback, callbackArg, hintMemoryBarrier);
+        return rmset->get((Managed<T> *) NULL)->protect(tid, (Managed<T> *) obj, notRetiredCallback, callbackArg, hintMemoryBarrier);
     }
     
     template <typename T>
     inline void unprotect(const int tid, T * const obj) {
-        rmset->get((T *) NULL)->unprotect(tid, obj);
+        rmset->get((Managed<T> *) NULL)->unprotect(tid, (Managed<T> *) obj);
     }
     
     // for DEBRA+
@@ -217,12 +308,12 @@ public:
     // warning: qProtect must be reentrant and lock-free (i.e., async-signal-safe)
     template <typename T>
     inline bool qProtect(const int tid, T * const obj, CallbackType notRetiredCallback, CallbackArg callbackArg, bool hintMemoryBarrier = true) {
-        return rmset->get((T *) NULL)->qProtect(tid, obj, notRetiredCallback, callbackArg, hintMemoryBarrier);
+        return rmset->get((Managed<T> *) NULL)->qProtect(tid, (Managed<T> *) obj, notRetiredCallback, callbackArg, hintMemoryBarrier);
     }
     
     template <typename T>
     inline bool isQProtected(const int tid, T * const obj) {
-        return rmset->get((T *) NULL)->isQProtected(tid, obj);
+        return rmset->get((Managed<T> *) NULL)->isQProtected(tid, (Managed<T> *) obj);
     }
     
     inline void qUnprotectAll(const int tid) {
@@ -261,21 +352,50 @@ public:
     template <typename T>
     inline void retire(const int tid, T * const p) {
         assert(!Reclaim::supportsCrashRecovery() || isQuiescent(tid));
-        rmset->get((T *) NULL)->retire(tid, p);
+        rmset->get((Managed<T> *) NULL)->retire(tid, (Managed<T> *) p);
+    }
+
+    // retires the n records in ps with one call into the reclaimer,
+    // which epoch based reclaimers turn into a copy into their limbo bag
+    template <typename T>
+    inline void retire_batch(const int tid, T * const * const ps, const int n) {
+        assert(!Reclaim::supportsCrashRecovery() || isQuiescent(tid));
+        if (n > 0) rmset->get((Managed<T> *) NULL)->retire_batch(tid, (Managed<T> * const *) ps, n);
     }
 
     template <typename T>
     inline T * allocate(const int tid) {
         assert(!Reclaim::supportsCrashRecovery() || isQuiescent(tid));
 //        GSTATS_ADD_IX(tid, num_prop_epoch_allocations, 1, GSTATS_GET(tid, thread_announced_epoch));
-        return rmset->get((T *) NULL)->allocate(tid);
+        return (T *) rmset->get((Managed<T> *) NULL)->allocate(tid);
     }
     
     // optional function which can be used if it is safe to call free()
     template <typename T>
     inline void deallocate(const int tid, T * const p) {
         assert(!Reclaim::supportsCrashRecovery() || isQuiescent(tid));
-        rmset->get((T *) NULL)->deallocate(tid, p);
+        rmset->get((Managed<T> *) NULL)->deallocate(tid, (Managed<T> *) p);
+    }
+
+    template <typename T>
+    inline void deallocate_batch(const int tid, T * const * const ps, const int n) {
+        assert(!Reclaim::supportsCrashRecovery() || isQuiescent(tid));
+        if (n > 0) rmset->get((Managed<T> *) NULL)->deallocate_batch(tid, (Managed<T> * const *) ps, n);
+    }
+
+    // speculative allocation from the per-thread arena of type T (see op_arena.h).
+    // arena_abort() hands the records allocated since the last commit or abort
+    // out again, of every type, and arena_commit() adopts them.
+    template <typename T>
+    inline T * arena_allocate(const int tid) {
+        assert(!Reclaim::supportsCrashRecovery() || isQuiescent(tid));
+        return (T *) rmset->get((Managed<T> *) NULL)->arena_allocate(tid);
+    }
+    inline void arena_commit(const int tid) {
+        rmset->arena_commit(tid);
+    }
+    inline void arena_abort(const int tid) {
+        rmset->arena_abort(tid);
     }
 
     inline static bool shouldHelp() { // FOR DEBUGGING PURPOSES
@@ -17,6 +17,7 @@
 #include "plaf.h"
 #include "debug_info.h"
 #include "globals.h"
+#include "memory_footprint.h"
 
 #include "recovery_manager.h"
 
@@ -25,14 +26,18 @@
 #include "allocator_new.h"
 //#include "allocator_new_segregated.h"
 #include "allocator_once.h"
+#include "allocator_slab.h"
 
 #include "pool_interface.h"
 #include "pool_none.h"
 #include "pool_perthread_and_shared.h"
+#include "pool_recycle.h"
 #ifdef USE_LIBNUMA
 #include "pool_numa.h"
 #endif
 
+#include "op_arena.h"
+
 #include "reclaimer_interface.h"
 #include "reclaimer_none.h"
 #include "reclaimer_ebr_tree.h"
@@ -43,6 +48,7 @@
 #include "reclaimer_debracap.h"
 #include "reclaimer_debraplus.h"
 #include "reclaimer_hazardptr.h"
+#include "reclaimer_ibr.h"
 #ifdef USE_RECLAIMER_RCU
 #include "reclaimer_rcu.h"
 #endif
@@ -62,21 +68,28 @@ public:
     classAlloc      *alloc;
     classPool       *pool;
     classReclaim    *reclaim;
+    op_arena<Record, classPool> *arena;
     
     const int NUM_PROCESSES;
     debugInfo debugInfoRecord;
     RecoveryMgr<void *> * const recoveryMgr;
+    const std::string recordName; // registered with the memory footprint
     PAD;
 
     record_manager_single_type(const int numProcesses, RecoveryMgr<void *> * const _recoveryMgr)
-            : NUM_PROCESSES(numProcesses), debugInfoRecord(debugInfo(numProcesses)), recoveryMgr(_recoveryMgr) {
+            : NUM_PROCESSES(numProcesses), debugInfoRecord(debugInfo(numProcesses)), recoveryMgr(_recoveryMgr)
+            , recordName(memoryFootprintName(typeid(Record))) {
         VERBOSE DEBUG COUTATOMIC("constructor record_manager_single_type"<<std::endl);
         alloc = new classAlloc(numProcesses, &debugInfoRecord);
         pool = new classPool(numProcesses, alloc, &debugInfoRecord);
         reclaim = new classReclaim(numProcesses, pool, &debugInfoRecord, recoveryMgr);
+        arena = new op_arena<Record, classPool>(numProcesses, pool);
+        registerMemoryFootprint(recordName.c_str(), sizeof(Record), &debugInfoRecord);
     }
     ~record_manager_single_type() {
         VERBOSE DEBUG COUTATOMIC("destructor record_manager_single_type"<<std::endl);
+        unregisterMemoryFootprint(&debugInfoRecord);
+        delete arena;
         delete reclaim;
         delete pool;
         delete alloc;
@@ -90,6 +103,7 @@ public:
     }
     
     void deinitThread(const int tid) {
+        arena->deinitThread(tid);
         reclaim->deinitThread(tid);
         pool->deinitThread(tid);
         alloc->deinitThread(tid);
@@ -150,16 +164,43 @@ public:
         assert(!Reclaim::supportsCrashRecovery() || isQuiescent(tid));
         reclaim->retire(tid, p);
     }
+    inline void retire_batch(const int tid, record_pointer const * const ps, const int n) {
+        assert(!Reclaim::supportsCrashRecovery() || isQuiescent(tid));
+        reclaim->retire_batch(tid, ps, n);
+    }
     
     // for all schemes
     inline record_pointer allocate(const int tid) {
         assert(!Reclaim::supportsCrashRecovery() || isQuiescent(tid));
+        MEMORY_STATS debugInfoRecord.addObtained(tid, 1);
         return pool->get(tid);
     }
     inline void deallocate(const int tid, record_pointer p) {
         assert(!Reclaim::supportsCrashRecovery() || isQuiescent(tid));
+        MEMORY_STATS debugInfoRecord.addReleased(tid, 1);
         pool->add(tid, p);
     }
+    inline void deallocate_batch(const int tid, record_pointer const * const ps, const int n) {
+        assert(!Reclaim::supportsCrashRecovery() || isQuiescent(tid));
+        MEMORY_STATS debugInfoRecord.addReleased(tid, n);
+        for (int i=0;i<n;++i) {
+            pool->add(tid, ps[i]);
+        }
+    }
+
+    // for speculative allocations (see op_arena.h)
+    inline record_pointer arena_allocate(const int tid) {
+        assert(!Reclaim::supportsCrashRecovery() || isQuiescent(tid));
+        MEMORY_STATS debugInfoRecord.addObtained(tid, 1);
+        return arena->allocate(tid);
+    }
+    inline void arena_commit(const int tid) {
+        arena->commit(tid);
+    }
+    inline void arena_abort(const int tid) {
+        const int n = arena->abort(tid);
+        MEMORY_STATS debugInfoRecord.addReleased(tid, n);
+    }
 
     void printStatus(void) {
         long long allocated = debugInfoRecord.getTotalAllocated();
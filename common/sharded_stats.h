@@ -0,0 +1,49 @@
+/**
+ * Per-thread copies of a statistics struct, in the spirit of multi_counter.h.
+ * Each thread only updates the shard indexed by its tid, so updates are plain
+ * writes to a cache line no other thread writes. Reading sums all shards.
+ *
+ * Stats must be default constructible to zero and provide operator+=. Shards
+ * may individually wrap around (a thread can erase more keys than it
+ * inserted); unsigned sums still come out right.
+ */
+#ifndef SHARDED_STATS_H
+#define SHARDED_STATS_H
+
+#include "plaf.h"
+
+template <typename Stats>
+class sharded_stats {
+private:
+    struct shard {
+        PAD;
+        Stats stats;
+    };
+
+    shard shards_[MAX_THREADS_POW2];
+    PAD;
+
+public:
+    //! Shard written by thread tid.
+    Stats& operator [] (const int tid) {
+        return shards_[tid].stats;
+    }
+
+    //! Sum of all shards. Concurrent updates may or may not be included.
+    Stats sum() const {
+        Stats total;
+        for (int i = 0; i < MAX_THREADS_POW2; ++i) {
+            total += shards_[i].stats;
+        }
+        return total;
+    }
+
+    //! Reset all shards. Not safe against concurrent updates.
+    void clear() {
+        for (int i = 0; i < MAX_THREADS_POW2; ++i) {
+            shards_[i].stats = Stats();
+        }
+    }
+};
+
+#endif /* SHARDED_STATS_H */
@@ -1,11 +1,16 @@
 #pragma once
 
 #include "dup_par_node.h"
+#include "prefetching.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include <iostream>
 
 const unsigned int LEFT = 0;
 const unsigned int RIGHT = 1;
 const unsigned int MAX_CHILDREN = 2;
+const size_t BULK_LOAD_TASK_MIN = 1 << 14;
 
 #define bst	BST<skey_t, sval_t, RecMgr>
 
@@ -23,14 +28,32 @@ private:
 	int init[MAX_THREADS_POW2] = {0,};
 	RecMgr* recmgr;
 
+	// nodes replaced or copied by the running operation, gathered so they
+	// are retired or freed with one call into the record manager
+	struct write_set_t {
+		PAD;
+		std::vector<Node*> nodes;
+		PAD;
+	};
+	write_set_t write_set[MAX_THREADS_POW2];
+
 	void make_empty(Node* t);
 
 	Node* find(const skey_t& key, Node*& parent);
 
+	Node* allocate_node(const int& tid);
+	Node* load_root();
+
 	Node* create_node(const int& tid, const skey_t& key, const sval_t& value, unsigned int max_num_children);
 
 	Node* create_node(const int& tid, const Node& node);
 
+	Node* build(const skey_t* keys, const sval_t* values, size_t lo, size_t hi);
+
+	void retire_replaced(const int tid, bool unlinked_children = false);
+
+	void deallocate_copies(const int tid);
+
 	dinfo* create_dinfo(Node*& dup, Node*& parent, unsigned int orig_idx);
 
 	Node* dup_prologue(const int& tid, Node* orig);
@@ -55,10 +78,14 @@ public:
 
 	Node* get_root();
 
+	void bulk_load(const skey_t* keys, const sval_t* values, size_t n);
+
 	sval_t insert(const int tid, const skey_t& key, const sval_t& value);
 
 	sval_t insert_wrapper(const int tid, const skey_t& key, const sval_t& value);
 
+	sval_t upsert_wrapper(const int tid, const skey_t& key, const sval_t& value);
+
 	sval_t remove(const int tid, const skey_t& key);
 
 	sval_t remove_wrapper(const int tid, const skey_t& key);
@@ -75,30 +102,85 @@ void bst::make_empty(Node* t) {
 
 	make_empty(t->get_child(LEFT));
 	make_empty(t->get_child(RIGHT));
-	delete t;
+	recmgr->deallocate(0, t);
 }
 
 template <typename skey_t, typename sval_t, class RecMgr>
 Node* bst::find(const skey_t& key, Node*& parent)
 {
-	auto curr = root;
+	auto curr = load_root();
 
 	while (curr != nullptr && (curr->key != key || curr->is_del()))
 	{
+		// fetch both candidates while the key comparison resolves
+		prefetch_range(curr->children[LEFT], sizeof(Node));
+		prefetch_range(curr->children[RIGHT], sizeof(Node));
 		parent = curr;
 		curr = (key < curr->key) ? curr->get_child(LEFT) : curr->get_child(RIGHT);
+#ifdef RECLAIM_IBR
+		// a replaced parent keeps children that later operations retire, and
+		// one born after this thread's era reservation may be freed already.
+		// Node::close() marks replaced nodes before it links their
+		// duplications, so if parent is not marked here, curr was not retired
+		// before it was read.
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (parent->is_replaced())
+		{
+			// nothing is duplicated before find() returns; a changed root
+			// fails the root check in Node::close()
+			if (in_writing_function)
+				path->clear();
+			parent = nullptr;
+			curr = load_root();
+		}
+#endif
 	}
 
 	return curr;
 }
 
+// loads root; with RECLAIM_IBR this also extends the thread's era reservation,
+// as Node::get_child() does for the children
 template <typename skey_t, typename sval_t, class RecMgr>
-Node* bst::create_node(const int& tid, const skey_t& key, const sval_t& value, unsigned int max_num_children)
+Node* bst::load_root()
 {
+	Node* result = __atomic_load_n(&root, __ATOMIC_ACQUIRE);
+#ifdef RECLAIM_IBR
+	while (ibr_read_barrier())
+		result = __atomic_load_n(&root, __ATOMIC_ACQUIRE);
+#endif
+	return result;
+}
+
+// nodes allocated inside an operation come from the record manager's
+// per-operation arena, which is committed or rewound with the operation
+template <typename skey_t, typename sval_t, class RecMgr>
+Node* bst::allocate_node(const int& tid)
+{
+#ifdef USE_OP_ARENA
+	if (in_writing_function)
+	{
+		Node* result = recmgr->template arena_allocate<Node>(tid);
+#ifdef RECLAIM_IBR
+		result->birth_era = ibr_birth_era_now();
+#endif
+		return result;
+	}
+#endif
 	Node* result = (Node*)recmgr->template allocate<Node>(tid);
+#ifdef RECLAIM_IBR
+	result->birth_era = ibr_birth_era_now();
+#endif
+	return result;
+}
+
+template <typename skey_t, typename sval_t, class RecMgr>
+Node* bst::create_node(const int& tid, const skey_t& key, const sval_t& value, unsigned int max_num_children)
+{
+	Node* result = allocate_node(tid);
 	result->key = key;
 	result->value = value;
-	result->children.resize(max_num_children, nullptr);
+	result->children.assign(max_num_children, nullptr);
 	result->flags = 0;
 	pthread_spin_init(&result->dup_lock, PTHREAD_PROCESS_PRIVATE);
 	return result;
@@ -107,10 +189,15 @@ Node* bst::create_node(const int& tid, const skey_t& key, const sval_t& value, u
 template <typename skey_t, typename sval_t, class RecMgr>
 Node* bst::create_node(const int& tid, const Node& node)
 {
-	Node* result = (Node*)recmgr->template allocate<Node>(tid);
+	Node* result = allocate_node(tid);
 	result->key = node.key;
 	result->value = node.value;
 	result->children = node.children;
+#ifdef RECLAIM_IBR
+	// the children were just loaded from a shared node
+	while (ibr_read_barrier())
+		result->children = node.children;
+#endif
 	result->flags = node.flags;
 	pthread_spin_init(&result->dup_lock, PTHREAD_PROCESS_PRIVATE);
 	return result;
@@ -145,7 +232,7 @@ Node* bst::dup_epilogue(const int& tid, Node* orig, Node* dup)
 			unsigned int ch_idx = 0;
 			for (auto& ch : (*it)->children)
 			{
-				if (ch != nullptr && ch->key == orig->key)
+				if (ch == orig)
 				{
 					parent = *it;
 					child_idx = ch_idx;
@@ -253,6 +340,82 @@ Node* bst::get_root()
 	return root;
 }
 
+template <typename skey_t, typename sval_t, class RecMgr>
+Node* bst::build(const skey_t* keys, const sval_t* values, size_t lo, size_t hi)
+{
+	if (lo >= hi)
+		return nullptr;
+
+#ifdef _OPENMP
+	const int tid = omp_get_thread_num();
+#else
+	const int tid = 0;
+#endif
+	size_t mid = lo + (hi - lo) / 2;
+	Node* result = create_node(tid, keys[mid], values[mid], MAX_CHILDREN);
+
+	// the left half becomes a task while it is big enough to be worth one
+	#pragma omp task if (mid - lo > BULK_LOAD_TASK_MIN)
+	result->children[LEFT] = build(keys, values, lo, mid);
+	result->children[RIGHT] = build(keys, values, mid + 1, hi);
+	#pragma omp taskwait
+
+	return result;
+}
+
+// retires the originals of all duplications with one call into the record
+// manager. with unlinked_children, children that a remove dropped from a
+// duplicated node are retired along with it.
+template <typename skey_t, typename sval_t, class RecMgr>
+void bst::retire_replaced(const int tid, bool unlinked_children)
+{
+	auto& nodes = write_set[tid].nodes;
+	nodes.clear();
+	for (auto& d : *duplications)
+	{
+		if (unlinked_children && !d.orig->is_del())
+		{
+			unsigned int ch_idx = 0;
+			for (auto& ch : d.orig->children)
+			{
+				if (ch != nullptr && d.dup->get_child(ch_idx) == nullptr)
+					nodes.push_back(ch);
+				ch_idx++;
+			}
+		}
+
+		nodes.push_back(d.orig);
+	}
+	recmgr->retire_batch(tid, nodes.data(), (int)nodes.size());
+#ifdef USE_OP_ARENA
+	recmgr->arena_commit(tid);
+#endif
+}
+
+template <typename skey_t, typename sval_t, class RecMgr>
+void bst::deallocate_copies(const int tid)
+{
+#ifdef USE_OP_ARENA
+	recmgr->arena_abort(tid);
+#else
+	auto& nodes = write_set[tid].nodes;
+	nodes.clear();
+	for (auto& d : *duplications)
+		nodes.push_back(d.dup);
+	recmgr->deallocate_batch(tid, nodes.data(), (int)nodes.size());
+#endif
+}
+
+// builds a balanced tree from n sorted keys. the tree must be empty, and all
+// OpenMP threads must have been initialized (nodes are allocated by them).
+template <typename skey_t, typename sval_t, class RecMgr>
+void bst::bulk_load(const skey_t* keys, const sval_t* values, size_t n)
+{
+	#pragma omp parallel
+	#pragma omp single
+	root = build(keys, values, 0, n);
+}
+
 template <typename skey_t, typename sval_t, class RecMgr>
 sval_t bst::insert(const int tid, const skey_t& key, const sval_t& value)
 {
@@ -313,24 +476,49 @@ sval_t bst::insert_wrapper(const int tid, const skey_t& key, const sval_t& value
 		insertion_res = insert(tid, key, value);
 		if (Node::close(root) && locking_res)
 		{
-			for (auto& d : *duplications)
-			{
-				recmgr->retire(tid, d.orig);
-			}
+			retire_replaced(tid);
 			return insertion_res;
 		}
 		else
 		{
-			for (auto& d : *duplications)
-			{
-				recmgr->deallocate(tid, d.dup);
-			}
+			deallocate_copies(tid);
 		}
 	}
 
 	return insertion_res;
 }
 
+// inserts key, or replaces its value if it is already present. returns the
+// replaced value, or NO_VALUE if key was inserted. a new value keeps the shape
+// of the tree, so instead of duplicating the node its value is swapped in place
+// under its dup_lock. a node that was duplicated or unlinked keeps that lock
+// forever, so holding it means the node is still in the tree.
+template <typename skey_t, typename sval_t, class RecMgr>
+sval_t bst::upsert_wrapper(const int tid, const skey_t& key, const sval_t& value)
+{
+	while (1)
+	{
+		{
+			auto guard = recmgr->getGuard(tid);
+			Node* parent = nullptr;
+			auto found = (root == nullptr) ? nullptr : find(key, parent);
+			if (found != nullptr)
+			{
+				if (pthread_spin_trylock(&found->dup_lock))
+					continue;
+
+				sval_t res = __atomic_exchange_n(&found->value, value, __ATOMIC_ACQ_REL);
+				pthread_spin_unlock(&found->dup_lock);
+				return res;
+			}
+		}
+
+		/* absent: insert, unless the key showed up in the meantime */
+		if (insert_wrapper(tid, key, value) == NO_VALUE)
+			return NO_VALUE;
+	}
+}
+
 template <typename skey_t, typename sval_t, class RecMgr>
 sval_t bst::remove(const int tid, const skey_t& key)
 {
@@ -346,28 +534,59 @@ sval_t bst::remove(const int tid, const skey_t& key)
 		if (parent == nullptr)
 		{
 			auto found_dup = dup_prologue(tid, found);
-			found_dup->delete_node();
-			dup_epilogue(tid, found, found_dup);
+			if (found_dup != nullptr)
+			{
+				found_dup->delete_node();
+				dup_epilogue(tid, found, found_dup);
+			}
+			return res;
 		}
 
-		else if (parent->get_key() <= key)
+		/* the unlinked leaf stays locked, so upsert_wrapper cannot write to it */
+		if (pthread_spin_trylock(&found->dup_lock))
+		{
+			locking_res = false;
+			return NO_VALUE;
+		}
+		locked->push_back(std::make_pair(found, false));
+
+		if (parent->get_key() <= key)
 		{
 			auto parent_dup = dup_prologue(tid, parent);
-			parent_dup->set_child(RIGHT, nullptr);
-			dup_epilogue(tid, parent, parent_dup);
+			if (parent_dup != nullptr)
+			{
+				parent_dup->set_child(RIGHT, nullptr);
+				dup_epilogue(tid, parent, parent_dup);
+			}
+			else
+			{
+				locked->pop_back();
+				pthread_spin_unlock(&found->dup_lock);
+			}
 		}
 		else
 		{
 			auto parent_dup = dup_prologue(tid, parent);
-			parent_dup->set_child(LEFT, nullptr);
-			dup_epilogue(tid, parent, parent_dup);
+			if (parent_dup != nullptr)
+			{
+				parent_dup->set_child(LEFT, nullptr);
+				dup_epilogue(tid, parent, parent_dup);
+			}
+			else
+			{
+				locked->pop_back();
+				pthread_spin_unlock(&found->dup_lock);
+			}
 		}
 	}
 	else
 	{
 		auto found_dup = dup_prologue(tid, found);
-		found_dup->delete_node();
-		dup_epilogue(tid, found, found_dup);
+		if (found_dup != nullptr)
+		{
+			found_dup->delete_node();
+			dup_epilogue(tid, found, found_dup);
+		}
 	}
 
 	return res;
@@ -381,32 +600,16 @@ sval_t bst::remove_wrapper(const int tid, const skey_t& key)
 	{
 		auto guard = recmgr->getGuard(tid);
 		Node::open(root);
+		locking_res = true;
 		removal_res = remove(tid, key);
-		if (Node::close(root))
+		if (Node::close(root) && locking_res)
 		{
-			for (auto& d : *duplications)
-			{
-				if (!d.orig->is_del())
-				{
-					unsigned int ch_idx = 0;
-					for (auto& ch : d.orig->children)
-					{
-						if (ch != nullptr && d.dup->get_child(ch_idx) == nullptr)
-							recmgr->retire(tid, ch);
-						ch_idx++;
-					}
-				}
-
-				recmgr->retire(tid, d.orig);
-			}
+			retire_replaced(tid, true);
 			return removal_res;
 		}
 		else
 		{
-			for (auto& d : *duplications)
-			{
-				recmgr->deallocate(tid, d.dup);
-			}
+			deallocate_copies(tid);
 		}
 	}
 
@@ -416,11 +619,20 @@ sval_t bst::remove_wrapper(const int tid, const skey_t& key)
 template <typename skey_t, typename sval_t, class RecMgr>
 sval_t bst::search(const int tid, const skey_t& key) {
 	auto guard = recmgr->getGuard(tid, true);
-	auto curr = root;
+	auto curr = load_root();
 
 	while (curr != nullptr && (curr->key != key || curr->is_del()))
 	{
-		curr = (key < curr->key) ? curr->children[LEFT] : curr->children[RIGHT];
+		Node* parent = curr;
+		curr = (key < parent->key) ? parent->children[LEFT] : parent->children[RIGHT];
+#ifdef RECLAIM_IBR
+		while (ibr_read_barrier())
+			curr = (key < parent->key) ? parent->children[LEFT] : parent->children[RIGHT];
+		// restart from the root as find() does
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (parent->is_replaced())
+			curr = load_root();
+#endif
 	}
 
 	if (curr != nullptr)
@@ -10,6 +10,7 @@
 
 const unsigned char DUP_MASK = 0x01;
 const unsigned char DEL_MASK = 0x02;
+const unsigned char REPLACED_MASK = 0x04;
 const unsigned int MAX_UINT = std::numeric_limits<unsigned int>::max();
 static std::mutex g_mutex;
 
@@ -36,11 +37,17 @@ public:
 	unsigned char flags;
 	std::vector<Node*> children; 
 	pthread_spinlock_t dup_lock;
+#ifdef RECLAIM_IBR
+	long birth_era; // era the node was allocated in (see reclaimer_ibr.h)
+#endif
 
 	inline bool is_dup() { return (flags & DUP_MASK) == DUP_MASK; }
 	inline void set_dup() { flags ^= DUP_MASK; }
 	inline bool is_del() { return (flags & DEL_MASK) == DEL_MASK; }
 	inline void set_del() { flags |= DEL_MASK; }
+	inline bool is_replaced() { return (__atomic_load_n(&flags, __ATOMIC_RELAXED) & REPLACED_MASK) == REPLACED_MASK; }
+	inline void set_replaced() { flags |= REPLACED_MASK; }
+	inline void clear_replaced() { flags &= ~REPLACED_MASK; }
 	
 	static bool lock_duplications();
 	static void unlock_duplications(bool all);
@@ -112,6 +119,10 @@ bool Node::open(Node*& root)
 		locked = new std::vector<std::pair<Node*, bool>>();
 
 	orig_root = root;
+#ifdef RECLAIM_IBR
+	while (ibr_read_barrier())
+		orig_root = root;
+#endif
 	new_root = nullptr;
 	in_writing_function = true;
 	dup_happened = false;
@@ -158,6 +169,12 @@ bool Node::close(Node*& root)
 		}
 	}
 
+	/* mark the originals before any duplication is reachable: readers that
+	   find the mark on a parent start over (see bst::find()) */
+	for (auto& d : *duplications)
+		d.orig->set_replaced();
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
 	/* connect duplications to tree */
 	for (auto& d : *duplications)
 	{
@@ -176,6 +193,8 @@ bool Node::close(Node*& root)
 					__ATOMIC_RELAXED, 
 					__ATOMIC_RELAXED))
 			{
+				for (auto& r : *duplications)
+					r.orig->clear_replaced();
 				unlock_duplications(true);
 				// pthread_spin_unlock(&orig->dup_lock);
 				return false;
@@ -191,6 +210,8 @@ bool Node::close(Node*& root)
 					__ATOMIC_RELAXED, 
 					__ATOMIC_RELAXED))
 			{
+				for (auto& r : *duplications)
+					r.orig->clear_replaced();
 				unlock_duplications(true);
 				// pthread_spin_unlock(&orig->dup_lock);
 				return false;
@@ -221,6 +242,12 @@ Node* Node::get_child(unsigned int child_idx)
 		return nullptr;
 
 	Node* child = children.at(child_idx);
+#ifdef RECLAIM_IBR
+	// children are written in place, so every load of one must extend the
+	// era reservation (a path copy only needs this for the root)
+	while (ibr_read_barrier())
+		child = children.at(child_idx);
+#endif
 	if (in_writing_function && child != nullptr)
 	{
 		path->push_back(this);
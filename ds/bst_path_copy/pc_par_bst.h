@@ -1,6 +1,10 @@
 #pragma once
 
 #include "pc_par_node.h"
+#include "prefetching.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include <atomic>
 #include <iostream>
 #include <string>
@@ -8,6 +12,7 @@
 const unsigned int LEFT = 0;
 const unsigned int RIGHT = 1;
 const unsigned int MAX_CHILDREN = 2;
+const size_t BULK_LOAD_TASK_MIN = 1 << 14;
 
 #define bst	BST<skey_t, sval_t, RecMgr>
 
@@ -23,14 +28,32 @@ private:
 	int init[MAX_THREADS_POW2] = {0,};
 	RecMgr* recmgr;
 
+	// nodes replaced or copied by the running operation, gathered so they
+	// are retired or freed with one call into the record manager
+	struct write_set_t {
+		PAD;
+		std::vector<Node*> nodes;
+		PAD;
+	};
+	write_set_t write_set[MAX_THREADS_POW2];
+
 	void make_empty(Node* t);
 
 	Node* find(const skey_t& key, Node*& parent);
 
+	Node* allocate_node(const int& tid);
+	Node* load_root();
+
 	Node* create_node(const int& tid, const skey_t& key, const sval_t& value, unsigned int max_num_children);
 
 	Node* create_node(const int& tid, const Node& node);
 
+	Node* build(const skey_t* keys, const sval_t* values, size_t lo, size_t hi);
+
+	void retire_replaced(const int tid);
+
+	void deallocate_copies(const int tid);
+
 	Node* path_copy(const int& tid, Node* start);
 
 public:
@@ -51,10 +74,16 @@ public:
 
 	Node* get_root();
 
+	void bulk_load(const skey_t* keys, const sval_t* values, size_t n);
+
 	sval_t insert(const int tid, const skey_t& key, const sval_t& value);
 
 	sval_t insert_wrapper(const int tid, const skey_t& key, const sval_t& value);
 
+	sval_t upsert(const int tid, const skey_t& key, const sval_t& value);
+
+	sval_t upsert_wrapper(const int tid, const skey_t& key, const sval_t& value);
+
 	sval_t remove(const int tid, const skey_t& key);
 
 	sval_t remove_wrapper(const int tid, const skey_t& key);
@@ -75,7 +104,7 @@ void bst::make_empty(Node* t) {
 
 	make_empty(t->get_child(LEFT));
 	make_empty(t->get_child(RIGHT));
-	delete t;
+	recmgr->deallocate(0, t);
 }
 
 template <typename skey_t, typename sval_t, class RecMgr>
@@ -83,10 +112,13 @@ Node* bst::find(
 	const skey_t& key,
 	Node*& parent)
 {
-	auto curr = root;
+	auto curr = load_root();
 
 	while (curr != nullptr && (curr->key != key || curr->is_del()))
 	{
+		// fetch both candidates while the key comparison resolves
+		prefetch_range(curr->children[LEFT], sizeof(Node));
+		prefetch_range(curr->children[RIGHT], sizeof(Node));
 		parent = curr;
 		curr = (key < curr->key) ? curr->get_child(LEFT) : curr->get_child(RIGHT);
 	}
@@ -94,13 +126,49 @@ Node* bst::find(
 	return curr;
 }
 
+// loads root; with RECLAIM_IBR this also extends the thread's era reservation
+// to cover the snapshot below the root, since path copying never writes a
+// published node
 template <typename skey_t, typename sval_t, class RecMgr>
-Node* bst::create_node(const int& tid, const skey_t& key, const sval_t& value, unsigned int max_num_children)
+Node* bst::load_root()
 {
+	Node* result = __atomic_load_n(&root, __ATOMIC_ACQUIRE);
+#ifdef RECLAIM_IBR
+	while (ibr_read_barrier())
+		result = __atomic_load_n(&root, __ATOMIC_ACQUIRE);
+#endif
+	return result;
+}
+
+// nodes allocated inside an operation come from the record manager's
+// per-operation arena, which is committed or rewound with the operation
+template <typename skey_t, typename sval_t, class RecMgr>
+Node* bst::allocate_node(const int& tid)
+{
+#ifdef USE_OP_ARENA
+	if (in_writing_function)
+	{
+		Node* result = recmgr->template arena_allocate<Node>(tid);
+#ifdef RECLAIM_IBR
+		result->birth_era = ibr_birth_era_now();
+#endif
+		return result;
+	}
+#endif
 	Node* result = (Node*)recmgr->template allocate<Node>(tid);
+#ifdef RECLAIM_IBR
+	result->birth_era = ibr_birth_era_now();
+#endif
+	return result;
+}
+
+template <typename skey_t, typename sval_t, class RecMgr>
+Node* bst::create_node(const int& tid, const skey_t& key, const sval_t& value, unsigned int max_num_children)
+{
+	Node* result = allocate_node(tid);
 	result->key = key;
 	result->value = value;
-	result->children.resize(max_num_children, nullptr);
+	result->children.assign(max_num_children, nullptr);
 	result->flags = 0;
 	return result;
 }
@@ -108,7 +176,7 @@ Node* bst::create_node(const int& tid, const skey_t& key, const sval_t& value, u
 template <typename skey_t, typename sval_t, class RecMgr>
 Node* bst::create_node(const int& tid, const Node& node)
 {
-	Node* result = (Node*)recmgr->template allocate<Node>(tid);
+	Node* result = allocate_node(tid);
 	result->key = node.key;
 	result->value = node.value;
 	result->children = node.children;
@@ -212,6 +280,68 @@ Node* bst::get_root()
 	return root;
 }
 
+template <typename skey_t, typename sval_t, class RecMgr>
+Node* bst::build(const skey_t* keys, const sval_t* values, size_t lo, size_t hi)
+{
+	if (lo >= hi)
+		return nullptr;
+
+#ifdef _OPENMP
+	const int tid = omp_get_thread_num();
+#else
+	const int tid = 0;
+#endif
+	size_t mid = lo + (hi - lo) / 2;
+	Node* result = create_node(tid, keys[mid], values[mid], MAX_CHILDREN);
+
+	// the left half becomes a task while it is big enough to be worth one
+	#pragma omp task if (mid - lo > BULK_LOAD_TASK_MIN)
+	result->children[LEFT] = build(keys, values, lo, mid);
+	result->children[RIGHT] = build(keys, values, mid + 1, hi);
+	#pragma omp taskwait
+
+	return result;
+}
+
+// retires the nodes replaced by the path copy with one call into the record
+// manager
+template <typename skey_t, typename sval_t, class RecMgr>
+void bst::retire_replaced(const int tid)
+{
+	auto& nodes = write_set[tid].nodes;
+	nodes.clear();
+	for (auto& d : *duplications)
+		nodes.push_back(d.first);
+	recmgr->retire_batch(tid, nodes.data(), (int)nodes.size());
+#ifdef USE_OP_ARENA
+	recmgr->arena_commit(tid);
+#endif
+}
+
+template <typename skey_t, typename sval_t, class RecMgr>
+void bst::deallocate_copies(const int tid)
+{
+#ifdef USE_OP_ARENA
+	recmgr->arena_abort(tid);
+#else
+	auto& nodes = write_set[tid].nodes;
+	nodes.clear();
+	for (auto& d : *duplications)
+		nodes.push_back(d.second);
+	recmgr->deallocate_batch(tid, nodes.data(), (int)nodes.size());
+#endif
+}
+
+// builds a balanced tree from n sorted keys. the tree must be empty, and all
+// OpenMP threads must have been initialized (nodes are allocated by them).
+template <typename skey_t, typename sval_t, class RecMgr>
+void bst::bulk_load(const skey_t* keys, const sval_t* values, size_t n)
+{
+	#pragma omp parallel
+	#pragma omp single
+	root = build(keys, values, 0, n);
+}
+
 template <typename skey_t, typename sval_t, class RecMgr>
 sval_t bst::insert(const int tid, const skey_t& key, const sval_t& value)
 {
@@ -256,24 +386,60 @@ sval_t bst::insert_wrapper(const int tid, const skey_t& key, const sval_t& value
 		insertion_res = insert(tid, key, value);
 		if (Node::close(root))
 		{
-			for (auto& d : *duplications)
-			{
-				recmgr->retire(tid, d.first);
-			}
+			retire_replaced(tid);
 			return insertion_res;
 		}
 		else
 		{
-			for (auto& d : *duplications)
-			{
-				recmgr->deallocate(tid, d.second);
-			}
+			deallocate_copies(tid);
 		}
 	}
 
 	return insertion_res;
 }
 
+// inserts key, or replaces its value if it is already present. returns the
+// replaced value, or NO_VALUE if key was inserted. a new value keeps the shape
+// of the tree, so only the path from the root to the key's node is copied.
+template <typename skey_t, typename sval_t, class RecMgr>
+sval_t bst::upsert(const int tid, const skey_t& key, const sval_t& value)
+{
+	Node* parent = nullptr;
+	auto found = (orig_root == nullptr) ? nullptr : find(key, parent);
+
+	if (found == nullptr)
+		return insert(tid, key, value);
+
+	sval_t res = found->get_value();
+	auto found_dup = path_copy(tid, found);
+	found_dup->set_value(value);
+	return res;
+}
+
+template <typename skey_t, typename sval_t, class RecMgr>
+sval_t bst::upsert_wrapper(const int tid, const skey_t& key, const sval_t& value)
+{
+	sval_t upsert_res;
+
+	while (1)
+	{
+		auto guard = recmgr->getGuard(tid);
+		Node::open(root);
+		upsert_res = upsert(tid, key, value);
+		if (Node::close(root))
+		{
+			retire_replaced(tid);
+			return upsert_res;
+		}
+		else
+		{
+			deallocate_copies(tid);
+		}
+	}
+
+	return upsert_res;
+}
+
 template <typename skey_t, typename sval_t, class RecMgr>
 sval_t bst::remove(const int tid, const skey_t& key)
 {
@@ -322,8 +488,7 @@ sval_t bst::remove_wrapper(const int tid, const skey_t& key)
 		removal_res = remove(tid, key);
 	} while (!Node::close(root));
 
-	for (auto& d : *duplications)
-		recmgr->retire(tid, d.first);
+	retire_replaced(tid);
 
 	return removal_res;
 }
@@ -331,7 +496,7 @@ sval_t bst::remove_wrapper(const int tid, const skey_t& key)
 template <typename skey_t, typename sval_t, class RecMgr>
 sval_t bst::search(const int tid, const skey_t& key) {
 	auto guard = recmgr->getGuard(tid, true);
-	auto curr = root;
+	auto curr = load_root();
 
 	while (curr != nullptr && (curr->key != key || curr->is_del()))
 	{
@@ -19,6 +19,9 @@ public:
 	sval_t value;
 	unsigned char flags;
 	std::vector<Node*> children;
+#ifdef RECLAIM_IBR
+	long birth_era; // era the node was allocated in (see reclaimer_ibr.h)
+#endif
 
 	inline bool is_del() { return (flags & DEL_MASK) == DEL_MASK; }
 	inline void set_del() { flags |= DEL_MASK; }
@@ -29,6 +32,7 @@ public:
 	bool is_deleted();
 	
 	Node* set_key(const skey_t& new_key);
+	Node* set_value(const sval_t& new_value);
 	Node* set_child(unsigned int child_idx, Node* new_child);
 	Node* delete_node();
 
@@ -70,6 +74,10 @@ bool Node::open(Node*& root)
 		duplications = new std::unordered_map<Node*, Node*>();
 		
 	orig_root = root;
+#ifdef RECLAIM_IBR
+	while (ibr_read_barrier())
+		orig_root = root;
+#endif
 	in_writing_function = true;
 	pc_happened = false;
 	return true;
@@ -136,6 +144,13 @@ Node* Node::set_key(const skey_t& new_key)
 	return this;
 }
 
+template <typename skey_t, typename sval_t>
+Node* Node::set_value(const sval_t& new_value)
+{
+	this->value = new_value;
+	return this;
+}
+
 template <typename skey_t, typename sval_t>
 Node* Node::set_child(unsigned int child_idx, Node* new_child)
 {
@@ -1,10 +1,15 @@
 #pragma once
 
 #include "ser_node.h"
+#include "prefetching.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 const unsigned int LEFT = 0;
 const unsigned int RIGHT = 1;
 const unsigned int MAX_CHILDREN = 2;
+const size_t BULK_LOAD_TASK_MIN = 1 << 14;
 
 #define bst	BST<skey_t, sval_t, RecMgr>
 
@@ -28,6 +33,8 @@ private:
 
 	Node* create_node(const int& tid, const Node& node);
 
+	Node* build(const skey_t* keys, const sval_t* values, size_t lo, size_t hi);
+
 public:
 	BST(
 		const int _NUM_THREADS, 
@@ -46,10 +53,16 @@ public:
 
 	Node* get_root();
 
+	void bulk_load(const skey_t* keys, const sval_t* values, size_t n);
+
 	sval_t insert(const int tid, const skey_t& key, const sval_t& value);
 
 	sval_t insert_wrapper(const int tid, const skey_t& key, const sval_t& value);
 
+	sval_t upsert(const int tid, const skey_t& key, const sval_t& value);
+
+	sval_t upsert_wrapper(const int tid, const skey_t& key, const sval_t& value);
+
 	sval_t remove(const int tid, const skey_t& key);
 
 	sval_t remove_wrapper(const int tid, const skey_t& key);
@@ -66,7 +79,7 @@ void bst::make_empty(Node* t) {
 
 	make_empty(t->get_child(LEFT));
 	make_empty(t->get_child(RIGHT));
-	delete t;
+	recmgr->deallocate(0, t);
 }
 
 template <typename skey_t, typename sval_t, class RecMgr>
@@ -76,6 +89,9 @@ Node* bst::find(const skey_t& key, Node*& parent)
 
 	while (curr != nullptr && (curr->key != key || curr->is_del()))
 	{
+		// fetch both candidates while the key comparison resolves
+		prefetch_range(curr->children[LEFT], sizeof(Node));
+		prefetch_range(curr->children[RIGHT], sizeof(Node));
 		parent = curr;
 		curr = (key < curr->key) ? curr->get_child(LEFT) : curr->get_child(RIGHT);
 	}
@@ -159,6 +175,39 @@ Node* bst::get_root()
 	return root;
 }
 
+template <typename skey_t, typename sval_t, class RecMgr>
+Node* bst::build(const skey_t* keys, const sval_t* values, size_t lo, size_t hi)
+{
+	if (lo >= hi)
+		return nullptr;
+
+#ifdef _OPENMP
+	const int tid = omp_get_thread_num();
+#else
+	const int tid = 0;
+#endif
+	size_t mid = lo + (hi - lo) / 2;
+	Node* result = create_node(tid, keys[mid], values[mid], MAX_CHILDREN);
+
+	// the left half becomes a task while it is big enough to be worth one
+	#pragma omp task if (mid - lo > BULK_LOAD_TASK_MIN)
+	result->children[LEFT] = build(keys, values, lo, mid);
+	result->children[RIGHT] = build(keys, values, mid + 1, hi);
+	#pragma omp taskwait
+
+	return result;
+}
+
+// builds a balanced tree from n sorted keys. the tree must be empty, and all
+// OpenMP threads must have been initialized (nodes are allocated by them).
+template <typename skey_t, typename sval_t, class RecMgr>
+void bst::bulk_load(const skey_t* keys, const sval_t* values, size_t n)
+{
+	#pragma omp parallel
+	#pragma omp single
+	root = build(keys, values, 0, n);
+}
+
 template <typename skey_t, typename sval_t, class RecMgr>
 sval_t bst::insert(const int tid, const skey_t& key, const sval_t& value)
 {
@@ -205,6 +254,41 @@ sval_t bst::insert_wrapper(const int tid, const skey_t& key, const sval_t& value
 	return insertion_res;
 }
 
+// inserts key, or replaces its value if it is already present. returns the
+// replaced value, or NO_VALUE if key was inserted.
+template <typename skey_t, typename sval_t, class RecMgr>
+sval_t bst::upsert(const int tid, const skey_t& key, const sval_t& value)
+{
+	Node* parent = nullptr;
+	auto found = (root == nullptr) ? nullptr : find(key, parent);
+
+	if (found == nullptr)
+		return insert(tid, key, value);
+
+	sval_t res = found->get_value();
+	found->set_value(value);
+	return res;
+}
+
+template <typename skey_t, typename sval_t, class RecMgr>
+sval_t bst::upsert_wrapper(const int tid, const skey_t& key, const sval_t& value)
+{
+	sval_t upsert_res;
+
+	while (1)
+	{
+		auto guard = recmgr->getGuard(tid);
+		Node::open(root);
+		upsert_res = upsert(tid, key, value);
+		if (Node::close(root))
+		{
+			return upsert_res;
+		}
+	}
+
+	return upsert_res;
+}
+
 template <typename skey_t, typename sval_t, class RecMgr>
 sval_t bst::remove(const int tid, const skey_t& key)
 {
@@ -47,6 +47,7 @@ public:
 	bool is_deleted();
 
 	Node* set_key(const skey_t& new_key);
+	Node* set_value(const sval_t& new_value);
 	Node* set_child(unsigned int child_idx, Node* new_child);
 	Node* delete_node();
 
@@ -109,6 +110,13 @@ Node* Node::set_key(const skey_t& new_key)
 	return this;
 }
 
+template<typename skey_t, typename sval_t>
+Node* Node::set_value(const sval_t& new_value)
+{
+	this->value = new_value;
+	return this;
+}
+
 template<typename skey_t, typename sval_t>
 Node* Node::set_child(unsigned int child_idx, Node* new_child)
 {
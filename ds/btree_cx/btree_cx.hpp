@@ -161,6 +161,7 @@ public:
     //! Frees up all used B+ tree memory pages
     ~btree_ser()
     {
+        tree_.clear(0); // while the record manager still owns the nodes
         delete tree_.recmgr; 
     }
 
@@ -188,6 +189,14 @@ public:
         return tree_.root_;
     }
 
+    //! Bulk load a sorted range of (key, value) pairs into the empty tree,
+    //! see BTree::bulk_load. Not safe against concurrent operations.
+    template <typename Iterator>
+    void bulk_load(const int tid, Iterator ibegin, Iterator iend)
+    {
+        tree_.bulk_load(tid, ibegin, iend);
+    }
+
 
 public:
     //! \name Key and Value Comparison Function Objects
@@ -232,6 +241,22 @@ public:
             return (*it).second;
     }
 
+    //! Look up keys[0,n) under a single guard and store the value of keys[i],
+    //! or NO_VALUE, in values[i]. The descents are interleaved, see
+    //! btree_impl::find_batch.
+    void find_batch(const int tid, const skey_t* keys, size_t n, sval_t* values) {
+        auto guard = tree_.recmgr->getGuard(tid, true);
+        iterator its[btree_impl::find_batch_width];
+        for (size_t base = 0; base < n; base += btree_impl::find_batch_width) {
+            const size_t m = (n - base < btree_impl::find_batch_width)
+                             ? n - base : btree_impl::find_batch_width;
+            tree_.find_batch(keys + base, m, its);
+            const iterator end = tree_.end();
+            for (size_t i = 0; i < m; ++i)
+                values[base + i] = (its[i] == end) ? NO_VALUE : (*its[i]).second;
+        }
+    }
+
 public:
     //! \name Public Insertion Functions
     //! \{
@@ -252,6 +277,24 @@ public:
             return value;
     }
 
+    //! Insert a key/data pair into the B+ tree, or replace the data of the key
+    //! if it is already present. Returns NO_VALUE if the key was inserted.
+    //! Updates only report a bool through the CX construction, so on a replace
+    //! this returns the new data rather than the replaced one.
+    sval_t upsert(const int tid, const skey_t& key, const sval_t& value) {
+        auto guard = tree_.recmgr->getGuard(tid);
+        bool result = cx.applyUpdate([=] (btree_impl *tree) {
+            auto res = tree->insert(tid, std::make_pair(key, value));
+            if (!res.second)
+                (*res.first).second = value;
+            return res.second;
+        }, tid);
+        if (result)
+            return NO_VALUE;
+        else
+            return value;
+    }
+
     //! \}
 
 public:
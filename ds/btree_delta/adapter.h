@@ -0,0 +1,222 @@
+/**
+ * Implementation of the lock-free external BST of Ellen, Fatourou, Ruppert and van Breugel.
+ * This is a heavily modified version of the ASCYLIB implementation (see copyright in ellen.h).
+ * The modifications are copyrighted (consistent with the original license)
+ *   by Maya Arbel-Raviv and Trevor Brown, 2018.
+ */
+
+#ifndef BST_ADAPTER_H
+#define BST_ADAPTER_H
+
+#include <iostream>
+#include <csignal>
+#include "errors.h"
+#include "random_fnv1a.h"
+#include <vector>
+#ifdef _OPENMP
+#   include <omp.h>
+#endif
+#ifdef USE_TREE_STATS
+#   define TREE_STATS_BYTES_AT_DEPTH
+#   include "tree_stats.h"
+#endif
+#include "btree_delta.hpp"
+#include <iostream>
+
+#define RECORD_MANAGER_T record_manager<Reclaim, Alloc, Pool, tlx::inner_node<K, std::pair<K,V>>, tlx::leaf_node<K, std::pair<K,V>>, tlx::leaf_delta<K, std::pair<K,V>>>
+#define DATA_STRUCTURE_T btree_delta<K, V, RECORD_MANAGER_T>
+
+template <typename K, typename V, class Reclaim = reclaimer_debra<K>, class Alloc = allocator_new<K>, class Pool = pool_none<K>>
+class ds_adapter {
+private:
+    const V NO_VALUE;
+    DATA_STRUCTURE_T * const ds;
+
+public:
+    ds_adapter(const int NUM_THREADS,
+               const K& KEY_MIN,
+               const K& KEY_MAX,
+               const V& VALUE_RESERVED,
+               RandomFNV1A * const unused2)
+    : NO_VALUE(VALUE_RESERVED)
+    , ds(new DATA_STRUCTURE_T(NUM_THREADS, KEY_MIN, KEY_MAX, NO_VALUE, 0 /* unused */))
+    {}
+    // bulk loads the initNumKeys sorted keys in initKeys (see
+    // prefillWithArrayConstruction in microbench/main.cpp)
+    ds_adapter(const int NUM_THREADS,
+               const K& KEY_MIN,
+               const K& KEY_MAX,
+               const V& VALUE_RESERVED,
+               RandomFNV1A * const unused2,
+               const K * const initKeys,
+               const V * const initValues,
+               const size_t initNumKeys,
+               const size_t unused3)
+    : NO_VALUE(VALUE_RESERVED)
+    , ds(new DATA_STRUCTURE_T(NUM_THREADS, KEY_MIN, KEY_MAX, NO_VALUE, 0 /* unused */))
+    {
+        std::vector<std::pair<K,V>> items(initNumKeys);
+        #pragma omp parallel
+        {
+#ifdef _OPENMP
+            ds->initThread(omp_get_thread_num());
+#endif
+            #pragma omp for schedule(static)
+            for (size_t i = 0; i < initNumKeys; ++i) {
+                items[i] = std::make_pair(initKeys[i], initValues[i]);
+            }
+        }
+        ds->bulk_load(0, items.begin(), items.end());
+    }
+    ~ds_adapter() {
+        delete ds;
+    }
+    
+    V getNoValue() {
+        return NO_VALUE;
+    }
+    
+    void initThread(const int tid) {
+        ds->initThread(tid);
+    }
+    void deinitThread(const int tid) {
+        ds->deinitThread(tid);
+    }
+
+    V insert(const int tid, const K& key, const V& val) {
+        return ds->upsert(tid, key, val);
+    }
+    V insertIfAbsent(const int tid, const K& key, const V& val) {
+        return ds->insert(tid, key, val);
+    }
+    V erase(const int tid, const K& key) {
+        return ds->erase(tid, key);
+    }
+    V find(const int tid, const K& key) {
+        return ds->find(tid, key);
+    }
+    // looks up keys[0..n) with interleaved descents, values[i] gets the
+    // value of keys[i] or getNoValue()
+    void find_batch(const int tid, const K * const keys, const size_t n, V * const values) {
+        ds->find_batch(tid, keys, n, values);
+    }
+    bool contains(const int tid, const K& key) {
+        return find(tid, key) != getNoValue();
+    }
+    int rangeQuery(const int tid, const K& lo, const K& hi, K * const resultKeys, V * const resultValues) {
+        setbench_error("not implemented");
+    }
+    // erases every key in [lo, hi], returns how many were erased
+    int erase_range(const int tid, const K& lo, const K& hi) {
+        return ds->erase_range(tid, lo, hi);
+    }
+    void printSummary() {
+        // ds->printTree();
+        auto recmgr = ds->debugGetRecMgr();
+        recmgr->printStatus();
+    }
+    bool validateStructure() {
+        return true;
+    }
+    void printObjectSizes() {
+        std::cout<<"sizes: node="
+                 <<(sizeof(int))
+                 <<std::endl;
+    }
+
+#ifdef USE_TREE_STATS
+    class NodeHandler {
+    public:
+        typedef struct tlx::node * NodePtrType;
+        K minKey;
+        K maxKey;
+        
+        NodeHandler(const K& _minKey, const K& _maxKey) {
+            minKey = _minKey;
+            maxKey = _maxKey;
+        }
+        
+        class ChildIterator {
+        private:
+            bool child_slots[TLX_BTREE_MAX(DATA_STRUCTURE_T::btree_impl::inner_slotmax, 
+                DATA_STRUCTURE_T::btree_impl::leaf_slotmax) + 1];
+            NodePtrType node; // node being iterated over
+
+        public:
+            ChildIterator(NodePtrType _node) {
+                node = _node;
+                if (node)
+                    for (int i = 0; i <= node->slotuse; i++)
+                        child_slots[i] = true;
+            }
+            bool hasNext() {
+                if (!node || node->is_leafnode())
+                    return false;
+
+                bool res = false;
+                for (int i = 0; i <= node->slotuse; i++)
+                    if (child_slots[i])
+                        res = true;
+                return res;
+            }
+            NodePtrType next() {
+                if (!node || node->is_leafnode())
+                    setbench_error("ERROR: it is suspected that you are calling ChildIterator::next() without first verifying that it hasNext()");
+                
+                struct DATA_STRUCTURE_T::btree_impl::InnerNode* in = 
+                    static_cast<struct DATA_STRUCTURE_T::btree_impl::InnerNode*>(node);
+                for (int i = 0; i <= node->slotuse; i++)
+                {
+                    if (child_slots[i])
+                    {
+                        child_slots[i] = false;
+                        return in->childid[i];
+                    }
+                }
+                setbench_error("ERROR: it is suspected that you are calling ChildIterator::next() without first verifying that it hasNext()");
+            }
+        };
+        
+        bool isLeaf(NodePtrType node) {
+            return (node && node->is_leafnode());
+        }
+        size_t getNumChildren(NodePtrType node) {
+            if (!node || isLeaf(node)) return 0;
+            return node->slotuse + 1;
+        }
+        size_t getNumKeys(NodePtrType node) {
+            if (!node || !node->is_leafnode()) return 0;
+            return tlx::delta_chain(node) ? tlx::delta_chain(node)->size : node->slotuse;
+        }
+        size_t getSumOfKeys(NodePtrType node) {
+            int sum_keys = 0;
+
+            if (node && node->is_leafnode()) {
+                struct DATA_STRUCTURE_T::btree_impl::LeafNode* ln = 
+                    static_cast<struct DATA_STRUCTURE_T::btree_impl::LeafNode*>(node);
+                std::pair<K,V> slotdata[DATA_STRUCTURE_T::btree_impl::leaf_slotmax];
+                int size = tlx::read_leaf<K, std::pair<K,V>>(ln, tlx::delta_chain(ln), slotdata);
+                for (int i = 0; i < size; i++) {
+                    sum_keys += slotdata[i].first;
+                }
+            }
+            return sum_keys;
+        }
+        ChildIterator getChildIterator(NodePtrType node) {
+            return ChildIterator(node);
+        }
+        static size_t getSizeInBytes(NodePtrType node) { 
+            if (node)
+                return sizeof(*node); 
+            else
+                return 0;
+        }
+    };
+
+    TreeStats<NodeHandler> * createTreeStats(const K& _minKey, const K& _maxKey) {
+        return new TreeStats<NodeHandler>(new NodeHandler(_minKey, _maxKey), ds->get_root(), false);
+    }
+#endif 
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,4631 @@
+/*******************************************************************************
+ * tlx/container/btree.hpp
+ *
+ * Part of tlx - http://panthema.net/tlx
+ *
+ * Copyright (C) 2008-2017 Timo Bingmann <tb@panthema.net>
+ *
+ * All rights reserved. Published under the Boost Software License, Version 1.0
+ ******************************************************************************/
+#ifndef TLX_CONTAINER_BTREE_HEADER
+#define TLX_CONTAINER_BTREE_HEADER
+
+#include "btree_node.hpp"
+#include "btree_search.h"
+#include "sharded_stats.h"
+#include "prefetching.h"
+
+// *** Required Headers from the STL
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <utility>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace tlx {
+
+//! \addtogroup tlx_container
+//! \{
+//! \defgroup tlx_container_btree B+ Trees
+//! B+ tree variants
+//! \{
+
+#ifdef BTREE_RELAXED_ERASE
+//! Set while erase_one_descend() runs as a lazy rebalancing step: nothing is
+//! removed, only the topmost underflowing node on the path is repaired.
+thread_local bool rebalancing = false;
+
+//! Set by erase_one_descend() when an underflow was left behind for a later
+//! rebalancing step.
+thread_local bool underflow_res = false;
+#endif
+
+/*!
+ * Basic class implementing a B+ tree data structure in memory.
+ *
+ * The base implementation of an in-memory B+ tree. It is based on the
+ * implementation in Cormen's Introduction into Algorithms, Jan Jannink's paper
+ * and other algorithm resources. Almost all STL-required function calls are
+ * implemented. The asymptotic time requirements of the STL are not always
+ * fulfilled in theory, however, in practice this B+ tree performs better than a
+ * red-black tree and almost always uses less memory. The insertion function
+ * splits the nodes on the recursion unroll. Erase is largely based on Jannink's
+ * ideas.
+ *
+ * This class is specialized into btree_set, btree_multiset, btree_map and
+ * btree_multimap using default template parameters and facade functions.
+ */
+template <typename Key, typename Value,
+          typename KeyOfValue,
+          typename RecMgr,
+          typename Compare = std::less<Key>,
+          typename Traits = btree_default_traits<Key, Value>,
+          bool Duplicates = false,
+          typename Allocator = std::allocator<Value> >
+class BTree
+{
+public:
+    //! \name Template Parameter Types
+    //! \{
+
+    //! First template parameter: The key type of the B+ tree. This is stored in
+    //! inner nodes.
+    typedef Key key_type;
+
+    //! Second template parameter: Composition pair of key and data types, or
+    //! just the key for set containers. This data type is stored in the leaves.
+    typedef Value value_type;
+
+    //! Third template: key extractor class to pull key_type from value_type.
+    typedef KeyOfValue key_of_value;
+
+    //! Fourth template parameter: key_type comparison function object
+    typedef Compare key_compare;
+
+    //! Fifth template parameter: Traits object used to define more parameters
+    //! of the B+ tree
+    typedef Traits traits;
+
+    //! Sixth template parameter: Allow duplicate keys in the B+ tree. Used to
+    //! implement multiset and multimap.
+    static const bool allow_duplicates = Duplicates;
+
+    //! Seventh template parameter: STL allocator for tree nodes
+    typedef Allocator allocator_type;
+
+    //! \}
+
+    // The macro TLX_BTREE_FRIENDS can be used by outside class to access the B+
+    // tree internals. This was added for wxBTreeDemo to be able to draw the
+    // tree.
+    TLX_BTREE_FRIENDS;
+
+public:
+    //! \name Constructed Types
+    //! \{
+
+    //! Typedef of our own type
+    typedef BTree<key_type, value_type, key_of_value, RecMgr, key_compare,
+                  traits, allow_duplicates, allocator_type> Self;
+
+    typedef inner_node<key_type, value_type> InnerNode;
+    typedef leaf_node<key_type, value_type> LeafNode;
+    typedef leaf_delta<key_type, value_type> LeafDelta;
+
+    //! Size type used to count keys
+    typedef size_t size_type;
+
+    //! \}
+
+public:
+    //! \name Static Constant Options and Values of the B+ Tree
+    //! \{
+
+    //! Base B+ tree parameter: The number of key/data slots in each leaf
+    static const unsigned short leaf_slotmax = traits::leaf_slots;
+
+    //! Base B+ tree parameter: The number of key slots in each inner node,
+    //! this can differ from slots in each leaf.
+    static const unsigned short inner_slotmax = traits::inner_slots;
+
+    //! Computed B+ tree parameter: The minimum number of key/data slots used
+    //! in a leaf. If fewer slots are used, the leaf will be merged or slots
+    //! shifted from it's siblings.
+    static const unsigned short leaf_slotmin = (leaf_slotmax / 2);
+
+    //! Computed B+ tree parameter: The minimum number of key slots used
+    //! in an inner node. If fewer slots are used, the inner node will be
+    //! merged or slots shifted from it's siblings.
+    static const unsigned short inner_slotmin = (inner_slotmax / 2);
+
+    //! Debug parameter: Enables expensive and thorough checking of the B+ tree
+    //! invariants after each insert/erase operation.
+    static const bool self_verify = traits::self_verify;
+
+    //! Debug parameter: Prints out lots of debug information about how the
+    //! algorithms change the tree. Requires the header file to be compiled
+    //! with TLX_BTREE_DEBUG and the key type must be std::ostream printable.
+    static const bool debug = traits::debug;
+
+    //! \}
+
+public:
+    //! \name Iterators and Reverse Iterators
+    //! \{
+
+    class iterator;
+    class const_iterator;
+    class reverse_iterator;
+    class const_reverse_iterator;
+
+    //! STL-like iterator object for B+ tree items. The iterator points to a
+    //! specific slot number in a leaf.
+    class iterator
+    {
+    public:
+        // *** Types
+
+        //! The key type of the btree. Returned by key().
+        typedef typename BTree::key_type key_type;
+
+        //! The value type of the btree. Returned by operator*().
+        typedef typename BTree::value_type value_type;
+
+        //! Reference to the value_type. STL required.
+        typedef value_type& reference;
+
+        //! Pointer to the value_type. STL required.
+        typedef value_type* pointer;
+
+        //! STL-magic iterator category
+        typedef std::bidirectional_iterator_tag iterator_category;
+
+        //! STL-magic
+        typedef ptrdiff_t difference_type;
+
+        //! Our own type
+        typedef iterator self;
+
+    private:
+        // *** Members
+
+        //! The currently referenced leaf node of the tree
+        typename BTree::LeafNode* curr_leaf;
+
+        //! Current key/data slot referenced
+        unsigned short curr_slot;
+
+        //! Friendly to the const_iterator, so it may access the two data items
+        //! directly.
+        friend class const_iterator;
+
+        //! Also friendly to the reverse_iterator, so it may access the two
+        //! data items directly.
+        friend class reverse_iterator;
+
+        //! Also friendly to the const_reverse_iterator, so it may access the
+        //! two data items directly.
+        friend class const_reverse_iterator;
+
+        //! Also friendly to the base btree class, because erase_iter() needs
+        //! to read the curr_leaf and curr_slot values directly.
+        friend class BTree<key_type, value_type, key_of_value, RecMgr, key_compare,
+                           traits, allow_duplicates, allocator_type>;
+
+        // The macro TLX_BTREE_FRIENDS can be used by outside class to access
+        // the B+ tree internals. This was added for wxBTreeDemo to be able to
+        // draw the tree.
+        TLX_BTREE_FRIENDS;
+
+    public:
+        // *** Methods
+
+        //! Default-Constructor of a mutable iterator
+        iterator()
+            : curr_leaf(nullptr), curr_slot(0)
+        { }
+
+        //! Initializing-Constructor of a mutable iterator
+        iterator(typename BTree::LeafNode* l, unsigned short s)
+            : curr_leaf(l), curr_slot(s)
+        { }
+
+        //! Copy-constructor from a reverse iterator
+        iterator(const reverse_iterator& it) // NOLINT
+            : curr_leaf(it.curr_leaf), curr_slot(it.curr_slot)
+        { }
+
+        //! Dereference the iterator.
+        reference operator * () const {
+            auto bla = curr_leaf->get_slot(0);             
+            return curr_leaf->get_slot(curr_slot);
+        }
+
+        //! Dereference the iterator.
+        pointer operator -> () const {
+            return &curr_leaf->get_slot(curr_slot);
+        }
+
+        //! Key of the current slot.
+        const key_type& key() const {
+            return curr_leaf->key(curr_slot);
+        }
+
+        //! Prefix++ advance the iterator to the next slot.
+        iterator& operator ++ () {
+            if (curr_slot + 1u < curr_leaf->get_slotuse()) {
+                ++curr_slot;
+            }
+            else if (curr_leaf->next_leaf != nullptr) {
+                curr_leaf = curr_leaf->next_leaf;
+                curr_slot = 0;
+            }
+            else {
+                // this is end()
+                curr_slot = curr_leaf->get_slotuse();
+            }
+
+            return *this;
+        }
+
+        //! Postfix++ advance the iterator to the next slot.
+        iterator operator ++ (int) {
+            iterator tmp = *this;   // copy ourselves
+
+            if (curr_slot + 1u < curr_leaf->get_slotuse()) {
+                ++curr_slot;
+            }
+            else if (curr_leaf->next_leaf != nullptr) {
+                curr_leaf = curr_leaf->next_leaf;
+                curr_slot = 0;
+            }
+            else {
+                // this is end()
+                curr_slot = curr_leaf->get_slotuse();
+            }
+
+            return tmp;
+        }
+
+        //! Prefix-- backstep the iterator to the last slot.
+        iterator& operator -- () {
+            if (curr_slot > 0) {
+                --curr_slot;
+            }
+            else if (curr_leaf->prev_leaf != nullptr) {
+                curr_leaf = curr_leaf->prev_leaf;
+                curr_slot = curr_leaf->get_slotuse() - 1;
+            }
+            else {
+                // this is begin()
+                curr_slot = 0;
+            }
+
+            return *this;
+        }
+
+        //! Postfix-- backstep the iterator to the last slot.
+        iterator operator -- (int) {
+            iterator tmp = *this;   // copy ourselves
+
+            if (curr_slot > 0) {
+                --curr_slot;
+            }
+            else if (curr_leaf->prev_leaf != nullptr) {
+                curr_leaf = curr_leaf->prev_leaf;
+                curr_slot = curr_leaf->get_slotuse() - 1;
+            }
+            else {
+                // this is begin()
+                curr_slot = 0;
+            }
+
+            return tmp;
+        }
+
+        //! Equality of iterators.
+        bool operator == (const iterator& x) const {
+            return (x.curr_leaf == curr_leaf) && (x.curr_slot == curr_slot);
+        }
+
+        //! Inequality of iterators.
+        bool operator != (const iterator& x) const {
+            return (x.curr_leaf != curr_leaf) || (x.curr_slot != curr_slot);
+        }
+    };
+
+    //! STL-like read-only iterator object for B+ tree items. The iterator
+    //! points to a specific slot number in a leaf.
+    class const_iterator
+    {
+    public:
+        // *** Types
+
+        //! The key type of the btree. Returned by key().
+        typedef typename BTree::key_type key_type;
+
+        //! The value type of the btree. Returned by operator*().
+        typedef typename BTree::value_type value_type;
+
+        //! Reference to the value_type. STL required.
+        typedef const value_type& reference;
+
+        //! Pointer to the value_type. STL required.
+        typedef const value_type* pointer;
+
+        //! STL-magic iterator category
+        typedef std::bidirectional_iterator_tag iterator_category;
+
+        //! STL-magic
+        typedef ptrdiff_t difference_type;
+
+        //! Our own type
+        typedef const_iterator self;
+
+    private:
+        // *** Members
+
+        //! The currently referenced leaf node of the tree
+        const typename BTree::LeafNode* curr_leaf;
+
+        //! Current key/data slot referenced
+        unsigned short curr_slot;
+
+        //! Friendly to the reverse_const_iterator, so it may access the two
+        //! data items directly
+        friend class const_reverse_iterator;
+
+        // The macro TLX_BTREE_FRIENDS can be used by outside class to access
+        // the B+ tree internals. This was added for wxBTreeDemo to be able to
+        // draw the tree.
+        TLX_BTREE_FRIENDS;
+
+    public:
+        // *** Methods
+
+        //! Default-Constructor of a const iterator
+        const_iterator()
+            : curr_leaf(nullptr), curr_slot(0)
+        { }
+
+        //! Initializing-Constructor of a const iterator
+        const_iterator(const typename BTree::LeafNode* l, unsigned short s)
+            : curr_leaf(l), curr_slot(s)
+        { }
+
+        //! Copy-constructor from a mutable iterator
+        const_iterator(const iterator& it) // NOLINT
+            : curr_leaf(it.curr_leaf), curr_slot(it.curr_slot)
+        { }
+
+        //! Copy-constructor from a mutable reverse iterator
+        const_iterator(const reverse_iterator& it) // NOLINT
+            : curr_leaf(it.curr_leaf), curr_slot(it.curr_slot)
+        { }
+
+        //! Copy-constructor from a const reverse iterator
+        const_iterator(const const_reverse_iterator& it) // NOLINT
+            : curr_leaf(it.curr_leaf), curr_slot(it.curr_slot)
+        { }
+
+        //! Dereference the iterator.
+        reference operator * () const {
+            return curr_leaf->get_slot(curr_slot);
+        }
+
+        //! Dereference the iterator.
+        pointer operator -> () const {
+            return &curr_leaf->get_slot(curr_slot);
+        }
+
+        //! Key of the current slot.
+        const key_type& key() const {
+            return curr_leaf->key(curr_slot);
+        }
+
+        //! Prefix++ advance the iterator to the next slot.
+        const_iterator& operator ++ () {
+            if (curr_slot + 1u < curr_leaf->get_slotuse()) {
+                ++curr_slot;
+            }
+            else if (curr_leaf->next_leaf != nullptr) {
+                curr_leaf = curr_leaf->next_leaf;
+                curr_slot = 0;
+            }
+            else {
+                // this is end()
+                curr_slot = curr_leaf->get_slotuse();
+            }
+
+            return *this;
+        }
+
+        //! Postfix++ advance the iterator to the next slot.
+        const_iterator operator ++ (int) {
+            const_iterator tmp = *this;   // copy ourselves
+
+            if (curr_slot + 1u < curr_leaf->get_slotuse()) {
+                ++curr_slot;
+            }
+            else if (curr_leaf->next_leaf != nullptr) {
+                curr_leaf = curr_leaf->next_leaf;
+                curr_slot = 0;
+            }
+            else {
+                // this is end()
+                curr_slot = curr_leaf->get_slotuse();
+            }
+
+            return tmp;
+        }
+
+        //! Prefix-- backstep the iterator to the last slot.
+        const_iterator& operator -- () {
+            if (curr_slot > 0) {
+                --curr_slot;
+            }
+            else if (curr_leaf->prev_leaf != nullptr) {
+                curr_leaf = curr_leaf->prev_leaf;
+                curr_slot = curr_leaf->get_slotuse() - 1;
+            }
+            else {
+                // this is begin()
+                curr_slot = 0;
+            }
+
+            return *this;
+        }
+
+        //! Postfix-- backstep the iterator to the last slot.
+        const_iterator operator -- (int) {
+            const_iterator tmp = *this;   // copy ourselves
+
+            if (curr_slot > 0) {
+                --curr_slot;
+            }
+            else if (curr_leaf->prev_leaf != nullptr) {
+                curr_leaf = curr_leaf->prev_leaf;
+                curr_slot = curr_leaf->get_slotuse() - 1;
+            }
+            else {
+                // this is begin()
+                curr_slot = 0;
+            }
+
+            return tmp;
+        }
+
+        //! Equality of iterators.
+        bool operator == (const const_iterator& x) const {
+            return (x.curr_leaf == curr_leaf) && (x.curr_slot == curr_slot);
+        }
+
+        //! Inequality of iterators.
+        bool operator != (const const_iterator& x) const {
+            return (x.curr_leaf != curr_leaf) || (x.curr_slot != curr_slot);
+        }
+    };
+
+    //! STL-like mutable reverse iterator object for B+ tree items. The
+    //! iterator points to a specific slot number in a leaf.
+    class reverse_iterator
+    {
+    public:
+        // *** Types
+
+        //! The key type of the btree. Returned by key().
+        typedef typename BTree::key_type key_type;
+
+        //! The value type of the btree. Returned by operator*().
+        typedef typename BTree::value_type value_type;
+
+        //! Reference to the value_type. STL required.
+        typedef value_type& reference;
+
+        //! Pointer to the value_type. STL required.
+        typedef value_type* pointer;
+
+        //! STL-magic iterator category
+        typedef std::bidirectional_iterator_tag iterator_category;
+
+        //! STL-magic
+        typedef ptrdiff_t difference_type;
+
+        //! Our own type
+        typedef reverse_iterator self;
+
+    private:
+        // *** Members
+
+        //! The currently referenced leaf node of the tree
+        typename BTree::LeafNode* curr_leaf;
+
+        //! One slot past the current key/data slot referenced.
+        unsigned short curr_slot;
+
+        //! Friendly to the const_iterator, so it may access the two data items
+        //! directly
+        friend class iterator;
+
+        //! Also friendly to the const_iterator, so it may access the two data
+        //! items directly
+        friend class const_iterator;
+
+        //! Also friendly to the const_iterator, so it may access the two data
+        //! items directly
+        friend class const_reverse_iterator;
+
+        // The macro TLX_BTREE_FRIENDS can be used by outside class to access
+        // the B+ tree internals. This was added for wxBTreeDemo to be able to
+        // draw the tree.
+        TLX_BTREE_FRIENDS;
+
+    public:
+        // *** Methods
+
+        //! Default-Constructor of a reverse iterator
+        reverse_iterator()
+            : curr_leaf(nullptr), curr_slot(0)
+        { }
+
+        //! Initializing-Constructor of a mutable reverse iterator
+        reverse_iterator(typename BTree::LeafNode* l, unsigned short s)
+            : curr_leaf(l), curr_slot(s)
+        { }
+
+        //! Copy-constructor from a mutable iterator
+        reverse_iterator(const iterator& it) // NOLINT
+            : curr_leaf(it.curr_leaf), curr_slot(it.curr_slot)
+        { }
+
+        //! Dereference the iterator.
+        reference operator * () const {
+            TLX_BTREE_ASSERT(curr_slot > 0);
+            return curr_leaf->get_slot(curr_slot - 1);
+        }
+
+        //! Dereference the iterator.
+        pointer operator -> () const {
+            TLX_BTREE_ASSERT(curr_slot > 0);
+            return &curr_leaf->get_slot(curr_slot - 1);
+        }
+
+        //! Key of the current slot.
+        const key_type& key() const {
+            TLX_BTREE_ASSERT(curr_slot > 0);
+            return curr_leaf->key(curr_slot - 1);
+        }
+
+        //! Prefix++ advance the iterator to the next slot.
+        reverse_iterator& operator ++ () {
+            if (curr_slot > 1) {
+                --curr_slot;
+            }
+            else if (curr_leaf->prev_leaf != nullptr) {
+                curr_leaf = curr_leaf->prev_leaf;
+                curr_slot = curr_leaf->get_slotuse();
+            }
+            else {
+                // this is begin() == rend()
+                curr_slot = 0;
+            }
+
+            return *this;
+        }
+
+        //! Postfix++ advance the iterator to the next slot.
+        reverse_iterator operator ++ (int) {
+            reverse_iterator tmp = *this;   // copy ourselves
+
+            if (curr_slot > 1) {
+                --curr_slot;
+            }
+            else if (curr_leaf->prev_leaf != nullptr) {
+                curr_leaf = curr_leaf->prev_leaf;
+                curr_slot = curr_leaf->get_slotuse();
+            }
+            else {
+                // this is begin() == rend()
+                curr_slot = 0;
+            }
+
+            return tmp;
+        }
+
+        //! Prefix-- backstep the iterator to the last slot.
+        reverse_iterator& operator -- () {
+            if (curr_slot < curr_leaf->get_slotuse()) {
+                ++curr_slot;
+            }
+            else if (curr_leaf->next_leaf != nullptr) {
+                curr_leaf = curr_leaf->next_leaf;
+                curr_slot = 1;
+            }
+            else {
+                // this is end() == rbegin()
+                curr_slot = curr_leaf->get_slotuse();
+            }
+
+            return *this;
+        }
+
+        //! Postfix-- backstep the iterator to the last slot.
+        reverse_iterator operator -- (int) {
+            reverse_iterator tmp = *this;   // copy ourselves
+
+            if (curr_slot < curr_leaf->get_slotuse()) {
+                ++curr_slot;
+            }
+            else if (curr_leaf->next_leaf != nullptr) {
+                curr_leaf = curr_leaf->next_leaf;
+                curr_slot = 1;
+            }
+            else {
+                // this is end() == rbegin()
+                curr_slot = curr_leaf->get_slotuse();
+            }
+
+            return tmp;
+        }
+
+        //! Equality of iterators.
+        bool operator == (const reverse_iterator& x) const {
+            return (x.curr_leaf == curr_leaf) && (x.curr_slot == curr_slot);
+        }
+
+        //! Inequality of iterators.
+        bool operator != (const reverse_iterator& x) const {
+            return (x.curr_leaf != curr_leaf) || (x.curr_slot != curr_slot);
+        }
+    };
+
+    //! STL-like read-only reverse iterator object for B+ tree items. The
+    //! iterator points to a specific slot number in a leaf.
+    class const_reverse_iterator
+    {
+    public:
+        // *** Types
+
+        //! The key type of the btree. Returned by key().
+        typedef typename BTree::key_type key_type;
+
+        //! The value type of the btree. Returned by operator*().
+        typedef typename BTree::value_type value_type;
+
+        //! Reference to the value_type. STL required.
+        typedef const value_type& reference;
+
+        //! Pointer to the value_type. STL required.
+        typedef const value_type* pointer;
+
+        //! STL-magic iterator category
+        typedef std::bidirectional_iterator_tag iterator_category;
+
+        //! STL-magic
+        typedef ptrdiff_t difference_type;
+
+        //! Our own type
+        typedef const_reverse_iterator self;
+
+    private:
+        // *** Members
+
+        //! The currently referenced leaf node of the tree
+        const typename BTree::LeafNode* curr_leaf;
+
+        //! One slot past the current key/data slot referenced.
+        unsigned short curr_slot;
+
+        //! Friendly to the const_iterator, so it may access the two data items
+        //! directly.
+        friend class reverse_iterator;
+
+        // The macro TLX_BTREE_FRIENDS can be used by outside class to access
+        // the B+ tree internals. This was added for wxBTreeDemo to be able to
+        // draw the tree.
+        TLX_BTREE_FRIENDS;
+
+    public:
+        // *** Methods
+
+        //! Default-Constructor of a const reverse iterator.
+        const_reverse_iterator()
+            : curr_leaf(nullptr), curr_slot(0)
+        { }
+
+        //! Initializing-Constructor of a const reverse iterator.
+        const_reverse_iterator(
+            const typename BTree::LeafNode* l, unsigned short s)
+            : curr_leaf(l), curr_slot(s)
+        { }
+
+        //! Copy-constructor from a mutable iterator.
+        const_reverse_iterator(const iterator& it) // NOLINT
+            : curr_leaf(it.curr_leaf), curr_slot(it.curr_slot)
+        { }
+
+        //! Copy-constructor from a const iterator.
+        const_reverse_iterator(const const_iterator& it) // NOLINT
+            : curr_leaf(it.curr_leaf), curr_slot(it.curr_slot)
+        { }
+
+        //! Copy-constructor from a mutable reverse iterator.
+        const_reverse_iterator(const reverse_iterator& it) // NOLINT
+            : curr_leaf(it.curr_leaf), curr_slot(it.curr_slot)
+        { }
+
+        //! Dereference the iterator.
+        reference operator * () const {
+            TLX_BTREE_ASSERT(curr_slot > 0);
+            return curr_leaf->get_slot(curr_slot - 1);
+        }
+
+        //! Dereference the iterator.
+        pointer operator -> () const {
+            TLX_BTREE_ASSERT(curr_slot > 0);
+            return &curr_leaf->get_slot(curr_slot - 1);
+        }
+
+        //! Key of the current slot.
+        const key_type& key() const {
+            TLX_BTREE_ASSERT(curr_slot > 0);
+            return curr_leaf->key(curr_slot - 1);
+        }
+
+        //! Prefix++ advance the iterator to the previous slot.
+        const_reverse_iterator& operator ++ () {
+            if (curr_slot > 1) {
+                --curr_slot;
+            }
+            else if (curr_leaf->prev_leaf != nullptr) {
+                curr_leaf = curr_leaf->prev_leaf;
+                curr_slot = curr_leaf->get_slotuse();
+            }
+            else {
+                // this is begin() == rend()
+                curr_slot = 0;
+            }
+
+            return *this;
+        }
+
+        //! Postfix++ advance the iterator to the previous slot.
+        const_reverse_iterator operator ++ (int) {
+            const_reverse_iterator tmp = *this;   // copy ourselves
+
+            if (curr_slot > 1) {
+                --curr_slot;
+            }
+            else if (curr_leaf->prev_leaf != nullptr) {
+                curr_leaf = curr_leaf->prev_leaf;
+                curr_slot = curr_leaf->get_slotuse();
+            }
+            else {
+                // this is begin() == rend()
+                curr_slot = 0;
+            }
+
+            return tmp;
+        }
+
+        //! Prefix-- backstep the iterator to the next slot.
+        const_reverse_iterator& operator -- () {
+            if (curr_slot < curr_leaf->get_slotuse()) {
+                ++curr_slot;
+            }
+            else if (curr_leaf->next_leaf != nullptr) {
+                curr_leaf = curr_leaf->next_leaf;
+                curr_slot = 1;
+            }
+            else {
+                // this is end() == rbegin()
+                curr_slot = curr_leaf->get_slotuse();
+            }
+
+            return *this;
+        }
+
+        //! Postfix-- backstep the iterator to the next slot.
+        const_reverse_iterator operator -- (int) {
+            const_reverse_iterator tmp = *this;   // copy ourselves
+
+            if (curr_slot < curr_leaf->get_slotuse()) {
+                ++curr_slot;
+            }
+            else if (curr_leaf->next_leaf != nullptr) {
+                curr_leaf = curr_leaf->next_leaf;
+                curr_slot = 1;
+            }
+            else {
+                // this is end() == rbegin()
+                curr_slot = curr_leaf->get_slotuse();
+            }
+
+            return tmp;
+        }
+
+        //! Equality of iterators.
+        bool operator == (const const_reverse_iterator& x) const {
+            return (x.curr_leaf == curr_leaf) && (x.curr_slot == curr_slot);
+        }
+
+        //! Inequality of iterators.
+        bool operator != (const const_reverse_iterator& x) const {
+            return (x.curr_leaf != curr_leaf) || (x.curr_slot != curr_slot);
+        }
+    };
+
+    //! \}
+
+public:
+    //! \name Small Statistics Structure
+    //! \{
+
+    /*!
+     * A small struct containing basic statistics about the B+ tree. It can be
+     * fetched using get_stats().
+     */
+    struct tree_stats {
+        //! Number of items in the B+ tree
+        size_type size;
+
+        //! Number of leaves in the B+ tree
+        size_type leaves;
+
+        //! Number of inner nodes in the B+ tree
+        size_type inner_nodes;
+
+        //! Number of underflowing nodes left behind by relaxed erases and not
+        //! yet repaired by a rebalancing step
+        size_type underflows;
+
+        //! Number of updates applied as delta records
+        size_type deltas;
+
+        //! Number of leaves replaced by a copy with their delta chain applied
+        size_type consolidations;
+
+        //! Base B+ tree parameter: The number of key/data slots in each leaf
+        static const unsigned short leaf_slots = Self::leaf_slotmax;
+
+        //! Base B+ tree parameter: The number of key slots in each inner node.
+        static const unsigned short inner_slots = Self::inner_slotmax;
+
+        //! Zero initialized
+        tree_stats()
+            : size(0),
+              leaves(0), inner_nodes(0), underflows(0),
+              deltas(0), consolidations(0)
+        { }
+
+        //! Return the total number of nodes
+        size_type nodes() const {
+            return inner_nodes + leaves;
+        }
+
+        //! Return the average fill of leaves
+        double avgfill_leaves() const {
+            return static_cast<double>(size) / (leaves * leaf_slots);
+        }
+
+        //! Add the counts of another shard
+        tree_stats& operator += (const tree_stats& other) {
+            size += other.size;
+            leaves += other.leaves;
+            inner_nodes += other.inner_nodes;
+            underflows += other.underflows;
+            deltas += other.deltas;
+            consolidations += other.consolidations;
+            return *this;
+        }
+    };
+
+    //! \}
+
+public:
+    //! \name Tree Object Data Members
+    //! \{
+
+    //! Pointer to the B+ tree's root node, either leaf or inner node.
+    node* root_;
+
+    RecMgr * recmgr;
+
+    //! Pointer to first leaf in the double linked leaf chain.
+    LeafNode* head_leaf_;
+
+    //! Pointer to last leaf in the double linked leaf chain.
+    LeafNode* tail_leaf_;
+
+    //! Other small statistics about the B+ tree, one shard per thread.
+    sharded_stats<tree_stats> stats_;
+
+    //! Key comparison object. More comparison functions are generated from
+    //! this < relation.
+    key_compare key_less_;
+
+    //! Memory allocator.
+    allocator_type allocator_;
+
+    //! \}
+
+public:
+    //! \name Constructors and Destructor
+    //! \{
+
+    //! Default constructor initializing an empty B+ tree with the standard key
+    //! comparison function.
+    explicit BTree(const int _NUM_THREADS, const allocator_type& alloc = allocator_type())
+        : root_(nullptr), head_leaf_(nullptr), tail_leaf_(nullptr),
+          allocator_(alloc),
+          recmgr(new RecMgr(_NUM_THREADS))
+    { }
+
+    //! Constructor initializing an empty B+ tree with a special key
+    //! comparison object.
+    explicit BTree(const key_compare& kcf,
+                   const allocator_type& alloc = allocator_type())
+        : root_(nullptr), head_leaf_(nullptr), tail_leaf_(nullptr),
+          key_less_(kcf), allocator_(alloc)
+    { }
+
+    //! Constructor initializing a B+ tree with the range [first,last). The
+    //! range need not be sorted. To create a B+ tree from a sorted range, use
+    //! bulk_load().
+    template <class InputIterator>
+    BTree(InputIterator first, InputIterator last,
+          const allocator_type& alloc = allocator_type())
+        : root_(nullptr), head_leaf_(nullptr), tail_leaf_(nullptr),
+          allocator_(alloc) {
+        insert(0, first, last);
+    }
+
+    //! Constructor initializing a B+ tree with the range [first,last) and a
+    //! special key comparison object.  The range need not be sorted. To create
+    //! a B+ tree from a sorted range, use bulk_load().
+    template <class InputIterator>
+    BTree(InputIterator first, InputIterator last, const key_compare& kcf,
+          const allocator_type& alloc = allocator_type())
+        : root_(nullptr), head_leaf_(nullptr), tail_leaf_(nullptr),
+          key_less_(kcf), allocator_(alloc) {
+        insert(0, first, last);
+    }
+
+    //! Frees up all used B+ tree memory pages
+    ~BTree() {
+        clear(0);
+    }
+
+    //! Fast swapping of two identical B+ tree objects.
+    void swap(BTree& from) {
+        std::swap(root_, from.root_);
+        std::swap(head_leaf_, from.head_leaf_);
+        std::swap(tail_leaf_, from.tail_leaf_);
+        std::swap(stats_, from.stats_);
+        std::swap(key_less_, from.key_less_);
+        std::swap(allocator_, from.allocator_);
+    }
+
+    //! \}
+
+public:
+    //! \name Key and Value Comparison Function Objects
+    //! \{
+
+    //! Function class to compare value_type objects. Required by the STL
+    class value_compare
+    {
+    protected:
+        //! Key comparison function from the template parameter
+        key_compare key_comp;
+
+        //! Constructor called from BTree::value_comp()
+        explicit value_compare(key_compare kc)
+            : key_comp(kc)
+        { }
+
+        //! Friendly to the btree class so it may call the constructor
+        friend class BTree<key_type, value_type, key_of_value, RecMgr, key_compare,
+                           traits, allow_duplicates, allocator_type>;
+
+    public:
+        //! Function call "less"-operator resulting in true if x < y.
+        bool operator () (const value_type& x, const value_type& y) const {
+            return key_comp(x.first, y.first);
+        }
+    };
+
+    //! Constant access to the key comparison object sorting the B+ tree.
+    key_compare key_comp() const {
+        return key_less_;
+    }
+
+    //! Constant access to a constructed value_type comparison object. Required
+    //! by the STL.
+    value_compare value_comp() const {
+        return value_compare(key_less_);
+    }
+
+    //! \}
+
+private:
+    //! \name Convenient Key Comparison Functions Generated From key_less
+    //! \{
+
+    //! True if a < b ? "constructed" from key_less_()
+    bool key_less(const key_type& a, const key_type& b) const {
+        return key_less_(a, b);
+    }
+
+    //! True if a <= b ? constructed from key_less()
+    bool key_lessequal(const key_type& a, const key_type& b) const {
+        return !key_less_(b, a);
+    }
+
+    //! Distance in bytes between consecutive keys of a node, as passed to
+    //! key_search: leaves hold value_type pairs, inner nodes a key array.
+    template <typename node_type>
+    static constexpr size_t key_stride() {
+        return std::is_same<node_type, LeafNode>::value
+               ? sizeof(value_type) : sizeof(key_type);
+    }
+
+    //! Prefetches every cache line of the child in the given slot of inner,
+    //! so the key search in the child does not take one dependent miss per
+    //! line. A no-op unless compiled with USE_PREFETCHING (prefetching.h).
+    static void prefetch_child(const InnerNode* inner, unsigned short slot) {
+        prefetch_range((void*)inner->childid[slot],
+                       inner->level == 1 ? sizeof(LeafNode) : sizeof(InnerNode));
+    }
+
+    //! True if a > b ? constructed from key_less()
+    bool key_greater(const key_type& a, const key_type& b) const {
+        return key_less_(b, a);
+    }
+
+    //! True if a >= b ? constructed from key_less()
+    bool key_greaterequal(const key_type& a, const key_type& b) const {
+        return !key_less_(a, b);
+    }
+
+    //! True if a == b ? constructed from key_less(). This requires the <
+    //! relation to be a total order, otherwise the B+ tree cannot be sorted.
+    bool key_equal(const key_type& a, const key_type& b) const {
+        return !key_less_(a, b) && !key_less_(b, a);
+    }
+
+    //! \}
+
+public:
+    //! \name Allocators
+    //! \{
+
+    //! Return the base node allocator provided during construction.
+    allocator_type get_allocator() const {
+        return allocator_;
+    }
+
+    //! \}
+
+private:
+    //! \name Node Object Allocation and Deallocation Functions
+    //! \{
+
+    //! Allocate a node. New nodes are tracked here rather than in
+    //! node::node(), which a pool runs when it fills a whole block.
+    template <typename Node>
+    Node * allocate_node(const int& tid) {
+        Node* n = (Node*)recmgr->template allocate<Node>(tid);
+        if (allocated)
+            allocated->insert({n, true});
+        return n;
+    }
+
+    //! Allocate and initialize a leaf node
+    LeafNode * allocate_leaf(const int& tid) {
+        LeafNode* n = allocate_node<LeafNode>(tid);
+        n->initialize();
+        return n;
+    }
+
+    //! Copy a leaf, the copy has the delta chain of other applied to it.
+    LeafNode * allocate_leaf(const int& tid, LeafNode * other) {
+        LeafNode* n = allocate_node<LeafNode>(tid);
+        n->copy_header(other);
+        n->delta_head = nullptr;
+        n->slotuse = read_leaf<key_type, value_type>(other, frozen->at(other), n->slotdata);
+        return n;
+    }
+
+    //! Allocate and initialize an inner node
+    InnerNode * allocate_inner(const int& tid, unsigned short level) {
+        InnerNode* n = allocate_node<InnerNode>(tid);
+        n->initialize(level);
+        return n;
+    }
+
+    InnerNode * allocate_inner(const int& tid, InnerNode * other) {
+        InnerNode* n = allocate_node<InnerNode>(tid);
+        n->copy_live(other);
+        return n;
+    }
+
+    //! Free a node right away, without the duplication bookkeeping of
+    //! free_node(). Only for nodes no other thread can reach, as in clear().
+    void deallocate_node(const int& tid, node* n) {
+        if (n->is_leafnode())
+            recmgr->deallocate(tid, static_cast<LeafNode*>(n));
+        else
+            recmgr->deallocate(tid, static_cast<InnerNode*>(n));
+    }
+
+    //! Correctly free either inner or leaf node, destructs all contained key
+    //! and value objects.
+    void free_node(const int& tid, node* n) {
+        // after an abort the merge that emptied n did not happen
+        if (pc_abort)
+            return;
+
+        if (n->is_leafnode() && allocated->find(n) == allocated->end())
+            delta_claim(n);
+        duplications->insert({n, nullptr});
+    }
+
+    //! \}
+
+public:
+    //! \name Duplication functions
+    //! 
+    //! \{
+
+    node * path_copy(const int& tid, node * orig)
+    {
+        if (allocated->find(orig) != allocated->end())
+        {
+            return orig;
+        }
+
+        if (duplications->find(orig) != duplications->end())
+        {
+            return duplications->at(orig);
+        }
+
+        if (pc_abort || (orig->is_leafnode() && !delta_claim(orig)))
+        {
+            return nullptr;
+        }
+
+        node * duplication;
+        if (orig->is_leafnode())
+            duplication = (node *)allocate_leaf(tid, static_cast<LeafNode*>(orig));
+        else
+            duplication = (node *)allocate_inner(tid, static_cast<InnerNode*>(orig));
+
+        duplications->insert({orig, duplication});
+
+        node * current = orig;
+        node * current_dup = duplication;
+        InnerNode * parent;
+        InnerNode * parent_dup;
+
+        bool reached_root = false;
+        std::pair<node*, unsigned int> pair;
+        while (!(reached_root = (node_parent_map->find(current) == node_parent_map->end())) &&
+            (pair = node_parent_map->at(current), duplications->find(pair.first) == duplications->end()) &&
+            allocated->find(pair.first) == allocated->end())
+        {
+            parent = static_cast<InnerNode*>(pair.first);
+            auto child_idx = pair.second;
+            parent_dup = allocate_inner(tid, parent);
+            parent_dup->childid[child_idx] = current_dup;
+            duplications->insert({ (node *)parent, (node *)parent_dup });
+
+            current = (node *)parent;
+            current_dup = (node *)parent_dup;
+        }
+
+        if (reached_root)
+        {
+            new_root = current_dup;
+        }
+        else // reached a duplicated parent, or one allocated by this operation
+        {
+            InnerNode * parent = static_cast<InnerNode*>(node_parent_map->at(current).first);
+            auto child_idx = node_parent_map->at(current).second;
+            InnerNode * to_update = (allocated->find(parent) != allocated->end()) ?
+                parent : static_cast<InnerNode*>(duplications->at(parent));
+            if (to_update && to_update->childid[child_idx] == current)
+                to_update->childid[child_idx] = current_dup;
+        }
+
+        pc_happened = true;
+        return duplication;
+    }
+    
+    //! \}
+
+public:
+    //! \name Delta Record Fast Paths
+    //! Updates that fit into their leaf prepend a delta record to it with one
+    //! CAS. Splits, merges and consolidations run as path copies, which freeze
+    //! the delta chains of the leaves they replace.
+    //! \{
+
+    //! Outcome of a fast path: the operation took effect, raced with a path
+    //! copy of its leaf and must be retried, or has to run as a path copy.
+    enum delta_status { delta_done, delta_retry, delta_slow };
+
+    //! Descend from the current root to the leaf responsible for key.
+    LeafNode* delta_descend(const key_type& key, bool* is_root) const {
+        node* n = __atomic_load_n(&root_, __ATOMIC_ACQUIRE);
+        *is_root = true;
+        if (!n) return nullptr;
+
+        while (!n->is_leafnode())
+        {
+            const InnerNode* inner = static_cast<const InnerNode*>(n);
+            n = inner->childid[find_lower(inner, key)];
+            *is_root = false;
+        }
+
+        return static_cast<LeafNode*>(n);
+    }
+
+    //! Locate key in a leaf with the delta chain head applied, returns nullptr
+    //! if it is not there.
+    const value_type* delta_lookup(const LeafNode* leaf, const delta_record* head,
+                                   const key_type& key) const {
+        for (const delta_record* d = head; d != nullptr; d = d->next)
+        {
+            const LeafDelta* ld = static_cast<const LeafDelta*>(d);
+            if (key_equal(key, key_of_value::get(ld->slotdata)))
+                return (d->kind != DELTA_DELETE) ? &ld->slotdata : nullptr;
+        }
+
+        unsigned short slot = find_lower(leaf, key);
+        return (slot < leaf->slotuse && key_equal(key, key_of_value::get(leaf->slotdata[slot])))
+               ? &leaf->slotdata[slot] : nullptr;
+    }
+
+    //! Look up key without a path copy, returns nullptr if it is not there.
+    const value_type* delta_find(const key_type& key) const {
+        bool is_root;
+        const LeafNode* leaf = delta_descend(key, &is_root);
+        if (!leaf) return nullptr;
+
+        return delta_lookup(leaf, delta_chain(leaf), key);
+    }
+
+    //! Number of lookups delta_find_batch() keeps in flight at once.
+    static const size_t find_batch_width = 32;
+
+    //! delta_find() for keys[0,n), results go to out[i]. Up to
+    //! find_batch_width lookups descend in lock step from one snapshot of the
+    //! root, one level per round, and each round prefetches all the children
+    //! it picked before searching any of them, so their cache misses overlap
+    //! instead of being taken one after the other. Prefetches regardless of
+    //! USE_PREFETCHING.
+    void delta_find_batch(const key_type* keys, size_t n, const value_type** out) const {
+        node* root = __atomic_load_n(&root_, __ATOMIC_ACQUIRE);
+        if (!root) {
+            std::fill(out, out + n, nullptr);
+            return;
+        }
+
+        node* cur[find_batch_width];
+        for (size_t base = 0; base < n; base += find_batch_width)
+        {
+            const key_type* k = keys + base;
+            const size_t m = (n - base < find_batch_width) ? n - base : find_batch_width;
+            std::fill(cur, cur + m, root);
+
+            while (!cur[0]->is_leafnode())
+            {
+                for (size_t i = 0; i < m; ++i)
+                {
+                    const InnerNode* inner = static_cast<const InnerNode*>(cur[i]);
+                    cur[i] = inner->childid[find_lower(inner, k[i])];
+                    prefetch_lines(cur[i], inner->level == 1 ? sizeof(LeafNode) : sizeof(InnerNode));
+                }
+            }
+
+            for (size_t i = 0; i < m; ++i)
+            {
+                const LeafNode* leaf = static_cast<const LeafNode*>(cur[i]);
+                out[base + i] = delta_lookup(leaf, delta_chain(leaf), k[i]);
+            }
+        }
+    }
+
+    //! Insert value by prepending a delta record to its leaf, unless the leaf
+    //! is full or its chain is long enough to be consolidated.
+    delta_status delta_insert(const int& tid, const value_type& value, bool* inserted) {
+        const key_type& key = key_of_value::get(value);
+        bool is_root;
+        LeafNode* leaf = delta_descend(key, &is_root);
+        if (!leaf) return delta_slow;
+
+        delta_record* head = __atomic_load_n(&leaf->delta_head, __ATOMIC_ACQUIRE);
+        if (delta_is_frozen(head)) return delta_retry;
+
+        if (delta_lookup(leaf, head, key) != nullptr)
+        {
+            *inserted = false;
+            return delta_done;
+        }
+
+        unsigned short size = head ? head->size : leaf->slotuse;
+        unsigned short length = head ? head->length : 0;
+        if (size >= leaf_slotmax || length >= BTREE_DELTA_CHAIN_MAX)
+            return delta_slow;
+
+        LeafDelta* d = (LeafDelta*)recmgr->template allocate<LeafDelta>(tid);
+        d->kind = DELTA_INSERT;
+        d->size = size + 1;
+        d->length = length + 1;
+        d->next = head;
+        d->slotdata = value;
+
+        if (__atomic_compare_exchange_n(&leaf->delta_head, &head, (delta_record*)d,
+                                        false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            ++stats_[tid].size;
+            ++stats_[tid].deltas;
+            *inserted = true;
+            return delta_done;
+        }
+
+        recmgr->deallocate(tid, d);
+        return delta_retry;
+    }
+
+    //! Replace the data of key by prepending an update record to its leaf. The
+    //! size of the leaf does not change, so only a chain that is long enough
+    //! to be consolidated sends this to a path copy. Sets *replaced to false
+    //! if key is not in the tree, the replaced pair goes to *old otherwise.
+    delta_status delta_update(const int& tid, const value_type& value,
+                              value_type* old, bool* replaced) {
+        const key_type& key = key_of_value::get(value);
+        bool is_root;
+        LeafNode* leaf = delta_descend(key, &is_root);
+        if (!leaf)
+        {
+            *replaced = false;
+            return delta_done;
+        }
+
+        delta_record* head = __atomic_load_n(&leaf->delta_head, __ATOMIC_ACQUIRE);
+        if (delta_is_frozen(head)) return delta_retry;
+
+        const value_type* found = delta_lookup(leaf, head, key);
+        if (found == nullptr)
+        {
+            *replaced = false;
+            return delta_done;
+        }
+
+        unsigned short size = head ? head->size : leaf->slotuse;
+        unsigned short length = head ? head->length : 0;
+        if (length >= BTREE_DELTA_CHAIN_MAX)
+            return delta_slow;
+
+        LeafDelta* d = (LeafDelta*)recmgr->template allocate<LeafDelta>(tid);
+        d->kind = DELTA_UPDATE;
+        d->size = size;
+        d->length = length + 1;
+        d->next = head;
+        d->slotdata = value;
+        *old = *found;
+
+        if (__atomic_compare_exchange_n(&leaf->delta_head, &head, (delta_record*)d,
+                                        false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            ++stats_[tid].deltas;
+            *replaced = true;
+            return delta_done;
+        }
+
+        recmgr->deallocate(tid, d);
+        return delta_retry;
+    }
+
+    //! Erase key by prepending a delta record to its leaf, unless the leaf
+    //! would underflow or its chain is long enough to be consolidated.
+    delta_status delta_erase(const int& tid, const key_type& key, bool* erased) {
+        bool is_root;
+        LeafNode* leaf = delta_descend(key, &is_root);
+        if (!leaf)
+        {
+            *erased = false;
+            return delta_done;
+        }
+
+        delta_record* head = __atomic_load_n(&leaf->delta_head, __ATOMIC_ACQUIRE);
+        if (delta_is_frozen(head)) return delta_retry;
+
+        const value_type* found = delta_lookup(leaf, head, key);
+        if (found == nullptr)
+        {
+            *erased = false;
+            return delta_done;
+        }
+
+        unsigned short size = head ? head->size : leaf->slotuse;
+        unsigned short length = head ? head->length : 0;
+        if ((size <= leaf_slotmin && !is_root) || length >= BTREE_DELTA_CHAIN_MAX)
+            return delta_slow;
+
+        LeafDelta* d = (LeafDelta*)recmgr->template allocate<LeafDelta>(tid);
+        d->kind = DELTA_DELETE;
+        d->size = size - 1;
+        d->length = length + 1;
+        d->next = head;
+        d->slotdata = *found;
+
+        if (__atomic_compare_exchange_n(&leaf->delta_head, &head, (delta_record*)d,
+                                        false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            --stats_[tid].size;
+            ++stats_[tid].deltas;
+            *erased = true;
+            return delta_done;
+        }
+
+        recmgr->deallocate(tid, d);
+        return delta_retry;
+    }
+
+    //! Pick a key that routes to leaf, from its chain or its base slots.
+    //! Returns false if the leaf has neither.
+    bool delta_key(const LeafNode* leaf, key_type* key) const {
+        const delta_record* head = delta_chain(leaf);
+        if (head != nullptr)
+        {
+            *key = key_of_value::get(static_cast<const LeafDelta*>(head)->slotdata);
+            return true;
+        }
+
+        if (leaf->slotuse > 0)
+        {
+            *key = key_of_value::get(leaf->slotdata[0]);
+            return true;
+        }
+
+        return false;
+    }
+
+    //! Replace leaf, if it is still reached by key, with a copy that has its
+    //! delta chain applied. Runs inside a path copy.
+    void consolidate(const int& tid, const key_type& key, const LeafNode* leaf) {
+        node* n = orig_root;
+        if (!n) return;
+
+        while (!n->is_leafnode())
+        {
+            const InnerNode* inner = static_cast<const InnerNode*>(n);
+            n = inner->get_child(find_lower(inner, key));
+        }
+
+        if (n != leaf || delta_chain(n) == nullptr)
+            return;
+
+        consolidating = true;
+        if (path_copy(tid, n) != nullptr)
+            ++stats_[tid].consolidations;
+        consolidating = false;
+    }
+
+    //! \}
+
+public:
+    //! \name Fast Destruction of the B+ Tree
+    //! \{
+
+    //! Frees all key/data pairs and all nodes of the tree.
+    void clear(const int& tid) {
+        if (root_)
+        {
+            clear_recursive(tid, root_);
+            deallocate_node(tid, root_);
+
+            root_ = nullptr;
+            head_leaf_ = tail_leaf_ = nullptr;
+
+            stats_.clear();
+        }
+
+        TLX_BTREE_ASSERT(stats_.sum().size == 0);
+    }
+
+private:
+    //! Recursively free up nodes.
+    void clear_recursive(const int& tid, node* n) {
+        if (n->is_leafnode())
+        {
+            LeafNode* leafnode = static_cast<LeafNode*>(n);
+
+            for (unsigned short slot = 0; slot < leafnode->get_slotuse(); ++slot)
+            {
+                // data objects are deleted by LeafNode's destructor
+            }
+        }
+        else
+        {
+            InnerNode* innernode = static_cast<InnerNode*>(n);
+
+            for (unsigned short slot = 0; slot < innernode->get_slotuse() + 1; ++slot)
+            {
+                clear_recursive(tid, innernode->get_child(slot));
+                deallocate_node(tid, innernode->get_child(slot));
+            }
+        }
+    }
+
+    //! \}
+
+public:
+    //! \name STL Iterator Construction Functions
+    //! \{
+
+    //! Constructs a read/data-write iterator that points to the first slot in
+    //! the first leaf of the B+ tree.
+    iterator begin() {
+        return iterator(head_leaf_, 0);
+    }
+
+    //! Constructs a read/data-write iterator that points to the first invalid
+    //! slot in the last leaf of the B+ tree.
+    iterator end() {
+        return iterator(tail_leaf_, tail_leaf_ ? tail_leaf_->get_slotuse() : 0);
+    }
+
+    //! Constructs a read-only constant iterator that points to the first slot
+    //! in the first leaf of the B+ tree.
+    const_iterator begin() const {
+        return const_iterator(head_leaf_, 0);
+    }
+
+    //! Constructs a read-only constant iterator that points to the first
+    //! invalid slot in the last leaf of the B+ tree.
+    const_iterator end() const {
+        return const_iterator(tail_leaf_, tail_leaf_ ? tail_leaf_->get_slotuse() : 0);
+    }
+
+    //! Constructs a read/data-write reverse iterator that points to the first
+    //! invalid slot in the last leaf of the B+ tree. Uses STL magic.
+    reverse_iterator rbegin() {
+        return reverse_iterator(end());
+    }
+
+    //! Constructs a read/data-write reverse iterator that points to the first
+    //! slot in the first leaf of the B+ tree. Uses STL magic.
+    reverse_iterator rend() {
+        return reverse_iterator(begin());
+    }
+
+    //! Constructs a read-only reverse iterator that points to the first
+    //! invalid slot in the last leaf of the B+ tree. Uses STL magic.
+    const_reverse_iterator rbegin() const {
+        return const_reverse_iterator(end());
+    }
+
+    //! Constructs a read-only reverse iterator that points to the first slot
+    //! in the first leaf of the B+ tree. Uses STL magic.
+    const_reverse_iterator rend() const {
+        return const_reverse_iterator(begin());
+    }
+
+    //! \}
+
+private:
+    //! \name B+ Tree Node Binary Search Functions
+    //! \{
+
+    //! Searches for the first key in the node n greater or equal to key. Uses
+    //! binary search with an optional linear self-verification. This is a
+    //! template function, because the slotkey array is located at different
+    //! places in LeafNode and InnerNode.
+    template <typename node_type>
+    unsigned short find_lower(const node_type* n, const key_type& key) const {
+        if (sizeof(*n) > traits::binsearch_threshold)
+        {
+            if (n->get_slotuse() == 0) return 0;
+
+            unsigned short lo = 0, hi = n->get_slotuse();
+
+            while (lo < hi)
+            {
+                unsigned short mid = (lo + hi) >> 1;
+
+                if (key_lessequal(key, n->key(mid))) {
+                    hi = mid; // key <= mid
+                }
+                else {
+                    lo = mid + 1; // key > mid
+                }
+            }
+
+            TLX_BTREE_PRINT("BTree::find_lower: on " << n <<
+                            " key " << key << " -> " << lo << " / " << hi);
+
+            // verify result using simple linear search
+            if (self_verify)
+            {
+                unsigned short i = 0;
+                while (i < n->get_slotuse() && key_less(n->key(i), key)) ++i;
+
+                TLX_BTREE_PRINT("BTree::find_lower: testfind: " << i);
+                TLX_BTREE_ASSERT(i == lo);
+            }
+
+            return lo;
+        }
+        else // for nodes <= binsearch_threshold count keys with key_search.
+        {
+            unsigned short slotuse = n->get_slotuse();
+            if (slotuse == 0) return 0;
+            return key_search<false, key_stride<node_type>(), key_type, key_compare>::count(
+                &n->key(0), slotuse, key, key_less_);
+        }
+    }
+
+    //! Searches for the first key in the node n greater than key. Uses binary
+    //! search with an optional linear self-verification. This is a template
+    //! function, because the slotkey array is located at different places in
+    //! LeafNode and InnerNode.
+    template <typename node_type>
+    unsigned short find_upper(const node_type* n, const key_type& key) const {
+        if (sizeof(*n) > traits::binsearch_threshold)
+        {
+            if (n->get_slotuse() == 0) return 0;
+
+            unsigned short lo = 0, hi = n->get_slotuse();
+
+            while (lo < hi)
+            {
+                unsigned short mid = (lo + hi) >> 1;
+
+                if (key_less(key, n->key(mid))) {
+                    hi = mid; // key < mid
+                }
+                else {
+                    lo = mid + 1; // key >= mid
+                }
+            }
+
+            TLX_BTREE_PRINT("BTree::find_upper: on " << n <<
+                            " key " << key << " -> " << lo << " / " << hi);
+
+            // verify result using simple linear search
+            if (self_verify)
+            {
+                unsigned short i = 0;
+                while (i < n->get_slotuse() && key_lessequal(n->key(i), key)) ++i;
+
+                TLX_BTREE_PRINT("BTree::find_upper testfind: " << i);
+                TLX_BTREE_ASSERT(i == hi);
+            }
+
+            return lo;
+        }
+        else // for nodes <= binsearch_threshold count keys with key_search.
+        {
+            unsigned short slotuse = n->get_slotuse();
+            if (slotuse == 0) return 0;
+            return key_search<true, key_stride<node_type>(), key_type, key_compare>::count(
+                &n->key(0), slotuse, key, key_less_);
+        }
+    }
+
+    //! \}
+
+public:
+    //! \name Access Functions to the Item Count
+    //! \{
+
+    //! Return the number of key/data pairs in the B+ tree
+    size_type size() const {
+        return stats_.sum().size;
+    }
+
+    //! Returns true if there is at least one key/data pair in the B+ tree
+    bool empty() const {
+        return (size() == size_type(0));
+    }
+
+    //! Returns the largest possible size of the B+ Tree. This is just a
+    //! function required by the STL standard, the B+ Tree can hold more items.
+    size_type max_size() const {
+        return size_type(-1);
+    }
+
+    //! Return the current statistics, summed over all threads.
+    struct tree_stats get_stats() const {
+        return stats_.sum();
+    }
+
+    //! \}
+
+public:
+    //! \name STL Access Functions Querying the Tree by Descending to a Leaf
+    //! \{
+
+    //! Non-STL function checking whether a key is in the B+ tree. The same as
+    //! (find(k) != end()) or (count() != 0).
+    bool exists(const key_type& key) const {
+        const node* n = root_;
+        if (!n) return false;
+
+        while (!n->is_leafnode())
+        {
+            const InnerNode* inner = static_cast<const InnerNode*>(n);
+            unsigned short slot = find_lower(inner, key);
+            prefetch_child(inner, slot);
+
+            n = inner->get_child(slot);
+        }
+
+        const LeafNode* leaf = static_cast<const LeafNode*>(n);
+
+        unsigned short slot = find_lower(leaf, key);
+        return (slot < leaf->get_slotuse() && key_equal(key, leaf->key(slot)));
+    }
+
+    //! Tries to locate a key in the B+ tree and returns an iterator to the
+    //! key/data slot if found. If unsuccessful it returns end().
+    iterator find(const key_type& key) {
+        node* n = root_;
+        if (!n) return end();
+
+        while (!n->is_leafnode())
+        {
+            const InnerNode* inner = static_cast<const InnerNode*>(n);
+            unsigned short slot = find_lower(inner, key);
+            prefetch_child(inner, slot);
+
+            n = inner->get_child(slot);
+        }
+
+        LeafNode* leaf = static_cast<LeafNode*>(n);
+
+        unsigned short slot = find_lower(leaf, key);
+        return (slot < leaf->get_slotuse() && key_equal(key, leaf->key(slot)))
+               ? iterator(leaf, slot) : end();
+    }
+
+    //! Tries to locate a key in the B+ tree and returns an constant iterator to
+    //! the key/data slot if found. If unsuccessful it returns end().
+    const_iterator find(const key_type& key) const {
+        const node* n = root_;
+        if (!n) return end();
+
+        while (!n->is_leafnode())
+        {
+            const InnerNode* inner = static_cast<const InnerNode*>(n);
+            unsigned short slot = find_lower(inner, key);
+            prefetch_child(inner, slot);
+
+            n = inner->get_child(slot);
+        }
+
+        const LeafNode* leaf = static_cast<const LeafNode*>(n);
+
+        unsigned short slot = find_lower(leaf, key);
+        return (slot < leaf->get_slotuse() && key_equal(key, leaf->key(slot)))
+               ? const_iterator(leaf, slot) : end();
+    }
+
+    //! Replace the data of key, path copying only its leaf since a new value
+    //! leaves the shape of the tree unchanged. Runs inside a path copy.
+    //! Returns false if key is not in the tree, the replaced pair goes to
+    //! *old otherwise.
+    bool replace(const int& tid, const value_type& value, value_type* old) {
+        const key_type& key = key_of_value::get(value);
+        node* n = orig_root;
+        if (!n) return false;
+
+        while (!n->is_leafnode())
+        {
+            const InnerNode* inner = static_cast<const InnerNode*>(n);
+            n = inner->get_child(find_lower(inner, key));
+        }
+
+        LeafNode* leaf = static_cast<LeafNode*>(n);
+        unsigned short slot = find_lower(leaf, key);
+        if (slot >= leaf->get_slotuse() || !key_equal(key, leaf->key(slot)))
+            return false;
+
+        *old = leaf->get_slot(slot);
+        auto leaf_dup = static_cast<LeafNode*>(path_copy(tid, leaf));
+        if (leaf_dup != nullptr)
+            leaf_dup->set_slot(slot, value);
+        return true;
+    }
+
+    //! Tries to locate a key in the B+ tree and returns the number of identical
+    //! key entries found.
+    size_type count(const key_type& key) const {
+        const node* n = root_;
+        if (!n) return 0;
+
+        while (!n->is_leafnode())
+        {
+            const InnerNode* inner = static_cast<const InnerNode*>(n);
+            unsigned short slot = find_lower(inner, key);
+            prefetch_child(inner, slot);
+
+            n = inner->get_child(slot);
+        }
+
+        const LeafNode* leaf = static_cast<const LeafNode*>(n);
+
+        unsigned short slot = find_lower(leaf, key);
+        size_type num = 0;
+
+        while (leaf && slot < leaf->get_slotuse() && key_equal(key, leaf->key(slot)))
+        {
+            ++num;
+            if (++slot >= leaf->get_slotuse())
+            {
+                leaf = leaf->next_leaf;
+                slot = 0;
+            }
+        }
+
+        return num;
+    }
+
+    //! Searches the B+ tree and returns an iterator to the first pair equal to
+    //! or greater than key, or end() if all keys are smaller.
+    iterator lower_bound(const key_type& key) {
+        node* n = root_;
+        if (!n) return end();
+
+        while (!n->is_leafnode())
+        {
+            const InnerNode* inner = static_cast<const InnerNode*>(n);
+            unsigned short slot = find_lower(inner, key);
+            prefetch_child(inner, slot);
+
+            n = inner->get_child(slot);
+        }
+
+        LeafNode* leaf = static_cast<LeafNode*>(n);
+
+        unsigned short slot = find_lower(leaf, key);
+        return iterator(leaf, slot);
+    }
+
+    //! Searches the B+ tree and returns a constant iterator to the first pair
+    //! equal to or greater than key, or end() if all keys are smaller.
+    const_iterator lower_bound(const key_type& key) const {
+        const node* n = root_;
+        if (!n) return end();
+
+        while (!n->is_leafnode())
+        {
+            const InnerNode* inner = static_cast<const InnerNode*>(n);
+            unsigned short slot = find_lower(inner, key);
+            prefetch_child(inner, slot);
+
+            n = inner->get_child(slot);
+        }
+
+        const LeafNode* leaf = static_cast<const LeafNode*>(n);
+
+        unsigned short slot = find_lower(leaf, key);
+        return const_iterator(leaf, slot);
+    }
+
+    //! Searches the B+ tree and returns an iterator to the first pair greater
+    //! than key, or end() if all keys are smaller or equal.
+    iterator upper_bound(const key_type& key) {
+        node* n = root_;
+        if (!n) return end();
+
+        while (!n->is_leafnode())
+        {
+            const InnerNode* inner = static_cast<const InnerNode*>(n);
+            unsigned short slot = find_upper(inner, key);
+            prefetch_child(inner, slot);
+
+            n = inner->get_child(slot);
+        }
+
+        LeafNode* leaf = static_cast<LeafNode*>(n);
+
+        unsigned short slot = find_upper(leaf, key);
+        return iterator(leaf, slot);
+    }
+
+    //! Searches the B+ tree and returns a constant iterator to the first pair
+    //! greater than key, or end() if all keys are smaller or equal.
+    const_iterator upper_bound(const key_type& key) const {
+        const node* n = root_;
+        if (!n) return end();
+
+        while (!n->is_leafnode())
+        {
+            const InnerNode* inner = static_cast<const InnerNode*>(n);
+            unsigned short slot = find_upper(inner, key);
+            prefetch_child(inner, slot);
+
+            n = inner->get_child(slot);
+        }
+
+        const LeafNode* leaf = static_cast<const LeafNode*>(n);
+
+        unsigned short slot = find_upper(leaf, key);
+        return const_iterator(leaf, slot);
+    }
+
+    //! Searches the B+ tree and returns both lower_bound() and upper_bound().
+    std::pair<iterator, iterator> equal_range(const key_type& key) {
+        return std::pair<iterator, iterator>(
+            lower_bound(key), upper_bound(key));
+    }
+
+    //! Searches the B+ tree and returns both lower_bound() and upper_bound().
+    std::pair<const_iterator, const_iterator>
+    equal_range(const key_type& key) const {
+        return std::pair<const_iterator, const_iterator>(
+            lower_bound(key), upper_bound(key));
+    }
+
+    //! \}
+
+public:
+    //! \name B+ Tree Object Comparison Functions
+    //! \{
+
+    //! Equality relation of B+ trees of the same type. B+ trees of the same
+    //! size and equal elements (both key and data) are considered equal. Beware
+    //! of the random ordering of duplicate keys.
+    bool operator == (const BTree& other) const {
+        return (size() == other.size()) &&
+               std::equal(begin(), end(), other.begin());
+    }
+
+    //! Inequality relation. Based on operator==.
+    bool operator != (const BTree& other) const {
+        return !(*this == other);
+    }
+
+    //! Total ordering relation of B+ trees of the same type. It uses
+    //! std::lexicographical_compare() for the actual comparison of elements.
+    bool operator < (const BTree& other) const {
+        return std::lexicographical_compare(
+            begin(), end(), other.begin(), other.end());
+    }
+
+    //! Greater relation. Based on operator<.
+    bool operator > (const BTree& other) const {
+        return other < *this;
+    }
+
+    //! Less-equal relation. Based on operator<.
+    bool operator <= (const BTree& other) const {
+        return !(other < *this);
+    }
+
+    //! Greater-equal relation. Based on operator<.
+    bool operator >= (const BTree& other) const {
+        return !(*this < other);
+    }
+
+    //! \}
+
+public:
+    //! \name Fast Copy: Assign Operator and Copy Constructors
+    //! \{
+
+    //! Assignment operator. All the key/data pairs are copied.
+    BTree& operator = (const BTree& other) {
+        if (this != &other)
+        {
+            clear(0);
+
+            key_less_ = other.key_comp();
+            allocator_ = other.get_allocator();
+
+            if (other.size() != 0)
+            {
+                stats_.clear();
+                if (other.root_) {
+                    root_ = copy_recursive(0, other.root_); // <=====
+                }
+                stats_ = other.stats_;
+            }
+
+            if (self_verify) verify();
+        }
+        return *this;
+    }
+
+    //! Copy constructor. The newly initialized B+ tree object will contain a
+    //! copy of all key/data pairs.
+    BTree(const BTree& other)
+        : root_(nullptr), head_leaf_(nullptr), tail_leaf_(nullptr),
+          stats_(other.stats_),
+          key_less_(other.key_comp()),
+          allocator_(other.get_allocator()) {
+        if (size() > 0)
+        {
+            stats_.clear();
+            stats_[0].size = other.size();
+            if (other.root_) {
+                root_ = copy_recursive(0, other.root_); // <=====
+            }
+            if (self_verify) verify();
+        }
+    }
+
+private:
+    //! Recursively copy nodes from another B+ tree object
+    struct node * copy_recursive(const int& tid, const node* n) {
+        if (n->is_leafnode())
+        {
+            const LeafNode* leaf = static_cast<const LeafNode*>(n);
+            LeafNode* newleaf = allocate_leaf(tid);
+            stats_[tid].leaves++;
+
+            newleaf->set_slotuse(leaf->get_slotuse());
+            newleaf->copy_to_slotdata(
+                    leaf->get_slotdata_vec(), 
+                    leaf->get_slotdata_vec() + leaf->get_slotuse(), 
+                    newleaf->get_slotdata_vec());
+
+            if (head_leaf_ == nullptr)
+            {
+                head_leaf_ = tail_leaf_ = newleaf;
+                newleaf->prev_leaf = newleaf->next_leaf = nullptr;
+            }
+            else
+            {
+                newleaf->prev_leaf = tail_leaf_;
+                tail_leaf_->next_leaf = newleaf;
+                tail_leaf_ = newleaf;
+            }
+
+            return newleaf;
+        }
+        else
+        {
+            const InnerNode* inner = static_cast<const InnerNode*>(n);
+            InnerNode* newinner = allocate_inner(tid, inner->get_level());
+            stats_[tid].inner_nodes++;
+
+            newinner->set_slotuse(inner->get_slotuse());
+            newinner->copy_to_slotkey(
+                inner->get_slotkey_vec(), 
+                inner->get_slotkey_vec() + inner->get_slotuse(), 
+                newinner->get_slotkey_vec());
+
+            for (unsigned short slot = 0; slot <= inner->get_slotuse(); ++slot)
+            {
+                newinner->set_child(slot, copy_recursive(inner->get_child(slot)));
+            }
+
+            return newinner;
+        }
+    }
+
+    //! \}
+
+public:
+    //! \name Public Insertion Functions
+    //! \{
+
+    //! Attempt to insert a key/data pair into the B+ tree. If the tree does not
+    //! allow duplicate keys, then the insert may fail if it is already present.
+    std::pair<iterator, bool> insert(const int& tid, const value_type& x) {
+        return insert_start(tid, key_of_value::get(x), x);
+    }
+
+    //! Attempt to insert a key/data pair into the B+ tree. The iterator hint is
+    //! currently ignored by the B+ tree insertion routine.
+    iterator insert(const int& tid, iterator /* hint */, const value_type& x) {
+        return insert_start(tid, key_of_value::get(x), x).first;
+    }
+
+    //! Attempt to insert the range [first,last) of value_type pairs into the B+
+    //! tree. Each key/data pair is inserted individually; to bulk load the
+    //! tree, use a constructor with range.
+    template <typename InputIterator>
+    void insert(const int& tid, InputIterator first, InputIterator last) {
+        InputIterator iter = first;
+        while (iter != last)
+        {
+            insert(tid, *iter);
+            ++iter;
+        }
+    }
+
+    //! \}
+
+private:
+    //! \name Private Insertion Functions
+    //! \{
+
+    //! Start the insertion descent at the current root and handle root splits.
+    //! Returns true if the item was inserted
+    std::pair<iterator, bool>
+    insert_start(const int& tid, const key_type& key, const value_type& value) {
+
+        node* newchild = nullptr;
+        key_type newkey = key_type();
+
+        // the first root leaf is published by the commit's CAS on root_ like
+        // any new root, so concurrent first inserts cannot overwrite it
+        node* root = orig_root;
+        if (root == nullptr) {
+            root = new_root = head_leaf_ = tail_leaf_ = allocate_leaf(tid);
+            pc_happened = true;
+        }
+
+#ifdef BTREE_TOPDOWN_SPLIT
+        // split a full inner root before descending, insert_descend() then
+        // splits every full inner child on the way down and only a leaf split
+        // propagates one level up
+        node* start = root;
+        if (is_full_node(root))
+        {
+            split_full_node(tid, root, key, &newkey, &newchild);
+            grow_root(tid, newkey, newchild);
+            newchild = nullptr;
+
+            // the operation will not commit, new_root is not set
+            if (pc_abort)
+                return std::pair<iterator, bool>(iterator(), false);
+
+            start = new_root;
+        }
+
+        std::pair<iterator, bool> r =
+            insert_descend(tid, start, key, value, &newkey, &newchild);
+#else
+        std::pair<iterator, bool> r =
+            insert_descend(tid, root, key, value, &newkey, &newchild);
+#endif
+
+        if (newchild)
+        {
+            // this only occurs if insert_descend() could not insert the key
+            // into the root node, this mean the root is full and a new root
+            // needs to be created.
+            grow_root(tid, newkey, newchild);
+        }
+
+        // the size is counted by the caller once its copy is published
+
+#ifdef TLX_BTREE_DEBUG
+        if (debug) print(std::cout);
+#endif
+
+        if (self_verify) {
+            verify();
+            TLX_BTREE_ASSERT(exists(key));
+        }
+        return r;
+    }
+
+    /*!
+     * Insert an item into the B+ tree.
+     *
+     * Descend down the nodes to a leaf, insert the key/data pair in a free
+     * slot. If the node overflows, then it must be split and the new split node
+     * inserted into the parent. Unroll / this splitting up to the root.
+     *
+     * With BTREE_TOPDOWN_SPLIT every full inner node is split before the
+     * descent enters it, so the parent of the leaf always has room for the
+     * leaf's split. Leaves are still split on the way back up: the base slots
+     * of a leaf with a delta chain do not tell whether it is full.
+    */
+    std::pair<iterator, bool> insert_descend(
+        const int& tid, node* n, const key_type& key, const value_type& value,
+        key_type* splitkey, node** splitnode) {
+        
+        // std::cout << n << std::endl;
+        if (!n->is_leafnode())
+        {
+            // std::cout << "1" << std::endl;
+            InnerNode* inner = static_cast<InnerNode*>(n);
+
+            key_type newkey = key_type();
+            node* newchild = nullptr;
+            
+            unsigned short slot = find_lower(inner, key);
+            
+            prefetch_child(inner, slot);
+
+            TLX_BTREE_PRINT(
+                "BTree::insert_descend into " << inner->get_child(slot));
+
+#ifdef BTREE_TOPDOWN_SPLIT
+            // inner is never full here, so a full inner child is split before
+            // the descent and only inner, the child and its new sibling change
+            if (is_full_node(inner->get_child(slot)))
+            {
+                split_full_node(tid, inner->get_child(slot), key, &newkey, &newchild);
+                insert_into_inner(tid, inner, slot, newkey, newchild);
+                newchild = nullptr;
+
+                // an aborted split leaves inner unchanged
+                if (pc_abort)
+                    return std::pair<iterator, bool>(iterator(), false);
+
+                if (key_less(newkey, key))
+                    ++slot;
+            }
+
+            // only a leaf child splits on the way back up, and a leaf is never
+            // pre-split, so inner still has room for it below
+#endif
+
+            std::pair<iterator, bool> r =
+                insert_descend(tid, inner->get_child(slot),
+                               key, value, &newkey, &newchild);
+
+            if (newchild)
+            {
+                TLX_BTREE_PRINT("BTree::insert_descend newchild" <<
+                                " with key " << newkey <<
+                                " node " << newchild << " at slot " << slot);
+
+                if (inner->is_full())
+                {
+                    split_inner_node(tid, inner, splitkey, splitnode, slot);
+
+                    TLX_BTREE_PRINT("BTree::insert_descend done split_inner:" <<
+                                    " putslot: " << slot <<
+                                    " putkey: " << newkey <<
+                                    " upkey: " << *splitkey);
+
+#ifdef TLX_BTREE_DEBUG
+                    if (debug)
+                    {
+                        print_node(std::cout, inner);
+                        print_node(std::cout, *splitnode);
+                    }
+#endif
+
+                    // check if insert slot is in the split sibling node
+                    TLX_BTREE_PRINT("BTree::insert_descend switch: "
+                                    << slot << " > " << inner->get_slotuse() + 1);
+
+                    if (slot == inner->get_slotuse() + 1 &&
+                        inner->get_slotuse() < (*splitnode)->get_slotuse())
+                    {
+                        // special case when the insert slot matches the split
+                        // place between the two nodes, then the insert key
+                        // becomes the split key.
+
+                        TLX_BTREE_ASSERT(inner->get_slotuse() + 1 < inner_slotmax);
+
+                        InnerNode* split = static_cast<InnerNode*>(*splitnode);
+
+                        // move the split key and it's datum into the left node
+                        
+                        auto inner_dup = static_cast<InnerNode*>(path_copy(tid, inner));
+                        if (inner_dup != nullptr) {
+                            inner_dup->set_slotkey(inner_dup->get_slotuse(), *splitkey);
+                            inner_dup->set_child(inner_dup->get_slotuse() + 1, split->get_child(0));
+                            inner_dup->set_slotuse(inner_dup->get_slotuse() + 1);
+                        }
+
+                        // set new split key and move corresponding datum into
+                        // right node
+                        auto split_dup = static_cast<InnerNode*>(path_copy(tid, split));
+                        if (split_dup != nullptr) {
+                            split_dup->set_child(0, newchild);
+                        }
+
+                        *splitkey = newkey;
+                        // std::cout << "2 first" << std::endl;
+                        return r;
+                    }
+                    else if (slot >= inner->get_slotuse() + 1)
+                    {
+                        // in case the insert slot is in the newly create split
+                        // node, we reuse the code below.
+                        
+                        slot -= inner->get_slotuse() + 1;
+                        inner = static_cast<InnerNode*>(*splitnode);
+                        TLX_BTREE_PRINT(
+                            "BTree::insert_descend switching to "
+                            "splitted node " << inner << " slot " << slot);
+                    }
+                }
+
+                // move items and put pointer to child node into correct slot
+                TLX_BTREE_ASSERT(slot >= 0 && slot <= inner->get_slotuse());
+
+                insert_into_inner(tid, inner, slot, newkey, newchild);
+            }
+            // std::cout << "2 second" << std::endl;
+            return r;
+        }
+        else // n->is_leafnode() == true
+        {
+            // std::cout << "3" << std::endl;
+            LeafNode* leaf = static_cast<LeafNode*>(n);
+
+            unsigned short slot = find_lower(leaf, key);
+
+            if (!allow_duplicates &&
+                slot < leaf->get_slotuse() && key_equal(key, leaf->key(slot))) 
+            {
+                // std::cout << "4 first" << std::endl;
+                return std::pair<iterator, bool>(iterator(leaf, slot), false);
+            }
+
+            if (leaf->is_full())
+            {
+                split_leaf_node(tid, leaf, splitkey, splitnode);
+
+                // check if insert slot is in the split sibling node
+                if (slot >= leaf->get_slotuse())
+                {
+                    slot -= leaf->get_slotuse();
+                    leaf = static_cast<LeafNode*>(*splitnode);
+                }
+            }
+
+            // move items and put data item into correct data slot
+            TLX_BTREE_ASSERT(slot >= 0 && slot <= leaf->get_slotuse());
+
+            auto leaf_dup = static_cast<LeafNode*>(path_copy(tid, leaf));
+            if (leaf_dup != nullptr) {
+                leaf_dup->copy_backward_to_slotdata(
+                    leaf_dup->get_slotdata_vec() + slot, 
+                    leaf_dup->get_slotdata_vec() + leaf_dup->get_slotuse(),
+                    leaf_dup->get_slotdata_vec() + leaf_dup->get_slotuse() + 1);
+
+                leaf_dup->set_slot(slot, value);
+                leaf_dup->set_slotuse(leaf_dup->get_slotuse() + 1);
+            }
+
+            if (splitnode && leaf != *splitnode && slot == leaf->get_slotuse() - 1)
+            {
+                // special case: the node was split, and the insert is at the
+                // last slot of the old node. then the splitkey must be updated.
+                *splitkey = key;
+            }
+            // std::cout << "4 second" << std::endl;
+            return std::pair<iterator, bool>(iterator(leaf, slot), true);
+        }
+    }
+
+    //! Put a new root above the current one after the old root was split into
+    //! new_root and newchild with separator newkey.
+    void grow_root(const int& tid, const key_type& newkey, node* newchild) {
+        InnerNode* newroot = allocate_inner(tid, orig_root->get_level() + 1);
+
+        auto newroot_dup = static_cast<InnerNode*>(path_copy(tid, newroot));
+        if (newroot_dup != nullptr) {
+            newroot_dup->set_slotkey(0, newkey);
+
+            newroot_dup->set_child(0, new_root);
+            newroot_dup->set_child(1, newchild);
+
+            newroot_dup->set_slotuse(1);
+        }
+
+        /* TOMER CHANGE - TODO */
+        auto root_dup = path_copy(tid, newroot);
+        if (root_dup != nullptr)
+        {
+            root_dup = newroot;
+        }
+
+        new_root = root_dup;
+        // root_ = newroot;
+    }
+
+    //! Insert newkey and its right child newchild into a non-full inner node at
+    //! slot.
+    void insert_into_inner(const int& tid, InnerNode* inner, unsigned short slot,
+                           const key_type& newkey, node* newchild) {
+        auto inner_dup = static_cast<InnerNode*>(path_copy(tid, inner));
+        if (inner_dup != nullptr) {
+            inner_dup->copy_backward_to_slotkey(
+                inner_dup->get_slotkey_vec() + slot, 
+                inner_dup->get_slotkey_vec() + inner_dup->get_slotuse(),
+                inner_dup->get_slotkey_vec() + inner_dup->get_slotuse() + 1);
+            inner_dup->copy_backward_to_childid(
+                inner_dup->get_childid_vec() + slot, 
+                inner_dup->get_childid_vec() + inner_dup->get_slotuse() + 1,
+                inner_dup->get_childid_vec() + inner_dup->get_slotuse() + 2);
+
+            inner_dup->set_slotkey(slot, newkey);
+            inner_dup->set_child(slot + 1, newchild);
+            inner_dup->set_slotuse(inner_dup->get_slotuse() + 1);
+        }
+    }
+
+#ifdef BTREE_TOPDOWN_SPLIT
+    //! True if n is an inner node with no free slot left. Leaves are never
+    //! split ahead of the insert, see insert_descend().
+    bool is_full_node(const node* n) const {
+        return !n->is_leafnode() && static_cast<const InnerNode*>(n)->is_full();
+    }
+
+    //! Split a full inner node before the descent reaches it. The split is
+    //! balanced towards the child that key descends into.
+    void split_full_node(const int& tid, node* n, const key_type& key,
+                         key_type* out_newkey, node** out_newnode) {
+        InnerNode* inner = static_cast<InnerNode*>(n);
+        split_inner_node(tid, inner, out_newkey, out_newnode,
+                         find_lower(inner, key));
+    }
+#endif
+
+    //! Split up a leaf node into two equally-filled sibling leaves. Returns the
+    //! new nodes and it's insertion key in the two parameters.
+    void split_leaf_node(const int& tid, LeafNode* leaf,
+                         key_type* out_newkey, node** out_newleaf) {
+        TLX_BTREE_ASSERT(leaf->is_full());
+
+        unsigned short mid = (leaf->get_slotuse() >> 1);
+
+        TLX_BTREE_PRINT("BTree::split_leaf_node on " << leaf);
+
+        LeafNode* newleaf = allocate_leaf(tid);
+
+        auto newleaf_dup = static_cast<LeafNode*>(path_copy(tid, newleaf));
+        if (newleaf_dup != nullptr) {
+            newleaf_dup->set_slotuse(leaf->get_slotuse() - mid);
+
+            /* ITERATOR ISSUE - TODO */
+            // newleaf->next_leaf = leaf->next_leaf;
+            // if (newleaf->next_leaf == nullptr) {
+            //     TLX_BTREE_ASSERT(leaf == tail_leaf_);
+            //     tail_leaf_ = newleaf;
+            // }
+            // else {
+            //     newleaf->next_leaf->prev_leaf = newleaf;
+            // }
+
+            newleaf_dup->copy_to_slotdata(
+                    leaf->get_slotdata_vec() + mid, 
+                    leaf->get_slotdata_vec() + leaf->get_slotuse(), 
+                    newleaf_dup->get_slotdata_vec());
+        }
+
+        auto leaf_dup = static_cast<LeafNode*>(path_copy(tid, leaf));
+        if (leaf_dup != nullptr) {
+            leaf_dup->set_slotuse(mid);
+        }
+        
+
+        /* ITERATOR ISSUE - TODO */
+        // leaf->next_leaf = newleaf;
+        // newleaf->prev_leaf = leaf;
+
+        *out_newkey = leaf->key(leaf->get_slotuse() - 1);
+        *out_newleaf = newleaf;
+    }
+
+    //! Split up an inner node into two equally-filled sibling nodes. Returns
+    //! the new nodes and it's insertion key in the two parameters. Requires the
+    //! slot of the item will be inserted, so the nodes will be the same size
+    //! after the insert.
+    void split_inner_node(const int& tid, InnerNode* inner, key_type* out_newkey,
+                          node** out_newinner, unsigned int addslot) {
+        TLX_BTREE_ASSERT(inner->is_full());
+
+        unsigned short mid = (inner->get_slotuse() >> 1);
+
+        TLX_BTREE_PRINT("BTree::split_inner: mid " << mid <<
+                        " addslot " << addslot);
+
+        // if the split is uneven and the overflowing item will be put into the
+        // larger node, then the smaller split node may underflow
+        if (addslot <= mid && mid > inner->get_slotuse() - (mid + 1))
+            mid--;
+
+        TLX_BTREE_PRINT("BTree::split_inner: mid " << mid <<
+                        " addslot " << addslot);
+
+        TLX_BTREE_PRINT("BTree::split_inner_node on " << inner <<
+                        " into two nodes " << mid << " and " <<
+                        inner->get_slotuse() - (mid + 1) << " sized");
+
+        InnerNode* newinner = allocate_inner(tid, inner->get_level());
+
+        auto newinner_dup = static_cast<InnerNode*>(path_copy(tid, newinner));
+        if (newinner_dup != nullptr) {
+            newinner_dup->set_slotuse(inner->get_slotuse() - (mid + 1));
+
+            newinner_dup->copy_to_slotkey(
+                inner->get_slotkey_vec() + mid + 1, 
+                inner->get_slotkey_vec() + inner->get_slotuse(), 
+                newinner_dup->get_slotkey_vec());
+            newinner_dup->copy_to_childid(
+                inner->get_childid_vec() + mid + 1, 
+                inner->get_childid_vec() + inner->get_slotuse() + 1, 
+                newinner_dup->get_childid_vec());
+        }
+
+        auto inner_dup = static_cast<InnerNode*>(path_copy(tid, inner));
+        if (inner_dup != nullptr) {
+            inner_dup->set_slotuse(mid);
+        }
+
+        *out_newkey = inner->key(mid);
+        *out_newinner = newinner;
+    }
+
+    //! \}
+
+public:
+    //! \name Bulk Loader - Construct Tree from Sorted Sequence
+    //! \{
+
+    //! Bulk load a sorted range. Loads items into leaves and constructs a
+    //! B-tree above them. The tree must be empty when calling this function.
+    //! The iterators must be random access: each level is split into equal
+    //! chunks that are filled in parallel when compiled with OpenMP. Nodes are
+    //! allocated with the OpenMP thread number as tid, so the caller must have
+    //! initialized those threads with the record manager.
+    template <typename Iterator>
+    void bulk_load(const int& tid, Iterator ibegin, Iterator iend) {
+        TLX_BTREE_ASSERT(empty());
+
+        // calculate number of leaves needed, round up.
+        const size_t num_items = iend - ibegin;
+        if (num_items == 0) return;
+        const size_t num_leaves = (num_items + leaf_slotmax - 1) / leaf_slotmax;
+
+        stats_[tid].size = num_items;
+        stats_[tid].leaves = num_leaves;
+
+        TLX_BTREE_PRINT("BTree::bulk_load, level 0: " << num_items <<
+                        " items into " << num_leaves <<
+                        " leaves with up to " <<
+                        ((num_items + num_leaves - 1) / num_leaves) <<
+                        " items per leaf.");
+
+        // nodes of the level being built, and the max key of any descendant
+        // of each of them.
+        node** level_nodes = new node*[num_leaves];
+        const key_type** level_maxkey = new const key_type*[num_leaves];
+
+        // leaf i gets items [i * N / L, (i + 1) * N / L). Chunk sizes differ
+        // by at most one, so no leaf is underfull.
+        #pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < num_leaves; ++i)
+        {
+            LeafNode* leaf = allocate_leaf(bulk_load_tid(tid));
+
+            const size_t first = i * num_items / num_leaves;
+            const size_t last = (i + 1) * num_items / num_leaves;
+            leaf->set_slotuse(static_cast<int>(last - first));
+            for (size_t s = 0; s < last - first; ++s)
+                leaf->set_slot(s, ibegin[first + s]);
+
+            level_nodes[i] = leaf;
+            level_maxkey[i] = &leaf->key(leaf->get_slotuse() - 1);
+        }
+
+        // the leaf chain is not kept up to date by duplicating updates (split
+        // does not link new leaves either), so the leaves are left unlinked:
+        // a stale link would make merge_leaves write to a retired leaf.
+
+        head_leaf_ = static_cast<LeafNode*>(level_nodes[0]);
+        tail_leaf_ = static_cast<LeafNode*>(level_nodes[num_leaves - 1]);
+
+        // build inner levels the same way until a single node is left. if the
+        // btree is so small to fit into one leaf, that leaf is the root.
+        size_t num_children = num_leaves;
+        for (unsigned short level = 1; num_children != 1; ++level)
+        {
+            const size_t num_parents =
+                (num_children + (inner_slotmax + 1) - 1) / (inner_slotmax + 1);
+
+            TLX_BTREE_PRINT(
+                "BTree::bulk_load, level " << level <<
+                    ": " << num_children << " children in " <<
+                    num_parents << " inner nodes with up to " <<
+                ((num_children + num_parents - 1) / num_parents) <<
+                    " children per inner node.");
+
+            node** parents = new node*[num_parents];
+            stats_[tid].inner_nodes += num_parents;
+            const key_type** parent_maxkey = new const key_type*[num_parents];
+
+            #pragma omp parallel for schedule(static)
+            for (size_t i = 0; i < num_parents; ++i)
+            {
+                InnerNode* n = allocate_inner(bulk_load_tid(tid), level);
+
+                // an inner node has one more child than keys.
+                const size_t first = i * num_children / num_parents;
+                const size_t last = (i + 1) * num_children / num_parents;
+                TLX_BTREE_ASSERT(last - first > 0);
+                n->set_slotuse(static_cast<int>(last - first - 1));
+
+                // copy max key of each child but the last and set children
+                for (unsigned short s = 0; s < last - first - 1; ++s)
+                {
+                    n->set_slotkey(s, *level_maxkey[first + s]);
+                    n->set_child(s, level_nodes[first + s]);
+                }
+                n->set_child(static_cast<unsigned short>(last - first - 1), level_nodes[last - 1]);
+
+                parents[i] = n;
+                parent_maxkey[i] = level_maxkey[last - 1];
+            }
+
+            delete[] level_nodes;
+            delete[] level_maxkey;
+            level_nodes = parents;
+            level_maxkey = parent_maxkey;
+            num_children = num_parents;
+        }
+
+        root_ = level_nodes[0];
+        delete[] level_nodes;
+        delete[] level_maxkey;
+
+        if (self_verify) verify();
+    }
+
+    //! \}
+
+private:
+    //! Allocation tid of the calling thread inside bulk_load's parallel loops.
+    static int bulk_load_tid(const int& tid) {
+#ifdef _OPENMP
+        return omp_get_thread_num();
+#else
+        return tid;
+#endif
+    }
+
+    //! \name Support Class Encapsulating Deletion Results
+    //! \{
+
+    //! Result flags of recursive deletion.
+    enum result_flags_t {
+        //! Deletion successful and no fix-ups necessary.
+        btree_ok = 0,
+
+        //! Deletion not successful because key was not found.
+        btree_not_found = 1,
+
+        //! Deletion successful, the last key was updated so parent slotkeys
+        //! need updates.
+        btree_update_lastkey = 2,
+
+        //! Deletion successful, children nodes were merged and the parent needs
+        //! to remove the empty node.
+        btree_fixmerge = 4
+    };
+
+    //! B+ tree recursive deletion has much information which is needs to be
+    //! passed upward.
+    struct result_t {
+        //! Merged result flags
+        result_flags_t flags;
+
+        //! The key to be updated at the parent's slot
+        key_type lastkey;
+
+        //! Constructor of a result with a specific flag, this can also be used
+        //! as for implicit conversion.
+        result_t(result_flags_t f = btree_ok) // NOLINT
+            : flags(f), lastkey()
+        { }
+
+        //! Constructor with a lastkey value.
+        result_t(result_flags_t f, const key_type& k)
+            : flags(f), lastkey(k)
+        { }
+
+        //! Test if this result object has a given flag set.
+        bool has(result_flags_t f) const {
+            return (flags & f) != 0;
+        }
+
+        //! Merge two results OR-ing the result flags and overwriting lastkeys.
+        result_t& operator |= (const result_t& other) {
+            flags = result_flags_t(flags | other.flags);
+
+            // we overwrite existing lastkeys on purpose
+            if (other.has(btree_update_lastkey))
+                lastkey = other.lastkey;
+
+            return *this;
+        }
+    };
+
+    //! \}
+
+public:
+    //! \name Public Erase Functions
+    //! \{
+
+    //! Erases one (the first) of the key/data pairs associated with the given
+    //! key.
+    bool erase_one(const int& tid, const key_type& key) {
+        TLX_BTREE_PRINT("BTree::erase_one(" << key <<
+                        ") on btree size " << size());
+
+        if (self_verify) verify();
+
+        if (!orig_root) return false;
+
+#ifdef BTREE_RELAXED_ERASE
+        underflow_res = false;
+#endif
+        
+        result_t result = erase_one_descend(
+            tid, key, orig_root, nullptr, nullptr, nullptr, nullptr, nullptr, 0);
+
+
+#ifdef TLX_BTREE_DEBUG
+        if (debug) print(std::cout);
+#endif
+        if (self_verify) verify();
+        
+        return !result.has(btree_not_found);
+    }
+
+    //! Erase all pairs with lo <= key <= hi in one operation. The subtrees
+    //! between the paths to lo and hi hold only keys in the range: they are
+    //! unlinked whole and all their nodes are retired with the operation's
+    //! other replaced nodes. Only the nodes on the two boundary paths are
+    //! rebuilt, and rebalanced against their siblings on the way up. Returns
+    //! the number of pairs erased.
+    size_type erase_range(const int& tid, const key_type& lo, const key_type& hi) {
+        if (!orig_root || key_less(hi, lo)) return 0;
+
+        std::deque<range_part> parts;
+        size_type erased = 0;
+
+        // the root has no separator after it, its max is never read
+        range_part* root = erase_range_descend(
+            tid, parts, orig_root, key_type(), lo, hi, &erased);
+        // a leaf on the way has delta records, pc_finish() consolidates it
+        if (pc_abort || root->orig)
+            return 0;
+
+        // an inner root left with a single child is replaced by it
+        while (root->level > 0 && root->kids.size() == 1)
+            root = root->kids[0];
+
+        new_root = range_part_empty(root) ? nullptr : erase_range_build(tid, root);
+        pc_happened = true;
+
+        return erased;
+    }
+
+#ifdef BTREE_RELAXED_ERASE
+    //! Run one lazy rebalancing step on the path to key: the topmost
+    //! underflowing node on that path is repaired by shifting or merging with
+    //! a sibling. Returns true if an underflow may remain on the path.
+    bool rebalance_one(const int& tid, const key_type& key) {
+        if (!orig_root) return false;
+
+        rebalancing = true;
+        underflow_res = false;
+
+        erase_one_descend(
+            tid, key, orig_root, nullptr, nullptr, nullptr, nullptr, nullptr, 0);
+
+        rebalancing = false;
+
+        return underflow_res;
+    }
+#endif
+
+    //! Erases all the key/data pairs associated with the given key. This is
+    //! implemented using erase_one().
+    size_type erase(const int& tid, const key_type& key) {
+        size_type c = 0;
+
+        while (erase_one(tid, key))
+        {
+            ++c;
+            if (!allow_duplicates) break;
+        }
+
+        return c;
+    }
+
+    //! Erase the key/data pair referenced by the iterator.
+    void erase(const int& tid, iterator iter) {
+        TLX_BTREE_PRINT("BTree::erase_iter(" << iter.curr_leaf <<
+                        "," << iter.curr_slot << ") on btree size " << size());
+        
+        if (self_verify) verify();
+
+        if (!root_) return;
+
+        result_t result = erase_iter_descend(
+            tid, iter, root_, nullptr, nullptr, nullptr, nullptr, nullptr, 0);
+
+
+#ifdef TLX_BTREE_DEBUG
+        if (debug) print(std::cout);
+#endif
+        if (self_verify) verify();
+    }
+
+#ifdef BTREE_TODO
+    //! Erase all key/data pairs in the range [first,last). This function is
+    //! currently not implemented by the B+ Tree.
+    void erase(iterator /* first */, iterator /* last */) {
+        abort();
+    }
+#endif
+
+    //! \}
+
+private:
+    //! \name Private Erase Functions
+    //! \{
+
+    //! A node on the boundary paths of erase_range(), rebuilt in place of the
+    //! node orig. While orig is set the node is unchanged; range_open() moves
+    //! its contents into slots or kids. The separator keys of an inner node are
+    //! the max of each child but the last.
+    struct range_part {
+        node* orig;
+        unsigned short level;
+        //! Largest key in the subtree, the separator after it in its parent
+        key_type max;
+        std::vector<value_type> slots;
+        std::vector<range_part*> kids;
+    };
+
+    range_part* range_wrap(std::deque<range_part>& parts, node* n,
+                           const key_type& max) {
+        parts.emplace_back();
+        range_part* p = &parts.back();
+        p->orig = n;
+        // a node's level never changes, so unlike get_level() this reads no
+        // copy: n may already be replaced by this operation
+        p->level = n->level;
+        p->max = max;
+        return p;
+    }
+
+    //! Move the contents of an unchanged node into p. The node itself is
+    //! retired when the operation commits, so it is read completely first.
+    void range_open(const int& tid, std::deque<range_part>& parts, range_part* p) {
+        node* n = p->orig;
+        if (!n) return;
+
+        if (n->is_leafnode())
+        {
+            const LeafNode* leaf = static_cast<const LeafNode*>(n);
+            for (unsigned short slot = 0; slot < leaf->get_slotuse(); ++slot)
+                p->slots.push_back(leaf->get_slot(slot));
+        }
+        else
+        {
+            const InnerNode* inner = static_cast<const InnerNode*>(n);
+            for (unsigned short slot = 0; slot <= inner->get_slotuse(); ++slot)
+            {
+                p->kids.push_back(range_wrap(
+                    parts, inner->get_child(slot),
+                    slot < inner->get_slotuse() ? inner->key(slot) : p->max));
+            }
+        }
+
+        p->orig = nullptr;
+        free_node(tid, n);
+    }
+
+    static bool range_part_empty(const range_part* p) {
+        return !p->orig && (p->level == 0 ? p->slots.empty() : p->kids.empty());
+    }
+
+    //! Only rebuilt nodes are checked: an unchanged node only underflows with
+    //! BTREE_RELAXED_ERASE, and then a rebalancing step for it is pending.
+    static bool range_part_underflow(const range_part* p) {
+        if (p->orig) return false;
+        if (p->level == 0) return p->slots.size() < leaf_slotmin;
+        return p->kids.size() - 1 < inner_slotmin;
+    }
+
+    //! Erase lo <= key <= hi from the subtree of n, whose largest key is max.
+    //! Returns the part for n, which is unchanged if the subtree holds no key
+    //! in the range.
+    range_part* erase_range_descend(const int& tid, std::deque<range_part>& parts,
+                                    node* n, const key_type& max,
+                                    const key_type& lo, const key_type& hi,
+                                    size_type* erased) {
+        range_part* p = range_wrap(parts, n, max);
+
+        if (n->is_leafnode())
+        {
+            const LeafNode* leaf = static_cast<const LeafNode*>(n);
+            unsigned short first = find_lower(leaf, lo);
+            unsigned short last = find_upper(leaf, hi);
+            if (first >= last)
+                return p;
+
+            range_open(tid, parts, p);
+            p->slots.erase(p->slots.begin() + first, p->slots.begin() + last);
+            *erased += last - first;
+            if (!p->slots.empty())
+                p->max = key_of_value::get(p->slots.back());
+            return p;
+        }
+
+        const InnerNode* inner = static_cast<const InnerNode*>(n);
+        unsigned short first = find_lower(inner, lo);
+        unsigned short last = find_upper(inner, hi);
+        unsigned short slotuse = inner->get_slotuse();
+
+        // the children strictly between first and last hold only keys in the
+        // range, the paths to lo and hi end in first and last
+        range_part* left = erase_range_descend(
+            tid, parts, inner->get_child(first),
+            first < slotuse ? inner->key(first) : max, lo, hi, erased);
+        if (pc_abort)
+            return p;
+
+        range_part* right = left;
+        if (last != first)
+        {
+            right = erase_range_descend(
+                tid, parts, inner->get_child(last),
+                last < slotuse ? inner->key(last) : max, lo, hi, erased);
+        }
+        if (pc_abort || (left->orig && right->orig && last - first < 2))
+            return p;
+
+        range_open(tid, parts, p);
+        for (unsigned short slot = first + 1; slot < last; ++slot)
+            erase_range_drop(tid, p->kids[slot]->orig, erased);
+
+        p->kids[first] = left;
+        p->kids[last] = right;
+        if (last - first > 1)
+            p->kids.erase(p->kids.begin() + first + 1, p->kids.begin() + last);
+        p->kids.erase(std::remove_if(p->kids.begin(), p->kids.end(), range_part_empty),
+                      p->kids.end());
+
+        erase_range_fix(tid, parts, p);
+        if (!p->kids.empty())
+            p->max = p->kids.back()->max;
+        return p;
+    }
+
+    //! Unlink the whole subtree of n, counting its pairs into erased.
+    void erase_range_drop(const int& tid, node* n, size_type* erased) {
+        if (pc_abort)
+            return;
+
+        if (n->is_leafnode())
+        {
+            *erased += n->get_slotuse();
+        }
+        else
+        {
+            const InnerNode* inner = static_cast<const InnerNode*>(n);
+            for (unsigned short slot = 0; slot <= inner->get_slotuse(); ++slot)
+                erase_range_drop(tid, inner->get_child(slot), erased);
+        }
+        free_node(tid, n);
+    }
+
+    //! Repair the underflowing rebuilt children of p, each by merging it with
+    //! or balancing it against an adjacent sibling. The separator between two
+    //! inner siblings is the max of the left one's last child, so it moves
+    //! down into a merged node with the children. A merge can join a child
+    //! that underflows with its new siblings, which are then repaired too.
+    void erase_range_fix(const int& tid, std::deque<range_part>& parts, range_part* p) {
+        size_t i = 0;
+        while (p->kids.size() > 1 && i < p->kids.size())
+        {
+            if (!range_part_underflow(p->kids[i]))
+            {
+                ++i;
+                continue;
+            }
+
+            size_t a = (i + 1 < p->kids.size()) ? i : i - 1;
+            range_part* left = p->kids[a];
+            range_part* right = p->kids[a + 1];
+            range_open(tid, parts, left);
+            range_open(tid, parts, right);
+            if (pc_abort)
+                return;
+
+            if (left->level == 0)
+            {
+                std::vector<value_type>& ls = left->slots;
+                std::vector<value_type>& rs = right->slots;
+                size_t total = ls.size() + rs.size();
+                if (total <= leaf_slotmax)
+                {
+                    ls.insert(ls.end(), rs.begin(), rs.end());
+                    left->max = right->max;
+                    p->kids.erase(p->kids.begin() + a + 1);
+                }
+                else
+                {
+                    size_t half = total / 2;
+                    if (ls.size() < half)
+                    {
+                        size_t n = half - ls.size();
+                        ls.insert(ls.end(), rs.begin(), rs.begin() + n);
+                        rs.erase(rs.begin(), rs.begin() + n);
+                    }
+                    else
+                    {
+                        rs.insert(rs.begin(), ls.begin() + half, ls.end());
+                        ls.erase(ls.begin() + half, ls.end());
+                    }
+                    left->max = key_of_value::get(ls.back());
+                }
+            }
+            else
+            {
+                std::vector<range_part*>& lk = left->kids;
+                std::vector<range_part*>& rk = right->kids;
+                size_t total = lk.size() + rk.size();
+                if (total <= inner_slotmax + 1u)
+                {
+                    lk.insert(lk.end(), rk.begin(), rk.end());
+                    left->max = right->max;
+                    p->kids.erase(p->kids.begin() + a + 1);
+                    erase_range_fix(tid, parts, left);
+                }
+                else
+                {
+                    size_t half = total / 2;
+                    if (lk.size() < half)
+                    {
+                        size_t n = half - lk.size();
+                        lk.insert(lk.end(), rk.begin(), rk.begin() + n);
+                        rk.erase(rk.begin(), rk.begin() + n);
+                    }
+                    else
+                    {
+                        rk.insert(rk.begin(), lk.begin() + half, lk.end());
+                        lk.erase(lk.begin() + half, lk.end());
+                    }
+                    left->max = lk.back()->max;
+                    erase_range_fix(tid, parts, left);
+                    erase_range_fix(tid, parts, right);
+                }
+            }
+
+            i = a;
+        }
+    }
+
+    //! Write a rebuilt part and its rebuilt descendants to new nodes.
+    node* erase_range_build(const int& tid, const range_part* p) {
+        if (p->orig)
+            return p->orig;
+
+        if (p->level == 0)
+        {
+            LeafNode* leaf = allocate_leaf(tid);
+            leaf->set_slotuse(p->slots.size());
+            for (unsigned short slot = 0; slot < p->slots.size(); ++slot)
+                leaf->set_slot(slot, p->slots[slot]);
+            return leaf;
+        }
+
+        InnerNode* inner = allocate_inner(tid, p->level);
+        for (unsigned short slot = 0; slot < p->kids.size(); ++slot)
+        {
+            inner->set_child(slot, erase_range_build(tid, p->kids[slot]));
+            if (slot + 1u < p->kids.size())
+                inner->set_slotkey(slot, p->kids[slot]->max);
+        }
+        inner->set_slotuse(p->kids.size() - 1);
+        return inner;
+    }
+
+    /*!
+     * Erase one (the first) key/data pair in the B+ tree matching key.
+     *
+     * Descends down the tree in search of key. During the descent the parent,
+     * left and right siblings and their parents are computed and passed
+     * down. Once the key/data pair is found, it is removed from the leaf. If
+     * the leaf underflows 6 different cases are handled. These cases resolve
+     * the underflow by shifting key/data pairs from adjacent sibling nodes,
+     * merging two sibling nodes or trimming the tree.
+     *
+     * With BTREE_RELAXED_ERASE only the leaf is written and an underflow is
+     * just flagged in underflow_res. rebalance_one() later runs the same
+     * descent with rebalancing set to resolve it, one node per call.
+     */
+    result_t erase_one_descend(const int& tid, 
+                               const key_type& key,
+                               node* curr,
+                               node* left, node* right,
+                               InnerNode* left_parent, InnerNode* right_parent,
+                               InnerNode* parent, unsigned int parentslot) {                                   
+        
+        if (curr->is_leafnode())
+        {
+            LeafNode* leaf = static_cast<LeafNode*>(curr);
+            LeafNode* left_leaf = static_cast<LeafNode*>(left);
+            LeafNode* right_leaf = static_cast<LeafNode*>(right);
+
+            unsigned short slot = find_lower(leaf, key);
+
+#ifdef BTREE_RELAXED_ERASE
+            if (rebalancing)
+            {
+                if (leaf->is_underflow() && leaf != root_)
+                {
+                    return fix_leaf_underflow(
+                        tid, leaf, left_leaf, right_leaf,
+                        left_parent, right_parent, parent, parentslot);
+                }
+                return btree_ok;
+            }
+#endif
+            
+            if (slot >= leaf->get_slotuse() || !key_equal(key, leaf->key(slot)))
+            {
+                TLX_BTREE_PRINT("Could not find key " << key << " to erase.");
+
+                return btree_not_found;
+            }
+
+            TLX_BTREE_PRINT(
+                "Found key in leaf " << curr << " at slot " << slot);
+            
+            auto leaf_dup = static_cast<LeafNode*>(path_copy(tid, leaf));
+            if (leaf_dup != nullptr) {
+                leaf_dup->copy_to_slotdata(
+                        leaf_dup->get_slotdata_vec() + slot + 1, 
+                        leaf_dup->get_slotdata_vec() + leaf_dup->get_slotuse(),
+                        leaf_dup->get_slotdata_vec() + slot);
+                leaf_dup->set_slotuse(leaf_dup->get_slotuse() - 1);
+            }
+
+#ifdef BTREE_RELAXED_ERASE
+            // Only the leaf is written: the parent's split key may now be
+            // larger than the leaf's last key, which is still a valid upper
+            // bound for searches, and an underflow is left for rebalance_one().
+            if (leaf->is_underflow() && leaf != root_)
+                underflow_res = true;
+
+            return btree_ok;
+#endif
+
+            result_t myres = btree_ok;
+
+            // if the last key of the leaf was changed, the parent is notified
+            // and updates the key of this leaf
+            if (slot == leaf->get_slotuse())
+            {
+                if (parent && parentslot < parent->get_slotuse())
+                {
+                    TLX_BTREE_ASSERT(parent->get_child(parentslot) == curr);
+                    auto parent_dup = static_cast<InnerNode*>(path_copy(tid, parent));
+                    if (parent_dup != nullptr) {
+                        parent_dup->set_slotkey(parentslot, leaf->key(leaf->get_slotuse() - 1));
+                    }
+                }
+                else
+                {
+                    if (leaf->get_slotuse() >= 1)
+                    {
+                        TLX_BTREE_PRINT("Scheduling lastkeyupdate: key " <<
+                                        leaf->key(leaf->get_slotuse() - 1));
+                        myres |= result_t(
+                            btree_update_lastkey, leaf->key(leaf->get_slotuse() - 1));
+                    }
+                    else
+                    {
+                        TLX_BTREE_ASSERT(leaf == root_);
+                    }
+                }
+            }
+            
+            if (leaf->is_underflow() && !(leaf == root_ && leaf->get_slotuse() >= 1))
+            {
+                myres |= fix_leaf_underflow(
+                    tid, leaf, left_leaf, right_leaf,
+                    left_parent, right_parent, parent, parentslot);
+            }
+            
+            return myres;
+        }
+        else // !curr->is_leafnode()
+        {   
+            InnerNode* inner = static_cast<InnerNode*>(curr);
+            InnerNode* left_inner = static_cast<InnerNode*>(left);
+            InnerNode* right_inner = static_cast<InnerNode*>(right);
+
+            node* myleft, * myright;
+            InnerNode* myleft_parent, * myright_parent;
+
+            unsigned short slot = find_lower(inner, key);
+
+            prefetch_child(inner, slot);
+
+#ifdef BTREE_RELAXED_ERASE
+            // repair the topmost underflow on the path first, so every merge
+            // further down happens below a parent with at least two children
+            if (rebalancing && inner->is_underflow() &&
+                !(inner == root_ && inner->get_slotuse() >= 1))
+            {
+                underflow_res = true;
+                return fix_inner_underflow(
+                    tid, inner, left_inner, right_inner,
+                    left_parent, right_parent, parent, parentslot);
+            }
+#endif
+
+            if (slot == 0) {
+                myleft =
+                    (left == nullptr) ? nullptr :
+                    static_cast<InnerNode*>(left)->get_child(left->get_slotuse() - 1);
+                myleft_parent = left_parent;
+            }
+            else {
+                myleft = inner->get_child(slot - 1);
+                myleft_parent = inner;
+            }
+
+            if (slot == inner->get_slotuse()) {
+                myright =
+                    (right == nullptr) ? nullptr :
+                    static_cast<InnerNode*>(right)->get_child(0);
+                myright_parent = right_parent;
+            }
+            else {
+                myright = inner->get_child(slot + 1);
+                myright_parent = inner;
+            }
+
+            TLX_BTREE_PRINT("erase_one_descend into " << inner->get_child(slot));
+
+            result_t result = erase_one_descend(
+                tid,
+                key,
+                inner->get_child(slot),
+                myleft, myright,
+                myleft_parent, myright_parent,
+                inner, slot);
+
+            result_t myres = btree_ok;
+
+            if (result.has(btree_not_found))
+            {
+                return result;
+            }
+
+            if (result.has(btree_update_lastkey))
+            {
+                if (parent && parentslot < parent->get_slotuse())
+                {
+                    TLX_BTREE_PRINT("Fixing lastkeyupdate: key " <<
+                                    result.lastkey << " into parent " <<
+                                    parent << " at parentslot " <<
+                                    parentslot);
+
+                    TLX_BTREE_ASSERT(parent->get_child(parentslot) == curr);
+                    auto parent_dup = static_cast<InnerNode*>(path_copy(tid, parent));
+                    if (parent_dup != nullptr) {
+                        parent_dup->set_slotkey(parentslot, result.lastkey);
+                    }
+                }
+                else
+                {
+                    TLX_BTREE_PRINT(
+                        "Forwarding lastkeyupdate: key " << result.lastkey);
+                    myres |= result_t(btree_update_lastkey, result.lastkey);
+                }
+            }
+
+            if (result.has(btree_fixmerge))
+            {
+                // either the current node or the next is empty and should be
+                // removed. a merge into the first child always removes the
+                // second one, even if both were empty.
+                if (slot == 0 || inner->get_child(slot)->get_slotuse() != 0)
+                    slot++;
+
+                // this is the child slot invalidated by the merge
+                TLX_BTREE_ASSERT(inner->get_child(slot)->get_slotuse() == 0);
+
+                free_node(tid, inner->get_child(slot));
+
+                auto inner_dup = static_cast<InnerNode*>(path_copy(tid, inner));
+                if (inner_dup != nullptr) {
+                    inner_dup->copy_to_slotkey(
+                        inner_dup->get_slotkey_vec() + slot, 
+                        inner_dup->get_slotkey_vec() + inner_dup->get_slotuse(),
+                        inner_dup->get_slotkey_vec() + slot - 1);
+                    inner_dup->copy_to_childid(
+                        inner_dup->get_childid_vec() + slot + 1,
+                        inner_dup->get_childid_vec() + inner_dup->get_slotuse() + 1,
+                        inner_dup->get_childid_vec() + slot);
+
+                    inner_dup->set_slotuse(inner_dup->get_slotuse() - 1);
+                }
+
+                if (inner->get_level() == 1 &&
+                    inner->get_child(slot - 1)->get_slotuse() != 0)
+                {
+                    // fix split key for children leaves
+                    slot--;
+                    LeafNode* child =
+                        static_cast<LeafNode*>(inner->get_child(slot));
+                    auto inner_dup = static_cast<InnerNode*>(path_copy(tid, inner));
+                    if (inner_dup != nullptr) {
+                        inner_dup->set_slotkey(slot, child->key(child->get_slotuse() - 1));
+                    }
+                }
+            }
+
+#ifdef BTREE_RELAXED_ERASE
+            // a merge below may leave this node short, which is repaired by
+            // the next rebalancing step
+            if (rebalancing && inner->is_underflow() &&
+                !(inner == root_ && inner->get_slotuse() >= 1))
+            {
+                underflow_res = true;
+            }
+
+            return myres;
+#endif
+
+            if (inner->is_underflow() &&
+                !(inner == root_ && inner->get_slotuse() >= 1))
+            {
+                myres |= fix_inner_underflow(
+                    tid, inner, left_inner, right_inner,
+                    left_parent, right_parent, parent, parentslot);
+            }
+            
+            return myres;
+        }
+    }
+
+    /*!
+     * Resolve the underflow of a leaf after an erase. The six cases shift
+     * key/data pairs from an adjacent sibling, merge with a sibling or trim
+     * the tree if the leaf was the root.
+     */
+    result_t fix_leaf_underflow(const int& tid,
+                                LeafNode* leaf,
+                                LeafNode* left_leaf, LeafNode* right_leaf,
+                                InnerNode* left_parent, InnerNode* right_parent,
+                                InnerNode* parent, unsigned int parentslot) {
+        result_t myres = btree_ok;
+
+        // determine what to do about the underflow
+
+        // case : if this empty leaf is the root, then delete all nodes
+        // and set root to nullptr.
+        if (left_leaf == nullptr && right_leaf == nullptr)
+        {
+            TLX_BTREE_ASSERT(leaf == root_);
+            TLX_BTREE_ASSERT(leaf->get_slotuse() == 0);
+
+            free_node(tid, root_);
+
+            // root_ = leaf = nullptr; // TODO
+            auto root_dup = path_copy(tid, orig_root);
+            if (root_dup != nullptr)
+            {
+                root_dup = nullptr;
+            }
+
+            new_root = root_dup;
+
+            auto leaf_dup = static_cast<LeafNode*>(path_copy(tid, leaf));
+            if (leaf_dup != nullptr) {
+                leaf_dup = nullptr;
+            }
+            
+            // head_leaf_ = tail_leaf_ = nullptr; // TODO
+
+            // both will be decremented when the erase commits
+            TLX_BTREE_ASSERT(stats_.sum().size == 1);
+            TLX_BTREE_ASSERT(stats_.sum().leaves == 1);
+            TLX_BTREE_ASSERT(stats_.sum().inner_nodes == 0);
+            
+            return btree_ok;
+        }
+        // case : if both left and right leaves would underflow in case
+        // of a shift, then merging is necessary. choose the more local
+        // merger with our parent
+        else if ((left_leaf == nullptr || left_leaf->is_few()) &&
+                 (right_leaf == nullptr || right_leaf->is_few()))
+        {
+            if (left_parent == parent)
+                myres |= merge_leaves(tid, left_leaf, leaf, left_parent);
+            else
+                myres |= merge_leaves(tid, leaf, right_leaf, right_parent);
+        }
+        // case : the right leaf has extra data, so balance right with
+        // current
+        else if ((left_leaf != nullptr && left_leaf->is_few()) &&
+                 (right_leaf != nullptr && !right_leaf->is_few()))
+        {
+            if (right_parent == parent)
+                myres |= shift_left_leaf(
+                    tid, leaf, right_leaf, right_parent, parentslot);
+            else
+                myres |= merge_leaves(tid, left_leaf, leaf, left_parent);
+        }
+        // case : the left leaf has extra data, so balance left with
+        // current
+        else if ((left_leaf != nullptr && !left_leaf->is_few()) &&
+                 (right_leaf != nullptr && right_leaf->is_few()))
+        {
+            if (left_parent == parent)
+                shift_right_leaf(
+                    tid, left_leaf, leaf, left_parent, parentslot - 1);
+            else
+                myres |= merge_leaves(tid, leaf, right_leaf, right_parent);
+        }
+        // case : both the leaf and right leaves have extra data and our
+        // parent, choose the leaf with more data
+        else if (left_parent == right_parent)
+        {
+            if (left_leaf->get_slotuse() <= right_leaf->get_slotuse())
+                myres |= shift_left_leaf(
+                    tid, leaf, right_leaf, right_parent, parentslot);
+            else
+                shift_right_leaf(
+                    tid, left_leaf, leaf, left_parent, parentslot - 1);
+        }
+        else
+        {
+            if (left_parent == parent)
+                shift_right_leaf(
+                    tid, left_leaf, leaf, left_parent, parentslot - 1);
+            else
+                myres |= shift_left_leaf(
+                    tid, leaf, right_leaf, right_parent, parentslot);
+        }
+
+        return myres;
+    }
+
+    /*!
+     * Resolve the underflow of an inner node after a merge of its children,
+     * by the same cases as fix_leaf_underflow().
+     */
+    result_t fix_inner_underflow(const int& tid,
+                                 InnerNode* inner,
+                                 InnerNode* left_inner, InnerNode* right_inner,
+                                 InnerNode* left_parent, InnerNode* right_parent,
+                                 InnerNode* parent, unsigned int parentslot) {
+        result_t myres = btree_ok;
+
+        // case: the inner node is the root and has just one child. that
+        // child becomes the new root
+        if (left_inner == nullptr && right_inner == nullptr)
+        {
+            TLX_BTREE_ASSERT(inner == root_);
+            TLX_BTREE_ASSERT(inner->get_slotuse() == 0);
+            
+            // root_ = inner->get_child(0); // TODO
+
+            auto root_dup = path_copy(tid, orig_root);
+            if (root_dup != nullptr) {
+                root_dup = inner->get_child(0);
+            }
+
+            new_root = root_dup;
+
+            auto inner_dup = static_cast<InnerNode*>(path_copy(tid, inner));
+            if (inner_dup != nullptr) {
+                inner_dup->set_slotuse(0);
+            }
+
+            free_node(tid, inner);
+            
+            return btree_ok;
+        }
+        // case : if both left and right leaves would underflow in case
+        // of a shift, then merging is necessary. choose the more local
+        // merger with our parent
+        else if ((left_inner == nullptr || left_inner->is_few()) &&
+                 (right_inner == nullptr || right_inner->is_few()))
+        {
+            if (left_parent == parent)
+                myres |= merge_inner(
+                    tid, left_inner, inner, left_parent, parentslot - 1);
+            else
+                myres |= merge_inner(
+                    tid, inner, right_inner, right_parent, parentslot);
+        }
+        // case : the right leaf has extra data, so balance right with
+        // current
+        else if ((left_inner != nullptr && left_inner->is_few()) &&
+                 (right_inner != nullptr && !right_inner->is_few()))
+        {
+            if (right_parent == parent)
+                shift_left_inner(
+                    tid, inner, right_inner, right_parent, parentslot);
+            else
+                myres |= merge_inner(
+                    tid, left_inner, inner, left_parent, parentslot - 1);
+        }
+        // case : the left leaf has extra data, so balance left with
+        // current
+        else if ((left_inner != nullptr && !left_inner->is_few()) &&
+                 (right_inner != nullptr && right_inner->is_few()))
+        {
+            if (left_parent == parent) {
+                shift_right_inner(
+                    tid, left_inner, inner, left_parent, parentslot - 1);
+            }
+            else {
+                myres |= merge_inner(
+                    tid, inner, right_inner, right_parent, parentslot);
+            }
+        }
+        // case : both the leaf and right leaves have extra data and our
+        // parent, choose the leaf with more data
+        else if (left_parent == right_parent)
+        {
+            if (left_inner->get_slotuse() <= right_inner->get_slotuse()) {
+                shift_left_inner(
+                    tid, inner, right_inner, right_parent, parentslot);
+            }
+            else {
+                shift_right_inner(
+                    tid, left_inner, inner, left_parent, parentslot - 1);
+            }
+        }
+        else
+        {
+            if (left_parent == parent) {
+                shift_right_inner(
+                    tid, left_inner, inner, left_parent, parentslot - 1);
+            }
+            else {
+                shift_left_inner(
+                    tid, inner, right_inner, right_parent, parentslot);
+            }
+        }
+
+        return myres;
+    }
+
+    /*!
+     * Erase one key/data pair referenced by an iterator in the B+ tree.
+     *
+     * Descends down the tree in search of an iterator. During the descent the
+     * parent, left and right siblings and their parents are computed and passed
+     * down. The difficulty is that the iterator contains only a pointer to a
+     * LeafNode, which means that this function must do a recursive depth first
+     * search for that leaf node in the subtree containing all pairs of the same
+     * key. This subtree can be very large, even the whole tree, though in
+     * practice it would not make sense to have so many duplicate keys.
+     *
+     * Once the referenced key/data pair is found, it is removed from the leaf
+     * and the same underflow cases are handled as in erase_one_descend.
+     */
+    result_t erase_iter_descend(const int& tid, 
+                                const iterator& iter,
+                                node* curr,
+                                node* left, node* right,
+                                InnerNode* left_parent, InnerNode* right_parent,
+                                InnerNode* parent, unsigned int parentslot) {
+        if (curr->is_leafnode())
+        {
+            LeafNode* leaf = static_cast<LeafNode*>(curr);
+            LeafNode* left_leaf = static_cast<LeafNode*>(left);
+            LeafNode* right_leaf = static_cast<LeafNode*>(right);
+
+            // if this is not the correct leaf, get next step in recursive
+            // search
+            if (leaf != iter.curr_leaf)
+            {
+                return btree_not_found;
+            }
+
+            if (iter.curr_slot >= leaf->get_slotuse())
+            {
+                TLX_BTREE_PRINT("Could not find iterator (" <<
+                                iter.curr_leaf << "," << iter.curr_slot <<
+                                ") to erase. Invalid leaf node?");
+
+                return btree_not_found;
+            }
+
+            unsigned short slot = iter.curr_slot;
+
+            TLX_BTREE_PRINT("Found iterator in leaf " <<
+                            curr << " at slot " << slot);
+
+            leaf->copy_to_slotdata(
+                    leaf->get_slotdata_vec() + slot + 1, 
+                    leaf->get_slotdata_vec() + leaf->get_slotuse(),
+                    leaf->get_slotdata_vec() + slot);
+
+            leaf->set_slotuse(leaf->get_slotuse() - 1);
+
+            result_t myres = btree_ok;
+
+            // if the last key of the leaf was changed, the parent is notified
+            // and updates the key of this leaf
+            if (slot == leaf->get_slotuse())
+            {
+                if (parent && parentslot < parent->get_slotuse())
+                {
+                    TLX_BTREE_ASSERT(parent->get_child(parentslot) == curr);
+                    parent->set_slotkey(parentslot, leaf->key(leaf->get_slotuse() - 1));
+                }
+                else
+                {
+                    if (leaf->get_slotuse() >= 1)
+                    {
+                        TLX_BTREE_PRINT("Scheduling lastkeyupdate: key " <<
+                                        leaf->key(leaf->get_slotuse() - 1));
+                        myres |= result_t(
+                            btree_update_lastkey, leaf->key(leaf->get_slotuse() - 1));
+                    }
+                    else
+                    {
+                        TLX_BTREE_ASSERT(leaf == root_);
+                    }
+                }
+            }
+
+            if (leaf->is_underflow() && !(leaf == root_ && leaf->get_slotuse() >= 1))
+            {
+                // determine what to do about the underflow
+
+                // case : if this empty leaf is the root, then delete all nodes
+                // and set root to nullptr.
+                if (left_leaf == nullptr && right_leaf == nullptr)
+                {
+                    TLX_BTREE_ASSERT(leaf == root_);
+                    TLX_BTREE_ASSERT(leaf->get_slotuse() == 0);
+
+                    free_node(tid, root_);
+
+                    root_ = leaf = nullptr;
+                    head_leaf_ = tail_leaf_ = nullptr;
+
+                    // both will be decremented when the erase commits
+                    TLX_BTREE_ASSERT(stats_.sum().size == 1);
+                    TLX_BTREE_ASSERT(stats_.sum().leaves == 1);
+                    TLX_BTREE_ASSERT(stats_.sum().inner_nodes == 0);
+
+                    return btree_ok;
+                }
+                // case : if both left and right leaves would underflow in case
+                // of a shift, then merging is necessary. choose the more local
+                // merger with our parent
+                else if ((left_leaf == nullptr || left_leaf->is_few()) &&
+                         (right_leaf == nullptr || right_leaf->is_few()))
+                {
+                    if (left_parent == parent)
+                        myres |= merge_leaves(left_leaf, leaf, left_parent);
+                    else
+                        myres |= merge_leaves(leaf, right_leaf, right_parent);
+                }
+                // case : the right leaf has extra data, so balance right with
+                // current
+                else if ((left_leaf != nullptr && left_leaf->is_few()) &&
+                         (right_leaf != nullptr && !right_leaf->is_few()))
+                {
+                    if (right_parent == parent) {
+                        myres |= shift_left_leaf(
+                            tid, leaf, right_leaf, right_parent, parentslot);
+                    }
+                    else {
+                        myres |= merge_leaves(left_leaf, leaf, left_parent);
+                    }
+                }
+                // case : the left leaf has extra data, so balance left with
+                // current
+                else if ((left_leaf != nullptr && !left_leaf->is_few()) &&
+                         (right_leaf != nullptr && right_leaf->is_few()))
+                {
+                    if (left_parent == parent) {
+                        shift_right_leaf(
+                            tid, left_leaf, leaf, left_parent, parentslot - 1);
+                    }
+                    else {
+                        myres |= merge_leaves(leaf, right_leaf, right_parent);
+                    }
+                }
+                // case : both the leaf and right leaves have extra data and our
+                // parent, choose the leaf with more data
+                else if (left_parent == right_parent)
+                {
+                    if (left_leaf->get_slotuse() <= right_leaf->get_slotuse()) {
+                        myres |= shift_left_leaf(
+                            tid, leaf, right_leaf, right_parent, parentslot);
+                    }
+                    else {
+                        shift_right_leaf(
+                            tid, left_leaf, leaf, left_parent, parentslot - 1);
+                    }
+                }
+                else
+                {
+                    if (left_parent == parent) {
+                        shift_right_leaf(
+                            tid, left_leaf, leaf, left_parent, parentslot - 1);
+                    }
+                    else {
+                        myres |= shift_left_leaf(
+                            tid, leaf, right_leaf, right_parent, parentslot);
+                    }
+                }
+            }
+
+            return myres;
+        }
+        else // !curr->is_leafnode()
+        {
+            InnerNode* inner = static_cast<InnerNode*>(curr);
+            InnerNode* left_inner = static_cast<InnerNode*>(left);
+            InnerNode* right_inner = static_cast<InnerNode*>(right);
+
+            // find first slot below which the searched iterator might be
+            // located.
+
+            result_t result;
+            unsigned short slot = find_lower(inner, iter.key());
+
+            while (slot <= inner->get_slotuse())
+            {
+                node* myleft, * myright;
+                InnerNode* myleft_parent, * myright_parent;
+
+                if (slot == 0) {
+                    myleft = (left == nullptr) ? nullptr
+                             : static_cast<InnerNode*>(left)->get_child(
+                        left->get_slotuse() - 1);
+                    myleft_parent = left_parent;
+                }
+                else {
+                    myleft = inner->get_child(slot - 1);
+                    myleft_parent = inner;
+                }
+
+                if (slot == inner->get_slotuse()) {
+                    myright = (right == nullptr) ? nullptr
+                              : static_cast<InnerNode*>(right)->get_child(0);
+                    myright_parent = right_parent;
+                }
+                else {
+                    myright = inner->get_child(slot + 1);
+                    myright_parent = inner;
+                }
+
+                TLX_BTREE_PRINT("erase_iter_descend into " <<
+                                inner->get_child(slot));
+
+                result = erase_iter_descend(tid, 
+                                            iter,
+                                            inner->get_child(slot),
+                                            myleft, myright,
+                                            myleft_parent, myright_parent,
+                                            inner, slot);
+
+                if (!result.has(btree_not_found))
+                    break;
+
+                // continue recursive search for leaf on next slot
+
+                if (slot < inner->get_slotuse() &&
+                    key_less(inner->get_slotkey(slot), iter.key()))
+                    return btree_not_found;
+
+                ++slot;
+            }
+
+            if (slot > inner->get_slotuse())
+                return btree_not_found;
+
+            result_t myres = btree_ok;
+
+            if (result.has(btree_update_lastkey))
+            {
+                if (parent && parentslot < parent->get_slotuse())
+                {
+                    TLX_BTREE_PRINT("Fixing lastkeyupdate: key " <<
+                                    result.lastkey << " into parent " <<
+                                    parent << " at parentslot " << parentslot);
+
+                    TLX_BTREE_ASSERT(parent->get_child(parentslot) == curr);
+                    parent->set_slotkey(parentslot, result.lastkey);
+                }
+                else
+                {
+                    TLX_BTREE_PRINT(
+                        "Forwarding lastkeyupdate: key " << result.lastkey);
+                    myres |= result_t(btree_update_lastkey, result.lastkey);
+                }
+            }
+
+            if (result.has(btree_fixmerge))
+            {
+                // either the current node or the next is empty and should be
+                // removed
+                if (inner->get_child(slot)->get_slotuse() != 0)
+                    slot++;
+
+                // this is the child slot invalidated by the merge
+                TLX_BTREE_ASSERT(inner->get_child(slot)->get_slotuse() == 0);
+
+                free_node(tid, inner->get_child(slot));
+
+                inner->copy_to_slotkey(
+                    inner->get_slotkey_vec() + slot, 
+                    inner->get_slotkey_vec() + inner->get_slotuse(),
+                    inner->get_slotkey_vec() + slot - 1);
+                inner->copy_to_childid(
+                    inner->get_childid_vec() + slot + 1,
+                    inner->get_childid_vec() + inner->get_slotuse() + 1,
+                    inner->get_childid_vec() + slot);
+
+                inner->set_slotuse(inner->get_slotuse() - 1);
+
+                if (inner->get_level() == 1)
+                {
+                    // fix split key for children leaves
+                    slot--;
+                    LeafNode* child =
+                        static_cast<LeafNode*>(inner->get_child(slot));
+                    inner->set_slotkey(slot, child->key(child->get_slotuse() - 1));
+                }
+            }
+
+            if (inner->is_underflow() &&
+                !(inner == root_ && inner->get_slotuse() >= 1))
+            {
+                // case: the inner node is the root and has just one
+                // child. that child becomes the new root
+                if (left_inner == nullptr && right_inner == nullptr)
+                {
+                    TLX_BTREE_ASSERT(inner == root_);
+                    TLX_BTREE_ASSERT(inner->get_slotuse() == 0);
+
+                    root_ = inner->get_child(0);
+
+                    inner->set_slotuse(0);
+                    free_node(tid, inner);
+
+                    return btree_ok;
+                }
+                // case : if both left and right leaves would underflow in case
+                // of a shift, then merging is necessary. choose the more local
+                // merger with our parent
+                else if ((left_inner == nullptr || left_inner->is_few()) &&
+                         (right_inner == nullptr || right_inner->is_few()))
+                {
+                    if (left_parent == parent) {
+                        myres |= merge_inner(
+                            left_inner, inner, left_parent, parentslot - 1);
+                    }
+                    else {
+                        myres |= merge_inner(
+                            inner, right_inner, right_parent, parentslot);
+                    }
+                }
+                // case : the right leaf has extra data, so balance right with
+                // current
+                else if ((left_inner != nullptr && left_inner->is_few()) &&
+                         (right_inner != nullptr && !right_inner->is_few()))
+                {
+                    if (right_parent == parent) {
+                        shift_left_inner(
+                            tid, inner, right_inner, right_parent, parentslot);
+                    }
+                    else {
+                        myres |= merge_inner(
+                            left_inner, inner, left_parent, parentslot - 1);
+                    }
+                }
+                // case : the left leaf has extra data, so balance left with
+                // current
+                else if ((left_inner != nullptr && !left_inner->is_few()) &&
+                         (right_inner != nullptr && right_inner->is_few()))
+                {
+                    if (left_parent == parent) {
+                        shift_right_inner(
+                            left_inner, inner, left_parent, parentslot - 1);
+                    }
+                    else {
+                        myres |= merge_inner(
+                            inner, right_inner, right_parent, parentslot);
+                    }
+                }
+                // case : both the leaf and right leaves have extra data and our
+                // parent, choose the leaf with more data
+                else if (left_parent == right_parent)
+                {
+                    if (left_inner->get_slotuse() <= right_inner->get_slotuse()) {
+                        shift_left_inner(
+                            tid, inner, right_inner, right_parent, parentslot);
+                    }
+                    else {
+                        shift_right_inner(
+                            left_inner, inner, left_parent, parentslot - 1);
+                    }
+                }
+                else
+                {
+                    if (left_parent == parent) {
+                        shift_right_inner(
+                            left_inner, inner, left_parent, parentslot - 1);
+                    }
+                    else {
+                        shift_left_inner(
+                            tid, inner, right_inner, right_parent, parentslot);
+                    }
+                }
+            }
+
+            return myres;
+        }
+    }
+
+    //! Merge two leaf nodes. The function moves all key/data pairs from right
+    //! to left and sets right's slotuse to zero. The right slot is then removed
+    //! by the calling parent node.
+    result_t merge_leaves(const int& tid, 
+                          LeafNode* left, 
+                          LeafNode* right,
+                          InnerNode* parent) {
+        TLX_BTREE_PRINT("Merge leaf nodes " << left << " and " << right <<
+                        " with common parent " << parent << ".");
+        (void)parent;
+
+        TLX_BTREE_ASSERT(left->is_leafnode() && right->is_leafnode());
+        TLX_BTREE_ASSERT(parent->get_level() == 1);
+
+        TLX_BTREE_ASSERT(left->get_slotuse() + right->get_slotuse() < leaf_slotmax);
+
+		auto right_dup = static_cast<LeafNode*>(path_copy(tid, right));
+        auto left_dup = static_cast<LeafNode*>(path_copy(tid, left));
+        if (left_dup != nullptr) {
+            left_dup->copy_to_slotdata(
+                    right->get_slotdata_vec(), 
+                    right->get_slotdata_vec() + right->get_slotuse(),
+                    left_dup->get_slotdata_vec() + left_dup->get_slotuse());
+
+            left_dup->set_slotuse(left_dup->get_slotuse() + right->get_slotuse());
+        }
+
+        // the leaf chain is not maintained by copying updates, so it is not
+        // relinked here either: left is a published leaf that other threads
+        // read, and right->next_leaf may point to a leaf that was already
+        // retired and freed.
+
+        //auto right_dup = static_cast<LeafNode*>(path_copy(tid, right));
+        if (right_dup != nullptr) {
+            right_dup->set_slotuse(0);
+        }
+
+        return btree_fixmerge;
+    }
+
+    //! Merge two inner nodes. The function moves all key/childid pairs from
+    //! right to left and sets right's slotuse to zero. The right slot is then
+    //! removed by the calling parent node.
+    result_t merge_inner(const int& tid, 
+                                InnerNode* left, 
+                                InnerNode* right,
+                                InnerNode* parent, unsigned int parentslot) {
+        TLX_BTREE_PRINT("Merge inner nodes " << left << " and " << right <<
+                        " with common parent " << parent << ".");
+
+        TLX_BTREE_ASSERT(left->get_level() == right->get_level());
+        TLX_BTREE_ASSERT(parent->get_level() == left->get_level() + 1);
+
+        TLX_BTREE_ASSERT(parent->get_child(parentslot) == left);
+
+        TLX_BTREE_ASSERT(left->get_slotuse() + right->get_slotuse() < inner_slotmax);
+
+        if (self_verify)
+        {
+            // find the left node's slot in the parent's children
+            unsigned int leftslot = 0;
+            while (leftslot <= parent->get_slotuse() &&
+                   parent->get_child(leftslot) != left)
+                ++leftslot;
+
+            TLX_BTREE_ASSERT(leftslot < parent->get_slotuse());
+            TLX_BTREE_ASSERT(parent->get_child(leftslot) == left);
+            TLX_BTREE_ASSERT(parent->get_child(leftslot + 1) == right);
+
+            TLX_BTREE_ASSERT(parentslot == leftslot);
+        }
+
+        // retrieve the decision key from parent
+		auto right_dup = static_cast<InnerNode*>(path_copy(tid, right));
+        auto left_dup = static_cast<InnerNode*>(path_copy(tid, left));
+        if (left_dup != nullptr) {
+            left_dup->set_slotkey(left_dup->get_slotuse(), parent->get_slotkey(parentslot));
+            left_dup->set_slotuse(left_dup->get_slotuse() + 1);
+
+            // copy over keys and children from right
+            left_dup->copy_to_slotkey(
+                    right->get_slotkey_vec(),
+                    right->get_slotkey_vec() + right->get_slotuse(),
+                    left_dup->get_slotkey_vec() + left_dup->get_slotuse());
+            left_dup->copy_to_childid(
+                    right->get_childid_vec(), 
+                    right->get_childid_vec() + right->get_slotuse() + 1,
+                    left_dup->get_childid_vec() + left_dup->get_slotuse());
+
+            left_dup->set_slotuse(left_dup->get_slotuse() + right->get_slotuse());
+        }
+
+        //auto right_dup = static_cast<InnerNode*>(path_copy(tid, right));
+        if (right_dup != nullptr) {
+            right_dup->set_slotuse(0);
+        }
+
+        return btree_fixmerge;
+    }
+
+    //! Balance two leaf nodes. The function moves key/data pairs from right to
+    //! left so that both nodes are equally filled. The parent node is updated
+    //! if possible.
+    result_t shift_left_leaf(
+        const int& tid, LeafNode* left, LeafNode* right,
+        InnerNode* parent, unsigned int parentslot) {
+
+        TLX_BTREE_ASSERT(left->is_leafnode() && right->is_leafnode());
+        TLX_BTREE_ASSERT(parent->get_level() == 1);
+
+        // TLX_BTREE_ASSERT(left->next_leaf == right);
+        // TLX_BTREE_ASSERT(left == right->prev_leaf);
+
+        TLX_BTREE_ASSERT(left->get_slotuse() < right->get_slotuse());
+        TLX_BTREE_ASSERT(parent->get_child(parentslot) == left);
+
+        unsigned int shiftnum = (right->get_slotuse() - left->get_slotuse()) >> 1;
+
+        TLX_BTREE_PRINT("Shifting (leaf) " << shiftnum << " entries to left " <<
+                        left << " from right " << right <<
+                        " with common parent " << parent << ".");
+
+        TLX_BTREE_ASSERT(left->get_slotuse() + shiftnum < leaf_slotmax);
+
+        // copy the first items from the right node to the last slot in the left
+        // node.
+		auto right_dup = static_cast<LeafNode*>(path_copy(tid, right));
+        auto left_dup = static_cast<LeafNode*>(path_copy(tid, left));
+        if (left_dup != nullptr) {
+            left_dup->copy_to_slotdata(
+                    right->get_slotdata_vec(), 
+                    right->get_slotdata_vec() + shiftnum,
+                    left_dup->get_slotdata_vec() + left_dup->get_slotuse());
+
+            left_dup->set_slotuse(left_dup->get_slotuse() + shiftnum);
+        }
+
+        // shift all slots in the right node to the left
+        //auto right_dup = static_cast<LeafNode*>(path_copy(tid, right));
+        if (right_dup != nullptr) {
+            right_dup->copy_to_slotdata(
+                    right_dup->get_slotdata_vec() + shiftnum, 
+                    right_dup->get_slotdata_vec() + right_dup->get_slotuse(),
+                    right_dup->get_slotdata_vec());
+
+            right_dup->set_slotuse(right_dup->get_slotuse() - shiftnum);
+        }
+
+        // fixup parent
+        if (parentslot < parent->get_slotuse()) {
+            auto parent_dup = static_cast<InnerNode*>(path_copy(tid, parent));
+            if (parent_dup != nullptr) {
+                parent_dup->set_slotkey(parentslot, left->key(left->get_slotuse() - 1));
+            }
+            return btree_ok;
+        }
+        else {  // the update is further up the tree
+            return result_t(btree_update_lastkey, left->key(left->get_slotuse() - 1));
+        }
+    }
+
+    //! Balance two inner nodes. The function moves key/data pairs from right to
+    //! left so that both nodes are equally filled. The parent node is updated
+    //! if possible.
+    void shift_left_inner(
+                const int& tid, InnerNode* left, InnerNode* right,
+                InnerNode* parent, unsigned int parentslot) {
+        TLX_BTREE_ASSERT(left->get_level() == right->get_level());
+        TLX_BTREE_ASSERT(parent->get_level() == left->get_level() + 1);
+
+        TLX_BTREE_ASSERT(left->get_slotuse() < right->get_slotuse());
+        TLX_BTREE_ASSERT(parent->get_child(parentslot) == left);
+
+        unsigned int shiftnum = (right->get_slotuse() - left->get_slotuse()) >> 1;
+
+        TLX_BTREE_PRINT("Shifting (inner) " << shiftnum <<
+                        " entries to left " << left <<
+                        " from right " << right <<
+                        " with common parent " << parent << ".");
+
+        TLX_BTREE_ASSERT(left->get_slotuse() + shiftnum < inner_slotmax);
+
+        if (self_verify)
+        {
+            // find the left node's slot in the parent's children and compare to
+            // parentslot
+
+            unsigned int leftslot = 0;
+            while (leftslot <= parent->get_slotuse() &&
+                   parent->get_child(leftslot) != left)
+                ++leftslot;
+
+            TLX_BTREE_ASSERT(leftslot < parent->get_slotuse());
+            TLX_BTREE_ASSERT(parent->get_child(leftslot) == left);
+            TLX_BTREE_ASSERT(parent->get_child(leftslot + 1) == right);
+
+            TLX_BTREE_ASSERT(leftslot == parentslot);
+        }
+
+        // copy the parent's decision slotkey and childid to the first new key
+        // on the left
+		auto right_dup = static_cast<InnerNode*>(path_copy(tid, right));
+        auto left_dup = static_cast<InnerNode*>(path_copy(tid, left));
+        if (left_dup != nullptr) {
+            left_dup->set_slotkey(left_dup->get_slotuse(), parent->get_slotkey(parentslot));
+            left_dup->set_slotuse(left_dup->get_slotuse() + 1);
+
+            // copy the other items from the right node to the last slots in the
+            // left node.
+            left_dup->copy_to_slotkey(
+                    right->get_slotkey_vec(), 
+                    right->get_slotkey_vec() + shiftnum - 1,
+                    left_dup->get_slotkey_vec() + left_dup->get_slotuse());
+            left_dup->copy_to_childid(
+                    right->get_childid_vec(), 
+                    right->get_childid_vec() + shiftnum,
+                    left_dup->get_childid_vec() + left_dup->get_slotuse());
+
+            left_dup->set_slotuse(left_dup->get_slotuse() + (shiftnum - 1));
+        }
+
+        // fixup parent
+        auto parent_dup = static_cast<InnerNode*>(path_copy(tid, parent));
+        if (parent_dup != nullptr) {
+            parent_dup->set_slotkey(parentslot, right->get_slotkey(shiftnum - 1));
+        }
+
+        // shift all slots in the right node
+        //auto right_dup = static_cast<InnerNode*>(path_copy(tid, right));
+        if (right_dup != nullptr) {
+            right_dup->copy_to_slotkey(
+                right_dup->get_slotkey_vec() + shiftnum, 
+                right_dup->get_slotkey_vec() + right_dup->get_slotuse(),
+                right_dup->get_slotkey_vec());
+            right_dup->copy_to_childid(
+                right_dup->get_childid_vec() + shiftnum, 
+                right_dup->get_childid_vec() + right_dup->get_slotuse() + 1,
+                right_dup->get_childid_vec());
+
+            right_dup->set_slotuse(right_dup->get_slotuse() - shiftnum);
+        }
+    }
+
+    //! Balance two leaf nodes. The function moves key/data pairs from left to
+    //! right so that both nodes are equally filled. The parent node is updated
+    //! if possible.
+    void shift_right_leaf(
+                const int& tid, LeafNode* left, LeafNode* right,
+                InnerNode* parent, unsigned int parentslot) {
+        TLX_BTREE_ASSERT(left->is_leafnode() && right->is_leafnode());
+        TLX_BTREE_ASSERT(parent->get_level() == 1);
+
+        // TLX_BTREE_ASSERT(left->next_leaf == right);
+        // TLX_BTREE_ASSERT(left == right->prev_leaf);
+        TLX_BTREE_ASSERT(parent->get_child(parentslot) == left);
+
+        TLX_BTREE_ASSERT(left->get_slotuse() > right->get_slotuse());
+
+        unsigned int shiftnum = (left->get_slotuse() - right->get_slotuse()) >> 1;
+
+        TLX_BTREE_PRINT("Shifting (leaf) " << shiftnum <<
+                        " entries to right " << right <<
+                        " from left " << left <<
+                        " with common parent " << parent << ".");
+
+        if (self_verify)
+        {
+            // find the left node's slot in the parent's children
+            unsigned int leftslot = 0;
+            while (leftslot <= parent->get_slotuse() &&
+                   parent->get_child(leftslot) != left)
+                ++leftslot;
+
+            TLX_BTREE_ASSERT(leftslot < parent->get_slotuse());
+            TLX_BTREE_ASSERT(parent->get_child(leftslot) == left);
+            TLX_BTREE_ASSERT(parent->get_child(leftslot + 1) == right);
+
+            TLX_BTREE_ASSERT(leftslot == parentslot);
+        }
+
+        // shift all slots in the right node
+
+        TLX_BTREE_ASSERT(right->get_slotuse() + shiftnum < leaf_slotmax);
+
+		auto left_dup = static_cast<LeafNode*>(path_copy(tid, left));
+        auto right_dup = static_cast<LeafNode*>(path_copy(tid, right));
+        if (right_dup != nullptr) {
+            right_dup->copy_backward_to_slotdata(
+                    right_dup->get_slotdata_vec(), 
+                    right_dup->get_slotdata_vec() + right_dup->get_slotuse(),
+                    right_dup->get_slotdata_vec() + right_dup->get_slotuse() + shiftnum);
+
+            right_dup->set_slotuse(right_dup->get_slotuse() + shiftnum);
+
+            // copy the last items from the left node to the first slot in the right
+            // node.
+            right_dup->copy_to_slotdata(
+                    left->get_slotdata_vec() + left->get_slotuse() - shiftnum,
+                    left->get_slotdata_vec() + left->get_slotuse(), 
+                    right_dup->get_slotdata_vec());
+        }
+
+        //auto left_dup = static_cast<LeafNode*>(path_copy(tid, left));
+        if (left_dup != nullptr) {
+            left_dup->set_slotuse(left_dup->get_slotuse() - shiftnum);
+        }
+
+        auto parent_dup = static_cast<InnerNode*>(path_copy(tid, parent));
+        if (parent_dup != nullptr) {
+            parent_dup->set_slotkey(parentslot, left->key(left->get_slotuse() - 1));
+        }
+    }
+
+    //! Balance two inner nodes. The function moves key/data pairs from left to
+    //! right so that both nodes are equally filled. The parent node is updated
+    //! if possible.
+    void shift_right_inner(
+                const int& tid, InnerNode* left, InnerNode* right,
+                InnerNode* parent, unsigned int parentslot) {
+        TLX_BTREE_ASSERT(left->get_level() == right->get_level());
+        TLX_BTREE_ASSERT(parent->get_level() == left->get_level() + 1);
+
+        TLX_BTREE_ASSERT(left->get_slotuse() > right->get_slotuse());
+        TLX_BTREE_ASSERT(parent->get_child(parentslot) == left);
+
+        unsigned int shiftnum = (left->get_slotuse() - right->get_slotuse()) >> 1;
+
+        TLX_BTREE_PRINT("Shifting (leaf) " << shiftnum <<
+                        " entries to right " << right <<
+                        " from left " << left <<
+                        " with common parent " << parent << ".");
+
+        if (self_verify)
+        {
+            // find the left node's slot in the parent's children
+            unsigned int leftslot = 0;
+            while (leftslot <= parent->get_slotuse() &&
+                   parent->get_child(leftslot) != left)
+                ++leftslot;
+
+            TLX_BTREE_ASSERT(leftslot < parent->get_slotuse());
+            TLX_BTREE_ASSERT(parent->get_child(leftslot) == left);
+            TLX_BTREE_ASSERT(parent->get_child(leftslot + 1) == right);
+
+            TLX_BTREE_ASSERT(leftslot == parentslot);
+        }
+
+        // shift all slots in the right node
+
+        TLX_BTREE_ASSERT(right->get_slotuse() + shiftnum < inner_slotmax);
+
+		auto left_dup = static_cast<InnerNode*>(path_copy(tid, left));
+        auto right_dup = static_cast<InnerNode*>(path_copy(tid, right));
+        if (right_dup != nullptr) {
+            right_dup->copy_backward_to_slotkey(
+                right_dup->get_slotkey_vec(), 
+                right_dup->get_slotkey_vec() + right_dup->get_slotuse(),
+                right_dup->get_slotkey_vec() + right_dup->get_slotuse() + shiftnum);
+            right_dup->copy_backward_to_childid(
+                right_dup->get_childid_vec(), 
+                right_dup->get_childid_vec() + right_dup->get_slotuse() + 1,
+                right_dup->get_childid_vec() + right_dup->get_slotuse() + 1 + shiftnum);
+
+            right_dup->set_slotuse(right_dup->get_slotuse() + shiftnum);
+
+            // copy the parent's decision slotkey and childid to the last new key on
+            // the right
+            right_dup->set_slotkey(shiftnum - 1, parent->get_slotkey(parentslot));
+
+            // copy the remaining last items from the left node to the first slot in
+            // the right node.
+            right_dup->copy_to_slotkey(
+                    left->get_slotkey_vec() + left->get_slotuse() - shiftnum + 1,
+                    left->get_slotkey_vec() + left->get_slotuse(), 
+                    right_dup->get_slotkey_vec());
+            right_dup->copy_to_childid(
+                    left->get_childid_vec() + left->get_slotuse() - shiftnum + 1,
+                    left->get_childid_vec() + left->get_slotuse() + 1, 
+                    right_dup->get_childid_vec());
+        }
+
+        // copy the first to-be-removed key from the left node to the parent's
+        // decision slot
+        auto parent_dup = static_cast<InnerNode*>(path_copy(tid, parent));
+        if (parent_dup != nullptr) {
+            parent_dup->set_slotkey(parentslot, left->get_slotkey(left->get_slotuse() - shiftnum));
+        }
+
+        //auto left_dup = static_cast<InnerNode*>(path_copy(tid, left));
+        if (left_dup != nullptr) {
+            left_dup->set_slotuse(left_dup->get_slotuse() - shiftnum);
+        }
+    }
+
+    //! \}
+
+#ifdef TLX_BTREE_DEBUG
+
+public:
+    //! \name Debug Printing
+    //! \{
+
+    //! Print out the B+ tree structure with keys onto the given ostream. This
+    //! function requires that the header is compiled with TLX_BTREE_DEBUG and
+    //! that key_type is printable via std::ostream.
+    void print(std::ostream& os) const {
+        if (root_) {
+            print_node(os, root_, 0, true);
+        }
+    }
+
+    //! Print out only the leaves via the double linked list.
+    void print_leaves(std::ostream& os) const {
+        os << "leaves:" << std::endl;
+
+        const LeafNode* n = head_leaf_;
+
+        while (n)
+        {
+            os << "  " << n << std::endl;
+
+            n = n->next_leaf;
+        }
+    }
+
+private:
+    //! Recursively descend down the tree and print out nodes.
+    static void print_node(std::ostream& os, const node* node,
+                           unsigned int depth = 0, bool recursive = false) {
+        for (unsigned int i = 0; i < depth; i++) os << "  ";
+
+        os << "node " << node << " level " << node->get_level() <<
+            " slotuse " << node->get_slotuse() << std::endl;
+
+        if (node->is_leafnode())
+        {
+            const LeafNode* leafnode = static_cast<const LeafNode*>(node);
+
+            for (unsigned int i = 0; i < depth; i++) os << "  ";
+            os << "  leaf prev " << leafnode->prev_leaf <<
+                " next " << leafnode->next_leaf << std::endl;
+
+            for (unsigned int i = 0; i < depth; i++) os << "  ";
+
+            for (unsigned short slot = 0; slot < leafnode->get_slotuse(); ++slot)
+            {
+                // os << leafnode->key(slot) << " "
+                //    << "(data: " << leafnode->get_slot(slot) << ") ";
+                os << leafnode->key(slot) << "  ";
+            }
+            os << std::endl;
+        }
+        else
+        {
+            const InnerNode* innernode = static_cast<const InnerNode*>(node);
+
+            for (unsigned int i = 0; i < depth; i++) os << "  ";
+
+            for (unsigned short slot = 0; slot < innernode->get_slotuse(); ++slot)
+            {
+                os << "(" << innernode->get_child(slot) << ") "
+                   << innernode->get_slotkey(slot) << " ";
+            }
+            os << "(" << innernode->get_child(innernode->get_slotuse()) << ")"
+               << std::endl;
+
+            if (recursive)
+            {
+                for (unsigned short slot = 0;
+                     slot < innernode->get_slotuse() + 1; ++slot)
+                {
+                    print_node(
+                        os, innernode->get_child(slot), depth + 1, recursive);
+                }
+            }
+        }
+    }
+
+    //! \}
+#endif
+
+public:
+    //! \name Verification of B+ Tree Invariants
+    //! \{
+
+    //! Run a thorough verification of all B+ tree invariants. The program
+    //! aborts via tlx_die_unless() if something is wrong.
+    void verify() const {
+        key_type minkey, maxkey;
+        tree_stats vstats;
+
+        if (root_)
+        {
+            verify_node(root_, &minkey, &maxkey, vstats);
+
+            tree_stats stats = stats_.sum();
+            tlx_die_unless(vstats.size == stats.size);
+            tlx_die_unless(vstats.leaves == stats.leaves);
+            tlx_die_unless(vstats.inner_nodes == stats.inner_nodes);
+
+            verify_leaflinks();
+        }
+    }
+
+private:
+    //! Recursively descend down the tree and verify each node
+    void verify_node(const node* n, key_type* minkey, key_type* maxkey,
+                     tree_stats& vstats) const {
+        TLX_BTREE_PRINT("verifynode " << n);
+
+        if (n->is_leafnode())
+        {
+            const LeafNode* leaf = static_cast<const LeafNode*>(n);
+
+            tlx_die_unless(leaf == root_ || !leaf->is_underflow());
+            tlx_die_unless(leaf->get_slotuse() > 0);
+
+            for (unsigned short slot = 0; slot < leaf->get_slotuse() - 1; ++slot)
+            {
+                tlx_die_unless(
+                    key_lessequal(leaf->key(slot), leaf->key(slot + 1)));
+            }
+
+            *minkey = leaf->key(0);
+            *maxkey = leaf->key(leaf->get_slotuse() - 1);
+
+            vstats.leaves++;
+            vstats.size += leaf->get_slotuse();
+        }
+        else // !n->is_leafnode()
+        {
+            const InnerNode* inner = static_cast<const InnerNode*>(n);
+            vstats.inner_nodes++;
+
+            tlx_die_unless(inner == root_ || !inner->is_underflow());
+            tlx_die_unless(inner->get_slotuse() > 0);
+
+            for (unsigned short slot = 0; slot < inner->get_slotuse() - 1; ++slot)
+            {
+                tlx_die_unless(
+                    key_lessequal(inner->key(slot), inner->key(slot + 1)));
+            }
+
+            for (unsigned short slot = 0; slot <= inner->get_slotuse(); ++slot)
+            {
+                const node* subnode = inner->get_child(slot);
+                key_type subminkey = key_type();
+                key_type submaxkey = key_type();
+
+                tlx_die_unless(subnode->get_level() + 1 == inner->get_level());
+                verify_node(subnode, &subminkey, &submaxkey, vstats);
+
+                TLX_BTREE_PRINT("verify subnode " << subnode <<
+                                ": " << subminkey <<
+                                " - " << submaxkey);
+
+                if (slot == 0)
+                    *minkey = subminkey;
+                else
+                    tlx_die_unless(
+                        key_greaterequal(subminkey, inner->key(slot - 1)));
+
+                if (slot == inner->get_slotuse())
+                    *maxkey = submaxkey;
+                else
+                    tlx_die_unless(key_equal(inner->key(slot), submaxkey));
+
+                if (inner->get_level() == 1 && slot < inner->get_slotuse())
+                {
+                    // children are leaves and must be linked together in the
+                    // correct order
+                    const LeafNode* leafa = static_cast<const LeafNode*>(
+                        inner->get_child(slot));
+                    const LeafNode* leafb = static_cast<const LeafNode*>(
+                        inner->get_child(slot + 1));
+
+                    tlx_die_unless(leafa->next_leaf == leafb);
+                    tlx_die_unless(leafa == leafb->prev_leaf);
+                }
+                if (inner->get_level() == 2 && slot < inner->get_slotuse())
+                {
+                    // verify leaf links between the adjacent inner nodes
+                    const InnerNode* parenta = static_cast<const InnerNode*>(
+                        inner->get_child(slot));
+                    const InnerNode* parentb = static_cast<const InnerNode*>(
+                        inner->get_child(slot + 1));
+
+                    const LeafNode* leafa = static_cast<const LeafNode*>(
+                        parenta->get_child(parenta->get_slotuse()));
+                    const LeafNode* leafb = static_cast<const LeafNode*>(
+                        parentb->get_child(0));
+
+                    tlx_die_unless(leafa->next_leaf == leafb);
+                    tlx_die_unless(leafa == leafb->prev_leaf);
+                }
+            }
+        }
+    }
+
+    //! Verify the double linked list of leaves.
+    void verify_leaflinks() const {
+        const LeafNode* n = head_leaf_;
+
+        tlx_die_unless(n->get_level() == 0);
+        tlx_die_unless(!n || n->prev_leaf == nullptr);
+
+        unsigned int testcount = 0;
+
+        while (n)
+        {
+            tlx_die_unless(n->get_level() == 0);
+            tlx_die_unless(n->get_slotuse() > 0);
+
+            for (unsigned short slot = 0; slot < n->get_slotuse() - 1; ++slot)
+            {
+                tlx_die_unless(key_lessequal(n->key(slot), n->key(slot + 1)));
+            }
+
+            testcount += n->get_slotuse();
+
+            if (n->next_leaf)
+            {
+                tlx_die_unless(key_lessequal(n->key(n->get_slotuse() - 1),
+                                             n->next_leaf->key(0)));
+
+                tlx_die_unless(n == n->next_leaf->prev_leaf);
+            }
+            else
+            {
+                tlx_die_unless(tail_leaf_ == n);
+            }
+
+            n = n->next_leaf;
+        }
+
+        tlx_die_unless(testcount == size());
+    }
+
+    //! \}
+};
+
+//! \}
+//! \}
+
+} // namespace tlx
+
+#endif // !TLX_CONTAINER_BTREE_HEADER
+
+/******************************************************************************/
\ No newline at end of file
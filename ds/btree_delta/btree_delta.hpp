@@ -0,0 +1,559 @@
+#pragma once
+
+#include "btree.hpp"
+#include "record_manager.h"
+
+#ifdef BTREE_RELAXED_ERASE
+#   ifndef BTREE_RELAXED_STEPS_PER_OP
+#       define BTREE_RELAXED_STEPS_PER_OP 2 // rebalancing steps run by each update
+#   endif
+#endif
+
+template <typename skey_t, typename sval_t, class RecMgr>
+class btree_delta {
+public:
+    //! \name Template Parameter Types
+    //! \{
+
+    //! First template parameter: The key type of the btree. This is stored in
+    //! inner nodes.
+    typedef skey_t key_type;
+
+    //! Second template parameter: The value type associated with each key.
+    //! Stored in the B+ tree's leaves
+    typedef sval_t data_type;
+
+    //! Third template parameter: Key comparison function object
+    typedef std::less<skey_t> key_compare;
+
+    //! Fourth template parameter: Traits object used to define more parameters
+    //! of the B+ tree
+    typedef tlx::btree_default_traits<skey_t, std::pair<skey_t, skey_t> > traits;
+
+    //! Fifth template parameter: STL allocator
+    typedef std::allocator<std::pair<skey_t, skey_t> > allocator_type;
+
+public:
+    //! \name Constructed Types
+    //! \{
+
+    //! Typedef of our own type
+    typedef btree_delta<key_type, data_type, RecMgr> self;
+
+    //! Construct the STL-required value_type as a composition pair of key and
+    //! data types
+    typedef std::pair<key_type, data_type> value_type;
+
+    //! Key Extractor Struct
+    struct key_of_value {
+        //! pull first out of pair
+        static const key_type& get(const value_type& v) { return v.first; }
+    };
+
+    //! Implementation type of the btree_base
+    typedef tlx::BTree<key_type, value_type, key_of_value, RecMgr, key_compare,
+                  traits, false, allocator_type> btree_impl;
+
+    //! Function class comparing two value_type pairs.
+    typedef typename btree_impl::value_compare value_compare;
+
+    //! Size type used to count keys
+    typedef typename btree_impl::size_type size_type;
+
+    //! Small structure containing statistics about the tree
+    typedef typename btree_impl::tree_stats tree_stats;
+
+    //! Node types of the implementation
+    typedef typename btree_impl::LeafNode leaf_type;
+    typedef typename btree_impl::InnerNode inner_type;
+    typedef tlx::leaf_delta<key_type, value_type> delta_type;
+
+    //! \}
+
+public:
+    //! \name Static Constant Options and Values of the B+ Tree
+    //! \{
+
+    //! Base B+ tree parameter: The number of key/data slots in each leaf
+    static const unsigned short leaf_slotmax = btree_impl::leaf_slotmax;
+
+    //! Base B+ tree parameter: The number of key slots in each inner node,
+    //! this can differ from slots in each leaf.
+    static const unsigned short inner_slotmax = btree_impl::inner_slotmax;
+
+    //! Computed B+ tree parameter: The minimum number of key/data slots used
+    //! in a leaf. If fewer slots are used, the leaf will be merged or slots
+    //! shifted from it's siblings.
+    static const unsigned short leaf_slotmin = btree_impl::leaf_slotmin;
+
+    //! Computed B+ tree parameter: The minimum number of key slots used
+    //! in an inner node. If fewer slots are used, the inner node will be
+    //! merged or slots shifted from it's siblings.
+    static const unsigned short inner_slotmin = btree_impl::inner_slotmin;
+
+    //! Debug parameter: Enables expensive and thorough checking of the B+ tree
+    //! invariants after each insert/erase operation.
+    static const bool self_verify = btree_impl::self_verify;
+
+    //! Debug parameter: Prints out lots of debug information about how the
+    //! algorithms change the tree. Requires the header file to be compiled
+    //! with TLX_BTREE_DEBUG and the key type must be std::ostream printable.
+    static const bool debug = btree_impl::debug;
+
+    //! Operational parameter: Allow duplicate keys in the btree.
+    static const bool allow_duplicates = btree_impl::allow_duplicates;
+
+    //! \}
+
+public:
+    //! \name Iterators and Reverse Iterators
+    //! \{
+
+    //! STL-like iterator object for B+ tree items. The iterator points to a
+    //! specific slot number in a leaf.
+    typedef typename btree_impl::iterator iterator;
+
+    //! STL-like iterator object for B+ tree items. The iterator points to a
+    //! specific slot number in a leaf.
+    typedef typename btree_impl::const_iterator const_iterator;
+
+    //! create mutable reverse iterator by using STL magic
+    typedef typename btree_impl::reverse_iterator reverse_iterator;
+
+    //! create constant reverse iterator by using STL magic
+    typedef typename btree_impl::const_reverse_iterator const_reverse_iterator;
+
+    //! \}
+
+private:
+    //! \name Tree Implementation Object
+    //! \{
+
+    //! The contained implementation object
+    btree_impl tree_;
+
+    const unsigned int idx_id;
+    const skey_t KEY_MIN;
+    const skey_t KEY_MAX;
+    const sval_t NO_VALUE;
+	int init[MAX_THREADS_POW2] = {0,};
+    RecMgr* recmgr;
+
+    //! Nodes and delta records replaced or copied by the running operation,
+    //! split by type so they are retired or freed with one batch call per
+    //! type.
+    struct write_set_t {
+        PAD;
+        std::vector<leaf_type*> leaves;
+        std::vector<inner_type*> inner_nodes;
+        std::vector<delta_type*> deltas;
+        PAD;
+    };
+    write_set_t write_set[MAX_THREADS_POW2];
+
+#ifdef BTREE_RELAXED_ERASE
+    //! Relaxed erase: an erase only removes from its leaf and records the key
+    //! if the leaf underflowed. The underflows are repaired later, one shift
+    //! or merge per transaction.
+    struct relaxed_info_t {
+        PAD;
+        std::vector<skey_t> underflows;
+        PAD;
+    };
+    relaxed_info_t relaxed[MAX_THREADS_POW2];
+#endif
+
+    //! \}
+
+public:
+    //! \name Constructors and Destructor
+    //! \{
+
+    //! Default constructor initializing an empty B+ tree with the standard key
+    //! comparison function
+    explicit btree_delta(
+        const int _NUM_THREADS, 
+        const skey_t& _KEY_MIN, 
+        const skey_t& _KEY_MAX, 
+        const sval_t& _VALUE_RESERVED, 
+        unsigned int id) :
+        idx_id(id), 
+        KEY_MIN(_KEY_MIN), 
+        KEY_MAX(_KEY_MAX), 
+        NO_VALUE(_VALUE_RESERVED),  
+        tree_(_NUM_THREADS, allocator_type())
+    { 
+        const int tid = 0;
+        initThread(tid);
+        tree_.recmgr->endOp(tid);
+    }
+
+    //! Frees up all used B+ tree memory pages
+    ~btree_delta()
+    {
+        tree_.clear(0); // while the record manager still owns the nodes
+        delete tree_.recmgr; 
+    }
+
+    RecMgr* debugGetRecMgr()
+    {
+        return tree_.recmgr;
+    }
+
+    void initThread(const int tid)
+    {
+        if (init[tid]) return;
+        else init[tid] = !init[tid];
+        tree_.recmgr->initThread(tid);
+    }
+
+    void deinitThread(const int tid)
+    {
+        if (!init[tid]) return;
+        else init[tid] = !init[tid];
+#ifdef BTREE_RELAXED_ERASE
+        // no other thread repairs this thread's underflows
+        rebalance(tid, -1);
+#endif
+        tree_.recmgr->deinitThread(tid);
+    }
+
+    struct tlx::node* get_root()
+    {
+        return tree_.root_;
+    }
+
+    //! Bulk load a sorted range of (key, value) pairs into the empty tree,
+    //! see BTree::bulk_load. Not safe against concurrent operations.
+    template <typename Iterator>
+    void bulk_load(const int tid, Iterator ibegin, Iterator iend)
+    {
+        tree_.bulk_load(tid, ibegin, iend);
+    }
+
+
+public:
+    //! \name Key and Value Comparison Function Objects
+    //! \{
+
+    //! Constant access to the key comparison object sorting the B+ tree
+    key_compare key_comp() const {
+        return tree_.key_comp();
+    }
+
+    //! Constant access to a constructed value_type comparison object. required
+    //! by the STL
+    value_compare value_comp() const {
+        return tree_.value_comp();
+    }
+
+    //! \}
+
+public:
+    //! \name Allocators
+    //! \{
+
+    //! Return the base node allocator provided during construction.
+    allocator_type get_allocator() const {
+        return tree_.get_allocator();
+    }
+
+    //! \}
+
+public:
+    //! \name STL Access Functions Querying the Tree by Descending to a Leaf
+    //! \{
+
+    //! Tries to locate a key in the B+ tree and returns an iterator to the
+    //! key/data slot if found. If unsuccessful it returns end().
+    sval_t find(const int tid, const skey_t& key) 
+    {
+        auto guard = tree_.recmgr->getGuard(tid, true);
+        const value_type* found = tree_.delta_find(key);
+        if (found == nullptr) {
+            return NO_VALUE;
+        }
+        else {
+            return found->second;
+        }
+    }
+
+    //! Look up keys[0,n) under a single guard and store the value of keys[i],
+    //! or NO_VALUE, in values[i]. The descents are interleaved, see
+    //! btree_impl::delta_find_batch.
+    void find_batch(const int tid, const skey_t* keys, size_t n, sval_t* values)
+    {
+        auto guard = tree_.recmgr->getGuard(tid, true);
+        const value_type* found[btree_impl::find_batch_width];
+        for (size_t base = 0; base < n; base += btree_impl::find_batch_width)
+        {
+            const size_t m = (n - base < btree_impl::find_batch_width)
+                             ? n - base : btree_impl::find_batch_width;
+            tree_.delta_find_batch(keys + base, m, found);
+            for (size_t i = 0; i < m; ++i)
+                values[base + i] = (found[i] == nullptr) ? NO_VALUE : found[i]->second;
+        }
+    }
+
+public:
+    //! \name Public Insertion Functions
+    //! \{
+
+    //! Attempt to insert a key/data pair into the B+ tree. Fails if the pair is
+    //! already present.
+    sval_t insert(const int tid, const skey_t& key, const sval_t& value) 
+    {
+        bool inserted;
+        while (1)
+        {
+            auto guard = tree_.recmgr->getGuard(tid);
+            auto status = tree_.delta_insert(tid, std::make_pair(key, value), &inserted);
+            if (status == btree_impl::delta_done)
+                break;
+            if (status == btree_impl::delta_retry)
+                continue;
+
+            tlx::pc_open<key_type, value_type>(&tree_.root_);
+            inserted = tree_.insert(tid, std::make_pair(key, value)).second;
+            if (pc_finish(tid))
+            {
+                if (inserted)
+                    ++tree_.stats_[tid].size;
+                break;
+            }
+        }
+
+#ifdef BTREE_RELAXED_ERASE
+        rebalance(tid, BTREE_RELAXED_STEPS_PER_OP);
+#endif
+        if (inserted)
+            return NO_VALUE;
+        else
+            return value;
+    }
+
+    //! Insert a key/data pair into the B+ tree, or replace the data of the key
+    //! if it is already present. Returns the replaced data, or NO_VALUE if the
+    //! key was inserted. A replace prepends an update record to the key's
+    //! leaf, or path copies just that leaf when its chain is full.
+    sval_t upsert(const int tid, const skey_t& key, const sval_t& value) 
+    {
+        value_type old;
+        bool replaced;
+        while (1)
+        {
+            {
+                auto guard = tree_.recmgr->getGuard(tid);
+                auto status = tree_.delta_update(tid, std::make_pair(key, value), &old, &replaced);
+                if (status == btree_impl::delta_retry)
+                    continue;
+                if (status == btree_impl::delta_slow)
+                {
+                    tlx::pc_open<key_type, value_type>(&tree_.root_);
+                    replaced = tree_.replace(tid, std::make_pair(key, value), &old);
+                    if (!pc_finish(tid))
+                        continue;
+                }
+            }
+
+            if (replaced)
+                return old.second;
+
+            // absent: insert, unless the key showed up in the meantime
+            if (insert(tid, key, value) == NO_VALUE)
+                return NO_VALUE;
+        }
+    }
+
+    //! \}
+
+public:
+    //! \name Public Erase Functions
+    //! \{
+
+    //! Erases the key/data pairs associated with the given key. For this
+    //! unique-associative map there is no difference to erase().
+    sval_t erase(const int tid, const skey_t& key) 
+    {
+        bool removal_res;
+        while (1)
+        {
+            auto guard = tree_.recmgr->getGuard(tid);
+            auto status = tree_.delta_erase(tid, key, &removal_res);
+            if (status == btree_impl::delta_done)
+                break;
+            if (status == btree_impl::delta_retry)
+                continue;
+
+            tlx::pc_open<key_type, value_type>(&tree_.root_);
+            removal_res = tree_.erase_one(tid, key);
+            if (pc_finish(tid))
+            {
+                if (removal_res)
+                    --tree_.stats_[tid].size;
+                break;
+            }
+        }
+
+#ifdef BTREE_RELAXED_ERASE
+        if (tlx::underflow_res)
+        {
+            tlx::underflow_res = false;
+            relaxed[tid].underflows.push_back(key);
+            ++tree_.stats_[tid].underflows;
+        }
+        rebalance(tid, BTREE_RELAXED_STEPS_PER_OP);
+#endif
+        if (removal_res)
+            return (sval_t)(&key);
+        else
+            return NO_VALUE;
+    }
+
+    //! Erases all key/data pairs with lo <= key <= hi and returns their number.
+    //! The range is erased by one path copy: the subtrees inside the range are
+    //! unlinked whole and retired in one batch with the copied nodes.
+    int erase_range(const int tid, const skey_t& lo, const skey_t& hi) 
+    {
+        size_t erased;
+        while (1)
+        {
+            auto guard = tree_.recmgr->getGuard(tid);
+            tlx::pc_open<key_type, value_type>(&tree_.root_);
+            erased = tree_.erase_range(tid, lo, hi);
+            if (pc_finish(tid))
+            {
+                tree_.stats_[tid].size -= erased;
+                break;
+            }
+        }
+
+#ifdef BTREE_RELAXED_ERASE
+        rebalance(tid, BTREE_RELAXED_STEPS_PER_OP);
+#endif
+        return erased;
+    }
+
+#ifdef BTREE_RELAXED_ERASE
+    //! Run up to max_steps pending rebalancing steps of thread tid (all of
+    //! them if max_steps < 0). Every step is its own transaction, so its write
+    //! set is one shift or merge of two siblings and their parent.
+    void rebalance(const int tid, int max_steps = -1)
+    {
+        auto& underflows = relaxed[tid].underflows;
+        while (!underflows.empty() && max_steps-- != 0)
+        {
+            skey_t key = underflows.back();
+            underflows.pop_back();
+
+            bool more;
+            while (1)
+            {
+                auto guard = tree_.recmgr->getGuard(tid);
+                tlx::pc_open<key_type, value_type>(&tree_.root_);
+                more = tree_.rebalance_one(tid, key);
+                if (pc_finish(tid))
+                    break;
+            }
+
+            if (more)
+                underflows.push_back(key);
+            else
+                --tree_.stats_[tid].underflows;
+        }
+    }
+
+    //! Number of underflows recorded by thread tid and not yet repaired
+    size_t pending_underflows(const int tid)
+    {
+        return relaxed[tid].underflows.size();
+    }
+#endif
+
+    //! \}
+
+private:
+    //! \name Path Copy Transactions
+    //! \{
+
+    //! Publish the path copy opened by the caller. On success the replaced
+    //! nodes and the delta chains of the replaced leaves are retired,
+    //! otherwise the copies are freed and a leaf whose delta records made the
+    //! operation abort is consolidated before the caller retries.
+    bool pc_finish(const int tid)
+    {
+        if (tlx::pc_close<key_type, value_type>(&tree_.root_))
+        {
+            retire_replaced(tid);
+            return true;
+        }
+
+        deallocate_copies(tid);
+
+        tlx::node* leaf = tlx::pc_consolidate;
+        key_type key;
+        if (leaf != nullptr && tree_.delta_key(static_cast<leaf_type*>(leaf), &key))
+        {
+            tlx::pc_open<key_type, value_type>(&tree_.root_);
+            tree_.consolidate(tid, key, static_cast<leaf_type*>(leaf));
+            if (tlx::pc_close<key_type, value_type>(&tree_.root_))
+                retire_replaced(tid);
+            else
+                deallocate_copies(tid);
+        }
+
+        return false;
+    }
+
+    //! Split the nodes in map by type into the write set of thread tid. A
+    //! node's level never changes, so unlike is_leafnode() this reads no
+    //! copy.
+    template <typename Map>
+    write_set_t& split_write_set(const int tid, const Map& map)
+    {
+        write_set_t& ws = write_set[tid];
+        ws.leaves.clear();
+        ws.inner_nodes.clear();
+        for (auto& d : map)
+        {
+            if (d.first->level == 0)
+                ws.leaves.push_back(static_cast<leaf_type*>(d.first));
+            else
+                ws.inner_nodes.push_back(static_cast<inner_type*>(d.first));
+        }
+        return ws;
+    }
+
+    //! Retire the nodes replaced by the operation that just committed, and
+    //! count the nodes it published and replaced in the tree statistics.
+    void retire_replaced(const int tid)
+    {
+        // like the size, node counts change only once an operation commits
+        write_set_t& ws = split_write_set(tid, *tlx::allocated);
+        tree_.stats_[tid].leaves += ws.leaves.size();
+        tree_.stats_[tid].inner_nodes += ws.inner_nodes.size();
+
+        split_write_set(tid, *tlx::duplications);
+        tree_.stats_[tid].leaves -= ws.leaves.size();
+        tree_.stats_[tid].inner_nodes -= ws.inner_nodes.size();
+        tree_.recmgr->retire_batch(tid, ws.leaves.data(), ws.leaves.size());
+        tree_.recmgr->retire_batch(tid, ws.inner_nodes.data(), ws.inner_nodes.size());
+
+        ws.deltas.clear();
+        for (auto& f : *tlx::frozen)
+        {
+            for (tlx::delta_record* d = f.second; d != nullptr; d = d->next)
+                ws.deltas.push_back(static_cast<delta_type*>(d));
+        }
+        tree_.recmgr->retire_batch(tid, ws.deltas.data(), ws.deltas.size());
+    }
+
+    void deallocate_copies(const int tid)
+    {
+        write_set_t& ws = split_write_set(tid, *tlx::allocated);
+        tree_.recmgr->deallocate_batch(tid, ws.leaves.data(), ws.leaves.size());
+        tree_.recmgr->deallocate_batch(tid, ws.inner_nodes.data(), ws.inner_nodes.size());
+    }
+
+    //! \}
+};
\ No newline at end of file
@@ -0,0 +1,951 @@
+#pragma once
+
+#include "die/core.hpp"
+
+// *** Required Headers from the STL
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <utility>
+#include <pthread.h>
+#include <cstdint>
+#include <unordered_map>
+#include <iostream>
+
+#include <sstream>
+
+namespace tlx {
+
+// *** Debugging Macros
+
+#ifdef TLX_BTREE_DEBUG
+
+#include <iostream>
+
+//! Print out debug information to std::cout if TLX_BTREE_DEBUG is defined.
+#define TLX_BTREE_PRINT(x) \
+    do { if (debug) (std::cout << x << std::endl); } while (0)
+
+//! Assertion only if TLX_BTREE_DEBUG is defined. This is not used in verify().
+#define TLX_BTREE_ASSERT(x) \
+    do { assert(x); } while (0)
+
+#else
+
+//! Print out debug information to std::cout if TLX_BTREE_DEBUG is defined.
+#define TLX_BTREE_PRINT(x)          do { } while (0)
+
+//! Assertion only if TLX_BTREE_DEBUG is defined. This is not used in verify().
+#define TLX_BTREE_ASSERT(x)         do { } while (0)
+
+#endif
+
+//! The maximum of a and b. Used in some compile-time formulas.
+#define TLX_BTREE_MAX(a, b)          ((a) < (b) ? (b) : (a))
+
+#ifndef TLX_BTREE_FRIENDS
+//! The macro TLX_BTREE_FRIENDS can be used by outside class to access the B+
+//! tree internals. This was added for wxBTreeDemo to be able to draw the
+//! tree.
+#define TLX_BTREE_FRIENDS           friend class btree_friend
+#endif
+
+#define Innernode inner_node<Key, Value>
+#define Leafnode leaf_node<Key, Value>
+
+const unsigned char DUP_MASK = 0x01;
+const unsigned char DEL_MASK = 0x02;
+const unsigned int MAX_UINT = std::numeric_limits<unsigned int>::max();
+
+#ifndef BTREE_DELTA_CHAIN_MAX
+#define BTREE_DELTA_CHAIN_MAX 8 // delta records on a leaf before it is consolidated
+#endif
+
+const unsigned char DELTA_INSERT = 0x01;
+const unsigned char DELTA_DELETE = 0x02;
+const unsigned char DELTA_UPDATE = 0x03; // new data for a key in the leaf
+
+//! Low bit of a leaf's delta chain head, set while a path copy owns the leaf.
+const uintptr_t DELTA_FROZEN = 0x01;
+
+
+/*!
+ * Generates default traits for a B+ tree used as a set or map. It estimates
+ * leaf and inner node sizes by assuming a cache line multiple of 256 bytes.
+*/
+template <typename Key, typename Value>
+struct btree_default_traits {
+    //! If true, the tree will self verify its invariants after each insert() or
+    //! erase(). The header must have been compiled with TLX_BTREE_DEBUG
+    //! defined.
+    static const bool self_verify = false;
+
+    //! If true, the tree will print out debug information and a tree dump
+    //! during insert() or erase() operation. The header must have been
+    //! compiled with TLX_BTREE_DEBUG defined and key_type must be std::ostream
+    //! printable.
+    static const bool debug = false;
+
+    //! Number of slots in each leaf of the tree. Estimated so that each node
+    //! has a size of about 256 bytes.
+    static const int leaf_slots =
+        TLX_BTREE_MAX(8, 256 / (sizeof(Value)));
+
+    //! Number of slots in each inner node of the tree. Estimated so that each
+    //! node has a size of about 256 bytes.
+    static const int inner_slots =
+        TLX_BTREE_MAX(8, 256 / (sizeof(Key) + sizeof(void*)));
+
+    //! As of stx-btree-0.9, the code does linear search in find_lower() and
+    //! find_upper() instead of binary_search, unless the node size is larger
+    //! than this threshold. See notes at
+    //! http://panthema.net/2013/0504-STX-B+Tree-Binary-vs-Linear-Search
+    static const size_t binsearch_threshold = 256;
+};
+
+class node {
+public:
+    //! Level in the b-tree, if level == 0 -> leaf node
+    unsigned short level;
+
+    //! Number of key slotuse use, so the number of valid children or data
+    //! pointers
+    unsigned short slotuse;
+
+	unsigned char flags;
+    
+	inline bool is_del() { return (flags & DEL_MASK) == DEL_MASK; }
+	inline void set_del() { flags |= DEL_MASK; }
+
+    node();
+
+    //! Delayed initialisation of constructed node.
+    void initialize(const unsigned short l);
+
+    //! True if this is a leaf node.
+    bool is_leafnode() const;
+
+    unsigned short get_level() const;
+
+    unsigned short get_slotuse() const;
+
+    void set_slotuse(unsigned short new_slotuse);
+};
+
+//! A record in the delta chain of a leaf. The chain head is the newest record,
+//! size and length describe the leaf once this record is applied.
+class delta_record {
+public:
+    unsigned char kind;
+
+    //! Number of (key, data) pairs in the leaf with the chain applied
+    unsigned short size;
+
+    //! Number of records in the chain up to and including this one
+    unsigned short length;
+
+    delta_record* next;
+};
+
+//! Delta record carrying the (key, data) pair inserted into or deleted from a
+//! leaf.
+template <typename Key, typename Value>
+class leaf_delta : public delta_record {
+public:
+    Value slotdata;
+};
+
+//! Common part of all leaves, independent of the key and data types.
+class leaf_base : public node {
+public:
+    //! Newest delta record of the leaf, prepended by CAS. The base slots are
+    //! never written in place, updates that cannot be expressed as a delta
+    //! freeze the chain and replace the leaf by a path copy.
+    delta_record* delta_head;
+};
+
+//! Extended structure of a inner node in-memory. Contains only keys and no
+//! data items.
+template <typename Key, typename Value>
+class inner_node : public node {
+public:
+    //! Keys of children or data pointers
+    Key slotkey[btree_default_traits<Key, Value>::inner_slots]; // NOLINT
+
+    //! Pointers to children
+    node * childid[btree_default_traits<Key, Value>::inner_slots + 1]; // NOLINT
+
+    //! Set variables to initial values.
+    void initialize(const unsigned short l);
+
+    //! Return key in slot s
+    const Key& key(size_t s) const;
+
+    //! True if the node's slots are full.
+    bool is_full() const;
+    //! True if few used entries, less than half full.
+    bool is_few() const ;
+
+    //! True if node has too few entries.
+    bool is_underflow() const;
+
+    node * get_child(unsigned short slot) const;
+
+    node ** get_childid_vec();
+
+    void set_child(unsigned short slot, node * new_child);
+
+    void copy_to_childid(node ** src_first, node ** src_last, node ** dst_last);
+
+    void copy_backward_to_childid(node ** src_first, node ** src_last, node ** dst_last);
+
+    Key get_slotkey(unsigned short slot) const;
+
+    Key * get_slotkey_vec();
+
+    void set_slotkey(unsigned short slot, Key new_key);
+
+    void copy_to_slotkey(Key * src_first, Key * src_last, Key * dst_last);
+
+    void copy_backward_to_slotkey(Key * src_first, Key * src_last, Key * dst_last);
+
+    //! Copy the header and the used slots of other. The unused tails of the
+    //! key and child arrays are left as they are.
+    void copy_live(const inner_node* other);
+};
+
+//! Extended structure of a leaf node in memory. Contains pairs of keys and
+//! data items. Key and data slots are kept together in value_type.
+template <typename Key, typename Value>
+class leaf_node : public leaf_base {
+public:
+    //! Double linked list pointers to traverse the leaves
+    leaf_node* prev_leaf;
+
+    //! Double linked list pointers to traverse the leaves
+    leaf_node* next_leaf;
+
+    //! Array of (key, data) pairs
+    Value slotdata[btree_default_traits<Key, Value>::leaf_slots]; // NOLINT
+
+    //! Set variables to initial values
+    void initialize();
+
+    //! Return key in slot s.
+    const Key& key(size_t s) const;
+
+    //! True if the node's slots are full.
+    bool is_full() const;
+
+    //! True if few used entries, less than half full.
+    bool is_few() const;
+
+    //! True if node has too few entries.
+    bool is_underflow() const;
+
+    Value get_slot(unsigned short slot) const;
+
+    Value& get_slot(unsigned short slot);
+
+    Value * get_slotdata_vec();
+
+    //! Set the (key,data) pair in slot. Overloaded function used by
+    //! bulk_load().
+    void set_slot(unsigned short slot, const Value& value);
+
+    void copy_to_slotdata(Value * src_first, Value * src_last, Value * dst_last);
+
+    void copy_backward_to_slotdata(Value * src_first, Value * src_last, Value * dst_last);
+
+    //! Copy the header of other but none of its slots.
+    void copy_header(const leaf_node* other);
+};
+
+
+class duplication_info_t
+{
+public:
+	node* dup;
+	node* orig_parent;
+	unsigned int orig_idx;
+};
+
+class path_info_t
+{
+public:
+    node* child;
+    node* parent;
+    unsigned int child_idx;
+};
+
+thread_local std::unordered_map<node*, node*>* duplications = nullptr;
+
+thread_local std::unordered_map<node*, std::pair<node*, unsigned short>>* node_parent_map = nullptr;
+
+thread_local std::unordered_map<node*, bool>* allocated = nullptr;
+
+thread_local bool in_writing_function = false;
+
+thread_local bool pc_happened = false;
+
+//! Set when the operation read or tried to copy a leaf that has delta records,
+//! its base slots are stale and the path copy is not published.
+thread_local bool pc_abort = false;
+
+//! Leaf to consolidate before the aborted operation is retried.
+thread_local node* pc_consolidate = nullptr;
+
+//! Set while the path copy consolidates a leaf, only then may a leaf with delta
+//! records be copied.
+thread_local bool consolidating = false;
+
+//! Leaves replaced or removed by this operation, with the chain head each one
+//! was copied with. They are frozen at that head when the operation commits.
+thread_local std::unordered_map<node*, delta_record*>* frozen = nullptr;
+
+thread_local node* orig_root;
+
+thread_local node* new_root;
+
+inline bool delta_is_frozen(const delta_record* head)
+{
+    return ((uintptr_t)head & DELTA_FROZEN) != 0;
+}
+
+//! The delta chain of a leaf, without the frozen mark.
+inline delta_record* delta_chain(const node* n)
+{
+    delta_record* head = __atomic_load_n(&static_cast<const leaf_base*>(n)->delta_head, __ATOMIC_ACQUIRE);
+    return (delta_record*)((uintptr_t)head & ~DELTA_FROZEN);
+}
+
+//! Called on every read of a leaf by a writing function. The base slots are
+//! only the contents of a leaf while its delta chain is empty.
+inline void delta_check(const node* n)
+{
+    if (!in_writing_function || pc_abort || n->level != 0)
+        return;
+
+    node * orig = (node*)n;
+    if (duplications->find(orig) != duplications->end() ||
+        allocated->find(orig) != allocated->end())
+        return;
+
+    delta_record* head = __atomic_load_n(&static_cast<const leaf_base*>(n)->delta_head, __ATOMIC_ACQUIRE);
+    if (head != nullptr)
+    {
+        pc_abort = true;
+        if (!delta_is_frozen(head))
+            pc_consolidate = orig;
+    }
+}
+
+//! Record the delta chain head of a leaf that this operation replaces or
+//! removes. Only a consolidation may replace a leaf that has delta records.
+inline bool delta_claim(node* n)
+{
+    if (frozen->find(n) != frozen->end())
+        return true;
+
+    delta_record* head = __atomic_load_n(&static_cast<leaf_base*>(n)->delta_head, __ATOMIC_ACQUIRE);
+    if (!delta_is_frozen(head) && (head == nullptr || consolidating))
+    {
+        frozen->insert({n, head});
+        return true;
+    }
+
+    pc_abort = true;
+    if (head != nullptr && !delta_is_frozen(head))
+        pc_consolidate = n;
+    return false;
+}
+
+//! Freeze the claimed leaves at the heads they were copied with, so that no
+//! delta record is added to them after the commit. The freeze happens right
+//! before the root is swung, to keep the window in which writers of these
+//! leaves have to wait short. Returns false if a leaf got a new record.
+inline bool delta_freeze()
+{
+    for (auto& f : *frozen)
+    {
+        delta_record* head = f.second;
+        if (!__atomic_compare_exchange_n(&static_cast<leaf_base*>(f.first)->delta_head, &head,
+                (delta_record*)((uintptr_t)f.second | DELTA_FROZEN),
+                false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            // undo the leaves frozen so far
+            for (auto& g : *frozen)
+            {
+                if (g.first == f.first)
+                    break;
+                __atomic_store_n(&static_cast<leaf_base*>(g.first)->delta_head, g.second, __ATOMIC_RELEASE);
+            }
+
+            if (!delta_is_frozen(head))
+                pc_consolidate = f.first;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//! Copy the (key, data) pairs of a leaf with the delta chain starting at head
+//! applied to out, returns their number.
+template <typename Key, typename Value>
+unsigned short read_leaf(const Leafnode* leaf, const delta_record* head, Value* out)
+{
+    const delta_record* chain[BTREE_DELTA_CHAIN_MAX];
+    unsigned short length = 0;
+    for (const delta_record* d = head; d != nullptr; d = d->next)
+        chain[length++] = d;
+
+    unsigned short size = leaf->slotuse;
+    std::copy(leaf->slotdata, leaf->slotdata + size, out);
+
+    // oldest record first
+    while (length > 0)
+    {
+        auto d = static_cast<const leaf_delta<Key, Value>*>(chain[--length]);
+        Value* pos = std::lower_bound(out, out + size, d->slotdata,
+            [](const Value& a, const Value& b) { return a.first < b.first; });
+
+        if (d->kind == DELTA_INSERT)
+        {
+            std::copy_backward(pos, out + size, out + size + 1);
+            *pos = d->slotdata;
+            ++size;
+        }
+        else if (d->kind == DELTA_UPDATE)
+        {
+            *pos = d->slotdata;
+        }
+        else
+        {
+            std::copy(pos + 1, out + size, pos);
+            --size;
+        }
+    }
+
+    return size;
+}
+
+template <typename Key, typename Value>
+void pseudo_print_tree(node * n, int num_tabs, std::stringstream& total)
+{
+    if (!n)
+        return;
+
+    if (n->is_leafnode())
+    {
+        Leafnode * ln = static_cast<Leafnode *>(n);
+        for (int j = 0; j < num_tabs; j++)
+        {
+            total << "\t";
+        }
+        total << ln << "\n";
+        for (int i = 0; i < ln->slotuse; i++)
+        {
+            for (int j = 0; j < num_tabs + 1; j++)
+            {
+                total << "\t";
+            }
+            total << ln->slotdata[i].first << "\n";
+        }
+    }
+    else
+    {
+        Innernode * in = static_cast<Innernode *>(n);
+        for (int j = 0; j < num_tabs; j++)
+        {
+            total << "\t";
+        }
+        total << in << "\n";
+        for (int i = 0; i < in->slotuse; i++)
+        {
+            for (int j = 0; j < num_tabs; j++)
+            {
+                total << "\t";
+            }
+            total << in->slotkey[i] << "\n";
+        }
+        for (int i = 0; i <= in->slotuse; i++)
+        {
+            pseudo_print_tree<Key, Value>(in->childid[i], num_tabs + 1, total);
+        }
+    }
+}
+
+template <typename Key, typename Value>
+void print_tree(node * n, int num_tabs)
+{
+    if (!n)
+        return;
+
+    if (n->is_leafnode())
+    {
+        Leafnode * ln = static_cast<Leafnode *>(n);
+        for (int j = 0; j < num_tabs; j++)
+        {
+            std::cout << "\t";
+        }
+        std::cout << ln << std::endl;
+        for (int i = 0; i < ln->slotuse; i++)
+        {
+            for (int j = 0; j < num_tabs + 1; j++)
+            {
+                std::cout << "\t";
+            }
+            std::cout << ln->slotdata[i].first << std::endl;
+        }
+    }
+    else
+    {
+        Innernode * in = static_cast<Innernode *>(n);
+        for (int j = 0; j < num_tabs; j++)
+        {
+            std::cout << "\t";
+        }
+        std::cout << in << std::endl;
+        for (int i = 0; i < in->slotuse; i++)
+        {
+            for (int j = 0; j < num_tabs; j++)
+            {
+                std::cout << "\t";
+            }
+            std::cout << in->slotkey[i] << std::endl;
+        }
+        for (int i = 0; i <= in->slotuse; i++)
+        {
+            if (in->childid[i] == 0 || in == in->childid[i])
+            {
+                std::cout << "error " << in << "->childid[" << i << "] == " << in->childid[i] << std::endl;
+            }
+            else
+            {
+                print_tree<Key, Value>(in->childid[i], num_tabs + 1);
+            }
+        }
+    }
+}
+
+template <typename Key, typename Value>
+bool pc_open(node** root)
+{
+	if (duplications)
+		duplications->clear();
+	else
+		duplications = new std::unordered_map<node*, node*>();
+
+    if (node_parent_map)
+		node_parent_map->clear();
+	else
+		node_parent_map = new std::unordered_map<node*, std::pair<node*, unsigned short>>();
+
+    if (allocated)
+        allocated->clear();
+    else
+        allocated = new std::unordered_map<node*, bool>();
+
+    if (frozen)
+        frozen->clear();
+    else
+        frozen = new std::unordered_map<node*, delta_record*>();
+
+	// orig_root = *root;
+    __atomic_load(root, &orig_root, __ATOMIC_RELAXED);
+	new_root = orig_root;
+	in_writing_function = true;
+	pc_happened = false;
+	pc_abort = false;
+	pc_consolidate = nullptr;
+	return true;
+}
+
+template <typename Key, typename Value>
+bool pc_close(node** root)
+{
+	in_writing_function = false;
+
+	if (pc_abort || !delta_freeze())
+	{
+		return false;
+	}
+
+	if (pc_happened)
+	{
+		if (__atomic_compare_exchange_n(
+            root, 
+            &orig_root, 
+            new_root, 
+            true, 
+            __ATOMIC_RELAXED, 
+            __ATOMIC_RELAXED))
+        {
+            return true;
+        }
+
+        /* leaves that were not replaced take delta records again */
+        for (auto& f : *frozen)
+            __atomic_store_n(&static_cast<leaf_base*>(f.first)->delta_head, f.second, __ATOMIC_RELEASE);
+        return false;
+	}
+	else
+	{
+		return true;
+	}
+}
+
+node::node()
+{
+    // new nodes are tracked by BTree::allocate_node(): a pool constructs
+    // records a block at a time, not when the operation takes one
+}
+
+void node::initialize(const unsigned short l) {
+    level = l;
+    slotuse = 0;
+    flags = 0;
+}
+
+bool node::is_leafnode() const {
+    node * orig = (node*)this;
+    if (in_writing_function && duplications->find(orig) != duplications->end())
+    {
+        auto found = duplications->at(orig);
+        return (found->level == 0);
+    }
+
+    return (level == 0);
+}
+
+unsigned short node::get_level() const 
+{
+    node * orig = (node*)this;
+    if (in_writing_function && duplications->find(orig) != duplications->end())
+    {
+        auto found = duplications->at(orig);
+        return found->level;
+    }
+    
+    return level;
+}
+
+unsigned short node::get_slotuse() const 
+{
+    delta_check(this);
+    node * orig = (node*)this;
+    if (in_writing_function && duplications->find(orig) != duplications->end())
+    {
+        auto found = duplications->at(orig);
+        return found->slotuse;
+    }
+
+    return slotuse;
+}
+
+void node::set_slotuse(unsigned short new_slotuse) {
+    slotuse = new_slotuse;
+}
+
+
+
+template <typename Key, typename Value>
+void Innernode::initialize(const unsigned short l) {
+    node::initialize(l);
+}
+
+template <typename Key, typename Value>
+const Key& Innernode::key(size_t s) const {
+    node * orig = (node*)this;
+    if (in_writing_function && duplications->find(orig) != duplications->end())
+    {
+        auto found = duplications->at(orig);
+        return ((Innernode*)found)->slotkey[s];
+    }
+
+    return slotkey[s];
+}
+
+template <typename Key, typename Value>
+bool Innernode::is_full() const {
+    node * orig = (node*)this;
+    if (in_writing_function && duplications->find(orig) != duplications->end())
+    {
+        auto found = duplications->at(orig);
+        return (found->slotuse == btree_default_traits<Key, Value>::inner_slots);
+    }
+
+    return (node::slotuse == btree_default_traits<Key, Value>::inner_slots);
+}
+
+template <typename Key, typename Value>
+bool Innernode::is_few() const {
+    node * orig = (node*)this;
+    if (in_writing_function && duplications->find(orig) != duplications->end())
+    {
+        auto found = duplications->at(orig);
+        return (found->slotuse <= btree_default_traits<Key, Value>::inner_slots / 2);
+    }
+
+    return (node::slotuse <= btree_default_traits<Key, Value>::inner_slots / 2);
+}
+
+template <typename Key, typename Value>
+bool Innernode::is_underflow() const {
+#ifdef BTREE_TOPDOWN_SPLIT
+    // splitting a full inner node ahead of the descent leaves one half a slot
+    // short of the usual minimum
+    const unsigned short slotmin = btree_default_traits<Key, Value>::inner_slots / 2 - 1;
+#else
+    const unsigned short slotmin = btree_default_traits<Key, Value>::inner_slots / 2;
+#endif
+    node * orig = (node*)this;
+    if (in_writing_function && duplications->find(orig) != duplications->end())
+    {
+        auto found = duplications->at(orig);
+        return (found->slotuse < slotmin);
+    }
+
+    return (node::slotuse < slotmin);
+}
+
+template <typename Key, typename Value>
+node * Innernode::get_child(unsigned short slot) const 
+{
+    node* child = childid[slot];
+    if (in_writing_function)
+    {
+        node * orig = (node*)this;
+        if (duplications->find(orig) != duplications->end())
+        {
+            node* dup = (duplications->at(orig));
+            child = ((Innernode*)dup)->childid[slot];
+            node_parent_map->insert(
+                std::make_pair<node*, std::pair<node*, unsigned short>>(
+                    (node*)child, std::make_pair<node*, unsigned short>(
+                        (node*)dup, (unsigned short)slot)));
+        }
+        else
+        {
+            node_parent_map->insert(
+                std::make_pair<node*, std::pair<node*, unsigned short>>(
+                    (node*)child, std::make_pair<node*, unsigned short>(
+                        (node*)this, (unsigned short)slot)));
+        }
+    }
+
+    return child;
+}
+
+template <typename Key, typename Value>
+node ** Innernode::get_childid_vec() 
+{
+    node * orig = (node*)this;
+    if (in_writing_function && duplications->find(orig) != duplications->end())
+    {
+        auto found = duplications->at(orig);
+        return ((Innernode*)found)->childid;
+    }
+
+    return childid;
+}
+
+template <typename Key, typename Value>
+void Innernode::set_child(unsigned short slot, node * new_child) {
+    childid[slot] = new_child;
+}
+
+template <typename Key, typename Value>
+void Innernode::copy_to_childid(node ** src_first, node ** src_last, node ** dst_last) {
+    std::copy(src_first, src_last, dst_last);
+}
+
+template <typename Key, typename Value>
+void Innernode::copy_backward_to_childid(node ** src_first, node ** src_last,  node ** dst_last) {
+    // std::memcpy((void*)(childid + offset), (void *)src_first, (long long int)src_last - (long long int)src_first);
+    std::copy_backward(src_first, src_last, dst_last);
+}
+
+template <typename Key, typename Value>
+Key Innernode::get_slotkey(unsigned short slot) const 
+{
+    node * orig = (node*)this;
+    if (in_writing_function && duplications->find(orig) != duplications->end())
+    {
+        auto found = duplications->at(orig);
+        return ((Innernode*)found)->slotkey[slot];
+    }
+
+    return slotkey[slot];
+}
+
+template <typename Key, typename Value>
+Key * Innernode::get_slotkey_vec() 
+{
+    node * orig = (node*)this;
+    if (in_writing_function && duplications->find(orig) != duplications->end())
+    {
+        auto found = duplications->at(orig);
+        return &((Innernode*)found)->slotkey[0];
+    }
+
+    return &slotkey[0];
+}
+
+template <typename Key, typename Value>
+void Innernode::set_slotkey(unsigned short slot, Key new_key) {
+    slotkey[slot] = new_key;
+}
+
+template <typename Key, typename Value>
+void Innernode::copy_to_slotkey(Key * src_first, Key * src_last, Key * dst_last) {
+    std::copy(src_first, src_last, dst_last);
+}
+
+template <typename Key, typename Value>
+void Innernode::copy_backward_to_slotkey(Key * src_first, Key * src_last, Key * dst_last) {
+    std::copy_backward(src_first, src_last, dst_last);
+}
+
+template <typename Key, typename Value>
+void Innernode::copy_live(const inner_node* other) {
+    // slotkey directly follows the header, childid is copied apart
+    std::memcpy((void*)this, (const void*)other,
+                (const char*)&other->slotkey[other->slotuse] - (const char*)other);
+    std::memcpy((void*)childid, (const void*)other->childid,
+                (other->slotuse + 1) * sizeof(node*));
+}
+
+
+
+template <typename Key, typename Value>
+void Leafnode::initialize() {
+    node::initialize(0);
+    delta_head = nullptr;
+    prev_leaf = next_leaf = nullptr;
+}
+
+template <typename Key, typename Value>
+const Key& Leafnode::key(size_t s) const {
+    delta_check(this);
+    node * orig = (node*)this;
+    if (in_writing_function && duplications->find(orig) != duplications->end())
+    {
+        auto found = duplications->at(orig);
+        return ((Leafnode*)found)->slotdata[s].first;
+    }
+
+    return slotdata[s].first;
+}
+
+template <typename Key, typename Value>
+bool Leafnode::is_full() const {
+    delta_check(this);
+    node * orig = (node*)this;
+    if (in_writing_function && duplications->find(orig) != duplications->end())
+    {
+        auto found = duplications->at(orig);
+        return (found->slotuse == btree_default_traits<Key, Value>::leaf_slots);
+    }
+
+    return (node::slotuse == btree_default_traits<Key, Value>::leaf_slots);
+}
+
+template <typename Key, typename Value>
+bool Leafnode::is_few() const {
+    delta_check(this);
+    node * orig = (node*)this;
+    if (in_writing_function && duplications->find(orig) != duplications->end())
+    {
+        auto found = duplications->at(orig);
+        return (found->slotuse <= btree_default_traits<Key, Value>::leaf_slots / 2);
+    }
+
+    return (node::slotuse <= btree_default_traits<Key, Value>::leaf_slots / 2);
+}
+
+template <typename Key, typename Value>
+bool Leafnode::is_underflow() const {
+    delta_check(this);
+    node * orig = (node*)this;
+    if (in_writing_function && duplications->find(orig) != duplications->end())
+    {
+        auto found = duplications->at(orig);
+        return (found->slotuse < btree_default_traits<Key, Value>::leaf_slots / 2);
+    }
+
+    return (node::slotuse < btree_default_traits<Key, Value>::leaf_slots / 2);
+}
+
+template <typename Key, typename Value>
+Value Leafnode::get_slot(unsigned short slot) const 
+{
+    delta_check(this);
+    node * orig = (node*)this;
+    if (in_writing_function && duplications->find(orig) != duplications->end())
+    {
+        auto found = duplications->at(orig);
+        return ((Leafnode*)found)->slotdata[slot];
+    }
+
+    return slotdata[slot];
+}
+
+template <typename Key, typename Value>
+Value& Leafnode::get_slot(unsigned short slot) 
+{
+    delta_check(this);
+    node * orig = (node*)this;
+    if (in_writing_function && duplications->find(orig) != duplications->end())
+    {
+        auto found = duplications->at(orig);
+        return ((Leafnode*)found)->slotdata[slot];
+    }
+
+    return slotdata[slot];
+}
+
+template <typename Key, typename Value>
+Value * Leafnode::get_slotdata_vec() 
+{
+    delta_check(this);
+    node * orig = (node*)this;
+    if (in_writing_function && duplications->find(orig) != duplications->end())
+    {
+        auto found = duplications->at(orig);
+        return &((Leafnode*)found)->slotdata[0];
+    }
+
+    return &slotdata[0];
+}
+
+template <typename Key, typename Value>
+void Leafnode::set_slot(unsigned short slot, const Value& value) {
+    TLX_BTREE_ASSERT(slot < node::slotuse);
+    slotdata[slot] = value;
+}
+
+template <typename Key, typename Value>
+void Leafnode::copy_to_slotdata(Value * src_first, Value * src_last, Value * dst_last) {
+    std::copy(src_first, src_last, dst_last);
+}
+
+template <typename Key, typename Value>
+void Leafnode::copy_backward_to_slotdata(Value * src_first, Value * src_last, Value * dst_last) {
+    std::copy_backward(src_first, src_last, dst_last);
+}
+
+template <typename Key, typename Value>
+void Leafnode::copy_header(const leaf_node* other) {
+    std::memcpy((void*)this, (const void*)other,
+                (const char*)&other->slotdata[0] - (const char*)other);
+}
+
+} // namespace tlx
\ No newline at end of file
@@ -12,6 +12,10 @@
 #include <csignal>
 #include "errors.h"
 #include "random_fnv1a.h"
+#include <vector>
+#ifdef _OPENMP
+#   include <omp.h>
+#endif
 #ifdef USE_TREE_STATS
 #   define TREE_STATS_BYTES_AT_DEPTH
 #   include "tree_stats.h"
@@ -19,7 +23,11 @@
 #include "btree_dup.hpp"
 #include <iostream>
 
+#ifdef RECORD_MANAGER_SIZE_CLASSES
+#define RECORD_MANAGER_T record_manager<Reclaim, Alloc, Pool, size_class<tlx::inner_node<K, std::pair<K,V>>, tlx::leaf_node<K, std::pair<K,V>>>>
+#else
 #define RECORD_MANAGER_T record_manager<Reclaim, Alloc, Pool, tlx::inner_node<K, std::pair<K,V>>, tlx::leaf_node<K, std::pair<K,V>>>
+#endif
 #define DATA_STRUCTURE_T btree_dup<K, V, RECORD_MANAGER_T>
 
 template <typename K, typename V, class Reclaim = reclaimer_debra<K>, class Alloc = allocator_new<K>, class Pool = pool_none<K>>
@@ -37,6 +45,33 @@ public:
     : NO_VALUE(VALUE_RESERVED)
     , ds(new DATA_STRUCTURE_T(NUM_THREADS, KEY_MIN, KEY_MAX, NO_VALUE, 0 /* unused */))
     {}
+    // bulk loads the initNumKeys sorted keys in initKeys (see
+    // prefillWithArrayConstruction in microbench/main.cpp)
+    ds_adapter(const int NUM_THREADS,
+               const K& KEY_MIN,
+               const K& KEY_MAX,
+               const V& VALUE_RESERVED,
+               RandomFNV1A * const unused2,
+               const K * const initKeys,
+               const V * const initValues,
+               const size_t initNumKeys,
+               const size_t unused3)
+    : NO_VALUE(VALUE_RESERVED)
+    , ds(new DATA_STRUCTURE_T(NUM_THREADS, KEY_MIN, KEY_MAX, NO_VALUE, 0 /* unused */))
+    {
+        std::vector<std::pair<K,V>> items(initNumKeys);
+        #pragma omp parallel
+        {
+#ifdef _OPENMP
+            ds->initThread(omp_get_thread_num());
+#endif
+            #pragma omp for schedule(static)
+            for (size_t i = 0; i < initNumKeys; ++i) {
+                items[i] = std::make_pair(initKeys[i], initValues[i]);
+            }
+        }
+        ds->bulk_load(0, items.begin(), items.end());
+    }
     ~ds_adapter() {
         delete ds;
     }
@@ -53,7 +88,7 @@ public:
     }
 
     V insert(const int tid, const K& key, const V& val) {
-        setbench_error("insert-replace functionality not implemented for this data structure");
+        return ds->upsert(tid, key, val);
     }
     V insertIfAbsent(const int tid, const K& key, const V& val) {
         return ds->insert(tid, key, val);
@@ -64,11 +99,20 @@ public:
     V find(const int tid, const K& key) {
         return ds->find(tid, key);
     }
+    // looks up keys[0..n) with interleaved descents, values[i] gets the
+    // value of keys[i] or getNoValue()
+    void find_batch(const int tid, const K * const keys, const size_t n, V * const values) {
+        ds->find_batch(tid, keys, n, values);
+    }
     bool contains(const int tid, const K& key) {
         return find(tid, key) != getNoValue();
     }
     int rangeQuery(const int tid, const K& lo, const K& hi, K * const resultKeys, V * const resultValues) {
-        setbench_error("not implemented");
+        return ds->range_query(tid, lo, hi, resultKeys, resultValues);
+    }
+    // erases every key in [lo, hi], returns how many were erased
+    int erase_range(const int tid, const K& lo, const K& hi) {
+        return ds->erase_range(tid, lo, hi);
     }
     void printSummary() {
         // ds->printTree();
@@ -11,17 +11,25 @@
 #define TLX_CONTAINER_BTREE_HEADER
 
 #include "btree_node.hpp"
+#include "btree_search.h"
+#include "sharded_stats.h"
+#include "prefetching.h"
 
 // *** Required Headers from the STL
 
 #include <algorithm>
 #include <cassert>
 #include <cstddef>
+#include <deque>
 #include <functional>
 #include <istream>
 #include <memory>
 #include <ostream>
 #include <utility>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include <vector>
 
 namespace tlx {
 
@@ -31,6 +39,16 @@ namespace tlx {
 //! B+ tree variants
 //! \{
 
+#ifdef BTREE_RELAXED_ERASE
+//! Set while erase_one_descend() runs as a lazy rebalancing step: nothing is
+//! removed, only the topmost underflowing node on the path is repaired.
+thread_local bool rebalancing = false;
+
+//! Set by erase_one_descend() when an underflow was left behind for a later
+//! rebalancing step.
+thread_local bool underflow_res = false;
+#endif
+
 thread_local bool locking_res = true;
 
 /*!
@@ -187,6 +205,12 @@ public:
         //! Current key/data slot referenced
         unsigned short curr_slot;
 
+#ifdef BTREE_SOA_LEAF
+        //! Keys and data sit in separate leaf arrays, so dereferencing
+        //! assembles the pair here.
+        mutable value_type temp_value;
+#endif
+
         //! Friendly to the const_iterator, so it may access the two data items
         //! directly.
         friend class const_iterator;
@@ -230,12 +254,22 @@ public:
         //! Dereference the iterator.
         reference operator * () const {
             auto bla = curr_leaf->get_slot(0);             
+#ifdef BTREE_SOA_LEAF
+            temp_value = curr_leaf->get_slot(curr_slot);
+            return temp_value;
+#else
             return curr_leaf->get_slot(curr_slot);
+#endif
         }
 
         //! Dereference the iterator.
         pointer operator -> () const {
+#ifdef BTREE_SOA_LEAF
+            temp_value = curr_leaf->get_slot(curr_slot);
+            return &temp_value;
+#else
             return &curr_leaf->get_slot(curr_slot);
+#endif
         }
 
         //! Key of the current slot.
@@ -363,6 +397,12 @@ public:
         //! Current key/data slot referenced
         unsigned short curr_slot;
 
+#ifdef BTREE_SOA_LEAF
+        //! Keys and data sit in separate leaf arrays, so dereferencing
+        //! assembles the pair here.
+        mutable value_type temp_value;
+#endif
+
         //! Friendly to the reverse_const_iterator, so it may access the two
         //! data items directly
         friend class const_reverse_iterator;
@@ -402,12 +442,22 @@ public:
 
         //! Dereference the iterator.
         reference operator * () const {
+#ifdef BTREE_SOA_LEAF
+            temp_value = curr_leaf->get_slot(curr_slot);
+            return temp_value;
+#else
             return curr_leaf->get_slot(curr_slot);
+#endif
         }
 
         //! Dereference the iterator.
         pointer operator -> () const {
+#ifdef BTREE_SOA_LEAF
+            temp_value = curr_leaf->get_slot(curr_slot);
+            return &temp_value;
+#else
             return &curr_leaf->get_slot(curr_slot);
+#endif
         }
 
         //! Key of the current slot.
@@ -535,6 +585,12 @@ public:
         //! One slot past the current key/data slot referenced.
         unsigned short curr_slot;
 
+#ifdef BTREE_SOA_LEAF
+        //! Keys and data sit in separate leaf arrays, so dereferencing
+        //! assembles the pair here.
+        mutable value_type temp_value;
+#endif
+
         //! Friendly to the const_iterator, so it may access the two data items
         //! directly
         friend class iterator;
@@ -573,13 +629,23 @@ public:
         //! Dereference the iterator.
         reference operator * () const {
             TLX_BTREE_ASSERT(curr_slot > 0);
+#ifdef BTREE_SOA_LEAF
+            temp_value = curr_leaf->get_slot(curr_slot - 1);
+            return temp_value;
+#else
             return curr_leaf->get_slot(curr_slot - 1);
+#endif
         }
 
         //! Dereference the iterator.
         pointer operator -> () const {
             TLX_BTREE_ASSERT(curr_slot > 0);
+#ifdef BTREE_SOA_LEAF
+            temp_value = curr_leaf->get_slot(curr_slot - 1);
+            return &temp_value;
+#else
             return &curr_leaf->get_slot(curr_slot - 1);
+#endif
         }
 
         //! Key of the current slot.
@@ -708,6 +774,12 @@ public:
         //! One slot past the current key/data slot referenced.
         unsigned short curr_slot;
 
+#ifdef BTREE_SOA_LEAF
+        //! Keys and data sit in separate leaf arrays, so dereferencing
+        //! assembles the pair here.
+        mutable value_type temp_value;
+#endif
+
         //! Friendly to the const_iterator, so it may access the two data items
         //! directly.
         friend class reverse_iterator;
@@ -749,13 +821,23 @@ public:
         //! Dereference the iterator.
         reference operator * () const {
             TLX_BTREE_ASSERT(curr_slot > 0);
+#ifdef BTREE_SOA_LEAF
+            temp_value = curr_leaf->get_slot(curr_slot - 1);
+            return temp_value;
+#else
             return curr_leaf->get_slot(curr_slot - 1);
+#endif
         }
 
         //! Dereference the iterator.
         pointer operator -> () const {
             TLX_BTREE_ASSERT(curr_slot > 0);
+#ifdef BTREE_SOA_LEAF
+            temp_value = curr_leaf->get_slot(curr_slot - 1);
+            return &temp_value;
+#else
             return &curr_leaf->get_slot(curr_slot - 1);
+#endif
         }
 
         //! Key of the current slot.
@@ -867,6 +949,10 @@ public:
         //! Number of inner nodes in the B+ tree
         size_type inner_nodes;
 
+        //! Number of underflowing nodes left behind by relaxed erases and not
+        //! yet repaired by a rebalancing step
+        size_type underflows;
+
         //! Base B+ tree parameter: The number of key/data slots in each leaf
         static const unsigned short leaf_slots = Self::leaf_slotmax;
 
@@ -876,7 +962,7 @@ public:
         //! Zero initialized
         tree_stats()
             : size(0),
-              leaves(0), inner_nodes(0)
+              leaves(0), inner_nodes(0), underflows(0)
         { }
 
         //! Return the total number of nodes
@@ -888,6 +974,15 @@ public:
         double avgfill_leaves() const {
             return static_cast<double>(size) / (leaves * leaf_slots);
         }
+
+        //! Add the counts of another shard
+        tree_stats& operator += (const tree_stats& other) {
+            size += other.size;
+            leaves += other.leaves;
+            inner_nodes += other.inner_nodes;
+            underflows += other.underflows;
+            return *this;
+        }
     };
 
     //! \}
@@ -907,8 +1002,8 @@ public:
     //! Pointer to last leaf in the double linked leaf chain.
     LeafNode* tail_leaf_;
 
-    //! Other small statistics about the B+ tree.
-    tree_stats stats_;
+    //! Other small statistics about the B+ tree, one shard per thread.
+    sharded_stats<tree_stats> stats_;
 
     //! Key comparison object. More comparison functions are generated from
     //! this < relation.
@@ -1032,6 +1127,27 @@ private:
         return !key_less_(b, a);
     }
 
+    //! Distance in bytes between consecutive keys of a node, as passed to
+    //! key_search: leaves hold value_type pairs (a key array of their own
+    //! with BTREE_SOA_LEAF), inner nodes a key array.
+    template <typename node_type>
+    static constexpr size_t key_stride() {
+#ifdef BTREE_SOA_LEAF
+        return sizeof(key_type);
+#else
+        return std::is_same<node_type, LeafNode>::value
+               ? sizeof(value_type) : sizeof(key_type);
+#endif
+    }
+
+    //! Prefetches every cache line of the child in the given slot of inner,
+    //! so the key search in the child does not take one dependent miss per
+    //! line. A no-op unless compiled with USE_PREFETCHING (prefetching.h).
+    static void prefetch_child(const InnerNode* inner, unsigned short slot) {
+        prefetch_range((void*)inner->childid[slot],
+                       inner->level == 1 ? sizeof(LeafNode) : sizeof(InnerNode));
+    }
+
     //! True if a > b ? constructed from key_less()
     bool key_greater(const key_type& a, const key_type& b) const {
         return key_less_(b, a);
@@ -1065,39 +1181,118 @@ private:
     //! \name Node Object Allocation and Deallocation Functions
     //! \{
 
+    //! Allocate a node. Nodes allocated while an update runs come from the
+    //! record manager's per-operation arena, which the wrapper commits or
+    //! rewinds together with the update. New nodes are tracked here rather
+    //! than in node::node(), which a pool runs when it fills a whole block.
+    template <typename Node>
+    Node * allocate_node(const int& tid) {
+        Node* n;
+#ifdef USE_OP_ARENA
+        if (in_writing_function)
+            n = recmgr->template arena_allocate<Node>(tid);
+        else
+#endif
+        n = (Node*)recmgr->template allocate<Node>(tid);
+#ifdef RECLAIM_IBR
+        n->birth_era = ibr_birth_era_now();
+#endif
+        if (allocated)
+            allocated->insert({n, true});
+        return n;
+    }
+
     //! Allocate and initialize a leaf node
     LeafNode * allocate_leaf(const int& tid) {
-        LeafNode* n = (LeafNode*)recmgr->template allocate<LeafNode>(tid);
+        LeafNode* n = allocate_node<LeafNode>(tid);
         n->initialize();
-        stats_.leaves++;
         return n;
     }
 
     LeafNode * allocate_leaf(const int& tid, LeafNode * other) {
-        LeafNode* n = (LeafNode*)recmgr->template allocate<LeafNode>(tid);
-        std::memcpy((void *)n, (void *)other, sizeof(LeafNode));
+        LeafNode* n = allocate_node<LeafNode>(tid);
+        n->copy_live(other);
+#ifdef RECLAIM_IBR
+        n->birth_era = ibr_birth_era_now(); // copy_live() copied other's
+#endif
         pthread_spin_init(&n->dup_lock, PTHREAD_PROCESS_PRIVATE);
+#ifdef BTREE_LEAF_COMBINING
+        n->pending = nullptr;
+        n->combining = 0;
+#endif
         return n;
     }
 
     //! Allocate and initialize an inner node
     InnerNode * allocate_inner(const int& tid, unsigned short level) {
-        InnerNode* n = (InnerNode*)recmgr->template allocate<InnerNode>(tid);
+        InnerNode* n = allocate_node<InnerNode>(tid);
         n->initialize(level);
-        stats_.inner_nodes++;
         return n;
     }
 
     InnerNode * allocate_inner(const int& tid, InnerNode * other) {
-        InnerNode* n = (InnerNode*)recmgr->template allocate<InnerNode>(tid);
-        std::memcpy((void *)n, (void *)other, sizeof(InnerNode));
+        InnerNode* n = allocate_node<InnerNode>(tid);
+        n->copy_live(other);
+#ifdef RECLAIM_IBR
+        // the child pointers were just loaded from a shared node
+        while (ibr_read_barrier())
+            n->copy_live(other);
+        n->birth_era = ibr_birth_era_now();
+#endif
         pthread_spin_init(&n->dup_lock, PTHREAD_PROCESS_PRIVATE);
         return n;
     }
 
+    //! Free a node right away, without the duplication bookkeeping of
+    //! free_node(). Only for nodes no other thread can reach, as in clear().
+    void deallocate_node(const int& tid, node* n) {
+        if (n->is_leafnode())
+            recmgr->deallocate(tid, static_cast<LeafNode*>(n));
+        else
+            recmgr->deallocate(tid, static_cast<InnerNode*>(n));
+    }
+
     //! Correctly free either inner or leaf node, destructs all contained key
     //! and value objects.
     void free_node(const int& tid, node* n) {
+        // a node duplicated by this operation was never published: drop it
+        // here and clear its original's entry, which is retired on commit
+        if (allocated->find(n) != allocated->end())
+        {
+            for (auto& d : *duplications)
+            {
+                if (d.second.dup == n)
+                {
+                    d.second.dup = nullptr;
+                    break;
+                }
+            }
+
+#ifndef USE_OP_ARENA
+            allocated->erase(n);
+            if (n->is_leafnode())
+                recmgr->deallocate(tid, static_cast<LeafNode*>(n));
+            else
+                recmgr->deallocate(tid, static_cast<InnerNode*>(n));
+            return;
+#endif
+            // an arena record cannot be freed on its own: an abort rewinds
+            // over it, and a commit retires it with the originals. it stays
+            // in allocated, so the commit counts it as published and retired.
+        }
+
+        // an original this operation already duplicated: the duplicate goes
+        // with it, or it would stay linked in the write set and leak. the
+        // exception is a root that collapsed into its only child, whose entry
+        // holds that child as the new root.
+        auto found = duplications->find(n);
+        if (found != duplications->end())
+        {
+            if (found->second.dup != nullptr && found->second.dup != new_root)
+                free_node(tid, found->second.dup);
+            return;
+        }
+
         duplications->insert({n, {nullptr, nullptr, 0}});
     }
 
@@ -1136,7 +1331,10 @@ public:
             parent = found.parent;
         }
 
-        if (parent != nullptr && locked->find(parent) == locked->end())
+        // a parent copied earlier in this operation is private, and its
+        // original is locked already
+        if (parent != nullptr && locked->find(parent) == locked->end() &&
+            allocated->find(parent) == allocated->end())
         {
             if (!pthread_spin_trylock(&parent->dup_lock))
             {
@@ -1201,6 +1399,14 @@ public:
             do_insert = true;
         }
 
+        /* a parent copied earlier in this operation is linked directly */
+        if (parent != nullptr && allocated->find(parent) != allocated->end())
+        {
+            InnerNode * i_parent = static_cast<InnerNode*>(parent);
+            if (i_parent->childid[child_idx] == orig)
+                i_parent->childid[child_idx] = dup;
+        }
+
         /* update if there is another duplication in the neighborhood */
         for (auto& d : *duplications)
         {
@@ -1233,6 +1439,10 @@ public:
         if (do_insert)
         {
             duplications->insert({orig, {dup, parent, child_idx}});
+
+            /* children reached through the duplication walk up to orig */
+            if (dup != nullptr && node_parent_map->find(orig) != node_parent_map->end())
+                node_parent_map->insert({dup, node_parent_map->at(orig)});
         }
 
         dup_happened = true;
@@ -1263,8 +1473,8 @@ public:
             auto temp_1 = dup_prologue(tid, current_1.self);
             dup_epilogue(tid, current_1.self, temp_1);
 
-            auto temp_2 = dup_prologue(tid, current_1.self);
-            dup_epilogue(tid, current_1.self, temp_2);
+            auto temp_2 = dup_prologue(tid, current_2.self);
+            dup_epilogue(tid, current_2.self, temp_2);
 
             current_1 = node_parent_map->at(current_1.parent);
             current_2 = node_parent_map->at(current_2.parent);
@@ -1288,6 +1498,128 @@ public:
 
     //! \}
 
+#ifdef BTREE_LEAF_COMBINING
+public:
+    //! \name Leaf Write Combining
+    //! Inserts and erases are published on the leaf they target, one thread
+    //! at a time applies all of them in a single duplication of that leaf.
+    //! \{
+
+    typedef combine_request<key_type, value_type> CombineRequest;
+
+    //! Descend from the current root to the leaf responsible for key, without
+    //! registering the path.
+    LeafNode* combine_descend(const key_type& key) const {
+        const node* n = load_root();
+        if (!n) return nullptr;
+
+        while (!n->is_leafnode())
+        {
+            const InnerNode* inner = static_cast<const InnerNode*>(n);
+            n = inner->get_child(find_lower(inner, key));
+        }
+
+        return static_cast<LeafNode*>(const_cast<node*>(n));
+    }
+
+    //! Apply the requests of batch, in order, to one duplication of target.
+    //! Requests that would split or underflow the leaf get outcome
+    //! COMBINE_FALLBACK. Returns false if key no longer leads to target, and
+    //! sets locking_res to false if another thread holds its lock.
+    bool combine_leaf(const int& tid, LeafNode* target, const key_type& key,
+                      const std::vector<CombineRequest*>& batch) {
+        node* n = orig_root;
+        if (!n) return false;
+
+        while (!n->is_leafnode())
+        {
+            InnerNode* inner = static_cast<InnerNode*>(n);
+            n = inner->get_child(find_lower(inner, key));
+        }
+
+        if (n != target)
+            return false;
+
+        // lock the leaf before reading it: an upsert writes its slots in place
+        // under dup_lock, and would be lost if the batch worked on a snapshot
+        // taken before. dup_prologue() keeps the lock if the leaf changes.
+        LeafNode* leaf = target;
+        if (pthread_spin_trylock(&leaf->dup_lock))
+        {
+            dup_unlock_duplications<Key, Value>(tid, true);
+            locking_res = false;
+            return true;
+        }
+        locked->insert(std::make_pair(static_cast<node*>(leaf), true));
+
+        value_type slotdata[leaf_slotmax];
+        unsigned short slotuse = leaf->get_slotuse();
+        for (unsigned short s = 0; s < slotuse; ++s)
+            slotdata[s] = leaf->get_slot(s);
+
+        bool changed = false;
+        for (CombineRequest* r : batch)
+        {
+            const key_type& rkey = key_of_value::get(r->slotdata);
+            value_type* pos = std::lower_bound(slotdata, slotdata + slotuse, r->slotdata,
+                [this](const value_type& a, const value_type& b) {
+                    return key_less(key_of_value::get(a), key_of_value::get(b));
+                });
+            bool present = (pos != slotdata + slotuse && key_equal(rkey, key_of_value::get(*pos)));
+
+            r->outcome = COMBINE_DONE;
+            if (r->kind == COMBINE_INSERT)
+            {
+                r->result = !present && slotuse < leaf_slotmax;
+                if (present)
+                    continue;
+                if (slotuse == leaf_slotmax)
+                {
+                    r->outcome = COMBINE_FALLBACK;
+                    continue;
+                }
+
+                std::copy_backward(pos, slotdata + slotuse, slotdata + slotuse + 1);
+                *pos = r->slotdata;
+                ++slotuse;
+            }
+            else
+            {
+                r->result = present && (slotuse > leaf_slotmin || leaf == orig_root);
+                if (!present)
+                    continue;
+                if (!r->result)
+                {
+                    r->outcome = COMBINE_FALLBACK;
+                    continue;
+                }
+
+                std::copy(pos + 1, slotdata + slotuse, pos);
+                --slotuse;
+            }
+            changed = true;
+        }
+
+        if (!changed)
+        {
+            dup_unlock_duplications<Key, Value>(tid, true);
+            return true;
+        }
+
+        auto leaf_dup = static_cast<LeafNode*>(dup_prologue(tid, leaf));
+        if (leaf_dup != nullptr) {
+            leaf_dup->set_slotuse(slotuse);
+            for (unsigned short s = 0; s < slotuse; ++s)
+                leaf_dup->set_slot(s, slotdata[s]);
+            dup_epilogue(tid, leaf, leaf_dup);
+        }
+
+        return true;
+    }
+
+    //! \}
+#endif
+
 public:
     //! \name Fast Destruction of the B+ Tree
     //! \{
@@ -1297,15 +1629,15 @@ public:
         if (root_)
         {
             clear_recursive(tid, root_);
-            free_node(tid, root_);
+            deallocate_node(tid, root_);
 
             root_ = nullptr;
             head_leaf_ = tail_leaf_ = nullptr;
 
-            stats_ = tree_stats();
+            stats_.clear();
         }
 
-        TLX_BTREE_ASSERT(stats_.size == 0);
+        TLX_BTREE_ASSERT(stats_.sum().size == 0);
     }
 
 private:
@@ -1327,7 +1659,7 @@ private:
             for (unsigned short slot = 0; slot < innernode->get_slotuse() + 1; ++slot)
             {
                 clear_recursive(tid, innernode->get_child(slot));
-                free_node(tid, innernode->get_child(slot));
+                deallocate_node(tid, innernode->get_child(slot));
             }
         }
     }
@@ -1431,11 +1763,12 @@ private:
 
             return lo;
         }
-        else // for nodes <= binsearch_threshold do linear search.
+        else // for nodes <= binsearch_threshold count keys with key_search.
         {
-            unsigned short lo = 0;
-            while (lo < n->get_slotuse() && key_less(n->key(lo), key)) ++lo;
-            return lo;
+            unsigned short slotuse = n->get_slotuse();
+            if (slotuse == 0) return 0;
+            return key_search<false, key_stride<node_type>(), key_type, key_compare>::count(
+                &n->key(0), slotuse, key, key_less_);
         }
     }
 
@@ -1478,11 +1811,12 @@ private:
 
             return lo;
         }
-        else // for nodes <= binsearch_threshold do linear search.
+        else // for nodes <= binsearch_threshold count keys with key_search.
         {
-            unsigned short lo = 0;
-            while (lo < n->get_slotuse() && key_lessequal(n->key(lo), key)) ++lo;
-            return lo;
+            unsigned short slotuse = n->get_slotuse();
+            if (slotuse == 0) return 0;
+            return key_search<true, key_stride<node_type>(), key_type, key_compare>::count(
+                &n->key(0), slotuse, key, key_less_);
         }
     }
 
@@ -1494,7 +1828,7 @@ public:
 
     //! Return the number of key/data pairs in the B+ tree
     size_type size() const {
-        return stats_.size;
+        return stats_.sum().size;
     }
 
     //! Returns true if there is at least one key/data pair in the B+ tree
@@ -1508,13 +1842,25 @@ public:
         return size_type(-1);
     }
 
-    //! Return a const reference to the current statistics.
-    const struct tree_stats& get_stats() const {
-        return stats_;
+    //! Return the current statistics, summed over all threads.
+    struct tree_stats get_stats() const {
+        return stats_.sum();
     }
 
     //! \}
 
+private:
+    //! Load root_. With RECLAIM_IBR this also extends the thread's era
+    //! reservation, as get_child() does for the child pointers.
+    node* load_root() const {
+        node* n = __atomic_load_n(&root_, __ATOMIC_ACQUIRE);
+#ifdef RECLAIM_IBR
+        while (ibr_read_barrier())
+            n = __atomic_load_n(&root_, __ATOMIC_ACQUIRE);
+#endif
+        return n;
+    }
+
 public:
     //! \name STL Access Functions Querying the Tree by Descending to a Leaf
     //! \{
@@ -1522,13 +1868,14 @@ public:
     //! Non-STL function checking whether a key is in the B+ tree. The same as
     //! (find(k) != end()) or (count() != 0).
     bool exists(const key_type& key) const {
-        const node* n = root_;
+        const node* n = load_root();
         if (!n) return false;
 
         while (!n->is_leafnode())
         {
             const InnerNode* inner = static_cast<const InnerNode*>(n);
             unsigned short slot = find_lower(inner, key);
+            prefetch_child(inner, slot);
 
             n = inner->get_child(slot);
         }
@@ -1542,13 +1889,14 @@ public:
     //! Tries to locate a key in the B+ tree and returns an iterator to the
     //! key/data slot if found. If unsuccessful it returns end().
     iterator find(const key_type& key) {
-        node* n = root_;
+        node* n = load_root();
         if (!n) return end();
 
         while (!n->is_leafnode())
         {
             const InnerNode* inner = static_cast<const InnerNode*>(n);
             unsigned short slot = find_lower(inner, key);
+            prefetch_child(inner, slot);
 
             n = inner->get_child(slot);
         }
@@ -1563,13 +1911,14 @@ public:
     //! Tries to locate a key in the B+ tree and returns an constant iterator to
     //! the key/data slot if found. If unsuccessful it returns end().
     const_iterator find(const key_type& key) const {
-        const node* n = root_;
+        const node* n = load_root();
         if (!n) return end();
 
         while (!n->is_leafnode())
         {
             const InnerNode* inner = static_cast<const InnerNode*>(n);
             unsigned short slot = find_lower(inner, key);
+            prefetch_child(inner, slot);
 
             n = inner->get_child(slot);
         }
@@ -1581,16 +1930,186 @@ public:
                ? const_iterator(leaf, slot) : end();
     }
 
+    //! Number of lookups find_batch() keeps in flight at once.
+    static const size_t find_batch_width = 32;
+
+    //! Looks up keys[0,n) and stores find(keys[i]) in out[i]. Up to
+    //! find_batch_width lookups descend in lock step, one level per round,
+    //! and each round prefetches all the children it picked before searching
+    //! any of them, so their cache misses overlap instead of being taken one
+    //! after the other. All leaves are at the same depth, so the lookups of a
+    //! round reach the leaves together. Prefetches regardless of
+    //! USE_PREFETCHING.
+    void find_batch(const key_type* keys, size_t n, iterator* out) {
+        node* root = load_root();
+        if (!root) {
+            for (size_t i = 0; i < n; ++i) out[i] = end();
+            return;
+        }
+
+        node* cur[find_batch_width];
+        for (size_t base = 0; base < n; base += find_batch_width)
+        {
+            const key_type* k = keys + base;
+            const size_t m = (n - base < find_batch_width) ? n - base : find_batch_width;
+            std::fill(cur, cur + m, root);
+
+            while (!cur[0]->is_leafnode())
+            {
+                for (size_t i = 0; i < m; ++i)
+                {
+                    const InnerNode* inner = static_cast<const InnerNode*>(cur[i]);
+                    unsigned short slot = find_lower(inner, k[i]);
+                    cur[i] = inner->get_child(slot);
+                    prefetch_lines(cur[i], inner->level == 1 ? sizeof(LeafNode) : sizeof(InnerNode));
+                }
+            }
+
+            for (size_t i = 0; i < m; ++i)
+            {
+                LeafNode* leaf = static_cast<LeafNode*>(cur[i]);
+                unsigned short slot = find_lower(leaf, k[i]);
+                out[base + i] = (slot < leaf->get_slotuse() && key_equal(k[i], leaf->key(slot)))
+                                ? iterator(leaf, slot) : end();
+            }
+        }
+    }
+
+    //! Outcome of replace_in_place().
+    enum replace_status { replace_done, replace_absent, replace_busy };
+
+    //! Swap the data of key in its leaf without duplicating anything, a new
+    //! value leaves the shape of the tree unchanged. The slot is written under
+    //! the leaf's dup_lock: a leaf that was duplicated or merged away keeps its
+    //! lock forever, so holding it means the leaf is still in the tree and
+    //! nobody is copying it. Returns replace_busy if the lock is taken and
+    //! replace_absent if key is not in the tree, the replaced data goes to
+    //! *old otherwise. The caller must hold a record manager guard.
+    replace_status replace_in_place(const value_type& value, value_type* old) {
+        const key_type& key = key_of_value::get(value);
+        node* n = load_root();
+        if (!n) return replace_absent;
+
+        while (!n->is_leafnode())
+        {
+            const InnerNode* inner = static_cast<const InnerNode*>(n);
+            n = inner->get_child(find_lower(inner, key));
+        }
+
+        LeafNode* leaf = static_cast<LeafNode*>(n);
+        unsigned short slot = find_lower(leaf, key);
+        if (slot >= leaf->get_slotuse() || !key_equal(key, leaf->key(slot)))
+            return replace_absent;
+
+        if (pthread_spin_trylock(&leaf->dup_lock))
+            return replace_busy;
+
+        *old = leaf->get_slot(slot);
+        __atomic_store_n(&leaf->version, leaf->version + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+#ifdef BTREE_SOA_LEAF
+        __atomic_store_n(&leaf->slotvalue[slot], value.second, __ATOMIC_RELEASE);
+#else
+        __atomic_store_n(&leaf->slotdata[slot].second, value.second, __ATOMIC_RELEASE);
+#endif
+        __atomic_store_n(&leaf->version, leaf->version + 1, __ATOMIC_RELEASE);
+        pthread_spin_unlock(&leaf->dup_lock);
+        return replace_done;
+    }
+
+    //! Calls visit(value) for every pair with lo <= key <= hi, in key order,
+    //! and returns false if they may not all have been in the tree at once.
+    //! A commit links its copies into live parents in place and a replaced
+    //! node is never linked again, so the scan records every child pointer it
+    //! follows and the version of every leaf it reads. If root_, all of these
+    //! pointers and versions are unchanged afterwards, the scan is linearized
+    //! when root_ is checked. Otherwise the pairs are not visited and the
+    //! caller retries. The caller must hold a record manager guard so that
+    //! no node of the scan is freed and reused under it.
+    template <typename Visitor>
+    bool range_query(const key_type& lo, const key_type& hi, Visitor&& visit) const {
+        const node* root = load_root();
+        if (!root || key_less(hi, lo)) return true;
+
+        range_query_state& rq = range_query_local();
+        rq.edges.clear();
+        rq.leaves.clear();
+        rq.values.clear();
+        if (!range_query_recursive(root, lo, hi, rq))
+            return false;
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (load_root() != root)
+            return false;
+        for (const auto& e : rq.edges)
+            if (__atomic_load_n(e.first, __ATOMIC_ACQUIRE) != e.second)
+                return false;
+        for (const auto& l : rq.leaves)
+            if (__atomic_load_n(l.first, __ATOMIC_ACQUIRE) != l.second)
+                return false;
+
+        for (const value_type& v : rq.values)
+            visit(v);
+        return true;
+    }
+
+private:
+    //! Child pointers, leaf versions and pairs read by a range query attempt.
+    struct range_query_state {
+        std::vector<std::pair<node* const*, const node*> > edges;
+        std::vector<std::pair<const unsigned int*, unsigned int> > leaves;
+        std::vector<value_type> values;
+    };
+
+    //! The calling thread's range query buffers, reused across calls.
+    static range_query_state& range_query_local() {
+        static thread_local range_query_state rq;
+        return rq;
+    }
+
+    //! Recursively collect the pairs in [lo,hi] below n. Returns false if a
+    //! leaf is being written in place.
+    bool range_query_recursive(const node* n, const key_type& lo,
+                               const key_type& hi, range_query_state& rq) const {
+        if (n->is_leafnode())
+        {
+            const LeafNode* leaf = static_cast<const LeafNode*>(n);
+            const unsigned int version = __atomic_load_n(&leaf->version, __ATOMIC_ACQUIRE);
+            if (version & 1)
+                return false;
+            rq.leaves.emplace_back(&leaf->version, version);
+
+            for (unsigned short slot = find_lower(leaf, lo);
+                 slot < leaf->get_slotuse() && !key_less(hi, leaf->key(slot)); ++slot)
+                rq.values.push_back(leaf->get_slot(slot));
+            return true;
+        }
+
+        const InnerNode* inner = static_cast<const InnerNode*>(n);
+        const unsigned short last = find_upper(inner, hi);
+        for (unsigned short slot = find_lower(inner, lo); slot <= last; ++slot)
+        {
+            node* const* edge = &inner->childid[slot];
+            const node* child = inner->load_child(slot);
+            rq.edges.emplace_back(edge, child);
+            if (!range_query_recursive(child, lo, hi, rq))
+                return false;
+        }
+        return true;
+    }
+
+public:
     //! Tries to locate a key in the B+ tree and returns the number of identical
     //! key entries found.
     size_type count(const key_type& key) const {
-        const node* n = root_;
+        const node* n = load_root();
         if (!n) return 0;
 
         while (!n->is_leafnode())
         {
             const InnerNode* inner = static_cast<const InnerNode*>(n);
             unsigned short slot = find_lower(inner, key);
+            prefetch_child(inner, slot);
 
             n = inner->get_child(slot);
         }
@@ -1616,13 +2135,14 @@ public:
     //! Searches the B+ tree and returns an iterator to the first pair equal to
     //! or greater than key, or end() if all keys are smaller.
     iterator lower_bound(const key_type& key) {
-        node* n = root_;
+        node* n = load_root();
         if (!n) return end();
 
         while (!n->is_leafnode())
         {
             const InnerNode* inner = static_cast<const InnerNode*>(n);
             unsigned short slot = find_lower(inner, key);
+            prefetch_child(inner, slot);
 
             n = inner->get_child(slot);
         }
@@ -1636,13 +2156,14 @@ public:
     //! Searches the B+ tree and returns a constant iterator to the first pair
     //! equal to or greater than key, or end() if all keys are smaller.
     const_iterator lower_bound(const key_type& key) const {
-        const node* n = root_;
+        const node* n = load_root();
         if (!n) return end();
 
         while (!n->is_leafnode())
         {
             const InnerNode* inner = static_cast<const InnerNode*>(n);
             unsigned short slot = find_lower(inner, key);
+            prefetch_child(inner, slot);
 
             n = inner->get_child(slot);
         }
@@ -1656,13 +2177,14 @@ public:
     //! Searches the B+ tree and returns an iterator to the first pair greater
     //! than key, or end() if all keys are smaller or equal.
     iterator upper_bound(const key_type& key) {
-        node* n = root_;
+        node* n = load_root();
         if (!n) return end();
 
         while (!n->is_leafnode())
         {
             const InnerNode* inner = static_cast<const InnerNode*>(n);
             unsigned short slot = find_upper(inner, key);
+            prefetch_child(inner, slot);
 
             n = inner->get_child(slot);
         }
@@ -1676,13 +2198,14 @@ public:
     //! Searches the B+ tree and returns a constant iterator to the first pair
     //! greater than key, or end() if all keys are smaller or equal.
     const_iterator upper_bound(const key_type& key) const {
-        const node* n = root_;
+        const node* n = load_root();
         if (!n) return end();
 
         while (!n->is_leafnode())
         {
             const InnerNode* inner = static_cast<const InnerNode*>(n);
             unsigned short slot = find_upper(inner, key);
+            prefetch_child(inner, slot);
 
             n = inner->get_child(slot);
         }
@@ -1764,7 +2287,7 @@ public:
 
             if (other.size() != 0)
             {
-                stats_.leaves = stats_.inner_nodes = 0;
+                stats_.clear();
                 if (other.root_) {
                     root_ = copy_recursive(0, other.root_); // <=====
                 }
@@ -1785,7 +2308,8 @@ public:
           allocator_(other.get_allocator()) {
         if (size() > 0)
         {
-            stats_.leaves = stats_.inner_nodes = 0;
+            stats_.clear();
+            stats_[0].size = other.size();
             if (other.root_) {
                 root_ = copy_recursive(0, other.root_); // <=====
             }
@@ -1800,6 +2324,7 @@ private:
         {
             const LeafNode* leaf = static_cast<const LeafNode*>(n);
             LeafNode* newleaf = allocate_leaf(tid);
+            stats_[tid].leaves++;
 
             newleaf->set_slotuse(leaf->get_slotuse());
             newleaf->copy_to_slotdata(
@@ -1825,6 +2350,7 @@ private:
         {
             const InnerNode* inner = static_cast<const InnerNode*>(n);
             InnerNode* newinner = allocate_inner(tid, inner->get_level());
+            stats_[tid].inner_nodes++;
 
             newinner->set_slotuse(inner->get_slotuse());
             newinner->copy_to_slotkey(
@@ -1885,45 +2411,48 @@ private:
         node* newchild = nullptr;
         key_type newkey = key_type();
 
-        if (root_ == nullptr) {
-            root_ = orig_root = head_leaf_ = tail_leaf_ = allocate_leaf(tid); //TODO
+        // the first root leaf is published by the commit's CAS on root_ like
+        // any new root, so concurrent first inserts cannot overwrite it
+        node* root = orig_root;
+        if (root == nullptr) {
+            root = new_root = head_leaf_ = tail_leaf_ = allocate_leaf(tid);
+            dup_happened = true;
         }
-        
+
+#ifdef BTREE_TOPDOWN_SPLIT
+        // split a full root before descending, insert_descend() then splits
+        // every full child on the way down and nothing propagates back up
+        node* start = root;
+        if (is_full_node(root))
+        {
+            split_full_node(tid, root, key, &newkey, &newchild);
+            grow_root(tid, newkey, newchild);
+            newchild = nullptr;
+
+            // a lock was busy, the operation will not commit and new_root is
+            // not set
+            if (locking_res == false)
+                return std::pair<iterator, bool>(iterator(), false);
+
+            start = new_root;
+        }
+
+        std::pair<iterator, bool> r =
+            insert_descend(tid, start, key, value, &newkey, &newchild);
+#else
         std::pair<iterator, bool> r =
-            insert_descend(tid, orig_root, key, value, &newkey, &newchild);
+            insert_descend(tid, root, key, value, &newkey, &newchild);
+#endif
 
         if (newchild)
         {
             // this only occurs if insert_descend() could not insert the key
             // into the root node, this mean the root is full and a new root
             // needs to be created.
-            InnerNode* newroot = allocate_inner(tid, orig_root->get_level() + 1);
-
-            auto newroot_dup = static_cast<InnerNode*>(dup_prologue(tid, newroot));
-            if (newroot_dup != nullptr) {
-                newroot_dup->set_slotkey(0, newkey);
-
-                newroot_dup->set_child(0, new_root);
-                newroot_dup->set_child(1, newchild);
-
-                newroot_dup->set_slotuse(1);
-                dup_epilogue(tid, newroot, newroot_dup);
-            }
-
-            /* TOMER CHANGE - TODO */
-            auto root_dup = dup_prologue(tid, orig_root);
-            if (root_dup != nullptr)
-            {
-                root_dup = newroot;
-                dup_epilogue(tid, orig_root, root_dup);
-            }
-
-            new_root = root_dup;
-            // root_ = newroot;
+            grow_root(tid, newkey, newchild);
         }
 
-        // increment size if the item was inserted
-        if (r.second) ++stats_.size;
+        // the size is counted by the caller once its copy is published
 
 #ifdef TLX_BTREE_DEBUG
         if (debug) print(std::cout);
@@ -1942,6 +2471,10 @@ private:
      * Descend down the nodes to a leaf, insert the key/data pair in a free
      * slot. If the node overflows, then it must be split and the new split node
      * inserted into the parent. Unroll / this splitting up to the root.
+     *
+     * With BTREE_TOPDOWN_SPLIT every full node is split before the descent
+     * enters it, so the leaf always has room and a split only writes the
+     * node, its new sibling and their parent.
     */
     std::pair<iterator, bool> insert_descend(
         const int& tid, node* n, const key_type& key, const value_type& value,
@@ -1955,10 +2488,36 @@ private:
             node* newchild = nullptr;
             
             unsigned short slot = find_lower(inner, key);
+            
+            prefetch_child(inner, slot);
 
             TLX_BTREE_PRINT(
                 "BTree::insert_descend into " << inner->get_child(slot));
 
+#ifdef BTREE_TOPDOWN_SPLIT
+            // inner is never full here, so a full child is split before the
+            // descent and only inner, the child and its new sibling change.
+            // The child is read once: a commit may relink a live inner to a
+            // fuller copy of it in the meantime.
+            node* child = inner->get_child(slot);
+            if (is_full_node(child))
+            {
+                split_full_node(tid, child, key, &newkey, &newchild);
+                insert_into_inner(tid, inner, slot, newkey, newchild);
+
+                // a split that could not lock its nodes leaves inner unchanged
+                if (locking_res == false)
+                    return std::pair<iterator, bool>(iterator(), false);
+
+                // inner is this operation's duplication now
+                if (key_less(newkey, key))
+                    ++slot;
+                child = inner->get_child(slot);
+            }
+
+            return insert_descend(tid, child, key, value, splitkey, splitnode);
+#endif
+
             std::pair<iterator, bool> r =
                 insert_descend(tid, inner->get_child(slot),
                                key, value, &newkey, &newchild);
@@ -2039,22 +2598,7 @@ private:
                 // move items and put pointer to child node into correct slot
                 TLX_BTREE_ASSERT(slot >= 0 && slot <= inner->get_slotuse());
 
-                auto inner_dup = static_cast<InnerNode*>(dup_prologue(tid, inner));
-                if (inner_dup != nullptr) {
-                    inner_dup->copy_backward_to_slotkey(
-                        inner_dup->get_slotkey_vec() + slot, 
-                        inner_dup->get_slotkey_vec() + inner_dup->get_slotuse(),
-                        inner_dup->get_slotkey_vec() + inner_dup->get_slotuse() + 1);
-                    inner_dup->copy_backward_to_childid(
-                        inner_dup->get_childid_vec() + slot, 
-                        inner_dup->get_childid_vec() + inner_dup->get_slotuse() + 1,
-                        inner_dup->get_childid_vec() + inner_dup->get_slotuse() + 2);
-
-                    inner_dup->set_slotkey(slot, newkey);
-                    inner_dup->set_child(slot + 1, newchild);
-                    inner_dup->set_slotuse(inner_dup->get_slotuse() + 1);
-                    dup_epilogue(tid, inner, inner_dup);
-                }
+                insert_into_inner(tid, inner, slot, newkey, newchild);
             }
 
             return r;
@@ -2109,6 +2653,91 @@ private:
         }
     }
 
+    //! Put a new root above the current one after the old root was split into
+    //! new_root and newchild with separator newkey.
+    void grow_root(const int& tid, const key_type& newkey, node* newchild) {
+        InnerNode* newroot = allocate_inner(tid, orig_root->get_level() + 1);
+
+#ifdef BTREE_TOPDOWN_SPLIT
+        // the descent continues below the new root, so the old root and its
+        // duplication move one level down in the path map
+        (*node_parent_map)[newroot] = { newroot, nullptr, 0, 0 };
+        (*node_parent_map)[orig_root] = { orig_root, newroot, 0, 1 };
+        (*node_parent_map)[new_root] = { orig_root, newroot, 0, 1 };
+#endif
+
+        auto newroot_dup = static_cast<InnerNode*>(dup_prologue(tid, newroot));
+        if (newroot_dup != nullptr) {
+            newroot_dup->set_slotkey(0, newkey);
+
+            newroot_dup->set_child(0, new_root);
+            newroot_dup->set_child(1, newchild);
+
+            newroot_dup->set_slotuse(1);
+            dup_epilogue(tid, newroot, newroot_dup);
+        }
+
+        /* TOMER CHANGE - TODO */
+        auto root_dup = dup_prologue(tid, orig_root);
+        if (root_dup != nullptr)
+        {
+            root_dup = newroot;
+            dup_epilogue(tid, orig_root, root_dup);
+        }
+
+        new_root = root_dup;
+        // root_ = newroot;
+    }
+
+    //! Insert newkey and its right child newchild into a non-full inner node at
+    //! slot.
+    void insert_into_inner(const int& tid, InnerNode* inner, unsigned short slot,
+                           const key_type& newkey, node* newchild) {
+        auto inner_dup = static_cast<InnerNode*>(dup_prologue(tid, inner));
+        if (inner_dup != nullptr) {
+            inner_dup->copy_backward_to_slotkey(
+                inner_dup->get_slotkey_vec() + slot, 
+                inner_dup->get_slotkey_vec() + inner_dup->get_slotuse(),
+                inner_dup->get_slotkey_vec() + inner_dup->get_slotuse() + 1);
+            inner_dup->copy_backward_to_childid(
+                inner_dup->get_childid_vec() + slot, 
+                inner_dup->get_childid_vec() + inner_dup->get_slotuse() + 1,
+                inner_dup->get_childid_vec() + inner_dup->get_slotuse() + 2);
+
+            inner_dup->set_slotkey(slot, newkey);
+            inner_dup->set_child(slot + 1, newchild);
+            inner_dup->set_slotuse(inner_dup->get_slotuse() + 1);
+            dup_epilogue(tid, inner, inner_dup);
+        }
+    }
+
+#ifdef BTREE_TOPDOWN_SPLIT
+    //! True if a leaf or inner node has no free slot left.
+    bool is_full_node(const node* n) const {
+        if (n->is_leafnode())
+            return static_cast<const LeafNode*>(n)->is_full();
+        else
+            return static_cast<const InnerNode*>(n)->is_full();
+    }
+
+    //! Split a full node before the descent reaches it. The split of an inner
+    //! node is balanced towards the child that key descends into.
+    void split_full_node(const int& tid, node* n, const key_type& key,
+                         key_type* out_newkey, node** out_newnode) {
+        if (n->is_leafnode())
+        {
+            split_leaf_node(tid, static_cast<LeafNode*>(n),
+                            out_newkey, out_newnode);
+        }
+        else
+        {
+            InnerNode* inner = static_cast<InnerNode*>(n);
+            split_inner_node(tid, inner, out_newkey, out_newnode,
+                             find_lower(inner, key));
+        }
+    }
+#endif
+
     //! Split up a leaf node into two equally-filled sibling leaves. Returns the
     //! new nodes and it's insertion key in the two parameters.
     void split_leaf_node(const int& tid, LeafNode* leaf,
@@ -2216,148 +2845,109 @@ public:
 
     //! Bulk load a sorted range. Loads items into leaves and constructs a
     //! B-tree above them. The tree must be empty when calling this function.
+    //! The iterators must be random access: each level is split into equal
+    //! chunks that are filled in parallel when compiled with OpenMP. Nodes are
+    //! allocated with the OpenMP thread number as tid, so the caller must have
+    //! initialized those threads with the record manager.
     template <typename Iterator>
     void bulk_load(const int& tid, Iterator ibegin, Iterator iend) {
         TLX_BTREE_ASSERT(empty());
 
-        stats_.size = iend - ibegin;
-
         // calculate number of leaves needed, round up.
-        size_t num_items = iend - ibegin;
-        size_t num_leaves = (num_items + leaf_slotmax - 1) / leaf_slotmax;
+        const size_t num_items = iend - ibegin;
+        if (num_items == 0) return;
+        const size_t num_leaves = (num_items + leaf_slotmax - 1) / leaf_slotmax;
 
-        TLX_BTREE_PRINT("BTree::bulk_load, level 0: " << stats_.size <<
+        stats_[tid].size = num_items;
+        stats_[tid].leaves = num_leaves;
+
+        TLX_BTREE_PRINT("BTree::bulk_load, level 0: " << num_items <<
                         " items into " << num_leaves <<
                         " leaves with up to " <<
-                        ((iend - ibegin + num_leaves - 1) / num_leaves) <<
+                        ((num_items + num_leaves - 1) / num_leaves) <<
                         " items per leaf.");
 
-        Iterator it = ibegin;
+        // nodes of the level being built, and the max key of any descendant
+        // of each of them.
+        node** level_nodes = new node*[num_leaves];
+        const key_type** level_maxkey = new const key_type*[num_leaves];
+
+        // leaf i gets items [i * N / L, (i + 1) * N / L). Chunk sizes differ
+        // by at most one, so no leaf is underfull.
+        #pragma omp parallel for schedule(static)
         for (size_t i = 0; i < num_leaves; ++i)
         {
-            // allocate new leaf node
-            LeafNode* leaf = allocate_leaf(tid);
-
-            // copy keys or (key,value) pairs into leaf nodes, uses template
-            // switch leaf->set_slot().
-            leaf->set_slotuse(static_cast<int>(num_items / (num_leaves - i)));
-            for (size_t s = 0; s < leaf->get_slotuse(); ++s, ++it)
-                leaf->set_slot(s, *it);
+            LeafNode* leaf = allocate_leaf(bulk_load_tid(tid));
 
-            if (tail_leaf_ != nullptr) {
-                tail_leaf_->next_leaf = leaf;
-                leaf->prev_leaf = tail_leaf_;
-            }
-            else {
-                head_leaf_ = leaf;
-            }
-            tail_leaf_ = leaf;
+            const size_t first = i * num_items / num_leaves;
+            const size_t last = (i + 1) * num_items / num_leaves;
+            leaf->set_slotuse(static_cast<int>(last - first));
+            for (size_t s = 0; s < last - first; ++s)
+                leaf->set_slot(s, ibegin[first + s]);
 
-            num_items -= leaf->get_slotuse();
+            level_nodes[i] = leaf;
+            level_maxkey[i] = &leaf->key(leaf->get_slotuse() - 1);
         }
 
-        TLX_BTREE_ASSERT(it == iend && num_items == 0);
+        // the leaf chain is not kept up to date by duplicating updates (split
+        // does not link new leaves either), so the leaves are left unlinked:
+        // a stale link would make merge_leaves write to a retired leaf.
 
-        // if the btree is so small to fit into one leaf, then we're done.
-        if (head_leaf_ == tail_leaf_) {
-            root_ = head_leaf_;
-            return;
-        }
+        head_leaf_ = static_cast<LeafNode*>(level_nodes[0]);
+        tail_leaf_ = static_cast<LeafNode*>(level_nodes[num_leaves - 1]);
 
-        TLX_BTREE_ASSERT(stats_.leaves == num_leaves);
+        // build inner levels the same way until a single node is left. if the
+        // btree is so small to fit into one leaf, that leaf is the root.
+        size_t num_children = num_leaves;
+        for (unsigned short level = 1; num_children != 1; ++level)
+        {
+            const size_t num_parents =
+                (num_children + (inner_slotmax + 1) - 1) / (inner_slotmax + 1);
 
-        // create first level of inner nodes, pointing to the leaves.
-        size_t num_parents =
-            (num_leaves + (inner_slotmax + 1) - 1) / (inner_slotmax + 1);
+            TLX_BTREE_PRINT(
+                "BTree::bulk_load, level " << level <<
+                    ": " << num_children << " children in " <<
+                    num_parents << " inner nodes with up to " <<
+                ((num_children + num_parents - 1) / num_parents) <<
+                    " children per inner node.");
 
-        TLX_BTREE_PRINT("BTree::bulk_load, level 1: " <<
-                        num_leaves << " leaves in " <<
-                        num_parents << " inner nodes with up to " <<
-                        ((num_leaves + num_parents - 1) / num_parents) <<
-                        " leaves per inner node.");
+            node** parents = new node*[num_parents];
+            stats_[tid].inner_nodes += num_parents;
+            const key_type** parent_maxkey = new const key_type*[num_parents];
 
-        // save inner nodes and maxkey for next level.
-        typedef std::pair<InnerNode*, const key_type*> nextlevel_type;
-        nextlevel_type* nextlevel = new nextlevel_type[num_parents];
+            #pragma omp parallel for schedule(static)
+            for (size_t i = 0; i < num_parents; ++i)
+            {
+                InnerNode* n = allocate_inner(bulk_load_tid(tid), level);
 
-        LeafNode* leaf = head_leaf_;
-        for (size_t i = 0; i < num_parents; ++i)
-        {
-            // allocate new inner node at level 1
-            InnerNode* n = allocate_inner(tid, 1);
+                // an inner node has one more child than keys.
+                const size_t first = i * num_children / num_parents;
+                const size_t last = (i + 1) * num_children / num_parents;
+                TLX_BTREE_ASSERT(last - first > 0);
+                n->set_slotuse(static_cast<int>(last - first - 1));
 
-            n->set_slotuse(static_cast<int>(num_leaves / (num_parents - i)));
-            TLX_BTREE_ASSERT(n->get_slotuse() > 0);
-            // this counts keys, but an inner node has keys+1 children.
-            n->set_slotuse(n->get_slotuse() - 1);
-
-            // copy last key from each leaf and set child
-            for (unsigned short s = 0; s < n->get_slotuse(); ++s)
-            {
-                n->set_slotkey(s, leaf->key(leaf->get_slotuse() - 1));
-                n->set_child(s, leaf);
-                leaf = leaf->next_leaf;
-            }
-            n->set_child(n->get_slotuse(), leaf);
-
-            // track max key of any descendant.
-            nextlevel[i].first = n;
-            nextlevel[i].second = &leaf->key(leaf->get_slotuse() - 1);
-
-            leaf = leaf->next_leaf;
-            num_leaves -= n->get_slotuse() + 1;
-        }
-
-        TLX_BTREE_ASSERT(leaf == nullptr && num_leaves == 0);
-
-        // recursively build inner nodes pointing to inner nodes.
-        for (int level = 2; num_parents != 1; ++level)
-        {
-            size_t num_children = num_parents;
-            num_parents =
-                (num_children + (inner_slotmax + 1) - 1) / (inner_slotmax + 1);
-
-            TLX_BTREE_PRINT(
-                "BTree::bulk_load, level " << level <<
-                    ": " << num_children << " children in " <<
-                    num_parents << " inner nodes with up to " <<
-                ((num_children + num_parents - 1) / num_parents) <<
-                    " children per inner node.");
-
-            size_t inner_index = 0;
-            for (size_t i = 0; i < num_parents; ++i)
-            {
-                // allocate new inner node at level
-                InnerNode* n = allocate_inner(tid, level);
-
-                n->set_slotuse(static_cast<int>(num_children / (num_parents - i)));
-                TLX_BTREE_ASSERT(n->get_slotuse() > 0);
-                // this counts keys, but an inner node has keys+1 children.
-                n->set_slotuse(n->get_slotuse() - 1);
-
-                // copy children and maxkeys from nextlevel
-                for (unsigned short s = 0; s < n->get_slotuse(); ++s)
+                // copy max key of each child but the last and set children
+                for (unsigned short s = 0; s < last - first - 1; ++s)
                 {
-                    n->set_slotkey(s, *nextlevel[inner_index].second);
-                    n->set_child(s, nextlevel[inner_index].first);
-                    ++inner_index;
+                    n->set_slotkey(s, *level_maxkey[first + s]);
+                    n->set_child(s, level_nodes[first + s]);
                 }
-                n->set_child(n->get_slotuse(), nextlevel[inner_index].first);
+                n->set_child(static_cast<unsigned short>(last - first - 1), level_nodes[last - 1]);
 
-                // reuse nextlevel array for parents, because we can overwrite
-                // slots we've already consumed.
-                nextlevel[i].first = n;
-                nextlevel[i].second = nextlevel[inner_index].second;
-
-                ++inner_index;
-                num_children -= n->get_slotuse() + 1;
+                parents[i] = n;
+                parent_maxkey[i] = level_maxkey[last - 1];
             }
 
-            TLX_BTREE_ASSERT(num_children == 0);
+            delete[] level_nodes;
+            delete[] level_maxkey;
+            level_nodes = parents;
+            level_maxkey = parent_maxkey;
+            num_children = num_parents;
         }
 
-        root_ = nextlevel[0].first;
-        delete[] nextlevel;
+        root_ = level_nodes[0];
+        delete[] level_nodes;
+        delete[] level_maxkey;
 
         if (self_verify) verify();
     }
@@ -2365,6 +2955,15 @@ public:
     //! \}
 
 private:
+    //! Allocation tid of the calling thread inside bulk_load's parallel loops.
+    static int bulk_load_tid(const int& tid) {
+#ifdef _OPENMP
+        return omp_get_thread_num();
+#else
+        return tid;
+#endif
+    }
+
     //! \name Support Class Encapsulating Deletion Results
     //! \{
 
@@ -2436,12 +3035,14 @@ public:
         if (self_verify) verify();
 
         if (!orig_root) return false;
+
+#ifdef BTREE_RELAXED_ERASE
+        underflow_res = false;
+#endif
         
         result_t result = erase_one_descend(
             tid, key, orig_root, nullptr, nullptr, nullptr, nullptr, nullptr, 0);
 
-        if (!result.has(btree_not_found))
-            --stats_.size;
 
 #ifdef TLX_BTREE_DEBUG
         if (debug) print(std::cout);
@@ -2451,6 +3052,97 @@ public:
         return !result.has(btree_not_found);
     }
 
+    //! Erase all pairs with lo <= key <= hi in one operation. The subtrees
+    //! between the paths to lo and hi hold only keys in the range: they are
+    //! unlinked whole and all their nodes are retired in one batch. Only the
+    //! nodes on the two boundary paths are rebuilt, and rebalanced against
+    //! their siblings on the way up. The rebuilt nodes form one subtree, which
+    //! dup_close() links in place of the topmost node it replaces. Every
+    //! replaced node is locked before it is read, and stays locked like any
+    //! duplicated node; the nodes above the subtree are unlocked on close.
+    //! Returns the number of pairs erased; sets locking_res to false if another
+    //! operation holds a lock or changed a node read, then the caller retries.
+    size_type erase_range(const int& tid, const key_type& lo, const key_type& hi) {
+        if (!orig_root || key_less(hi, lo)) return 0;
+
+        range_erase_t st;
+        size_type erased = 0;
+
+        // the root has no separator after it, its max is never read
+        range_part* top = erase_range_descend(
+            tid, st, orig_root, key_type(), lo, hi, &erased);
+        if (locking_res == false || top->orig)
+            return 0;
+
+        // a node whose only change is one rebuilt child is kept, the child is
+        // linked into it in place
+        node* parent = nullptr;
+        unsigned int slot = 0;
+        while (top->level > 0 && top->kids.size() == top->width)
+        {
+            unsigned int changed = 0, child = 0;
+            for (unsigned int i = 0; i < top->kids.size(); ++i)
+            {
+                if (!top->kids[i]->orig)
+                {
+                    ++changed;
+                    child = i;
+                }
+            }
+            if (changed != 1)
+                break;
+
+            (*locked)[top->from] = true;
+            parent = top->from;
+            slot = child;
+            top = top->kids[child];
+        }
+
+        node* dup;
+        if (parent == nullptr)
+        {
+            // an inner root left with a single child is replaced by it
+            range_part* root = top;
+            while (root->level > 0 && root->kids.size() == 1)
+                root = root->kids[0];
+
+            dup = new_root = range_part_empty(root) ? nullptr : erase_range_build(tid, root);
+        }
+        else
+        {
+            dup = erase_range_build(tid, top);
+        }
+
+        for (node* n : st.replaced)
+        {
+            if (n != top->from && !locked->at(n))
+                duplications->insert({n, {nullptr, nullptr, 0}});
+        }
+        duplications->insert({top->from, {dup, parent, slot}});
+        dup_happened = true;
+
+        return erased;
+    }
+
+#ifdef BTREE_RELAXED_ERASE
+    //! Run one lazy rebalancing step on the path to key: the topmost
+    //! underflowing node on that path is repaired by shifting or merging with
+    //! a sibling. Returns true if an underflow may remain on the path.
+    bool rebalance_one(const int& tid, const key_type& key) {
+        if (!orig_root) return false;
+
+        rebalancing = true;
+        underflow_res = false;
+
+        erase_one_descend(
+            tid, key, orig_root, nullptr, nullptr, nullptr, nullptr, nullptr, 0);
+
+        rebalancing = false;
+
+        return underflow_res;
+    }
+#endif
+
     //! Erases all the key/data pairs associated with the given key. This is
     //! implemented using erase_one().
     size_type erase(const int& tid, const key_type& key) {
@@ -2477,8 +3169,6 @@ public:
         result_t result = erase_iter_descend(
             tid, iter, root_, nullptr, nullptr, nullptr, nullptr, nullptr, 0);
 
-        if (!result.has(btree_not_found))
-            --stats_.size;
 
 #ifdef TLX_BTREE_DEBUG
         if (debug) print(std::cout);
@@ -2500,6 +3190,314 @@ private:
     //! \name Private Erase Functions
     //! \{
 
+    //! A node on the boundary paths of erase_range(), rebuilt in place of the
+    //! node from. While orig is set the node is unchanged; range_open() moves
+    //! its contents into slots or kids. The separator keys of an inner node are
+    //! the max of each child but the last.
+    struct range_part {
+        node* orig;
+        node* from;
+        unsigned short level;
+        //! Number of children of from when it was opened
+        size_t width;
+        //! Upper bound of the keys in the subtree, the separator after it in
+        //! its parent
+        key_type max;
+        std::vector<value_type> slots;
+        std::vector<range_part*> kids;
+    };
+
+    struct range_erase_t {
+        std::deque<range_part> parts;
+        //! Nodes opened or unlinked, in the order they were locked
+        std::vector<node*> replaced;
+    };
+
+    range_part* range_wrap(range_erase_t& st, node* n, const key_type& max) {
+        st.parts.emplace_back();
+        range_part* p = &st.parts.back();
+        p->orig = p->from = n;
+        p->level = n->level;
+        p->width = 0;
+        p->max = max;
+        return p;
+    }
+
+    //! Lock a node that erase_range() replaces. A node that was replaced by
+    //! another operation stays locked, so holding the lock means n is current.
+    bool range_lock(const int& tid, range_erase_t& st, node* n) {
+        if (locked->find(n) != locked->end())
+            return true;
+
+        if (pthread_spin_trylock(&n->dup_lock))
+        {
+            dup_unlock_duplications<Key, Value>(tid, true);
+            locking_res = false;
+            return false;
+        }
+
+        locked->insert(std::make_pair(n, false));
+        st.replaced.push_back(n);
+        return true;
+    }
+
+    //! Move the contents of an unchanged node into p, after locking it.
+    bool range_open(const int& tid, range_erase_t& st, range_part* p) {
+        node* n = p->orig;
+        if (!n) return true;
+        if (!range_lock(tid, st, n)) return false;
+
+        if (n->is_leafnode())
+        {
+            const LeafNode* leaf = static_cast<const LeafNode*>(n);
+            for (unsigned short slot = 0; slot < leaf->get_slotuse(); ++slot)
+                p->slots.push_back(leaf->get_slot(slot));
+        }
+        else
+        {
+            const InnerNode* inner = static_cast<const InnerNode*>(n);
+            for (unsigned short slot = 0; slot <= inner->get_slotuse(); ++slot)
+            {
+                p->kids.push_back(range_wrap(
+                    st, inner->childid[slot],
+                    slot < inner->get_slotuse() ? inner->key(slot) : p->max));
+            }
+            p->width = p->kids.size();
+        }
+
+        p->orig = nullptr;
+        return true;
+    }
+
+    static bool range_part_empty(const range_part* p) {
+        return !p->orig && (p->level == 0 ? p->slots.empty() : p->kids.empty());
+    }
+
+    //! Only rebuilt nodes are checked: an unchanged node only underflows with
+    //! BTREE_RELAXED_ERASE, and then a rebalancing step for it is pending.
+    static bool range_part_underflow(const range_part* p) {
+        if (p->orig) return false;
+        if (p->level == 0) return p->slots.size() < leaf_slotmin;
+        return p->kids.size() - 1 < inner_slotmin;
+    }
+
+    //! Erase lo <= key <= hi from the subtree of n, whose keys are at most
+    //! max. Returns the part for n, which is unchanged if the subtree holds no
+    //! key in the range.
+    range_part* erase_range_descend(const int& tid, range_erase_t& st,
+                                    node* n, const key_type& max,
+                                    const key_type& lo, const key_type& hi,
+                                    size_type* erased) {
+        range_part* p = range_wrap(st, n, max);
+
+        if (n->is_leafnode())
+        {
+            const LeafNode* leaf = static_cast<const LeafNode*>(n);
+            if (find_lower(leaf, lo) >= find_upper(leaf, hi))
+                return p;
+
+            // the slots are found again once the leaf is locked
+            if (!range_open(tid, st, p))
+                return p;
+            unsigned short first = 0, last = 0;
+            while (first < p->slots.size() && key_less(key_of_value::get(p->slots[first]), lo))
+                ++first;
+            last = first;
+            while (last < p->slots.size() && !key_less(hi, key_of_value::get(p->slots[last])))
+                ++last;
+
+            p->slots.erase(p->slots.begin() + first, p->slots.begin() + last);
+            *erased += last - first;
+            if (!p->slots.empty())
+                p->max = key_of_value::get(p->slots.back());
+            return p;
+        }
+
+        const InnerNode* inner = static_cast<const InnerNode*>(n);
+        unsigned short first = find_lower(inner, lo);
+        unsigned short last = find_upper(inner, hi);
+        unsigned short slotuse = inner->get_slotuse();
+        node* first_child = inner->load_child(first);
+        node* last_child = inner->load_child(last);
+
+        // the children strictly between first and last hold only keys in the
+        // range, the paths to lo and hi end in first and last
+        range_part* left = erase_range_descend(
+            tid, st, first_child,
+            first < slotuse ? inner->key(first) : max, lo, hi, erased);
+        if (locking_res == false)
+            return p;
+
+        range_part* right = left;
+        if (last != first)
+        {
+            right = erase_range_descend(
+                tid, st, last_child,
+                last < slotuse ? inner->key(last) : max, lo, hi, erased);
+        }
+        if (locking_res == false || (left->orig && right->orig && last - first < 2))
+            return p;
+
+        // the children were found without holding n's lock
+        if (!range_open(tid, st, p))
+            return p;
+        if (p->kids.size() != slotuse + 1u ||
+            p->kids[first]->orig != first_child || p->kids[last]->orig != last_child)
+        {
+            dup_unlock_duplications<Key, Value>(tid, true);
+            locking_res = false;
+            return p;
+        }
+
+        for (unsigned short slot = first + 1; slot < last; ++slot)
+        {
+            if (!erase_range_drop(tid, st, p->kids[slot]->orig, erased))
+                return p;
+        }
+
+        p->kids[first] = left;
+        p->kids[last] = right;
+        if (last - first > 1)
+            p->kids.erase(p->kids.begin() + first + 1, p->kids.begin() + last);
+        p->kids.erase(std::remove_if(p->kids.begin(), p->kids.end(), range_part_empty),
+                      p->kids.end());
+
+        erase_range_fix(tid, st, p);
+        if (!p->kids.empty())
+            p->max = p->kids.back()->max;
+        return p;
+    }
+
+    //! Lock and unlink the whole subtree of n, counting its pairs into erased.
+    bool erase_range_drop(const int& tid, range_erase_t& st, node* n, size_type* erased) {
+        if (!range_lock(tid, st, n))
+            return false;
+
+        if (n->is_leafnode())
+        {
+            *erased += n->get_slotuse();
+            return true;
+        }
+
+        const InnerNode* inner = static_cast<const InnerNode*>(n);
+        for (unsigned short slot = 0; slot <= inner->get_slotuse(); ++slot)
+        {
+            if (!erase_range_drop(tid, st, inner->childid[slot], erased))
+                return false;
+        }
+        return true;
+    }
+
+    //! Repair the underflowing rebuilt children of p, each by merging it with
+    //! or balancing it against an adjacent sibling. The separator between two
+    //! inner siblings is the max of the left one's last child, so it moves
+    //! down into a merged node with the children. A merge can join a child
+    //! that underflows with its new siblings, which are then repaired too.
+    void erase_range_fix(const int& tid, range_erase_t& st, range_part* p) {
+        size_t i = 0;
+        while (locking_res && p->kids.size() > 1 && i < p->kids.size())
+        {
+            if (!range_part_underflow(p->kids[i]))
+            {
+                ++i;
+                continue;
+            }
+
+            size_t a = (i + 1 < p->kids.size()) ? i : i - 1;
+            range_part* left = p->kids[a];
+            range_part* right = p->kids[a + 1];
+            if (!range_open(tid, st, left) || !range_open(tid, st, right))
+                return;
+
+            if (left->level == 0)
+            {
+                std::vector<value_type>& ls = left->slots;
+                std::vector<value_type>& rs = right->slots;
+                size_t total = ls.size() + rs.size();
+                if (total <= leaf_slotmax)
+                {
+                    ls.insert(ls.end(), rs.begin(), rs.end());
+                    left->max = right->max;
+                    p->kids.erase(p->kids.begin() + a + 1);
+                }
+                else
+                {
+                    size_t half = total / 2;
+                    if (ls.size() < half)
+                    {
+                        size_t n = half - ls.size();
+                        ls.insert(ls.end(), rs.begin(), rs.begin() + n);
+                        rs.erase(rs.begin(), rs.begin() + n);
+                    }
+                    else
+                    {
+                        rs.insert(rs.begin(), ls.begin() + half, ls.end());
+                        ls.erase(ls.begin() + half, ls.end());
+                    }
+                    left->max = key_of_value::get(ls.back());
+                }
+            }
+            else
+            {
+                std::vector<range_part*>& lk = left->kids;
+                std::vector<range_part*>& rk = right->kids;
+                size_t total = lk.size() + rk.size();
+                if (total <= inner_slotmax + 1u)
+                {
+                    lk.insert(lk.end(), rk.begin(), rk.end());
+                    left->max = right->max;
+                    p->kids.erase(p->kids.begin() + a + 1);
+                    erase_range_fix(tid, st, left);
+                }
+                else
+                {
+                    size_t half = total / 2;
+                    if (lk.size() < half)
+                    {
+                        size_t n = half - lk.size();
+                        lk.insert(lk.end(), rk.begin(), rk.begin() + n);
+                        rk.erase(rk.begin(), rk.begin() + n);
+                    }
+                    else
+                    {
+                        rk.insert(rk.begin(), lk.begin() + half, lk.end());
+                        lk.erase(lk.begin() + half, lk.end());
+                    }
+                    left->max = lk.back()->max;
+                    erase_range_fix(tid, st, left);
+                    erase_range_fix(tid, st, right);
+                }
+            }
+
+            i = a;
+        }
+    }
+
+    //! Write a rebuilt part and its rebuilt descendants to new nodes.
+    node* erase_range_build(const int& tid, const range_part* p) {
+        if (p->orig)
+            return p->orig;
+
+        if (p->level == 0)
+        {
+            LeafNode* leaf = allocate_leaf(tid);
+            leaf->set_slotuse(p->slots.size());
+            for (unsigned short slot = 0; slot < p->slots.size(); ++slot)
+                leaf->set_slot(slot, p->slots[slot]);
+            return leaf;
+        }
+
+        InnerNode* inner = allocate_inner(tid, p->level);
+        for (unsigned short slot = 0; slot < p->kids.size(); ++slot)
+        {
+            inner->set_child(slot, erase_range_build(tid, p->kids[slot]));
+            if (slot + 1u < p->kids.size())
+                inner->set_slotkey(slot, p->kids[slot]->max);
+        }
+        inner->set_slotuse(p->kids.size() - 1);
+        return inner;
+    }
+
     /*!
      * Erase one (the first) key/data pair in the B+ tree matching key.
      *
@@ -2509,6 +3507,10 @@ private:
      * the leaf underflows 6 different cases are handled. These cases resolve
      * the underflow by shifting key/data pairs from adjacent sibling nodes,
      * merging two sibling nodes or trimming the tree.
+     *
+     * With BTREE_RELAXED_ERASE only the leaf is written and an underflow is
+     * just flagged in underflow_res. rebalance_one() later runs the same
+     * descent with rebalancing set to resolve it, one node per call.
      */
     result_t erase_one_descend(const int& tid, 
                                const key_type& key,
@@ -2524,6 +3526,19 @@ private:
             LeafNode* right_leaf = static_cast<LeafNode*>(right);
 
             unsigned short slot = find_lower(leaf, key);
+
+#ifdef BTREE_RELAXED_ERASE
+            if (rebalancing)
+            {
+                if (leaf->is_underflow() && leaf != root_)
+                {
+                    return fix_leaf_underflow(
+                        tid, leaf, left_leaf, right_leaf,
+                        left_parent, right_parent, parent, parentslot);
+                }
+                return btree_ok;
+            }
+#endif
             
             if (slot >= leaf->get_slotuse() || !key_equal(key, leaf->key(slot)))
             {
@@ -2545,6 +3560,16 @@ private:
                 dup_epilogue(tid, leaf, leaf_dup);
             }
 
+#ifdef BTREE_RELAXED_ERASE
+            // Only the leaf is written: the parent's split key may now be
+            // larger than the leaf's last key, which is still a valid upper
+            // bound for searches, and an underflow is left for rebalance_one().
+            if (leaf->is_underflow() && leaf != root_)
+                underflow_res = true;
+
+            return btree_ok;
+#endif
+
             result_t myres = btree_ok;
 
             // if the last key of the leaf was changed, the parent is notified
@@ -2578,95 +3603,9 @@ private:
             
             if (leaf->is_underflow() && !(leaf == root_ && leaf->get_slotuse() >= 1))
             {
-                // determine what to do about the underflow
-
-                // case : if this empty leaf is the root, then delete all nodes
-                // and set root to nullptr.
-                if (left_leaf == nullptr && right_leaf == nullptr)
-                {
-                    TLX_BTREE_ASSERT(leaf == root_);
-                    TLX_BTREE_ASSERT(leaf->get_slotuse() == 0);
-
-                    free_node(tid, root_);
-
-                    // root_ = leaf = nullptr; // TODO
-                    auto root_dup = dup_prologue(tid, orig_root);
-                    if (root_dup != nullptr)
-                    {
-                        root_dup = nullptr;
-                        dup_epilogue(tid, orig_root, root_dup);
-                    }
-
-                    new_root = root_dup;
-
-                    auto leaf_dup = static_cast<LeafNode*>(dup_prologue(tid, leaf));
-                    if (leaf_dup != nullptr) {
-                        leaf_dup = nullptr;
-                        dup_epilogue(tid, leaf, leaf_dup);
-                    }
-                    
-                    // head_leaf_ = tail_leaf_ = nullptr; // TODO
-
-                    // will be decremented soon by insert_start()
-                    TLX_BTREE_ASSERT(stats_.size == 1);
-                    TLX_BTREE_ASSERT(stats_.leaves == 0);
-                    TLX_BTREE_ASSERT(stats_.inner_nodes == 0);
-                    
-                    return btree_ok;
-                }
-                // case : if both left and right leaves would underflow in case
-                // of a shift, then merging is necessary. choose the more local
-                // merger with our parent
-                else if ((left_leaf == nullptr || left_leaf->is_few()) &&
-                         (right_leaf == nullptr || right_leaf->is_few()))
-                {
-                    if (left_parent == parent)
-                        myres |= merge_leaves(tid, left_leaf, leaf, left_parent);
-                    else
-                        myres |= merge_leaves(tid, leaf, right_leaf, right_parent);
-                }
-                // case : the right leaf has extra data, so balance right with
-                // current
-                else if ((left_leaf != nullptr && left_leaf->is_few()) &&
-                         (right_leaf != nullptr && !right_leaf->is_few()))
-                {
-                    if (right_parent == parent)
-                        myres |= shift_left_leaf(
-                            tid, leaf, right_leaf, right_parent, parentslot);
-                    else
-                        myres |= merge_leaves(tid, left_leaf, leaf, left_parent);
-                }
-                // case : the left leaf has extra data, so balance left with
-                // current
-                else if ((left_leaf != nullptr && !left_leaf->is_few()) &&
-                         (right_leaf != nullptr && right_leaf->is_few()))
-                {
-                    if (left_parent == parent)
-                        shift_right_leaf(
-                            tid, left_leaf, leaf, left_parent, parentslot - 1);
-                    else
-                        myres |= merge_leaves(tid, leaf, right_leaf, right_parent);
-                }
-                // case : both the leaf and right leaves have extra data and our
-                // parent, choose the leaf with more data
-                else if (left_parent == right_parent)
-                {
-                    if (left_leaf->get_slotuse() <= right_leaf->get_slotuse())
-                        myres |= shift_left_leaf(
-                            tid, leaf, right_leaf, right_parent, parentslot);
-                    else
-                        shift_right_leaf(
-                            tid, left_leaf, leaf, left_parent, parentslot - 1);
-                }
-                else
-                {
-                    if (left_parent == parent)
-                        shift_right_leaf(
-                            tid, left_leaf, leaf, left_parent, parentslot - 1);
-                    else
-                        myres |= shift_left_leaf(
-                            tid, leaf, right_leaf, right_parent, parentslot);
-                }
+                myres |= fix_leaf_underflow(
+                    tid, leaf, left_leaf, right_leaf,
+                    left_parent, right_parent, parent, parentslot);
             }
             
             return myres;
@@ -2682,6 +3621,21 @@ private:
 
             unsigned short slot = find_lower(inner, key);
 
+            prefetch_child(inner, slot);
+
+#ifdef BTREE_RELAXED_ERASE
+            // repair the topmost underflow on the path first, so every merge
+            // further down happens below a parent with at least two children
+            if (rebalancing && inner->is_underflow() &&
+                !(inner == root_ && inner->get_slotuse() >= 1))
+            {
+                underflow_res = true;
+                return fix_inner_underflow(
+                    tid, inner, left_inner, right_inner,
+                    left_parent, right_parent, parent, parentslot);
+            }
+#endif
+
             if (slot == 0) {
                 myleft =
                     (left == nullptr) ? nullptr :
@@ -2748,8 +3702,9 @@ private:
             if (result.has(btree_fixmerge))
             {
                 // either the current node or the next is empty and should be
-                // removed
-                if (inner->get_child(slot)->get_slotuse() != 0)
+                // removed. a merge into the first child always removes the
+                // second one, even if both were empty.
+                if (slot == 0 || inner->get_child(slot)->get_slotuse() != 0)
                     slot++;
 
                 // this is the child slot invalidated by the merge
@@ -2772,7 +3727,8 @@ private:
                     dup_epilogue(tid, inner, inner_dup);
                 }
                 
-                if (inner->get_level() == 1)
+                if (inner->get_level() == 1 &&
+                    inner->get_child(slot - 1)->get_slotuse() != 0)
                 {
                     // fix split key for children leaves
                     slot--;
@@ -2786,103 +3742,234 @@ private:
                 }
             }
 
+#ifdef BTREE_RELAXED_ERASE
+            // a merge below may leave this node short, which is repaired by
+            // the next rebalancing step
+            if (rebalancing && inner->is_underflow() &&
+                !(inner == root_ && inner->get_slotuse() >= 1))
+            {
+                underflow_res = true;
+            }
+
+            return myres;
+#endif
+
             if (inner->is_underflow() &&
                 !(inner == root_ && inner->get_slotuse() >= 1))
             {
-                // case: the inner node is the root and has just one child. that
-                // child becomes the new root
-                if (left_inner == nullptr && right_inner == nullptr)
-                {
-                    TLX_BTREE_ASSERT(inner == root_);
-                    TLX_BTREE_ASSERT(inner->get_slotuse() == 0);
-                    
-                    // root_ = inner->get_child(0); // TODO
+                myres |= fix_inner_underflow(
+                    tid, inner, left_inner, right_inner,
+                    left_parent, right_parent, parent, parentslot);
+            }
+            
+            return myres;
+        }
+    }
 
-                    auto root_dup = dup_prologue(tid, orig_root);
-                    if (root_dup != nullptr) {
-                        root_dup = inner->get_child(0);
-                        dup_epilogue(tid, orig_root, root_dup);
-                    }
+    /*!
+     * Resolve the underflow of a leaf after an erase. The six cases shift
+     * key/data pairs from an adjacent sibling, merge with a sibling or trim
+     * the tree if the leaf was the root.
+     */
+    result_t fix_leaf_underflow(const int& tid,
+                                LeafNode* leaf,
+                                LeafNode* left_leaf, LeafNode* right_leaf,
+                                InnerNode* left_parent, InnerNode* right_parent,
+                                InnerNode* parent, unsigned int parentslot) {
+        result_t myres = btree_ok;
 
-                    new_root = root_dup;
+        // determine what to do about the underflow
 
-                    auto inner_dup = static_cast<InnerNode*>(dup_prologue(tid, inner));
-                    if (inner_dup != nullptr) {
-                        inner_dup->set_slotuse(0);
-                        dup_epilogue(tid, inner, inner_dup);
-                    }
+        // case : if this empty leaf is the root, then delete all nodes
+        // and set root to nullptr.
+        if (left_leaf == nullptr && right_leaf == nullptr)
+        {
+            TLX_BTREE_ASSERT(leaf == root_);
+            TLX_BTREE_ASSERT(leaf->get_slotuse() == 0);
 
-                    free_node(tid, inner);
-                    
-                    return btree_ok;
-                }
-                // case : if both left and right leaves would underflow in case
-                // of a shift, then merging is necessary. choose the more local
-                // merger with our parent
-                else if ((left_inner == nullptr || left_inner->is_few()) &&
-                         (right_inner == nullptr || right_inner->is_few()))
-                {
-                    if (left_parent == parent)
-                        myres |= merge_inner(
-                            tid, left_inner, inner, left_parent, parentslot - 1);
-                    else
-                        myres |= merge_inner(
-                            tid, inner, right_inner, right_parent, parentslot);
-                }
-                // case : the right leaf has extra data, so balance right with
-                // current
-                else if ((left_inner != nullptr && left_inner->is_few()) &&
-                         (right_inner != nullptr && !right_inner->is_few()))
-                {
-                    if (right_parent == parent)
-                        shift_left_inner(
-                            tid, inner, right_inner, right_parent, parentslot);
-                    else
-                        myres |= merge_inner(
-                            tid, left_inner, inner, left_parent, parentslot - 1);
-                }
-                // case : the left leaf has extra data, so balance left with
-                // current
-                else if ((left_inner != nullptr && !left_inner->is_few()) &&
-                         (right_inner != nullptr && right_inner->is_few()))
-                {
-                    if (left_parent == parent) {
-                        shift_right_inner(
-                            tid, left_inner, inner, left_parent, parentslot - 1);
-                    }
-                    else {
-                        myres |= merge_inner(
-                            tid, inner, right_inner, right_parent, parentslot);
-                    }
-                }
-                // case : both the leaf and right leaves have extra data and our
-                // parent, choose the leaf with more data
-                else if (left_parent == right_parent)
-                {
-                    if (left_inner->get_slotuse() <= right_inner->get_slotuse()) {
-                        shift_left_inner(
-                            tid, inner, right_inner, right_parent, parentslot);
-                    }
-                    else {
-                        shift_right_inner(
-                            tid, left_inner, inner, left_parent, parentslot - 1);
-                    }
-                }
-                else
-                {
-                    if (left_parent == parent) {
-                        shift_right_inner(
-                            tid, left_inner, inner, left_parent, parentslot - 1);
-                    }
-                    else {
-                        shift_left_inner(
-                            tid, inner, right_inner, right_parent, parentslot);
-                    }
-                }
+            free_node(tid, leaf);
+
+            // root_ = leaf = nullptr; // TODO
+            auto root_dup = dup_prologue(tid, orig_root);
+            if (root_dup != nullptr)
+            {
+                root_dup = nullptr;
+                dup_epilogue(tid, orig_root, root_dup);
+            }
+
+            new_root = root_dup;
+
+            auto leaf_dup = static_cast<LeafNode*>(dup_prologue(tid, leaf));
+            if (leaf_dup != nullptr) {
+                leaf_dup = nullptr;
+                dup_epilogue(tid, leaf, leaf_dup);
             }
             
-            return myres;
+            // head_leaf_ = tail_leaf_ = nullptr; // TODO
+
+            // both will be decremented when the erase commits
+            TLX_BTREE_ASSERT(stats_.sum().size == 1);
+            TLX_BTREE_ASSERT(stats_.sum().leaves == 1);
+            TLX_BTREE_ASSERT(stats_.sum().inner_nodes == 0);
+            
+            return btree_ok;
+        }
+        // case : if both left and right leaves would underflow in case
+        // of a shift, then merging is necessary. choose the more local
+        // merger with our parent
+        else if ((left_leaf == nullptr || left_leaf->is_few()) &&
+                 (right_leaf == nullptr || right_leaf->is_few()))
+        {
+            if (left_parent == parent)
+                myres |= merge_leaves(tid, left_leaf, leaf, left_parent);
+            else
+                myres |= merge_leaves(tid, leaf, right_leaf, right_parent);
+        }
+        // case : the right leaf has extra data, so balance right with
+        // current
+        else if ((left_leaf != nullptr && left_leaf->is_few()) &&
+                 (right_leaf != nullptr && !right_leaf->is_few()))
+        {
+            if (right_parent == parent)
+                myres |= shift_left_leaf(
+                    tid, leaf, right_leaf, right_parent, parentslot);
+            else
+                myres |= merge_leaves(tid, left_leaf, leaf, left_parent);
         }
+        // case : the left leaf has extra data, so balance left with
+        // current
+        else if ((left_leaf != nullptr && !left_leaf->is_few()) &&
+                 (right_leaf != nullptr && right_leaf->is_few()))
+        {
+            if (left_parent == parent)
+                shift_right_leaf(
+                    tid, left_leaf, leaf, left_parent, parentslot - 1);
+            else
+                myres |= merge_leaves(tid, leaf, right_leaf, right_parent);
+        }
+        // case : both the leaf and right leaves have extra data and our
+        // parent, choose the leaf with more data
+        else if (left_parent == right_parent)
+        {
+            if (left_leaf->get_slotuse() <= right_leaf->get_slotuse())
+                myres |= shift_left_leaf(
+                    tid, leaf, right_leaf, right_parent, parentslot);
+            else
+                shift_right_leaf(
+                    tid, left_leaf, leaf, left_parent, parentslot - 1);
+        }
+        else
+        {
+            if (left_parent == parent)
+                shift_right_leaf(
+                    tid, left_leaf, leaf, left_parent, parentslot - 1);
+            else
+                myres |= shift_left_leaf(
+                    tid, leaf, right_leaf, right_parent, parentslot);
+        }
+
+        return myres;
+    }
+
+    /*!
+     * Resolve the underflow of an inner node after a merge of its children,
+     * by the same cases as fix_leaf_underflow().
+     */
+    result_t fix_inner_underflow(const int& tid,
+                                 InnerNode* inner,
+                                 InnerNode* left_inner, InnerNode* right_inner,
+                                 InnerNode* left_parent, InnerNode* right_parent,
+                                 InnerNode* parent, unsigned int parentslot) {
+        result_t myres = btree_ok;
+
+        // case: the inner node is the root and has just one child. that
+        // child becomes the new root
+        if (left_inner == nullptr && right_inner == nullptr)
+        {
+            TLX_BTREE_ASSERT(inner == root_);
+            TLX_BTREE_ASSERT(inner->get_slotuse() == 0);
+            
+            // root_ = inner->get_child(0); // TODO
+
+            auto root_dup = dup_prologue(tid, orig_root);
+            if (root_dup != nullptr) {
+                root_dup = inner->get_child(0);
+                dup_epilogue(tid, orig_root, root_dup);
+            }
+
+            new_root = root_dup;
+
+            // inner is orig_root, so its duplication entry now holds the new
+            // root and must not be cleared. it is retired on commit.
+            free_node(tid, inner);
+            
+            return btree_ok;
+        }
+        // case : if both left and right leaves would underflow in case
+        // of a shift, then merging is necessary. choose the more local
+        // merger with our parent
+        else if ((left_inner == nullptr || left_inner->is_few()) &&
+                 (right_inner == nullptr || right_inner->is_few()))
+        {
+            if (left_parent == parent)
+                myres |= merge_inner(
+                    tid, left_inner, inner, left_parent, parentslot - 1);
+            else
+                myres |= merge_inner(
+                    tid, inner, right_inner, right_parent, parentslot);
+        }
+        // case : the right leaf has extra data, so balance right with
+        // current
+        else if ((left_inner != nullptr && left_inner->is_few()) &&
+                 (right_inner != nullptr && !right_inner->is_few()))
+        {
+            if (right_parent == parent)
+                shift_left_inner(
+                    tid, inner, right_inner, right_parent, parentslot);
+            else
+                myres |= merge_inner(
+                    tid, left_inner, inner, left_parent, parentslot - 1);
+        }
+        // case : the left leaf has extra data, so balance left with
+        // current
+        else if ((left_inner != nullptr && !left_inner->is_few()) &&
+                 (right_inner != nullptr && right_inner->is_few()))
+        {
+            if (left_parent == parent) {
+                shift_right_inner(
+                    tid, left_inner, inner, left_parent, parentslot - 1);
+            }
+            else {
+                myres |= merge_inner(
+                    tid, inner, right_inner, right_parent, parentslot);
+            }
+        }
+        // case : both the leaf and right leaves have extra data and our
+        // parent, choose the leaf with more data
+        else if (left_parent == right_parent)
+        {
+            if (left_inner->get_slotuse() <= right_inner->get_slotuse()) {
+                shift_left_inner(
+                    tid, inner, right_inner, right_parent, parentslot);
+            }
+            else {
+                shift_right_inner(
+                    tid, left_inner, inner, left_parent, parentslot - 1);
+            }
+        }
+        else
+        {
+            if (left_parent == parent) {
+                shift_right_inner(
+                    tid, left_inner, inner, left_parent, parentslot - 1);
+            }
+            else {
+                shift_left_inner(
+                    tid, inner, right_inner, right_parent, parentslot);
+            }
+        }
+
+        return myres;
     }
 
     /*!
@@ -2982,10 +4069,10 @@ private:
                     root_ = leaf = nullptr;
                     head_leaf_ = tail_leaf_ = nullptr;
 
-                    // will be decremented soon by insert_start()
-                    TLX_BTREE_ASSERT(stats_.size == 1);
-                    TLX_BTREE_ASSERT(stats_.leaves == 0);
-                    TLX_BTREE_ASSERT(stats_.inner_nodes == 0);
+                    // both will be decremented when the erase commits
+                    TLX_BTREE_ASSERT(stats_.sum().size == 1);
+                    TLX_BTREE_ASSERT(stats_.sum().leaves == 1);
+                    TLX_BTREE_ASSERT(stats_.sum().inner_nodes == 0);
 
                     return btree_ok;
                 }
@@ -3289,12 +4376,10 @@ private:
             dup_epilogue(tid, left, left_dup);
         }     
 
-        //TODO - iterator stuff
-        left->next_leaf = right->next_leaf;
-        if (left->next_leaf)
-            left->next_leaf->prev_leaf = left;
-        else
-            tail_leaf_ = left;
+        // the leaf chain is not maintained by copying updates, so it is not
+        // relinked here either: left is a published leaf that other threads
+        // read, and right->next_leaf may point to a leaf that was already
+        // retired and freed.
 
         // auto right_dup = static_cast<LeafNode*>(dup_prologue(tid, right));
         if (right_dup != nullptr) {
@@ -3776,9 +4861,10 @@ public:
         {
             verify_node(root_, &minkey, &maxkey, vstats);
 
-            tlx_die_unless(vstats.size == stats_.size);
-            tlx_die_unless(vstats.leaves == stats_.leaves);
-            tlx_die_unless(vstats.inner_nodes == stats_.inner_nodes);
+            tree_stats stats = stats_.sum();
+            tlx_die_unless(vstats.size == stats.size);
+            tlx_die_unless(vstats.leaves == stats.leaves);
+            tlx_die_unless(vstats.inner_nodes == stats.inner_nodes);
 
             verify_leaflinks();
         }
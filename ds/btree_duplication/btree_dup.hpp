@@ -3,6 +3,16 @@
 #include "btree.hpp"
 #include "record_manager.h"
 
+#ifdef BTREE_LEAF_COMBINING
+#   include <sched.h>
+#endif
+
+#ifdef BTREE_RELAXED_ERASE
+#   ifndef BTREE_RELAXED_STEPS_PER_OP
+#       define BTREE_RELAXED_STEPS_PER_OP 2 // rebalancing steps run by each update
+#   endif
+#endif
+
 template <typename skey_t, typename sval_t, class RecMgr>
 class btree_dup {
 public:
@@ -57,6 +67,10 @@ public:
     //! Small structure containing statistics about the tree
     typedef typename btree_impl::tree_stats tree_stats;
 
+    //! Node types of the implementation
+    typedef typename btree_impl::LeafNode leaf_type;
+    typedef typename btree_impl::InnerNode inner_type;
+
     //! \}
 
 public:
@@ -128,6 +142,42 @@ private:
 	int init[MAX_THREADS_POW2] = {0,};
     RecMgr* recmgr;
 
+    //! Nodes replaced or copied by the running operation, split by type so
+    //! they are retired or freed with one batch call per type.
+    struct write_set_t {
+        PAD;
+        std::vector<leaf_type*> leaves;
+        std::vector<inner_type*> inner_nodes;
+        PAD;
+    };
+    write_set_t write_set[MAX_THREADS_POW2];
+
+#ifdef BTREE_RELAXED_ERASE
+    //! Relaxed erase: an erase only removes from its leaf and records the key
+    //! if the leaf underflowed. The underflows are repaired later, one shift
+    //! or merge per transaction.
+    struct relaxed_info_t {
+        PAD;
+        std::vector<skey_t> underflows;
+        PAD;
+    };
+    relaxed_info_t relaxed[MAX_THREADS_POW2];
+#endif
+
+#ifdef BTREE_LEAF_COMBINING
+    typedef typename btree_impl::CombineRequest combine_request_t;
+
+    //! Leaf write combining: each thread publishes its update on the target
+    //! leaf, and the thread that combines for the leaf applies the whole batch.
+    struct combine_info_t {
+        PAD;
+        combine_request_t req;
+        std::vector<combine_request_t*> batch;
+        PAD;
+    };
+    combine_info_t combining[MAX_THREADS_POW2];
+#endif
+
     //! \}
 
 public:
@@ -156,6 +206,7 @@ public:
     //! Frees up all used B+ tree memory pages
     ~btree_dup()
     {
+        tree_.clear(0); // while the record manager still owns the nodes
         delete tree_.recmgr; 
     }
 
@@ -175,6 +226,10 @@ public:
     {
         if (!init[tid]) return;
         else init[tid] = !init[tid];
+#ifdef BTREE_RELAXED_ERASE
+        // no other thread repairs this thread's underflows
+        rebalance(tid, -1);
+#endif
         tree_.recmgr->deinitThread(tid);
     }
 
@@ -183,6 +238,14 @@ public:
         return tree_.root_;
     }
 
+    //! Bulk load a sorted range of (key, value) pairs into the empty tree,
+    //! see BTree::bulk_load. Not safe against concurrent operations.
+    template <typename Iterator>
+    void bulk_load(const int tid, Iterator ibegin, Iterator iend)
+    {
+        tree_.bulk_load(tid, ibegin, iend);
+    }
+
 
 public:
     //! \name Key and Value Comparison Function Objects
@@ -221,12 +284,63 @@ public:
     sval_t find(const int tid, const skey_t& key) 
     {
         auto guard = tree_.recmgr->getGuard(tid, true);
-        auto it = tree_.find(key);
-        if (it == tree_.end()) {
-            return NO_VALUE;
+        while (1)
+        {
+            try {
+                auto it = tree_.find(key);
+                if (it == tree_.end()) {
+                    return NO_VALUE;
+                }
+                else {
+                    return (*it).second;
+                }
+            }
+            catch (const tlx::replaced_node_read&) {}
         }
-        else {
-            return (*it).second;
+    }
+
+    //! Look up keys[0,n) under a single guard and store the value of keys[i],
+    //! or NO_VALUE, in values[i]. The descents are interleaved, see
+    //! btree_impl::find_batch.
+    void find_batch(const int tid, const skey_t* keys, size_t n, sval_t* values) {
+        auto guard = tree_.recmgr->getGuard(tid, true);
+        iterator its[btree_impl::find_batch_width];
+        for (size_t base = 0; base < n; base += btree_impl::find_batch_width) {
+            const size_t m = (n - base < btree_impl::find_batch_width)
+                             ? n - base : btree_impl::find_batch_width;
+            while (1)
+            {
+                try {
+                    tree_.find_batch(keys + base, m, its);
+                    break;
+                }
+                catch (const tlx::replaced_node_read&) {}
+            }
+            const iterator end = tree_.end();
+            for (size_t i = 0; i < m; ++i)
+                values[base + i] = (its[i] == end) ? NO_VALUE : (*its[i]).second;
+        }
+    }
+
+    //! Copy the pairs with lo <= key <= hi, in key order, into keys/values and
+    //! return how many there are. Linearizable, an attempt that overlapped a
+    //! commit in its range is retried, see btree_impl::range_query.
+    int range_query(const int tid, const skey_t& lo, const skey_t& hi,
+                    skey_t* keys, sval_t* values)
+    {
+        while (1)
+        {
+            auto guard = tree_.recmgr->getGuard(tid, true);
+            int cnt = 0;
+            try {
+                if (tree_.range_query(lo, hi, [&](const value_type& v) {
+                        keys[cnt] = v.first;
+                        values[cnt] = v.second;
+                        ++cnt;
+                    }))
+                    return cnt;
+            }
+            catch (const tlx::replaced_node_read&) {}
         }
     }
 
@@ -238,45 +352,82 @@ public:
     //! already present.
     sval_t insert(const int tid, const skey_t& key, const sval_t& value) 
     {
+        std::pair<iterator, bool> insertion_res;
+#ifdef BTREE_LEAF_COMBINING
+        if (combine(tid, tlx::COMBINE_INSERT, std::make_pair(key, value)) == tlx::COMBINE_DONE)
+        {
+            insertion_res.second = combining[tid].req.result;
+        }
+        else
+#endif
         while (1)
         {
             auto guard = tree_.recmgr->getGuard(tid);
             tlx::dup_open<key_type, value_type>(tid, &tree_.root_);
             tlx::locking_res = true;
-            auto insertion_res = tree_.insert(tid, std::make_pair(key, value));
-            tree_.dup_paths_to_lca(tid);
+            try {
+                insertion_res = tree_.insert(tid, std::make_pair(key, value));
+                tree_.dup_paths_to_lca(tid);
+            }
+            catch (const tlx::replaced_node_read&) {
+                abandon_attempt(tid);
+            }
 
             if (tlx::locking_res && tlx::dup_close<key_type, value_type>(tid, &tree_.root_))
             {
-                for (auto& d : *tlx::duplications)
-                {
-                    if (d.first->is_leafnode()) {
-                        tree_.recmgr->retire(tid, static_cast<tlx::leaf_node<key_type, value_type>*>(d.first));
-                    }
-                    else {
-                        tree_.recmgr->retire(tid, static_cast<tlx::inner_node<key_type, value_type>*>(d.first));
-                    }
-                }
-                
+                retire_replaced(tid);
+
                 if (insertion_res.second)
-                    return NO_VALUE;
-                else
-                    return value;
+                    ++tree_.stats_[tid].size;
+
+                break;
             }
             else
             {
                 if (tid == 0)
                     std::cout << key << " " << tlx::locking_res << std::endl;
-                for (auto& d : *tlx::allocated)
-                {
-                    if (d.first->is_leafnode()) {
-                        tree_.recmgr->deallocate(tid, static_cast<tlx::leaf_node<key_type, value_type>*>(d.first));
-                    }
-                    else {
-                        tree_.recmgr->deallocate(tid, static_cast<tlx::inner_node<key_type, value_type>*>(d.first));
-                    }
+                deallocate_copies(tid);
+            }
+        }
+
+#ifdef BTREE_RELAXED_ERASE
+        rebalance(tid, BTREE_RELAXED_STEPS_PER_OP);
+#endif
+        if (insertion_res.second)
+            return NO_VALUE;
+        else
+            return value;
+    }
+
+    //! Insert a key/data pair into the B+ tree, or replace the data of the key
+    //! if it is already present. Returns the replaced data, or NO_VALUE if the
+    //! key was inserted. A replace swaps the data in place under the leaf's
+    //! dup_lock instead of duplicating the leaf, see
+    //! btree_impl::replace_in_place.
+    sval_t upsert(const int tid, const skey_t& key, const sval_t& value) 
+    {
+        value_type old;
+        while (1)
+        {
+            typename btree_impl::replace_status status;
+            {
+                auto guard = tree_.recmgr->getGuard(tid, true);
+                try {
+                    status = tree_.replace_in_place(std::make_pair(key, value), &old);
+                }
+                catch (const tlx::replaced_node_read&) {
+                    status = btree_impl::replace_busy;
                 }
             }
+
+            if (status == btree_impl::replace_done)
+                return old.second;
+            if (status == btree_impl::replace_busy)
+                continue;
+
+            // absent: insert, unless the key showed up in the meantime
+            if (insert(tid, key, value) == NO_VALUE)
+                return NO_VALUE;
         }
     }
 
@@ -290,45 +441,345 @@ public:
     //! unique-associative map there is no difference to erase().
     sval_t erase(const int tid, const skey_t& key) 
     {
+        bool removal_res;
+#ifdef BTREE_LEAF_COMBINING
+#ifdef BTREE_RELAXED_ERASE
+        tlx::underflow_res = false;
+#endif
+        if (combine(tid, tlx::COMBINE_ERASE, std::make_pair(key, sval_t())) == tlx::COMBINE_DONE)
+        {
+            removal_res = combining[tid].req.result;
+        }
+        else
+#endif
         while (1)
         {
             auto guard = tree_.recmgr->getGuard(tid);
             tlx::dup_open<key_type, value_type>(tid, &tree_.root_);
             tlx::locking_res = true;
-            auto removal_res = tree_.erase_one(tid, key);
-            tree_.dup_paths_to_lca(tid);
+            try {
+                removal_res = tree_.erase_one(tid, key);
+                tree_.dup_paths_to_lca(tid);
+            }
+            catch (const tlx::replaced_node_read&) {
+                abandon_attempt(tid);
+            }
 
             if (tlx::locking_res && tlx::dup_close<key_type, value_type>(tid, &tree_.root_))
             {
-                for (auto& d : *tlx::duplications)
-                {
-                    if (d.first->is_leafnode()) {
-                        tree_.recmgr->retire(tid, static_cast<tlx::leaf_node<key_type, value_type>*>(d.first));
-                    }
-                    else {
-                        tree_.recmgr->retire(tid, static_cast<tlx::inner_node<key_type, value_type>*>(d.first));
-                    }
-                }
+                retire_replaced(tid);
 
                 if (removal_res)
-                    return (sval_t)(&key);
+                    --tree_.stats_[tid].size;
+
+                break;
+            }
+            else
+            {
+                deallocate_copies(tid);
+            }
+        }
+
+#ifdef BTREE_RELAXED_ERASE
+        if (tlx::underflow_res)
+        {
+            relaxed[tid].underflows.push_back(key);
+            ++tree_.stats_[tid].underflows;
+        }
+        rebalance(tid, BTREE_RELAXED_STEPS_PER_OP);
+#endif
+        if (removal_res)
+            return (sval_t)(&key);
+        else
+            return NO_VALUE;
+    }
+
+    //! Erases all key/data pairs with lo <= key <= hi and returns their number.
+    //! The range is erased by one operation: the subtrees inside the range are
+    //! unlinked whole and retired in one batch with the rebuilt nodes.
+    int erase_range(const int tid, const skey_t& lo, const skey_t& hi) 
+    {
+        size_t erased;
+        while (1)
+        {
+            auto guard = tree_.recmgr->getGuard(tid);
+            tlx::dup_open<key_type, value_type>(tid, &tree_.root_);
+            tlx::locking_res = true;
+            try {
+                erased = tree_.erase_range(tid, lo, hi);
+            }
+            catch (const tlx::replaced_node_read&) {
+                abandon_attempt(tid);
+            }
+
+            if (tlx::locking_res && tlx::dup_close<key_type, value_type>(tid, &tree_.root_))
+            {
+                retire_replaced(tid);
+
+                tree_.stats_[tid].size -= erased;
+                break;
+            }
+            else
+            {
+                deallocate_copies(tid);
+            }
+        }
+
+#ifdef BTREE_RELAXED_ERASE
+        rebalance(tid, BTREE_RELAXED_STEPS_PER_OP);
+#endif
+        return erased;
+    }
+
+#ifdef BTREE_RELAXED_ERASE
+    //! Run up to max_steps pending rebalancing steps of thread tid (all of
+    //! them if max_steps < 0). Every step is its own transaction, so its write
+    //! set is one shift or merge of two siblings and their parent.
+    void rebalance(const int tid, int max_steps = -1)
+    {
+        auto& underflows = relaxed[tid].underflows;
+        while (!underflows.empty() && max_steps-- != 0)
+        {
+            skey_t key = underflows.back();
+            underflows.pop_back();
+
+            bool more;
+            while (1)
+            {
+                auto guard = tree_.recmgr->getGuard(tid);
+                tlx::dup_open<key_type, value_type>(tid, &tree_.root_);
+                tlx::locking_res = true;
+                try {
+                    more = tree_.rebalance_one(tid, key);
+                    tree_.dup_paths_to_lca(tid);
+                }
+                catch (const tlx::replaced_node_read&) {
+                    abandon_attempt(tid);
+                }
+
+                if (tlx::locking_res && tlx::dup_close<key_type, value_type>(tid, &tree_.root_))
+                {
+                    retire_replaced(tid);
+                    break;
+                }
                 else
-                    return NO_VALUE;
+                {
+                    deallocate_copies(tid);
+                }
             }
+
+            if (more)
+                underflows.push_back(key);
             else
+                --tree_.stats_[tid].underflows;
+        }
+    }
+
+    //! Number of underflows recorded by thread tid and not yet repaired
+    size_t pending_underflows(const int tid)
+    {
+        return relaxed[tid].underflows.size();
+    }
+#endif
+
+    //! \}
+
+#ifdef BTREE_LEAF_COMBINING
+private:
+    //! \name Leaf Write Combining
+    //! \{
+
+    //! Publish an insert or erase on its leaf and wait until a combiner has
+    //! applied it, becoming the combiner if there is none. Returns
+    //! COMBINE_DONE, or COMBINE_FALLBACK if the update needs a split or merge
+    //! and has to run alone.
+    int combine(const int tid, const unsigned char kind, const value_type& slotdata)
+    {
+        combine_request_t& req = combining[tid].req;
+        req.kind = kind;
+        req.slotdata = slotdata;
+
+        while (1)
+        {
+            auto guard = tree_.recmgr->getGuard(tid);
+            leaf_type* leaf;
+            try {
+                leaf = tree_.combine_descend(slotdata.first);
+            }
+            catch (const tlx::replaced_node_read&) {
+                continue;
+            }
+            if (leaf == nullptr)
+                return tlx::COMBINE_FALLBACK;
+
+            __atomic_store_n(&req.state, tlx::COMBINE_PENDING, __ATOMIC_RELAXED);
+            combine_request_t* head = __atomic_load_n(&leaf->pending, __ATOMIC_ACQUIRE);
+            do {
+                if (head == (combine_request_t*)tlx::COMBINE_CLOSED)
+                    break;
+                req.next = head;
+            } while (!__atomic_compare_exchange_n(&leaf->pending, &head, &req,
+                                                  false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+            if (head == (combine_request_t*)tlx::COMBINE_CLOSED)
+                continue;
+
+            int state;
+            while ((state = __atomic_load_n(&req.state, __ATOMIC_ACQUIRE)) == tlx::COMBINE_PENDING)
             {
-                for (auto& d : *tlx::allocated)
+                int expected = 0;
+                if (__atomic_load_n(&leaf->combining, __ATOMIC_RELAXED) == 0 &&
+                    __atomic_compare_exchange_n(&leaf->combining, &expected, 1,
+                                                false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
                 {
-                    if (d.first->is_leafnode()) {
-                        tree_.recmgr->deallocate(tid, static_cast<tlx::leaf_node<key_type, value_type>*>(d.first));
-                    }
-                    else {
-                        tree_.recmgr->deallocate(tid, static_cast<tlx::inner_node<key_type, value_type>*>(d.first));
-                    }
+                    combine_leaf(tid, leaf, slotdata.first);
+                }
+                else
+                {
+                    sched_yield();
                 }
             }
+
+            if (state != tlx::COMBINE_RETRY)
+                return state;
         }
     }
 
+    //! Apply every request pending on leaf in one duplication and publish the
+    //! outcomes. If the leaf was replaced its pending list is closed, and the
+    //! requests that arrived meanwhile descend again.
+    void combine_leaf(const int tid, leaf_type* leaf, const skey_t& key)
+    {
+        auto& batch = combining[tid].batch;
+        batch.clear();
+        for (combine_request_t* r = __atomic_exchange_n(&leaf->pending, nullptr, __ATOMIC_ACQ_REL);
+             r != nullptr; r = r->next)
+        {
+            batch.push_back(r);
+        }
+        std::reverse(batch.begin(), batch.end());
+
+        bool reached;
+        while (1)
+        {
+            tlx::dup_open<key_type, value_type>(tid, &tree_.root_);
+            tlx::locking_res = true;
+            try {
+                reached = tree_.combine_leaf(tid, leaf, key, batch);
+                tree_.dup_paths_to_lca(tid);
+            }
+            catch (const tlx::replaced_node_read&) {
+                abandon_attempt(tid);
+            }
+
+            if (tlx::locking_res && tlx::dup_close<key_type, value_type>(tid, &tree_.root_))
+            {
+                retire_replaced(tid);
+                break;
+            }
+            else
+            {
+                deallocate_copies(tid);
+            }
+        }
+
+        // a replaced leaf keeps its combining flag set, nobody combines for it
+        // again and the requests still pending on it start over
+        bool replaced = !reached || tlx::duplications->find(leaf) != tlx::duplications->end();
+        if (replaced)
+        {
+            combine_request_t* r = __atomic_exchange_n(&leaf->pending,
+                (combine_request_t*)tlx::COMBINE_CLOSED, __ATOMIC_ACQ_REL);
+            while (r != nullptr)
+            {
+                // once it sees RETRY the owner may publish r on another leaf
+                combine_request_t* next = r->next;
+                __atomic_store_n(&r->state, tlx::COMBINE_RETRY, __ATOMIC_RELEASE);
+                r = next;
+            }
+        }
+
+        for (combine_request_t* r : batch)
+        {
+            int state = reached ? r->outcome : tlx::COMBINE_RETRY;
+            if (state == tlx::COMBINE_DONE && r->result)
+            {
+                if (r->kind == tlx::COMBINE_INSERT)
+                    ++tree_.stats_[tid].size;
+                else
+                    --tree_.stats_[tid].size;
+            }
+            __atomic_store_n(&r->state, state, __ATOMIC_RELEASE);
+        }
+
+        if (!replaced)
+            __atomic_store_n(&leaf->combining, 0, __ATOMIC_RELEASE);
+    }
+
+    //! \}
+#endif
+
+    //! \name Write Set
+    //! \{
+
+    //! Split the nodes in map by type into the write set of thread tid. A
+    //! node's level never changes, so unlike is_leafnode() this reads no
+    //! duplication.
+    template <typename Map>
+    write_set_t& split_write_set(const int tid, const Map& map)
+    {
+        write_set_t& ws = write_set[tid];
+        ws.leaves.clear();
+        ws.inner_nodes.clear();
+        for (auto& d : map)
+        {
+            if (d.first->level == 0)
+                ws.leaves.push_back(static_cast<leaf_type*>(d.first));
+            else
+                ws.inner_nodes.push_back(static_cast<inner_type*>(d.first));
+        }
+        return ws;
+    }
+
+    //! Retire the nodes replaced by the operation that just committed, and
+    //! count the nodes it published and replaced in the tree statistics.
+    void retire_replaced(const int tid)
+    {
+        // like the size, node counts change only once an operation commits
+        write_set_t& ws = split_write_set(tid, *tlx::allocated);
+        tree_.stats_[tid].leaves += ws.leaves.size();
+        tree_.stats_[tid].inner_nodes += ws.inner_nodes.size();
+
+        split_write_set(tid, *tlx::duplications);
+        tree_.stats_[tid].leaves -= ws.leaves.size();
+        tree_.stats_[tid].inner_nodes -= ws.inner_nodes.size();
+        tree_.recmgr->retire_batch(tid, ws.leaves.data(), ws.leaves.size());
+        tree_.recmgr->retire_batch(tid, ws.inner_nodes.data(), ws.inner_nodes.size());
+#ifdef USE_OP_ARENA
+        tree_.recmgr->arena_commit(tid);
+#endif
+    }
+
+    //! Give up an attempt that read a child pointer from a replaced node, see
+    //! tlx::replaced_node_read. Its locks are released as when dup_prologue()
+    //! finds a node locked, and the attempt fails like one.
+    void abandon_attempt(const int tid)
+    {
+        tlx::dup_unlock_duplications<key_type, value_type>(tid, true);
+        tlx::locking_res = false;
+    }
+
+    //! Free the copies made by an operation that failed to commit. With
+    //! USE_OP_ARENA they all came from the arena, which is just rewound.
+    void deallocate_copies(const int tid)
+    {
+#ifdef USE_OP_ARENA
+        tree_.recmgr->arena_abort(tid);
+#else
+        write_set_t& ws = split_write_set(tid, *tlx::allocated);
+        tree_.recmgr->deallocate_batch(tid, ws.leaves.data(), ws.leaves.size());
+        tree_.recmgr->deallocate_batch(tid, ws.inner_nodes.data(), ws.inner_nodes.size());
+#endif
+    }
+
     //! \}
 };
\ No newline at end of file
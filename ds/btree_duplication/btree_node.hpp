@@ -7,15 +7,21 @@
 #include <algorithm>
 #include <cassert>
 #include <cstddef>
+#include <cstring>
 #include <functional>
 #include <istream>
 #include <memory>
 #include <ostream>
 #include <utility>
 #include <pthread.h>
+#include <cstdint>
 #include <unordered_map>
 #include <iostream>
 
+#ifdef RECLAIM_IBR
+#include "record_manager.h"
+#endif
+
 namespace tlx {
 
 // *** Debugging Macros
@@ -59,6 +65,11 @@ const unsigned char DUP_MASK = 0x01;
 const unsigned char DEL_MASK = 0x02;
 const unsigned int MAX_UINT = std::numeric_limits<unsigned int>::max();
 
+//! Thrown with RECLAIM_IBR when a child pointer was read from a node that was
+//! replaced (see Innernode::load_child()). The operation starts over from the
+//! root.
+struct replaced_node_read {};
+
 
 /*!
  * Generates default traits for a B+ tree used as a set or map. It estimates
@@ -77,10 +88,17 @@ struct btree_default_traits {
     //! printable.
     static const bool debug = false;
 
+#ifdef BTREE_SOA_LEAF
+    //! Number of slots in each leaf of the tree. Estimated so that the key
+    //! array of each leaf has a size of about 256 bytes.
+    static const int leaf_slots =
+        TLX_BTREE_MAX(8, 256 / (sizeof(Key)));
+#else
     //! Number of slots in each leaf of the tree. Estimated so that each node
     //! has a size of about 256 bytes.
     static const int leaf_slots =
         TLX_BTREE_MAX(8, 256 / (sizeof(Value)));
+#endif
 
     //! Number of slots in each inner node of the tree. Estimated so that each
     //! node has a size of about 256 bytes.
@@ -105,9 +123,15 @@ public:
 
 	unsigned char flags;
 	pthread_spinlock_t dup_lock;
+
+#ifdef RECLAIM_IBR
+    //! Era the node was allocated in (see reclaimer_ibr.h)
+    long birth_era;
+#endif
     
 	inline bool is_del() { return (flags & DEL_MASK) == DEL_MASK; }
 	inline void set_del() { flags |= DEL_MASK; }
+	inline void clear_del() { flags &= ~DEL_MASK; }
 
     node();
 
@@ -151,6 +175,10 @@ public:
 
     node * get_child(unsigned short slot) const;
 
+    //! Load the child pointer in slot without the redirection to this
+    //! operation's duplicates done by get_child().
+    node * load_child(unsigned short slot) const;
+
     node ** get_childid_vec();
 
     void set_child(unsigned short slot, node * new_child);
@@ -168,21 +196,100 @@ public:
     void copy_to_slotkey(Key * src_first, Key * src_last, Key * dst_last);
 
     void copy_backward_to_slotkey(Key * src_first, Key * src_last, Key * dst_last);
+
+    //! Copy the header and the used slots of other. The unused tails of the
+    //! key and child arrays are left as they are.
+    void copy_live(const inner_node* other);
+};
+
+#ifdef BTREE_LEAF_COMBINING
+const unsigned char COMBINE_INSERT = 0x01;
+const unsigned char COMBINE_ERASE = 0x02;
+
+//! States of a combining request
+const int COMBINE_PENDING = 0;
+const int COMBINE_DONE = 1;         // applied by a combiner, result is set
+const int COMBINE_FALLBACK = 2;     // needs a split or merge, run it alone
+const int COMBINE_RETRY = 3;        // the leaf was replaced, descend again
+
+//! Pending list of a leaf that was replaced, no more requests are accepted.
+const uintptr_t COMBINE_CLOSED = 0x01;
+
+//! An insert or erase published on the leaf it targets. Whichever thread
+//! combines for that leaf applies all pending requests in one duplication.
+template <typename Key, typename Value>
+class combine_request {
+public:
+    combine_request* next;
+    unsigned char kind;
+    Value slotdata;
+
+    //! Outcome while the combiner's duplication is not yet committed
+    int outcome;
+    bool result;
+
+    //! Published by the combiner after its commit
+    int state;
+};
+#endif
+
+#ifdef BTREE_SOA_LEAF
+//! Position in the key and data arrays of a leaf. Takes the place of the
+//! Value* returned by get_slotdata_vec() when slots are interleaved.
+template <typename Key, typename Value>
+struct leaf_slot_ptr {
+    typedef typename Value::second_type data_type;
+
+    Key* key;
+    data_type* data;
+
+    leaf_slot_ptr operator + (ptrdiff_t n) const { return { key + n, data + n }; }
+
+    leaf_slot_ptr operator - (ptrdiff_t n) const { return { key - n, data - n }; }
 };
+#endif
 
 //! Extended structure of a leaf node in memory. Contains pairs of keys and
-//! data items. Key and data slots are kept together in value_type.
+//! data items. Key and data slots are kept together in value_type, or in two
+//! cache line aligned arrays with BTREE_SOA_LEAF.
 template <typename Key, typename Value>
 class leaf_node : public node {
 public:
+#ifdef BTREE_SOA_LEAF
+    typedef typename Value::second_type data_type;
+    typedef leaf_slot_ptr<Key, Value> slot_ptr;
+#else
+    typedef Value* slot_ptr;
+#endif
+
+#ifdef BTREE_LEAF_COMBINING
+    //! Requests published on this leaf and not yet taken by a combiner
+    combine_request<Key, Value>* pending;
+
+    //! Set while a thread combines the pending requests of this leaf
+    int combining;
+#endif
+
     //! Double linked list pointers to traverse the leaves
     leaf_node* prev_leaf;
 
     //! Double linked list pointers to traverse the leaves
     leaf_node* next_leaf;
 
+    //! Odd while replace_in_place() writes a value, so a range query can tell
+    //! whether the values it read are still current
+    unsigned int version;
+
+#ifdef BTREE_SOA_LEAF
+    //! Keys of the slots, scanned by find_lower() without touching the data
+    alignas(64) Key slotkey[btree_default_traits<Key, Value>::leaf_slots]; // NOLINT
+
+    //! Data items of the slots
+    alignas(64) data_type slotvalue[btree_default_traits<Key, Value>::leaf_slots]; // NOLINT
+#else
     //! Array of (key, data) pairs
     Value slotdata[btree_default_traits<Key, Value>::leaf_slots]; // NOLINT
+#endif
 
     //! Set variables to initial values
     void initialize();
@@ -201,17 +308,23 @@ public:
 
     Value get_slot(unsigned short slot) const;
 
+#ifndef BTREE_SOA_LEAF
     Value& get_slot(unsigned short slot);
+#endif
 
-    Value * get_slotdata_vec();
+    slot_ptr get_slotdata_vec();
 
     //! Set the (key,data) pair in slot. Overloaded function used by
     //! bulk_load().
     void set_slot(unsigned short slot, const Value& value);
 
-    void copy_to_slotdata(Value * src_first, Value * src_last, Value * dst_last);
+    void copy_to_slotdata(slot_ptr src_first, slot_ptr src_last, slot_ptr dst_last);
+
+    void copy_backward_to_slotdata(slot_ptr src_first, slot_ptr src_last, slot_ptr dst_last);
 
-    void copy_backward_to_slotdata(Value * src_first, Value * src_last, Value * dst_last);
+    //! Copy the header and the used slots of other. The unused slots are left
+    //! as they are.
+    void copy_live(const leaf_node* other);
 };
 
 
@@ -294,7 +407,11 @@ bool dup_open(int tid, node** root)
     // right_most_dup = nullptr;
 
 	orig_root = *root;
-	new_root = *root;
+#ifdef RECLAIM_IBR
+    while (ibr_read_barrier())
+        orig_root = *root;
+#endif
+	new_root = orig_root;
 	in_writing_function = true;
 	dup_happened = false;
 
@@ -307,13 +424,17 @@ bool dup_open(int tid, node** root)
 template <typename Key, typename Value>
 void dup_unlock_duplications(int tid, bool all)
 {
-	for (auto& l : *locked)
+	for (auto it = locked->begin(); it != locked->end(); )
 	{
-		if (all || l.second)
+		if (all || it->second)
         {
-            locked->erase(l.first);
-			pthread_spin_unlock(&l.first->dup_lock);
+			pthread_spin_unlock(&it->first->dup_lock);
+            it = locked->erase(it);
         }
+		else
+		{
+			++it;
+		}
 	}
 }
 
@@ -326,6 +447,7 @@ template <typename Key, typename Value>
 bool dup_close(int tid, node** root)
 {
     bool result = true;
+    node* expected_root;
 
 	in_writing_function = false;
 	if (!dup_happened)
@@ -348,13 +470,26 @@ bool dup_close(int tid, node** root)
 		auto orig_parent = static_cast<Innernode*>(d.second.orig_parent);
 		auto orig_idx = d.second.orig_idx;
 
+		// orig is locked, so it is current unless an operation that held the
+		// lock before replaced it: its contents, copied into this operation's
+		// duplicates, may then point to retired nodes
+		if (orig->is_del())
+        {
+			dup_unlock_duplications<Key, Value>(tid, true);
+            result = false;
+            goto end;
+		}
+
         if (duplications->find(orig_parent) != duplications->end() ||
             allocated->find(orig_parent) != allocated->end())
         {
             continue;
         }
         
-		if (orig_parent != nullptr && orig_parent->childid[orig_idx] != orig) 
+		// a parent that another operation replaced still points to orig,
+		// but linking into it would be lost when it is retired
+		if (orig_parent != nullptr &&
+            (orig_parent->is_del() || orig_parent->childid[orig_idx] != orig))
         {
 			dup_unlock_duplications<Key, Value>(tid, true);
             result = false;
@@ -362,6 +497,24 @@ bool dup_close(int tid, node** root)
 		}
 	}
 
+    /* replaced originals stay locked: mark them before any duplicate is
+       reachable, readers that find the mark restart (see load_child()) */
+	for (auto& d : *duplications)
+        d.first->set_del();
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    /* a new root is only installed over the root this operation started from */
+    expected_root = orig_root;
+    if (new_root != orig_root &&
+        !__atomic_compare_exchange_n(root, &expected_root, new_root, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+        for (auto& d : *duplications)
+            d.first->clear_del();
+        dup_unlock_duplications<Key, Value>(tid, true);
+        result = false;
+        goto end;
+    }
+
 	for (auto& d : *duplications)
 	{
 		auto orig = d.first;
@@ -379,10 +532,6 @@ bool dup_close(int tid, node** root)
 		{
             orig_parent->childid[orig_idx] = dup;
 		}
-		else
-		{
-            *root = new_root;
-		}
 	}
 
 	dup_unlock_duplications<Key, Value>(tid, false);
@@ -393,7 +542,8 @@ end:
 
 node::node()
 {
-    allocated->insert({this, true});
+    // new nodes are tracked by BTree::allocate_node(): a pool constructs
+    // records a block at a time, not when the operation takes one
 }
 
 void node::initialize(const unsigned short l) {
@@ -487,20 +637,49 @@ bool Innernode::is_few() const {
 
 template <typename Key, typename Value>
 bool Innernode::is_underflow() const {
+#ifdef BTREE_TOPDOWN_SPLIT
+    // splitting a full inner node ahead of the descent leaves one half a slot
+    // short of the usual minimum
+    const unsigned short slotmin = btree_default_traits<Key, Value>::inner_slots / 2 - 1;
+#else
+    const unsigned short slotmin = btree_default_traits<Key, Value>::inner_slots / 2;
+#endif
     node * orig = (node*)this;
     if (in_writing_function && duplications->find(orig) != duplications->end())
     {
         auto found = duplications->at(orig);
-        return (found.dup->slotuse < btree_default_traits<Key, Value>::inner_slots / 2);
+        return (found.dup->slotuse < slotmin);
     }
 
-    return (node::slotuse < btree_default_traits<Key, Value>::inner_slots / 2);
+    return (node::slotuse < slotmin);
+}
+
+template <typename Key, typename Value>
+node * Innernode::load_child(unsigned short slot) const
+{
+    node* child = __atomic_load_n(&childid[slot], __ATOMIC_ACQUIRE);
+#ifdef RECLAIM_IBR
+    // duplication writes child pointers in place, so every load of one must
+    // extend the era reservation (a path copy only needs this for the root)
+    while (ibr_read_barrier())
+        child = __atomic_load_n(&childid[slot], __ATOMIC_ACQUIRE);
+
+    // a replaced node keeps the children it had while later operations
+    // replace and retire them, and one born after this thread's reservation
+    // may be freed already. dup_close() marks replaced nodes before it links
+    // their duplicates, so if this node is not marked here, child was not
+    // retired before it was read.
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&flags, __ATOMIC_RELAXED) & DEL_MASK)
+        throw replaced_node_read();
+#endif
+    return child;
 }
 
 template <typename Key, typename Value>
 node * Innernode::get_child(unsigned short slot) const 
 {
-    node* child = childid[slot];
+    node* child = load_child(slot);
     if (in_writing_function)
     {
         node * orig = (node*)this;
@@ -604,12 +783,26 @@ void Innernode::copy_backward_to_slotkey(Key * src_first, Key * src_last, Key *
     std::copy_backward(src_first, src_last, dst_last);
 }
 
+template <typename Key, typename Value>
+void Innernode::copy_live(const inner_node* other) {
+    // slotkey directly follows the header, childid is copied apart
+    std::memcpy((void*)this, (const void*)other,
+                (const char*)&other->slotkey[other->slotuse] - (const char*)other);
+    std::memcpy((void*)childid, (const void*)other->childid,
+                (other->slotuse + 1) * sizeof(node*));
+}
+
 
 
 template <typename Key, typename Value>
 void Leafnode::initialize() {
     node::initialize(0);
     prev_leaf = next_leaf = nullptr;
+    version = 0;
+#ifdef BTREE_LEAF_COMBINING
+    pending = nullptr;
+    combining = 0;
+#endif
 }
 
 template <typename Key, typename Value>
@@ -618,10 +811,18 @@ const Key& Leafnode::key(size_t s) const {
     if (in_writing_function && duplications->find(orig) != duplications->end())
     {
         auto found = duplications->at(orig);
+#ifdef BTREE_SOA_LEAF
+        return ((Leafnode*)found.dup)->slotkey[s];
+#else
         return ((Leafnode*)found.dup)->slotdata[s].first;
+#endif
     }
 
+#ifdef BTREE_SOA_LEAF
+    return slotkey[s];
+#else
     return slotdata[s].first;
+#endif
 }
 
 template <typename Key, typename Value>
@@ -667,12 +868,21 @@ Value Leafnode::get_slot(unsigned short slot) const
     if (in_writing_function && duplications->find(orig) != duplications->end())
     {
         auto found = duplications->at(orig);
+#ifdef BTREE_SOA_LEAF
+        return Value(((Leafnode*)found.dup)->slotkey[slot], ((Leafnode*)found.dup)->slotvalue[slot]);
+#else
         return ((Leafnode*)found.dup)->slotdata[slot];
+#endif
     }
 
+#ifdef BTREE_SOA_LEAF
+    return Value(slotkey[slot], slotvalue[slot]);
+#else
     return slotdata[slot];
+#endif
 }
 
+#ifndef BTREE_SOA_LEAF
 template <typename Key, typename Value>
 Value& Leafnode::get_slot(unsigned short slot) 
 {
@@ -686,33 +896,68 @@ Value& Leafnode::get_slot(unsigned short slot)
     return slotdata[slot];
 }
 
+#endif
+
 template <typename Key, typename Value>
-Value * Leafnode::get_slotdata_vec() 
+typename Leafnode::slot_ptr Leafnode::get_slotdata_vec() 
 {
+    Leafnode * self = this;
     node * orig = (node*)this;
     if (in_writing_function && duplications->find(orig) != duplications->end())
     {
         auto found = duplications->at(orig);
-        return &((Leafnode*)found.dup)->slotdata[0];
+        self = (Leafnode*)found.dup;
     }
 
-    return &slotdata[0];
+#ifdef BTREE_SOA_LEAF
+    return { &self->slotkey[0], &self->slotvalue[0] };
+#else
+    return &self->slotdata[0];
+#endif
 }
 
 template <typename Key, typename Value>
 void Leafnode::set_slot(unsigned short slot, const Value& value) {
     TLX_BTREE_ASSERT(slot < node::slotuse);
+#ifdef BTREE_SOA_LEAF
+    slotkey[slot] = value.first;
+    slotvalue[slot] = value.second;
+#else
     slotdata[slot] = value;
+#endif
 }
 
 template <typename Key, typename Value>
-void Leafnode::copy_to_slotdata(Value * src_first, Value * src_last, Value * dst_last) {
+void Leafnode::copy_to_slotdata(slot_ptr src_first, slot_ptr src_last, slot_ptr dst_last) {
+#ifdef BTREE_SOA_LEAF
+    std::copy(src_first.key, src_last.key, dst_last.key);
+    std::copy(src_first.data, src_last.data, dst_last.data);
+#else
     std::copy(src_first, src_last, dst_last);
+#endif
 }
 
 template <typename Key, typename Value>
-void Leafnode::copy_backward_to_slotdata(Value * src_first, Value * src_last, Value * dst_last) {
+void Leafnode::copy_backward_to_slotdata(slot_ptr src_first, slot_ptr src_last, slot_ptr dst_last) {
+#ifdef BTREE_SOA_LEAF
+    std::copy_backward(src_first.key, src_last.key, dst_last.key);
+    std::copy_backward(src_first.data, src_last.data, dst_last.data);
+#else
     std::copy_backward(src_first, src_last, dst_last);
+#endif
+}
+
+template <typename Key, typename Value>
+void Leafnode::copy_live(const leaf_node* other) {
+#ifdef BTREE_SOA_LEAF
+    std::memcpy((void*)this, (const void*)other,
+                (const char*)&other->slotkey[other->slotuse] - (const char*)other);
+    std::memcpy((void*)slotvalue, (const void*)other->slotvalue,
+                other->slotuse * sizeof(data_type));
+#else
+    std::memcpy((void*)this, (const void*)other,
+                (const char*)&other->slotdata[other->slotuse] - (const char*)other);
+#endif
 }
 
 } // namespace tlx
\ No newline at end of file
@@ -11,6 +11,9 @@
 #define TLX_CONTAINER_BTREE_HEADER
 
 #include "btree_node.hpp"
+#include "btree_search.h"
+#include "sharded_stats.h"
+#include "prefetching.h"
 
 // *** Required Headers from the STL
 
@@ -22,6 +25,9 @@
 #include <memory>
 #include <ostream>
 #include <utility>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 namespace tlx {
 
@@ -888,6 +894,14 @@ public:
         double avgfill_leaves() const {
             return static_cast<double>(size) / (leaves * leaf_slots);
         }
+
+        //! Add the counts of another shard
+        tree_stats& operator += (const tree_stats& other) {
+            size += other.size;
+            leaves += other.leaves;
+            inner_nodes += other.inner_nodes;
+            return *this;
+        }
     };
 
     //! \}
@@ -907,8 +921,8 @@ public:
     //! Pointer to last leaf in the double linked leaf chain.
     LeafNode* tail_leaf_;
 
-    //! Other small statistics about the B+ tree.
-    tree_stats stats_;
+    //! Other small statistics about the B+ tree, one shard per thread.
+    sharded_stats<tree_stats> stats_;
 
     //! Key comparison object. More comparison functions are generated from
     //! this < relation.
@@ -1032,6 +1046,22 @@ private:
         return !key_less_(b, a);
     }
 
+    //! Distance in bytes between consecutive keys of a node, as passed to
+    //! key_search: leaves hold value_type pairs, inner nodes a key array.
+    template <typename node_type>
+    static constexpr size_t key_stride() {
+        return std::is_same<node_type, LeafNode>::value
+               ? sizeof(value_type) : sizeof(key_type);
+    }
+
+    //! Prefetches every cache line of the child in the given slot of inner,
+    //! so the key search in the child does not take one dependent miss per
+    //! line. A no-op unless compiled with USE_PREFETCHING (prefetching.h).
+    static void prefetch_child(const InnerNode* inner, unsigned short slot) {
+        prefetch_range((void*)inner->childid[slot],
+                       inner->level == 1 ? sizeof(LeafNode) : sizeof(InnerNode));
+    }
+
     //! True if a > b ? constructed from key_less()
     bool key_greater(const key_type& a, const key_type& b) const {
         return key_less_(b, a);
@@ -1065,36 +1095,55 @@ private:
     //! \name Node Object Allocation and Deallocation Functions
     //! \{
 
+    //! Allocate a node. New nodes are tracked here rather than in
+    //! node::node(), which a pool runs when it fills a whole block.
+    template <typename Node>
+    Node * allocate_node(const int& tid) {
+        Node* n = (Node*)recmgr->template allocate<Node>(tid);
+        if (allocated)
+            allocated->insert({n, true});
+        return n;
+    }
+
     //! Allocate and initialize a leaf node
     LeafNode * allocate_leaf(const int& tid) {
-        LeafNode* n = (LeafNode*)recmgr->template allocate<LeafNode>(tid);
+        LeafNode* n = allocate_node<LeafNode>(tid);
         n->initialize();
-        stats_.leaves++;
+        stats_[tid].leaves++;
         return n;
     }
 
     LeafNode * allocate_leaf(const int& tid, LeafNode * other) {
-        LeafNode* n = (LeafNode*)recmgr->template allocate<LeafNode>(tid);
-        std::memcpy((void *)n, (void *)other, sizeof(LeafNode));
+        LeafNode* n = allocate_node<LeafNode>(tid);
+        n->copy_live(other);
         pthread_spin_init(&n->dup_lock, PTHREAD_PROCESS_PRIVATE);
         return n;
     }
 
     //! Allocate and initialize an inner node
     InnerNode * allocate_inner(const int& tid, unsigned short level) {
-        InnerNode* n = (InnerNode*)recmgr->template allocate<InnerNode>(tid);
+        InnerNode* n = allocate_node<InnerNode>(tid);
         n->initialize(level);
-        stats_.inner_nodes++;
+        stats_[tid].inner_nodes++;
         return n;
     }
 
     InnerNode * allocate_inner(const int& tid, InnerNode * other) {
-        InnerNode* n = (InnerNode*)recmgr->template allocate<InnerNode>(tid);
-        std::memcpy((void *)n, (void *)other, sizeof(InnerNode));
+        InnerNode* n = allocate_node<InnerNode>(tid);
+        n->copy_live(other);
         pthread_spin_init(&n->dup_lock, PTHREAD_PROCESS_PRIVATE);
         return n;
     }
 
+    //! Free a node right away, without the duplication bookkeeping of
+    //! free_node(). Only for nodes no other thread can reach, as in clear().
+    void deallocate_node(const int& tid, node* n) {
+        if (n->is_leafnode())
+            recmgr->deallocate(tid, static_cast<LeafNode*>(n));
+        else
+            recmgr->deallocate(tid, static_cast<InnerNode*>(n));
+    }
+
     //! Correctly free either inner or leaf node, destructs all contained key
     //! and value objects.
     void free_node(const int& tid, node* n) {
@@ -1400,15 +1449,15 @@ public:
         if (root_)
         {
             clear_recursive(tid, root_);
-            free_node(tid, root_);
+            deallocate_node(tid, root_);
 
             root_ = nullptr;
             head_leaf_ = tail_leaf_ = nullptr;
 
-            stats_ = tree_stats();
+            stats_.clear();
         }
 
-        TLX_BTREE_ASSERT(stats_.size == 0);
+        TLX_BTREE_ASSERT(stats_.sum().size == 0);
     }
 
 private:
@@ -1430,7 +1479,7 @@ private:
             for (unsigned short slot = 0; slot < innernode->get_slotuse() + 1; ++slot)
             {
                 clear_recursive(tid, innernode->get_child(slot));
-                free_node(tid, innernode->get_child(slot));
+                deallocate_node(tid, innernode->get_child(slot));
             }
         }
     }
@@ -1534,11 +1583,12 @@ private:
 
             return lo;
         }
-        else // for nodes <= binsearch_threshold do linear search.
+        else // for nodes <= binsearch_threshold count keys with key_search.
         {
-            unsigned short lo = 0;
-            while (lo < n->get_slotuse() && key_less(n->key(lo), key)) ++lo;
-            return lo;
+            unsigned short slotuse = n->get_slotuse();
+            if (slotuse == 0) return 0;
+            return key_search<false, key_stride<node_type>(), key_type, key_compare>::count(
+                &n->key(0), slotuse, key, key_less_);
         }
     }
 
@@ -1581,11 +1631,12 @@ private:
 
             return lo;
         }
-        else // for nodes <= binsearch_threshold do linear search.
+        else // for nodes <= binsearch_threshold count keys with key_search.
         {
-            unsigned short lo = 0;
-            while (lo < n->get_slotuse() && key_lessequal(n->key(lo), key)) ++lo;
-            return lo;
+            unsigned short slotuse = n->get_slotuse();
+            if (slotuse == 0) return 0;
+            return key_search<true, key_stride<node_type>(), key_type, key_compare>::count(
+                &n->key(0), slotuse, key, key_less_);
         }
     }
 
@@ -1597,7 +1648,7 @@ public:
 
     //! Return the number of key/data pairs in the B+ tree
     size_type size() const {
-        return stats_.size;
+        return stats_.sum().size;
     }
 
     //! Returns true if there is at least one key/data pair in the B+ tree
@@ -1611,9 +1662,9 @@ public:
         return size_type(-1);
     }
 
-    //! Return a const reference to the current statistics.
-    const struct tree_stats& get_stats() const {
-        return stats_;
+    //! Return the current statistics, summed over all threads.
+    struct tree_stats get_stats() const {
+        return stats_.sum();
     }
 
     //! \}
@@ -1632,6 +1683,7 @@ public:
         {
             const InnerNode* inner = static_cast<const InnerNode*>(n);
             unsigned short slot = find_lower(inner, key);
+            prefetch_child(inner, slot);
 
             n = inner->get_child(slot);
         }
@@ -1652,6 +1704,7 @@ public:
         {
             const InnerNode* inner = static_cast<const InnerNode*>(n);
             unsigned short slot = find_lower(inner, key);
+            prefetch_child(inner, slot);
 
             n = inner->get_child(slot);
         }
@@ -1673,6 +1726,7 @@ public:
         {
             const InnerNode* inner = static_cast<const InnerNode*>(n);
             unsigned short slot = find_lower(inner, key);
+            prefetch_child(inner, slot);
 
             n = inner->get_child(slot);
         }
@@ -1684,6 +1738,86 @@ public:
                ? const_iterator(leaf, slot) : end();
     }
 
+    //! Number of lookups find_batch() keeps in flight at once.
+    static const size_t find_batch_width = 32;
+
+    //! Looks up keys[0,n) and stores find(keys[i]) in out[i]. Up to
+    //! find_batch_width lookups descend in lock step, one level per round,
+    //! and each round prefetches all the children it picked before searching
+    //! any of them, so their cache misses overlap instead of being taken one
+    //! after the other. All leaves are at the same depth, so the lookups of a
+    //! round reach the leaves together. Prefetches regardless of
+    //! USE_PREFETCHING.
+    void find_batch(const key_type* keys, size_t n, iterator* out) {
+        node* root = root_;
+        if (!root) {
+            for (size_t i = 0; i < n; ++i) out[i] = end();
+            return;
+        }
+
+        node* cur[find_batch_width];
+        for (size_t base = 0; base < n; base += find_batch_width)
+        {
+            const key_type* k = keys + base;
+            const size_t m = (n - base < find_batch_width) ? n - base : find_batch_width;
+            std::fill(cur, cur + m, root);
+
+            while (!cur[0]->is_leafnode())
+            {
+                for (size_t i = 0; i < m; ++i)
+                {
+                    const InnerNode* inner = static_cast<const InnerNode*>(cur[i]);
+                    unsigned short slot = find_lower(inner, k[i]);
+                    cur[i] = inner->get_child(slot);
+                    prefetch_lines(cur[i], inner->level == 1 ? sizeof(LeafNode) : sizeof(InnerNode));
+                }
+            }
+
+            for (size_t i = 0; i < m; ++i)
+            {
+                LeafNode* leaf = static_cast<LeafNode*>(cur[i]);
+                unsigned short slot = find_lower(leaf, k[i]);
+                out[base + i] = (slot < leaf->get_slotuse() && key_equal(k[i], leaf->key(slot)))
+                                ? iterator(leaf, slot) : end();
+            }
+        }
+    }
+
+    //! Outcome of replace_in_place().
+    enum replace_status { replace_done, replace_absent, replace_busy };
+
+    //! Swap the data of key in its leaf without duplicating anything, a new
+    //! value leaves the shape of the tree unchanged. The slot is written under
+    //! the leaf's dup_lock: a leaf that was duplicated or merged away keeps its
+    //! lock forever, so holding it means the leaf is still in the tree and
+    //! nobody is copying it. Returns replace_busy if the lock is taken and
+    //! replace_absent if key is not in the tree, the replaced data goes to
+    //! *old otherwise. The caller must hold a record manager guard.
+    replace_status replace_in_place(const value_type& value, value_type* old) {
+        const key_type& key = key_of_value::get(value);
+        node* n = root_;
+        if (!n) return replace_absent;
+
+        while (!n->is_leafnode())
+        {
+            const InnerNode* inner = static_cast<const InnerNode*>(n);
+            n = inner->get_child(find_lower(inner, key));
+        }
+
+        LeafNode* leaf = static_cast<LeafNode*>(n);
+        unsigned short slot = find_lower(leaf, key);
+        if (slot >= leaf->get_slotuse() || !key_equal(key, leaf->key(slot)))
+            return replace_absent;
+
+        if (pthread_spin_trylock(&leaf->dup_lock))
+            return replace_busy;
+
+        *old = leaf->get_slot(slot);
+        __atomic_store_n(&leaf->slotdata[slot].second, value.second, __ATOMIC_RELEASE);
+        pthread_spin_unlock(&leaf->dup_lock);
+        return replace_done;
+    }
+
     //! Tries to locate a key in the B+ tree and returns the number of identical
     //! key entries found.
     size_type count(const key_type& key) const {
@@ -1694,6 +1828,7 @@ public:
         {
             const InnerNode* inner = static_cast<const InnerNode*>(n);
             unsigned short slot = find_lower(inner, key);
+            prefetch_child(inner, slot);
 
             n = inner->get_child(slot);
         }
@@ -1726,6 +1861,7 @@ public:
         {
             const InnerNode* inner = static_cast<const InnerNode*>(n);
             unsigned short slot = find_lower(inner, key);
+            prefetch_child(inner, slot);
 
             n = inner->get_child(slot);
         }
@@ -1746,6 +1882,7 @@ public:
         {
             const InnerNode* inner = static_cast<const InnerNode*>(n);
             unsigned short slot = find_lower(inner, key);
+            prefetch_child(inner, slot);
 
             n = inner->get_child(slot);
         }
@@ -1766,6 +1903,7 @@ public:
         {
             const InnerNode* inner = static_cast<const InnerNode*>(n);
             unsigned short slot = find_upper(inner, key);
+            prefetch_child(inner, slot);
 
             n = inner->get_child(slot);
         }
@@ -1786,6 +1924,7 @@ public:
         {
             const InnerNode* inner = static_cast<const InnerNode*>(n);
             unsigned short slot = find_upper(inner, key);
+            prefetch_child(inner, slot);
 
             n = inner->get_child(slot);
         }
@@ -1867,7 +2006,7 @@ public:
 
             if (other.size() != 0)
             {
-                stats_.leaves = stats_.inner_nodes = 0;
+                stats_.clear();
                 if (other.root_) {
                     root_ = copy_recursive(0, other.root_); // <=====
                 }
@@ -1888,7 +2027,8 @@ public:
           allocator_(other.get_allocator()) {
         if (size() > 0)
         {
-            stats_.leaves = stats_.inner_nodes = 0;
+            stats_.clear();
+            stats_[0].size = other.size();
             if (other.root_) {
                 root_ = copy_recursive(0, other.root_); // <=====
             }
@@ -2030,8 +2170,7 @@ private:
             // root_ = newroot;
         }
 
-        // increment size if the item was inserted
-        if (r.second) ++stats_.size;
+        // the size is counted by the caller once its copy is published
 
 #ifdef TLX_BTREE_DEBUG
         if (debug) print(std::cout);
@@ -2063,6 +2202,8 @@ private:
             node* newchild = nullptr;
             
             unsigned short slot = find_lower(inner, key);
+            
+            prefetch_child(inner, slot);
 
             TLX_BTREE_PRINT(
                 "BTree::insert_descend into " << inner->get_child(slot));
@@ -2344,105 +2485,69 @@ public:
 
     //! Bulk load a sorted range. Loads items into leaves and constructs a
     //! B-tree above them. The tree must be empty when calling this function.
+    //! The iterators must be random access: each level is split into equal
+    //! chunks that are filled in parallel when compiled with OpenMP. Nodes are
+    //! allocated with the OpenMP thread number as tid, so the caller must have
+    //! initialized those threads with the record manager.
     template <typename Iterator>
     void bulk_load(const int& tid, Iterator ibegin, Iterator iend) {
         TLX_BTREE_ASSERT(empty());
 
-        stats_.size = iend - ibegin;
-
         // calculate number of leaves needed, round up.
-        size_t num_items = iend - ibegin;
-        size_t num_leaves = (num_items + leaf_slotmax - 1) / leaf_slotmax;
+        const size_t num_items = iend - ibegin;
+        if (num_items == 0) return;
+        const size_t num_leaves = (num_items + leaf_slotmax - 1) / leaf_slotmax;
 
-        TLX_BTREE_PRINT("BTree::bulk_load, level 0: " << stats_.size <<
+        stats_[tid].size = num_items;
+
+        TLX_BTREE_PRINT("BTree::bulk_load, level 0: " << num_items <<
                         " items into " << num_leaves <<
                         " leaves with up to " <<
-                        ((iend - ibegin + num_leaves - 1) / num_leaves) <<
+                        ((num_items + num_leaves - 1) / num_leaves) <<
                         " items per leaf.");
 
-        Iterator it = ibegin;
+        // nodes of the level being built, and the max key of any descendant
+        // of each of them.
+        node** level_nodes = new node*[num_leaves];
+        const key_type** level_maxkey = new const key_type*[num_leaves];
+
+        // leaf i gets items [i * N / L, (i + 1) * N / L). Chunk sizes differ
+        // by at most one, so no leaf is underfull.
+        #pragma omp parallel for schedule(static)
         for (size_t i = 0; i < num_leaves; ++i)
         {
-            // allocate new leaf node
-            LeafNode* leaf = allocate_leaf(tid);
+            LeafNode* leaf = allocate_leaf(bulk_load_tid(tid));
 
-            // copy keys or (key,value) pairs into leaf nodes, uses template
-            // switch leaf->set_slot().
-            leaf->set_slotuse(static_cast<int>(num_items / (num_leaves - i)));
-            for (size_t s = 0; s < leaf->get_slotuse(); ++s, ++it)
-                leaf->set_slot(s, *it);
+            const size_t first = i * num_items / num_leaves;
+            const size_t last = (i + 1) * num_items / num_leaves;
+            leaf->set_slotuse(static_cast<int>(last - first));
+            for (size_t s = 0; s < last - first; ++s)
+                leaf->set_slot(s, ibegin[first + s]);
 
-            if (tail_leaf_ != nullptr) {
-                tail_leaf_->next_leaf = leaf;
-                leaf->prev_leaf = tail_leaf_;
-            }
-            else {
-                head_leaf_ = leaf;
-            }
-            tail_leaf_ = leaf;
-
-            num_items -= leaf->get_slotuse();
+            level_nodes[i] = leaf;
+            level_maxkey[i] = &leaf->key(leaf->get_slotuse() - 1);
         }
 
-        TLX_BTREE_ASSERT(it == iend && num_items == 0);
-
-        // if the btree is so small to fit into one leaf, then we're done.
-        if (head_leaf_ == tail_leaf_) {
-            root_ = head_leaf_;
-            return;
-        }
-
-        TLX_BTREE_ASSERT(stats_.leaves == num_leaves);
-
-        // create first level of inner nodes, pointing to the leaves.
-        size_t num_parents =
-            (num_leaves + (inner_slotmax + 1) - 1) / (inner_slotmax + 1);
-
-        TLX_BTREE_PRINT("BTree::bulk_load, level 1: " <<
-                        num_leaves << " leaves in " <<
-                        num_parents << " inner nodes with up to " <<
-                        ((num_leaves + num_parents - 1) / num_parents) <<
-                        " leaves per inner node.");
-
-        // save inner nodes and maxkey for next level.
-        typedef std::pair<InnerNode*, const key_type*> nextlevel_type;
-        nextlevel_type* nextlevel = new nextlevel_type[num_parents];
-
-        LeafNode* leaf = head_leaf_;
-        for (size_t i = 0; i < num_parents; ++i)
+        // link the leaves once they all exist.
+        #pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < num_leaves; ++i)
         {
-            // allocate new inner node at level 1
-            InnerNode* n = allocate_inner(tid, 1);
-
-            n->set_slotuse(static_cast<int>(num_leaves / (num_parents - i)));
-            TLX_BTREE_ASSERT(n->get_slotuse() > 0);
-            // this counts keys, but an inner node has keys+1 children.
-            n->set_slotuse(n->get_slotuse() - 1);
-
-            // copy last key from each leaf and set child
-            for (unsigned short s = 0; s < n->get_slotuse(); ++s)
-            {
-                n->set_slotkey(s, leaf->key(leaf->get_slotuse() - 1));
-                n->set_child(s, leaf);
-                leaf = leaf->next_leaf;
-            }
-            n->set_child(n->get_slotuse(), leaf);
-
-            // track max key of any descendant.
-            nextlevel[i].first = n;
-            nextlevel[i].second = &leaf->key(leaf->get_slotuse() - 1);
-
-            leaf = leaf->next_leaf;
-            num_leaves -= n->get_slotuse() + 1;
+            LeafNode* leaf = static_cast<LeafNode*>(level_nodes[i]);
+            leaf->prev_leaf = (i > 0)
+                ? static_cast<LeafNode*>(level_nodes[i - 1]) : nullptr;
+            leaf->next_leaf = (i + 1 < num_leaves)
+                ? static_cast<LeafNode*>(level_nodes[i + 1]) : nullptr;
         }
 
-        TLX_BTREE_ASSERT(leaf == nullptr && num_leaves == 0);
+        head_leaf_ = static_cast<LeafNode*>(level_nodes[0]);
+        tail_leaf_ = static_cast<LeafNode*>(level_nodes[num_leaves - 1]);
 
-        // recursively build inner nodes pointing to inner nodes.
-        for (int level = 2; num_parents != 1; ++level)
+        // build inner levels the same way until a single node is left. if the
+        // btree is so small to fit into one leaf, that leaf is the root.
+        size_t num_children = num_leaves;
+        for (unsigned short level = 1; num_children != 1; ++level)
         {
-            size_t num_children = num_parents;
-            num_parents =
+            const size_t num_parents =
                 (num_children + (inner_slotmax + 1) - 1) / (inner_slotmax + 1);
 
             TLX_BTREE_PRINT(
@@ -2452,40 +2557,42 @@ public:
                 ((num_children + num_parents - 1) / num_parents) <<
                     " children per inner node.");
 
-            size_t inner_index = 0;
+            node** parents = new node*[num_parents];
+            const key_type** parent_maxkey = new const key_type*[num_parents];
+
+            #pragma omp parallel for schedule(static)
             for (size_t i = 0; i < num_parents; ++i)
             {
-                // allocate new inner node at level
-                InnerNode* n = allocate_inner(tid, level);
+                InnerNode* n = allocate_inner(bulk_load_tid(tid), level);
 
-                n->set_slotuse(static_cast<int>(num_children / (num_parents - i)));
-                TLX_BTREE_ASSERT(n->get_slotuse() > 0);
-                // this counts keys, but an inner node has keys+1 children.
-                n->set_slotuse(n->get_slotuse() - 1);
+                // an inner node has one more child than keys.
+                const size_t first = i * num_children / num_parents;
+                const size_t last = (i + 1) * num_children / num_parents;
+                TLX_BTREE_ASSERT(last - first > 0);
+                n->set_slotuse(static_cast<int>(last - first - 1));
 
-                // copy children and maxkeys from nextlevel
-                for (unsigned short s = 0; s < n->get_slotuse(); ++s)
+                // copy max key of each child but the last and set children
+                for (unsigned short s = 0; s < last - first - 1; ++s)
                 {
-                    n->set_slotkey(s, *nextlevel[inner_index].second);
-                    n->set_child(s, nextlevel[inner_index].first);
-                    ++inner_index;
+                    n->set_slotkey(s, *level_maxkey[first + s]);
+                    n->set_child(s, level_nodes[first + s]);
                 }
-                n->set_child(n->get_slotuse(), nextlevel[inner_index].first);
-
-                // reuse nextlevel array for parents, because we can overwrite
-                // slots we've already consumed.
-                nextlevel[i].first = n;
-                nextlevel[i].second = nextlevel[inner_index].second;
+                n->set_child(static_cast<unsigned short>(last - first - 1), level_nodes[last - 1]);
 
-                ++inner_index;
-                num_children -= n->get_slotuse() + 1;
+                parents[i] = n;
+                parent_maxkey[i] = level_maxkey[last - 1];
             }
 
-            TLX_BTREE_ASSERT(num_children == 0);
+            delete[] level_nodes;
+            delete[] level_maxkey;
+            level_nodes = parents;
+            level_maxkey = parent_maxkey;
+            num_children = num_parents;
         }
 
-        root_ = nextlevel[0].first;
-        delete[] nextlevel;
+        root_ = level_nodes[0];
+        delete[] level_nodes;
+        delete[] level_maxkey;
 
         if (self_verify) verify();
     }
@@ -2493,6 +2600,15 @@ public:
     //! \}
 
 private:
+    //! Allocation tid of the calling thread inside bulk_load's parallel loops.
+    static int bulk_load_tid(const int& tid) {
+#ifdef _OPENMP
+        return omp_get_thread_num();
+#else
+        return tid;
+#endif
+    }
+
     //! \name Support Class Encapsulating Deletion Results
     //! \{
 
@@ -2568,8 +2684,6 @@ public:
         result_t result = erase_one_descend(
             tid, key, orig_root, nullptr, nullptr, nullptr, nullptr, nullptr, 0);
 
-        if (!result.has(btree_not_found))
-            --stats_.size;
 
 #ifdef TLX_BTREE_DEBUG
         if (debug) print(std::cout);
@@ -2605,8 +2719,6 @@ public:
         result_t result = erase_iter_descend(
             tid, iter, root_, nullptr, nullptr, nullptr, nullptr, nullptr, 0);
 
-        if (!result.has(btree_not_found))
-            --stats_.size;
 
 #ifdef TLX_BTREE_DEBUG
         if (debug) print(std::cout);
@@ -2737,9 +2849,9 @@ private:
                     new_head_leaf = new_tail_leaf = nullptr; // TODO
 
                     // will be decremented soon by insert_start()
-                    TLX_BTREE_ASSERT(stats_.size == 1);
-                    TLX_BTREE_ASSERT(stats_.leaves == 0);
-                    TLX_BTREE_ASSERT(stats_.inner_nodes == 0);
+                    TLX_BTREE_ASSERT(stats_.sum().size == 1);
+                    TLX_BTREE_ASSERT(stats_.sum().leaves == 0);
+                    TLX_BTREE_ASSERT(stats_.sum().inner_nodes == 0);
                     
                     return btree_ok;
                 }
@@ -2811,6 +2923,8 @@ private:
 
             unsigned short slot = find_lower(inner, key);
 
+            prefetch_child(inner, slot);
+
             if (slot == 0) {
                 myleft =
                     (left == nullptr) ? nullptr :
@@ -3113,9 +3227,9 @@ private:
                     head_leaf_ = tail_leaf_ = nullptr;
 
                     // will be decremented soon by insert_start()
-                    TLX_BTREE_ASSERT(stats_.size == 1);
-                    TLX_BTREE_ASSERT(stats_.leaves == 0);
-                    TLX_BTREE_ASSERT(stats_.inner_nodes == 0);
+                    TLX_BTREE_ASSERT(stats_.sum().size == 1);
+                    TLX_BTREE_ASSERT(stats_.sum().leaves == 0);
+                    TLX_BTREE_ASSERT(stats_.sum().inner_nodes == 0);
 
                     return btree_ok;
                 }
@@ -3913,9 +4027,10 @@ public:
         {
             verify_node(root_, &minkey, &maxkey, vstats);
 
-            tlx_die_unless(vstats.size == stats_.size);
-            tlx_die_unless(vstats.leaves == stats_.leaves);
-            tlx_die_unless(vstats.inner_nodes == stats_.inner_nodes);
+            tree_stats stats = stats_.sum();
+            tlx_die_unless(vstats.size == stats.size);
+            tlx_die_unless(vstats.leaves == stats.leaves);
+            tlx_die_unless(vstats.inner_nodes == stats.inner_nodes);
 
             verify_leaflinks();
         }
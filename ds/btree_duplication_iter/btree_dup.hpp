@@ -156,6 +156,7 @@ public:
     //! Frees up all used B+ tree memory pages
     ~btree_dup()
     {
+        tree_.clear(0); // while the record manager still owns the nodes
         delete tree_.recmgr; 
     }
 
@@ -183,6 +184,14 @@ public:
         return tree_.root_;
     }
 
+    //! Bulk load a sorted range of (key, value) pairs into the empty tree,
+    //! see BTree::bulk_load. Not safe against concurrent operations.
+    template <typename Iterator>
+    void bulk_load(const int tid, Iterator ibegin, Iterator iend)
+    {
+        tree_.bulk_load(tid, ibegin, iend);
+    }
+
 
 public:
     //! \name Key and Value Comparison Function Objects
@@ -230,6 +239,22 @@ public:
         }
     }
 
+    //! Look up keys[0,n) under a single guard and store the value of keys[i],
+    //! or NO_VALUE, in values[i]. The descents are interleaved, see
+    //! btree_impl::find_batch.
+    void find_batch(const int tid, const skey_t* keys, size_t n, sval_t* values) {
+        auto guard = tree_.recmgr->getGuard(tid, true);
+        iterator its[btree_impl::find_batch_width];
+        for (size_t base = 0; base < n; base += btree_impl::find_batch_width) {
+            const size_t m = (n - base < btree_impl::find_batch_width)
+                             ? n - base : btree_impl::find_batch_width;
+            tree_.find_batch(keys + base, m, its);
+            const iterator end = tree_.end();
+            for (size_t i = 0; i < m; ++i)
+                values[base + i] = (its[i] == end) ? NO_VALUE : (*its[i]).second;
+        }
+    }
+
 public:
     //! \name Public Insertion Functions
     //! \{
@@ -267,8 +292,10 @@ public:
                     }
                 }
                 
-                if (insertion_res.second)
+                if (insertion_res.second) {
+                    ++tree_.stats_[tid].size;
                     return NO_VALUE;
+                }
                 else
                     return value;
             }
@@ -287,6 +314,33 @@ public:
         }
     }
 
+    //! Insert a key/data pair into the B+ tree, or replace the data of the key
+    //! if it is already present. Returns the replaced data, or NO_VALUE if the
+    //! key was inserted. A replace swaps the data in place under the leaf's
+    //! dup_lock instead of duplicating the leaf, see
+    //! btree_impl::replace_in_place.
+    sval_t upsert(const int tid, const skey_t& key, const sval_t& value) 
+    {
+        value_type old;
+        while (1)
+        {
+            typename btree_impl::replace_status status;
+            {
+                auto guard = tree_.recmgr->getGuard(tid, true);
+                status = tree_.replace_in_place(std::make_pair(key, value), &old);
+            }
+
+            if (status == btree_impl::replace_done)
+                return old.second;
+            if (status == btree_impl::replace_busy)
+                continue;
+
+            // absent: insert, unless the key showed up in the meantime
+            if (insert(tid, key, value) == NO_VALUE)
+                return NO_VALUE;
+        }
+    }
+
     //! \}
 
 public:
@@ -326,8 +380,10 @@ public:
                     }
                 }
 
-                if (removal_res)
+                if (removal_res) {
+                    --tree_.stats_[tid].size;
                     return (sval_t)(&key);
+                }
                 else
                     return NO_VALUE;
             }
@@ -7,6 +7,7 @@
 #include <algorithm>
 #include <cassert>
 #include <cstddef>
+#include <cstring>
 #include <functional>
 #include <istream>
 #include <memory>
@@ -176,6 +177,10 @@ public:
     void copy_to_slotkey(Key * src_first, Key * src_last, Key * dst_last);
 
     void copy_backward_to_slotkey(Key * src_first, Key * src_last, Key * dst_last);
+
+    //! Copy the header and the used slots of other. The unused tails of the
+    //! key and child arrays are left as they are.
+    void copy_live(const inner_node* other);
 };
 
 //! Extended structure of a leaf node in memory. Contains pairs of keys and
@@ -228,6 +233,10 @@ public:
 
     void copy_backward_to_slotdata(Value * src_first, Value * src_last, Value * dst_last);
 
+    //! Copy the header and the used slots of other. The unused slots are left
+    //! as they are.
+    void copy_live(const leaf_node* other);
+
     void set_next_leaf(leaf_node * new_next);
 
     void set_prev_leaf(leaf_node * new_prev);
@@ -487,7 +496,8 @@ end:
 
 node::node()
 {
-    allocated->insert({this, true});
+    // new nodes are tracked by BTree::allocate_node(): a pool constructs
+    // records a block at a time, not when the operation takes one
 }
 
 void node::initialize(const unsigned short l) {
@@ -726,6 +736,15 @@ void Innernode::copy_backward_to_slotkey(Key * src_first, Key * src_last, Key *
     std::copy_backward(src_first, src_last, dst_last);
 }
 
+template <typename Key, typename Value>
+void Innernode::copy_live(const inner_node* other) {
+    // slotkey directly follows the header, childid is copied apart
+    std::memcpy((void*)this, (const void*)other,
+                (const char*)&other->slotkey[other->slotuse] - (const char*)other);
+    std::memcpy((void*)childid, (const void*)other->childid,
+                (other->slotuse + 1) * sizeof(node*));
+}
+
 
 
 template <typename Key, typename Value>
@@ -879,6 +898,12 @@ void Leafnode::copy_backward_to_slotdata(Value * src_first, Value * src_last, Va
     std::copy_backward(src_first, src_last, dst_last);
 }
 
+template <typename Key, typename Value>
+void Leafnode::copy_live(const leaf_node* other) {
+    std::memcpy((void*)this, (const void*)other,
+                (const char*)&other->slotdata[other->slotuse] - (const char*)other);
+}
+
 template <typename Key, typename Value>
 void Leafnode::set_next_leaf(Leafnode * new_next)
 {
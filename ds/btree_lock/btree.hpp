@@ -11,6 +11,9 @@
 #define TLX_CONTAINER_BTREE_HEADER
 
 #include "die/core.hpp"
+#include "btree_search.h"
+#include "sharded_stats.h"
+#include "prefetching.h"
 
 // *** Required Headers from the STL
 
@@ -22,6 +25,9 @@
 #include <memory>
 #include <ostream>
 #include <utility>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include <cstring>
 #include <iostream>
 
@@ -1178,6 +1184,14 @@ public:
         double avgfill_leaves() const {
             return static_cast<double>(size) / (leaves * leaf_slots);
         }
+
+        //! Add the counts of another shard
+        tree_stats& operator += (const tree_stats& other) {
+            size += other.size;
+            leaves += other.leaves;
+            inner_nodes += other.inner_nodes;
+            return *this;
+        }
     };
 
     //! \}
@@ -1197,8 +1211,8 @@ public:
     //! Pointer to last leaf in the double linked leaf chain.
     LeafNode* tail_leaf_;
 
-    //! Other small statistics about the B+ tree.
-    tree_stats stats_;
+    //! Other small statistics about the B+ tree, one shard per thread.
+    sharded_stats<tree_stats> stats_;
 
     //! Key comparison object. More comparison functions are generated from
     //! this < relation.
@@ -1325,6 +1339,22 @@ private:
         return !key_less_(b, a);
     }
 
+    //! Distance in bytes between consecutive keys of a node, as passed to
+    //! key_search: leaves hold value_type pairs, inner nodes a key array.
+    template <typename node_type>
+    static constexpr size_t key_stride() {
+        return std::is_same<node_type, LeafNode>::value
+               ? sizeof(value_type) : sizeof(key_type);
+    }
+
+    //! Prefetches every cache line of the child in the given slot of inner,
+    //! so the key search in the child does not take one dependent miss per
+    //! line. A no-op unless compiled with USE_PREFETCHING (prefetching.h).
+    static void prefetch_child(const InnerNode* inner, unsigned short slot) {
+        prefetch_range((void*)inner->childid[slot],
+                       inner->level == 1 ? sizeof(LeafNode) : sizeof(InnerNode));
+    }
+
     //! True if a > b ? constructed from key_less()
     bool key_greater(const key_type& a, const key_type& b) const {
         return key_less_(b, a);
@@ -1372,7 +1402,7 @@ private:
     LeafNode * allocate_leaf(const int& tid) {
         LeafNode* n = (LeafNode*)recmgr->template allocate<LeafNode>(tid);
         n->initialize();
-        stats_.leaves++;
+        stats_[tid].leaves++;
         return n;
 
         // LeafNode* n = new (leaf_node_allocator().allocate(1)) LeafNode();
@@ -1391,7 +1421,7 @@ private:
     InnerNode * allocate_inner(const int& tid, unsigned short level) {
         InnerNode* n = (InnerNode*)recmgr->template allocate<InnerNode>(tid);
         n->initialize(level);
-        stats_.inner_nodes++;
+        stats_[tid].inner_nodes++;
         return n;
 
         // InnerNode* n = new (inner_node_allocator().allocate(1)) InnerNode();
@@ -1415,7 +1445,7 @@ private:
             // a.destroy(ln);
             // a.deallocate(ln, 1);
             recmgr->deallocate(tid, ln);
-            stats_.leaves--;
+            stats_[tid].leaves--;
         }
         else {
             InnerNode* in = static_cast<InnerNode*>(n);
@@ -1423,7 +1453,7 @@ private:
             // a.destroy(in);
             // a.deallocate(in, 1);
             recmgr->deallocate(tid, in);
-            stats_.inner_nodes--;
+            stats_[tid].inner_nodes--;
         }
     }
 
@@ -1443,10 +1473,10 @@ public:
             root_ = nullptr;
             head_leaf_ = tail_leaf_ = nullptr;
 
-            stats_ = tree_stats();
+            stats_.clear();
         }
 
-        TLX_BTREE_ASSERT(stats_.size == 0);
+        TLX_BTREE_ASSERT(stats_.sum().size == 0);
     }
 
 private:
@@ -1572,11 +1602,12 @@ private:
 
             return lo;
         }
-        else // for nodes <= binsearch_threshold do linear search.
+        else // for nodes <= binsearch_threshold count keys with key_search.
         {
-            unsigned short lo = 0;
-            while (lo < n->slotuse && key_less(n->key(lo), key)) ++lo;
-            return lo;
+            unsigned short slotuse = n->slotuse;
+            if (slotuse == 0) return 0;
+            return key_search<false, key_stride<node_type>(), key_type, key_compare>::count(
+                &n->key(0), slotuse, key, key_less_);
         }
     }
 
@@ -1619,11 +1650,12 @@ private:
 
             return lo;
         }
-        else // for nodes <= binsearch_threshold do linear search.
+        else // for nodes <= binsearch_threshold count keys with key_search.
         {
-            unsigned short lo = 0;
-            while (lo < n->slotuse && key_lessequal(n->key(lo), key)) ++lo;
-            return lo;
+            unsigned short slotuse = n->slotuse;
+            if (slotuse == 0) return 0;
+            return key_search<true, key_stride<node_type>(), key_type, key_compare>::count(
+                &n->key(0), slotuse, key, key_less_);
         }
     }
 
@@ -1635,7 +1667,7 @@ public:
 
     //! Return the number of key/data pairs in the B+ tree
     size_type size() const {
-        return stats_.size;
+        return stats_.sum().size;
     }
 
     //! Returns true if there is at least one key/data pair in the B+ tree
@@ -1649,9 +1681,9 @@ public:
         return size_type(-1);
     }
 
-    //! Return a const reference to the current statistics.
-    const struct tree_stats& get_stats() const {
-        return stats_;
+    //! Return the current statistics, summed over all threads.
+    struct tree_stats get_stats() const {
+        return stats_.sum();
     }
 
     //! \}
@@ -1670,6 +1702,7 @@ public:
         {
             const InnerNode* inner = static_cast<const InnerNode*>(n);
             unsigned short slot = find_lower(inner, key);
+            prefetch_child(inner, slot);
 
             n = inner->childid[slot];
         }
@@ -1690,6 +1723,7 @@ public:
         {
             const InnerNode* inner = static_cast<const InnerNode*>(n);
             unsigned short slot = find_lower(inner, key);
+            prefetch_child(inner, slot);
 
             n = inner->childid[slot];
         }
@@ -1711,6 +1745,7 @@ public:
         {
             const InnerNode* inner = static_cast<const InnerNode*>(n);
             unsigned short slot = find_lower(inner, key);
+            prefetch_child(inner, slot);
 
             n = inner->childid[slot];
         }
@@ -1722,6 +1757,51 @@ public:
                ? const_iterator(leaf, slot) : end();
     }
 
+    //! Number of lookups find_batch() keeps in flight at once.
+    static const size_t find_batch_width = 32;
+
+    //! Looks up keys[0,n) and stores find(keys[i]) in out[i]. Up to
+    //! find_batch_width lookups descend in lock step, one level per round,
+    //! and each round prefetches all the children it picked before searching
+    //! any of them, so their cache misses overlap instead of being taken one
+    //! after the other. All leaves are at the same depth, so the lookups of a
+    //! round reach the leaves together. Prefetches regardless of
+    //! USE_PREFETCHING.
+    void find_batch(const key_type* keys, size_t n, iterator* out) {
+        node* root = root_;
+        if (!root) {
+            for (size_t i = 0; i < n; ++i) out[i] = end();
+            return;
+        }
+
+        node* cur[find_batch_width];
+        for (size_t base = 0; base < n; base += find_batch_width)
+        {
+            const key_type* k = keys + base;
+            const size_t m = (n - base < find_batch_width) ? n - base : find_batch_width;
+            std::fill(cur, cur + m, root);
+
+            while (!cur[0]->is_leafnode())
+            {
+                for (size_t i = 0; i < m; ++i)
+                {
+                    const InnerNode* inner = static_cast<const InnerNode*>(cur[i]);
+                    unsigned short slot = find_lower(inner, k[i]);
+                    cur[i] = inner->childid[slot];
+                    prefetch_lines(cur[i], inner->level == 1 ? sizeof(LeafNode) : sizeof(InnerNode));
+                }
+            }
+
+            for (size_t i = 0; i < m; ++i)
+            {
+                LeafNode* leaf = static_cast<LeafNode*>(cur[i]);
+                unsigned short slot = find_lower(leaf, k[i]);
+                out[base + i] = (slot < leaf->slotuse && key_equal(k[i], leaf->key(slot)))
+                                ? iterator(leaf, slot) : end();
+            }
+        }
+    }
+
     //! Tries to locate a key in the B+ tree and returns the number of identical
     //! key entries found.
     size_type count(const key_type& key) const {
@@ -1732,6 +1812,7 @@ public:
         {
             const InnerNode* inner = static_cast<const InnerNode*>(n);
             unsigned short slot = find_lower(inner, key);
+            prefetch_child(inner, slot);
 
             n = inner->childid[slot];
         }
@@ -1764,6 +1845,7 @@ public:
         {
             const InnerNode* inner = static_cast<const InnerNode*>(n);
             unsigned short slot = find_lower(inner, key);
+            prefetch_child(inner, slot);
 
             n = inner->childid[slot];
         }
@@ -1784,6 +1866,7 @@ public:
         {
             const InnerNode* inner = static_cast<const InnerNode*>(n);
             unsigned short slot = find_lower(inner, key);
+            prefetch_child(inner, slot);
 
             n = inner->childid[slot];
         }
@@ -1804,6 +1887,7 @@ public:
         {
             const InnerNode* inner = static_cast<const InnerNode*>(n);
             unsigned short slot = find_upper(inner, key);
+            prefetch_child(inner, slot);
 
             n = inner->childid[slot];
         }
@@ -1824,6 +1908,7 @@ public:
         {
             const InnerNode* inner = static_cast<const InnerNode*>(n);
             unsigned short slot = find_upper(inner, key);
+            prefetch_child(inner, slot);
 
             n = inner->childid[slot];
         }
@@ -1905,7 +1990,7 @@ public:
 
             if (other.size() != 0)
             {
-                stats_.leaves = stats_.inner_nodes = 0;
+                stats_.clear();
                 if (other.root_) {
                     root_ = copy_recursive(0, other.root_); // <=====
                 }
@@ -1926,7 +2011,8 @@ public:
           allocator_(other.get_allocator()) {
         if (size() > 0)
         {
-            stats_.leaves = stats_.inner_nodes = 0;
+            stats_.clear();
+            stats_[0].size = other.size();
             if (other.root_) {
                 root_ = copy_recursive(0, other.root_); // <=====
             }
@@ -2047,7 +2133,7 @@ private:
         }
 
         // increment size if the item was inserted
-        if (r.second) ++stats_.size;
+        if (r.second) ++stats_[tid].size;
 
 #ifdef TLX_BTREE_DEBUG
         if (debug) print(std::cout);
@@ -2081,6 +2167,8 @@ private:
 
             unsigned short slot = find_lower(inner, key);
 
+            prefetch_child(inner, slot);
+
             TLX_BTREE_PRINT(
                 "BTree::insert_descend into " << inner->childid[slot]);
 
@@ -2294,105 +2382,69 @@ public:
 
     //! Bulk load a sorted range. Loads items into leaves and constructs a
     //! B-tree above them. The tree must be empty when calling this function.
+    //! The iterators must be random access: each level is split into equal
+    //! chunks that are filled in parallel when compiled with OpenMP. Nodes are
+    //! allocated with the OpenMP thread number as tid, so the caller must have
+    //! initialized those threads with the record manager.
     template <typename Iterator>
     void bulk_load(const int& tid, Iterator ibegin, Iterator iend) {
         TLX_BTREE_ASSERT(empty());
 
-        stats_.size = iend - ibegin;
-
         // calculate number of leaves needed, round up.
-        size_t num_items = iend - ibegin;
-        size_t num_leaves = (num_items + leaf_slotmax - 1) / leaf_slotmax;
+        const size_t num_items = iend - ibegin;
+        if (num_items == 0) return;
+        const size_t num_leaves = (num_items + leaf_slotmax - 1) / leaf_slotmax;
+
+        stats_[tid].size = num_items;
 
-        TLX_BTREE_PRINT("BTree::bulk_load, level 0: " << stats_.size <<
+        TLX_BTREE_PRINT("BTree::bulk_load, level 0: " << num_items <<
                         " items into " << num_leaves <<
                         " leaves with up to " <<
-                        ((iend - ibegin + num_leaves - 1) / num_leaves) <<
+                        ((num_items + num_leaves - 1) / num_leaves) <<
                         " items per leaf.");
 
-        Iterator it = ibegin;
+        // nodes of the level being built, and the max key of any descendant
+        // of each of them.
+        node** level_nodes = new node*[num_leaves];
+        const key_type** level_maxkey = new const key_type*[num_leaves];
+
+        // leaf i gets items [i * N / L, (i + 1) * N / L). Chunk sizes differ
+        // by at most one, so no leaf is underfull.
+        #pragma omp parallel for schedule(static)
         for (size_t i = 0; i < num_leaves; ++i)
         {
-            // allocate new leaf node
-            LeafNode* leaf = allocate_leaf(tid);
-
-            // copy keys or (key,value) pairs into leaf nodes, uses template
-            // switch leaf->set_slot().
-            leaf->slotuse = static_cast<int>(num_items / (num_leaves - i));
-            for (size_t s = 0; s < leaf->slotuse; ++s, ++it)
-                leaf->set_slot(s, *it);
-
-            if (tail_leaf_ != nullptr) {
-                tail_leaf_->next_leaf = leaf;
-                leaf->prev_leaf = tail_leaf_;
-            }
-            else {
-                head_leaf_ = leaf;
-            }
-            tail_leaf_ = leaf;
-
-            num_items -= leaf->slotuse;
-        }
+            LeafNode* leaf = allocate_leaf(bulk_load_tid(tid));
 
-        TLX_BTREE_ASSERT(it == iend && num_items == 0);
+            const size_t first = i * num_items / num_leaves;
+            const size_t last = (i + 1) * num_items / num_leaves;
+            leaf->slotuse = static_cast<unsigned short>(last - first);
+            for (size_t s = 0; s < last - first; ++s)
+                leaf->set_slot(s, ibegin[first + s]);
 
-        // if the btree is so small to fit into one leaf, then we're done.
-        if (head_leaf_ == tail_leaf_) {
-            root_ = head_leaf_;
-            return;
+            level_nodes[i] = leaf;
+            level_maxkey[i] = &leaf->key(leaf->slotuse - 1);
         }
 
-        TLX_BTREE_ASSERT(stats_.leaves == num_leaves);
-
-        // create first level of inner nodes, pointing to the leaves.
-        size_t num_parents =
-            (num_leaves + (inner_slotmax + 1) - 1) / (inner_slotmax + 1);
-
-        TLX_BTREE_PRINT("BTree::bulk_load, level 1: " <<
-                        num_leaves << " leaves in " <<
-                        num_parents << " inner nodes with up to " <<
-                        ((num_leaves + num_parents - 1) / num_parents) <<
-                        " leaves per inner node.");
-
-        // save inner nodes and maxkey for next level.
-        typedef std::pair<InnerNode*, const key_type*> nextlevel_type;
-        nextlevel_type* nextlevel = new nextlevel_type[num_parents];
-
-        LeafNode* leaf = head_leaf_;
-        for (size_t i = 0; i < num_parents; ++i)
+        // link the leaves once they all exist.
+        #pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < num_leaves; ++i)
         {
-            // allocate new inner node at level 1
-            InnerNode* n = allocate_inner(tid, 1);
-
-            n->slotuse = static_cast<int>(num_leaves / (num_parents - i));
-            TLX_BTREE_ASSERT(n->slotuse > 0);
-            // this counts keys, but an inner node has keys+1 children.
-            --n->slotuse;
-
-            // copy last key from each leaf and set child
-            for (unsigned short s = 0; s < n->slotuse; ++s)
-            {
-                n->slotkey[s] = leaf->key(leaf->slotuse - 1);
-                n->childid[s] = leaf;
-                leaf = leaf->next_leaf;
-            }
-            n->childid[n->slotuse] = leaf;
-
-            // track max key of any descendant.
-            nextlevel[i].first = n;
-            nextlevel[i].second = &leaf->key(leaf->slotuse - 1);
-
-            leaf = leaf->next_leaf;
-            num_leaves -= n->slotuse + 1;
+            LeafNode* leaf = static_cast<LeafNode*>(level_nodes[i]);
+            leaf->prev_leaf = (i > 0)
+                ? static_cast<LeafNode*>(level_nodes[i - 1]) : nullptr;
+            leaf->next_leaf = (i + 1 < num_leaves)
+                ? static_cast<LeafNode*>(level_nodes[i + 1]) : nullptr;
         }
 
-        TLX_BTREE_ASSERT(leaf == nullptr && num_leaves == 0);
+        head_leaf_ = static_cast<LeafNode*>(level_nodes[0]);
+        tail_leaf_ = static_cast<LeafNode*>(level_nodes[num_leaves - 1]);
 
-        // recursively build inner nodes pointing to inner nodes.
-        for (int level = 2; num_parents != 1; ++level)
+        // build inner levels the same way until a single node is left. if the
+        // btree is so small to fit into one leaf, that leaf is the root.
+        size_t num_children = num_leaves;
+        for (unsigned short level = 1; num_children != 1; ++level)
         {
-            size_t num_children = num_parents;
-            num_parents =
+            const size_t num_parents =
                 (num_children + (inner_slotmax + 1) - 1) / (inner_slotmax + 1);
 
             TLX_BTREE_PRINT(
@@ -2402,40 +2454,42 @@ public:
                 ((num_children + num_parents - 1) / num_parents) <<
                     " children per inner node.");
 
-            size_t inner_index = 0;
+            node** parents = new node*[num_parents];
+            const key_type** parent_maxkey = new const key_type*[num_parents];
+
+            #pragma omp parallel for schedule(static)
             for (size_t i = 0; i < num_parents; ++i)
             {
-                // allocate new inner node at level
-                InnerNode* n = allocate_inner(tid, level);
+                InnerNode* n = allocate_inner(bulk_load_tid(tid), level);
 
-                n->slotuse = static_cast<int>(num_children / (num_parents - i));
-                TLX_BTREE_ASSERT(n->slotuse > 0);
-                // this counts keys, but an inner node has keys+1 children.
-                --n->slotuse;
+                // an inner node has one more child than keys.
+                const size_t first = i * num_children / num_parents;
+                const size_t last = (i + 1) * num_children / num_parents;
+                TLX_BTREE_ASSERT(last - first > 0);
+                n->slotuse = static_cast<unsigned short>(last - first - 1);
 
-                // copy children and maxkeys from nextlevel
-                for (unsigned short s = 0; s < n->slotuse; ++s)
+                // copy max key of each child but the last and set children
+                for (unsigned short s = 0; s < last - first - 1; ++s)
                 {
-                    n->slotkey[s] = *nextlevel[inner_index].second;
-                    n->childid[s] = nextlevel[inner_index].first;
-                    ++inner_index;
+                    n->slotkey[s] = *level_maxkey[first + s];
+                    n->childid[s] = level_nodes[first + s];
                 }
-                n->childid[n->slotuse] = nextlevel[inner_index].first;
-
-                // reuse nextlevel array for parents, because we can overwrite
-                // slots we've already consumed.
-                nextlevel[i].first = n;
-                nextlevel[i].second = nextlevel[inner_index].second;
+                n->childid[last - first - 1] = level_nodes[last - 1];
 
-                ++inner_index;
-                num_children -= n->slotuse + 1;
+                parents[i] = n;
+                parent_maxkey[i] = level_maxkey[last - 1];
             }
 
-            TLX_BTREE_ASSERT(num_children == 0);
+            delete[] level_nodes;
+            delete[] level_maxkey;
+            level_nodes = parents;
+            level_maxkey = parent_maxkey;
+            num_children = num_parents;
         }
 
-        root_ = nextlevel[0].first;
-        delete[] nextlevel;
+        root_ = level_nodes[0];
+        delete[] level_nodes;
+        delete[] level_maxkey;
 
         if (self_verify) verify();
     }
@@ -2443,6 +2497,15 @@ public:
     //! \}
 
 private:
+    //! Allocation tid of the calling thread inside bulk_load's parallel loops.
+    static int bulk_load_tid(const int& tid) {
+#ifdef _OPENMP
+        return omp_get_thread_num();
+#else
+        return tid;
+#endif
+    }
+
     //! \name Support Class Encapsulating Deletion Results
     //! \{
 
@@ -2520,7 +2583,7 @@ public:
             tid, key, root_, nullptr, nullptr, nullptr, nullptr, nullptr, 0);
 
         if (!result.has(btree_not_found))
-            --stats_.size;
+            --stats_[tid].size;
 
 #ifdef TLX_BTREE_DEBUG
         if (debug) print(std::cout);
@@ -2557,7 +2620,7 @@ public:
             tid, iter, root_, nullptr, nullptr, nullptr, nullptr, nullptr, 0);
 
         if (!result.has(btree_not_found))
-            --stats_.size;
+            --stats_[tid].size;
 
 #ifdef TLX_BTREE_DEBUG
         if (debug) print(std::cout);
@@ -2662,9 +2725,9 @@ private:
                     head_leaf_ = tail_leaf_ = nullptr;
 
                     // will be decremented soon by insert_start()
-                    TLX_BTREE_ASSERT(stats_.size == 1);
-                    TLX_BTREE_ASSERT(stats_.leaves == 0);
-                    TLX_BTREE_ASSERT(stats_.inner_nodes == 0);
+                    TLX_BTREE_ASSERT(stats_.sum().size == 1);
+                    TLX_BTREE_ASSERT(stats_.sum().leaves == 0);
+                    TLX_BTREE_ASSERT(stats_.sum().inner_nodes == 0);
 
                     return btree_ok;
                 }
@@ -2736,6 +2799,8 @@ private:
 
             unsigned short slot = find_lower(inner, key);
 
+            prefetch_child(inner, slot);
+
             if (slot == 0) {
                 myleft =
                     (left == nullptr) ? nullptr :
@@ -3003,9 +3068,9 @@ private:
                     head_leaf_ = tail_leaf_ = nullptr;
 
                     // will be decremented soon by insert_start()
-                    TLX_BTREE_ASSERT(stats_.size == 1);
-                    TLX_BTREE_ASSERT(stats_.leaves == 0);
-                    TLX_BTREE_ASSERT(stats_.inner_nodes == 0);
+                    TLX_BTREE_ASSERT(stats_.sum().size == 1);
+                    TLX_BTREE_ASSERT(stats_.sum().leaves == 0);
+                    TLX_BTREE_ASSERT(stats_.sum().inner_nodes == 0);
 
                     return btree_ok;
                 }
@@ -3693,9 +3758,10 @@ public:
         {
             verify_node(root_, &minkey, &maxkey, vstats);
 
-            tlx_die_unless(vstats.size == stats_.size);
-            tlx_die_unless(vstats.leaves == stats_.leaves);
-            tlx_die_unless(vstats.inner_nodes == stats_.inner_nodes);
+            tree_stats stats = stats_.sum();
+            tlx_die_unless(vstats.size == stats.size);
+            tlx_die_unless(vstats.leaves == stats.leaves);
+            tlx_die_unless(vstats.inner_nodes == stats.inner_nodes);
 
             verify_leaflinks();
         }
@@ -7,6 +7,7 @@
 #include <algorithm>
 #include <cassert>
 #include <cstddef>
+#include <cstring>
 #include <functional>
 #include <istream>
 #include <memory>
@@ -18,6 +19,10 @@
 
 #include <sstream>
 
+#ifdef RECLAIM_IBR
+#include "record_manager.h"
+#endif
+
 namespace tlx {
 
 // *** Debugging Macros
@@ -106,6 +111,11 @@ public:
     unsigned short slotuse;
 
 	unsigned char flags;
+
+#ifdef RECLAIM_IBR
+    //! Era the node was allocated in (see reclaimer_ibr.h)
+    long birth_era;
+#endif
     
 	inline bool is_del() { return (flags & DEL_MASK) == DEL_MASK; }
 	inline void set_del() { flags |= DEL_MASK; }
@@ -169,6 +179,10 @@ public:
     void copy_to_slotkey(Key * src_first, Key * src_last, Key * dst_last);
 
     void copy_backward_to_slotkey(Key * src_first, Key * src_last, Key * dst_last);
+
+    //! Copy the header and the used slots of other. The unused tails of the
+    //! key and child arrays are left as they are.
+    void copy_live(const inner_node* other);
 };
 
 //! Extended structure of a leaf node in memory. Contains pairs of keys and
@@ -213,6 +227,10 @@ public:
     void copy_to_slotdata(Value * src_first, Value * src_last, Value * dst_last);
 
     void copy_backward_to_slotdata(Value * src_first, Value * src_last, Value * dst_last);
+
+    //! Copy the header and the used slots of other. The unused slots are left
+    //! as they are.
+    void copy_live(const leaf_node* other);
 };
 
 
@@ -365,6 +383,10 @@ bool pc_open(node** root)
 
 	// orig_root = *root;
     __atomic_load(root, &orig_root, __ATOMIC_RELAXED);
+#ifdef RECLAIM_IBR
+    while (ibr_read_barrier())
+        __atomic_load(root, &orig_root, __ATOMIC_RELAXED);
+#endif
 	new_root = orig_root;
 	in_writing_function = true;
 	pc_happened = false;
@@ -394,7 +416,8 @@ bool pc_close(node** root)
 
 node::node()
 {
-    allocated->insert({this, true});
+    // new nodes are tracked by BTree::allocate_node(): a pool constructs
+    // records a block at a time, not when the operation takes one
 }
 
 void node::initialize(const unsigned short l) {
@@ -487,14 +510,21 @@ bool Innernode::is_few() const {
 
 template <typename Key, typename Value>
 bool Innernode::is_underflow() const {
+#ifdef BTREE_TOPDOWN_SPLIT
+    // splitting a full inner node ahead of the descent leaves one half a slot
+    // short of the usual minimum
+    const unsigned short slotmin = btree_default_traits<Key, Value>::inner_slots / 2 - 1;
+#else
+    const unsigned short slotmin = btree_default_traits<Key, Value>::inner_slots / 2;
+#endif
     node * orig = (node*)this;
     if (in_writing_function && duplications->find(orig) != duplications->end())
     {
         auto found = duplications->at(orig);
-        return (found->slotuse < btree_default_traits<Key, Value>::inner_slots / 2);
+        return (found->slotuse < slotmin);
     }
 
-    return (node::slotuse < btree_default_traits<Key, Value>::inner_slots / 2);
+    return (node::slotuse < slotmin);
 }
 
 template <typename Key, typename Value>
@@ -595,6 +625,15 @@ void Innernode::copy_backward_to_slotkey(Key * src_first, Key * src_last, Key *
     std::copy_backward(src_first, src_last, dst_last);
 }
 
+template <typename Key, typename Value>
+void Innernode::copy_live(const inner_node* other) {
+    // slotkey directly follows the header, childid is copied apart
+    std::memcpy((void*)this, (const void*)other,
+                (const char*)&other->slotkey[other->slotuse] - (const char*)other);
+    std::memcpy((void*)childid, (const void*)other->childid,
+                (other->slotuse + 1) * sizeof(node*));
+}
+
 
 
 template <typename Key, typename Value>
@@ -706,4 +745,10 @@ void Leafnode::copy_backward_to_slotdata(Value * src_first, Value * src_last, Va
     std::copy_backward(src_first, src_last, dst_last);
 }
 
+template <typename Key, typename Value>
+void Leafnode::copy_live(const leaf_node* other) {
+    std::memcpy((void*)this, (const void*)other,
+                (const char*)&other->slotdata[other->slotuse] - (const char*)other);
+}
+
 } // namespace tlx
\ No newline at end of file
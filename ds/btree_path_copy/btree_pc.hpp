@@ -3,6 +3,12 @@
 #include "btree.hpp"
 #include "record_manager.h"
 
+#ifdef BTREE_RELAXED_ERASE
+#   ifndef BTREE_RELAXED_STEPS_PER_OP
+#       define BTREE_RELAXED_STEPS_PER_OP 2 // rebalancing steps run by each update
+#   endif
+#endif
+
 template <typename skey_t, typename sval_t, class RecMgr>
 class btree_dup {
 public:
@@ -57,6 +63,10 @@ public:
     //! Small structure containing statistics about the tree
     typedef typename btree_impl::tree_stats tree_stats;
 
+    //! Node types of the implementation
+    typedef typename btree_impl::LeafNode leaf_type;
+    typedef typename btree_impl::InnerNode inner_type;
+
     //! \}
 
 public:
@@ -128,6 +138,28 @@ private:
 	int init[MAX_THREADS_POW2] = {0,};
     RecMgr* recmgr;
 
+    //! Nodes replaced or copied by the running operation, split by type so
+    //! they are retired or freed with one batch call per type.
+    struct write_set_t {
+        PAD;
+        std::vector<leaf_type*> leaves;
+        std::vector<inner_type*> inner_nodes;
+        PAD;
+    };
+    write_set_t write_set[MAX_THREADS_POW2];
+
+#ifdef BTREE_RELAXED_ERASE
+    //! Relaxed erase: an erase only removes from its leaf and records the key
+    //! if the leaf underflowed. The underflows are repaired later, one shift
+    //! or merge per transaction.
+    struct relaxed_info_t {
+        PAD;
+        std::vector<skey_t> underflows;
+        PAD;
+    };
+    relaxed_info_t relaxed[MAX_THREADS_POW2];
+#endif
+
     //! \}
 
 public:
@@ -156,6 +188,7 @@ public:
     //! Frees up all used B+ tree memory pages
     ~btree_dup()
     {
+        tree_.clear(0); // while the record manager still owns the nodes
         delete tree_.recmgr; 
     }
 
@@ -175,6 +208,10 @@ public:
     {
         if (!init[tid]) return;
         else init[tid] = !init[tid];
+#ifdef BTREE_RELAXED_ERASE
+        // no other thread repairs this thread's underflows
+        rebalance(tid, -1);
+#endif
         tree_.recmgr->deinitThread(tid);
     }
 
@@ -183,6 +220,14 @@ public:
         return tree_.root_;
     }
 
+    //! Bulk load a sorted range of (key, value) pairs into the empty tree,
+    //! see BTree::bulk_load. Not safe against concurrent operations.
+    template <typename Iterator>
+    void bulk_load(const int tid, Iterator ibegin, Iterator iend)
+    {
+        tree_.bulk_load(tid, ibegin, iend);
+    }
+
 
 public:
     //! \name Key and Value Comparison Function Objects
@@ -230,6 +275,37 @@ public:
         }
     }
 
+    //! Look up keys[0,n) under a single guard and store the value of keys[i],
+    //! or NO_VALUE, in values[i]. The descents are interleaved, see
+    //! btree_impl::find_batch.
+    void find_batch(const int tid, const skey_t* keys, size_t n, sval_t* values) {
+        auto guard = tree_.recmgr->getGuard(tid, true);
+        iterator its[btree_impl::find_batch_width];
+        for (size_t base = 0; base < n; base += btree_impl::find_batch_width) {
+            const size_t m = (n - base < btree_impl::find_batch_width)
+                             ? n - base : btree_impl::find_batch_width;
+            tree_.find_batch(keys + base, m, its);
+            const iterator end = tree_.end();
+            for (size_t i = 0; i < m; ++i)
+                values[base + i] = (its[i] == end) ? NO_VALUE : (*its[i]).second;
+        }
+    }
+
+    //! Copy the pairs with lo <= key <= hi, in key order, into keys/values and
+    //! return how many there are. Linearizable, see btree_impl::range_query.
+    int range_query(const int tid, const skey_t& lo, const skey_t& hi,
+                    skey_t* keys, sval_t* values)
+    {
+        auto guard = tree_.recmgr->getGuard(tid, true);
+        int cnt = 0;
+        tree_.range_query(lo, hi, [&](const value_type& v) {
+            keys[cnt] = v.first;
+            values[cnt] = v.second;
+            ++cnt;
+        });
+        return cnt;
+    }
+
 public:
     //! \name Public Insertion Functions
     //! \{
@@ -238,45 +314,72 @@ public:
     //! already present.
     sval_t insert(const int tid, const skey_t& key, const sval_t& value) 
     {
+        std::pair<iterator, bool> insertion_res;
         while (1)
         {
             auto guard = tree_.recmgr->getGuard(tid);
             tlx::pc_open<key_type, value_type>(&tree_.root_);
-            auto insertion_res = tree_.insert(tid, std::make_pair(key, value));
+            insertion_res = tree_.insert(tid, std::make_pair(key, value));
             if ( tlx::pc_close<key_type, value_type>(&tree_.root_)) //TODO
             {
-                for (auto& d : *tlx::duplications)
-                {
-                    if (d.first->is_leafnode()) {
-                        tree_.recmgr->retire(tid, static_cast<tlx::leaf_node<key_type, value_type>*>(d.first));
-                    }
-                    else {
-                        tree_.recmgr->retire(tid, static_cast<tlx::inner_node<key_type, value_type>*>(d.first));
-                    }
-                }
-                
+                retire_replaced(tid);
+
                 if (insertion_res.second)
-                {  
-                    // std::cout << "after iserting " << key << std::endl;
-                    // tlx::print_tree<key_type, value_type>(tree_.root_, 0);
-                    return NO_VALUE;
-                }
-                else
-                    return value;
+                    ++tree_.stats_[tid].size;
+
+                break;
             }
             else
             {
-                for (auto& d : *tlx::allocated)
-                {
-                    if (d.first->is_leafnode()) {
-                        tree_.recmgr->deallocate(tid, static_cast<tlx::leaf_node<key_type, value_type>*>(d.first));
-                    }
-                    else {
-                        tree_.recmgr->deallocate(tid, static_cast<tlx::inner_node<key_type, value_type>*>(d.first));
-                    }
-                }
+                deallocate_copies(tid);
             }
         }
+
+#ifdef BTREE_RELAXED_ERASE
+        rebalance(tid, BTREE_RELAXED_STEPS_PER_OP);
+#endif
+        if (insertion_res.second)
+            return NO_VALUE;
+        else
+            return value;
+    }
+
+    //! Insert a key/data pair into the B+ tree, or replace the data of the key
+    //! if it is already present. Returns the replaced data, or NO_VALUE if the
+    //! key was inserted. A replace path copies just the key's leaf.
+    sval_t upsert(const int tid, const skey_t& key, const sval_t& value) 
+    {
+        value_type old;
+        bool replaced;
+        bool inserted;
+        while (1)
+        {
+            auto guard = tree_.recmgr->getGuard(tid);
+            tlx::pc_open<key_type, value_type>(&tree_.root_);
+            replaced = tree_.replace(tid, std::make_pair(key, value), &old);
+            inserted = !replaced && tree_.insert(tid, std::make_pair(key, value)).second;
+            if ( tlx::pc_close<key_type, value_type>(&tree_.root_))
+            {
+                retire_replaced(tid);
+
+                if (inserted)
+                    ++tree_.stats_[tid].size;
+
+                break;
+            }
+            else
+            {
+                deallocate_copies(tid);
+            }
+        }
+
+#ifdef BTREE_RELAXED_ERASE
+        rebalance(tid, BTREE_RELAXED_STEPS_PER_OP);
+#endif
+        if (replaced)
+            return old.second;
+        else
+            return NO_VALUE;
     }
 
     //! \}
@@ -289,42 +392,170 @@ public:
     //! unique-associative map there is no difference to erase().
     sval_t erase(const int tid, const skey_t& key) 
     {
+        bool removal_res;
         while (1)
         {
             auto guard = tree_.recmgr->getGuard(tid);
             tlx::pc_open<key_type, value_type>(&tree_.root_);
-            auto removal_res = tree_.erase_one(tid, key);
+            removal_res = tree_.erase_one(tid, key);
             if ( tlx::pc_close<key_type, value_type>(&tree_.root_))
             {
-                for (auto& d : *tlx::duplications)
-                {
-                    if (d.first->is_leafnode()) {
-                        tree_.recmgr->retire(tid, static_cast<tlx::leaf_node<key_type, value_type>*>(d.first));
-                    }
-                    else {
-                        tree_.recmgr->retire(tid, static_cast<tlx::inner_node<key_type, value_type>*>(d.first));
-                    }
-                }
+                retire_replaced(tid);
 
                 if (removal_res)
-                    return (sval_t)(&key);
-                else
-                    return NO_VALUE;
+                    --tree_.stats_[tid].size;
+
+                break;
             }
             else
             {
-                for (auto& d : *tlx::allocated)
+                deallocate_copies(tid);
+            }
+        }
+
+#ifdef BTREE_RELAXED_ERASE
+        if (tlx::underflow_res)
+        {
+            relaxed[tid].underflows.push_back(key);
+            ++tree_.stats_[tid].underflows;
+        }
+        rebalance(tid, BTREE_RELAXED_STEPS_PER_OP);
+#endif
+        if (removal_res)
+            return (sval_t)(&key);
+        else
+            return NO_VALUE;
+    }
+
+    //! Erases all key/data pairs with lo <= key <= hi and returns their number.
+    //! The range is erased by one path copy: the subtrees inside the range are
+    //! unlinked whole and retired in one batch with the copied nodes.
+    int erase_range(const int tid, const skey_t& lo, const skey_t& hi) 
+    {
+        size_t erased;
+        while (1)
+        {
+            auto guard = tree_.recmgr->getGuard(tid);
+            tlx::pc_open<key_type, value_type>(&tree_.root_);
+            erased = tree_.erase_range(tid, lo, hi);
+            if ( tlx::pc_close<key_type, value_type>(&tree_.root_))
+            {
+                retire_replaced(tid);
+
+                tree_.stats_[tid].size -= erased;
+                break;
+            }
+            else
+            {
+                deallocate_copies(tid);
+            }
+        }
+
+#ifdef BTREE_RELAXED_ERASE
+        rebalance(tid, BTREE_RELAXED_STEPS_PER_OP);
+#endif
+        return erased;
+    }
+
+#ifdef BTREE_RELAXED_ERASE
+    //! Run up to max_steps pending rebalancing steps of thread tid (all of
+    //! them if max_steps < 0). Every step is its own transaction, so its write
+    //! set is one shift or merge of two siblings and their parent.
+    void rebalance(const int tid, int max_steps = -1)
+    {
+        auto& underflows = relaxed[tid].underflows;
+        while (!underflows.empty() && max_steps-- != 0)
+        {
+            skey_t key = underflows.back();
+            underflows.pop_back();
+
+            bool more;
+            while (1)
+            {
+                auto guard = tree_.recmgr->getGuard(tid);
+                tlx::pc_open<key_type, value_type>(&tree_.root_);
+                more = tree_.rebalance_one(tid, key);
+
+                if ( tlx::pc_close<key_type, value_type>(&tree_.root_))
+                {
+                    retire_replaced(tid);
+                    break;
+                }
+                else
                 {
-                    if (d.first->is_leafnode()) {
-                        tree_.recmgr->deallocate(tid, static_cast<tlx::leaf_node<key_type, value_type>*>(d.first));
-                    }
-                    else {
-                        tree_.recmgr->deallocate(tid, static_cast<tlx::inner_node<key_type, value_type>*>(d.first));
-                    }
+                    deallocate_copies(tid);
                 }
             }
+
+            if (more)
+                underflows.push_back(key);
+            else
+                --tree_.stats_[tid].underflows;
         }
     }
 
+    //! Number of underflows recorded by thread tid and not yet repaired
+    size_t pending_underflows(const int tid)
+    {
+        return relaxed[tid].underflows.size();
+    }
+#endif
+
+    //! \}
+
+    //! \name Write Set
+    //! \{
+
+    //! Split the nodes in map by type into the write set of thread tid. A
+    //! node's level never changes, so unlike is_leafnode() this reads no
+    //! duplication.
+    template <typename Map>
+    write_set_t& split_write_set(const int tid, const Map& map)
+    {
+        write_set_t& ws = write_set[tid];
+        ws.leaves.clear();
+        ws.inner_nodes.clear();
+        for (auto& d : map)
+        {
+            if (d.first->level == 0)
+                ws.leaves.push_back(static_cast<leaf_type*>(d.first));
+            else
+                ws.inner_nodes.push_back(static_cast<inner_type*>(d.first));
+        }
+        return ws;
+    }
+
+    //! Retire the nodes replaced by the operation that just committed, and
+    //! count the nodes it published and replaced in the tree statistics.
+    void retire_replaced(const int tid)
+    {
+        // like the size, node counts change only once an operation commits
+        write_set_t& ws = split_write_set(tid, *tlx::allocated);
+        tree_.stats_[tid].leaves += ws.leaves.size();
+        tree_.stats_[tid].inner_nodes += ws.inner_nodes.size();
+
+        split_write_set(tid, *tlx::duplications);
+        tree_.stats_[tid].leaves -= ws.leaves.size();
+        tree_.stats_[tid].inner_nodes -= ws.inner_nodes.size();
+        tree_.recmgr->retire_batch(tid, ws.leaves.data(), ws.leaves.size());
+        tree_.recmgr->retire_batch(tid, ws.inner_nodes.data(), ws.inner_nodes.size());
+#ifdef USE_OP_ARENA
+        tree_.recmgr->arena_commit(tid);
+#endif
+    }
+
+    //! Free the copies made by an operation that failed to commit. With
+    //! USE_OP_ARENA they all came from the arena, which is just rewound.
+    void deallocate_copies(const int tid)
+    {
+#ifdef USE_OP_ARENA
+        tree_.recmgr->arena_abort(tid);
+#else
+        write_set_t& ws = split_write_set(tid, *tlx::allocated);
+        tree_.recmgr->deallocate_batch(tid, ws.leaves.data(), ws.leaves.size());
+        tree_.recmgr->deallocate_batch(tid, ws.inner_nodes.data(), ws.inner_nodes.size());
+#endif
+    }
+
     //! \}
 };
\ No newline at end of file
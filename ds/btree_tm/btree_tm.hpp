@@ -156,6 +156,7 @@ public:
     //! Frees up all used B+ tree memory pages
     ~btree_ser()
     {
+        tree_.clear(0); // while the record manager still owns the nodes
         delete tree_.recmgr; 
     }
 
@@ -183,6 +184,14 @@ public:
         return tree_.root_;
     }
 
+    //! Bulk load a sorted range of (key, value) pairs into the empty tree,
+    //! see BTree::bulk_load. Not safe against concurrent operations.
+    template <typename Iterator>
+    void bulk_load(const int tid, Iterator ibegin, Iterator iend)
+    {
+        tree_.bulk_load(tid, ibegin, iend);
+    }
+
 
 public:
     //! \name Key and Value Comparison Function Objects
@@ -227,6 +236,22 @@ public:
             return (*it).second; }
     }
 
+    //! Look up keys[0,n) under a single guard and store the value of keys[i],
+    //! or NO_VALUE, in values[i]. The descents are interleaved, see
+    //! btree_impl::find_batch.
+    void find_batch(const int tid, const skey_t* keys, size_t n, sval_t* values) {
+        auto guard = tree_.recmgr->getGuard(tid, true);
+        iterator its[btree_impl::find_batch_width];
+        for (size_t base = 0; base < n; base += btree_impl::find_batch_width) {
+            const size_t m = (n - base < btree_impl::find_batch_width)
+                             ? n - base : btree_impl::find_batch_width;
+            __transaction_atomic { tree_.find_batch(keys + base, m, its);
+            const iterator end = tree_.end();
+            for (size_t i = 0; i < m; ++i)
+                values[base + i] = (its[i] == end) ? NO_VALUE : (*its[i]).second; }
+        }
+    }
+
 public:
     //! \name Public Insertion Functions
     //! \{
@@ -242,6 +267,19 @@ public:
             return value; }
     }
 
+    //! Insert a key/data pair into the B+ tree, or replace the data of the key
+    //! if it is already present. Returns the replaced data, or NO_VALUE if the
+    //! key was inserted.
+    sval_t upsert(const int tid, const skey_t& key, const sval_t& value) {
+        auto guard = tree_.recmgr->getGuard(tid);
+        __transaction_atomic { auto res = tree_.insert(tid, std::make_pair(key, value));
+        if (res.second)
+            return NO_VALUE;
+        sval_t old = (*res.first).second;
+        (*res.first).second = value;
+        return old; }
+    }
+
     //! \}
 
 public:
@@ -258,5 +296,21 @@ public:
             return NO_VALUE; }
     }
 
+    //! Erases all key/data pairs with lo <= key <= hi and returns their number.
+    int erase_range(const int tid, const skey_t& lo, const skey_t& hi) {
+        auto guard = tree_.recmgr->getGuard(tid);
+        __transaction_atomic {
+            int cnt = 0;
+            for (auto it = tree_.lower_bound(lo);
+                 it != tree_.end() && !tree_.key_comp()(hi, it.key());
+                 it = tree_.lower_bound(lo)) {
+                skey_t key = it.key();
+                tree_.erase_one(tid, key);
+                ++cnt;
+            }
+            return cnt;
+        }
+    }
+
     //! \}
 };
\ No newline at end of file
@@ -245,7 +245,8 @@ template <typename skey_t, typename sval_t>
 rb_node<skey_t, sval_t>::rb_node()
 {
 	if (do_print) std::cout << "~~constructor: new_node=" << this << std::endl;
-	allocated->insert({this, true});
+	// new nodes are tracked by GetNode(): a pool constructs records a block
+	// at a time, not when the operation takes one
 }
 
 template <typename skey_t, typename sval_t>
@@ -1,9 +1,14 @@
 #pragma once
 
 #include "rb_node.h" 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 thread_local bool locking_res = true;
 
+const size_t BULK_LOAD_TASK_MIN = 1 << 14;
+
 template <typename skey_t, typename sval_t, class RecMgr>
 class rb_tree {
 private:
@@ -16,6 +21,15 @@ private:
 	int init[MAX_THREADS_POW2] = {0,};
 	RecMgr* recmgr;
 
+	// nodes replaced or copied by the running operation, gathered so they
+	// are retired or freed with one call into the record manager
+	struct write_set_t {
+		PAD;
+		std::vector<rb_node<skey_t, sval_t>*> nodes;
+		PAD;
+	};
+	write_set_t write_set[MAX_THREADS_POW2];
+
 	rb_node<skey_t, sval_t> * _lookup (skey_t k) {
 		rb_node<skey_t, sval_t> * p = root; 
 		while (p != NULL) {
@@ -775,6 +789,8 @@ private:
 	rb_node<skey_t, sval_t> * GetNode (const int & tid) {
 		rb_node<skey_t, sval_t> * result = 
 			(rb_node<skey_t, sval_t> *)recmgr->template allocate<rb_node<skey_t, sval_t>>(tid);
+		if (allocated)
+			allocated->insert({result, true});
 		pthread_spin_init(&result->dup_lock, PTHREAD_PROCESS_PRIVATE);
 		return result; 
 	}
@@ -782,6 +798,8 @@ private:
 	rb_node<skey_t, sval_t> * GetNode (const int & tid, rb_node<skey_t, sval_t> * node) {
 		rb_node<skey_t, sval_t> * result = 
 			(rb_node<skey_t, sval_t> *)recmgr->template allocate<rb_node<skey_t, sval_t>>(tid);
+		if (allocated)
+			allocated->insert({result, true});
 		std::memcpy((void *)result, (void *)node, sizeof(rb_node<skey_t, sval_t>));
 		pthread_spin_init(&result->dup_lock, PTHREAD_PROCESS_PRIVATE);
 		return result; 
@@ -791,6 +809,51 @@ private:
 		recmgr->deallocate(tid, n);
 	}
 
+	void retire_replaced(const int tid) {
+		auto& nodes = write_set[tid].nodes;
+		nodes.clear();
+		for (auto& d : *duplications)
+			nodes.push_back(d.first);
+		recmgr->retire_batch(tid, nodes.data(), (int)nodes.size());
+	}
+
+	void deallocate_copies(const int tid) {
+		auto& nodes = write_set[tid].nodes;
+		nodes.clear();
+		for (auto& d : *allocated)
+			nodes.push_back(d.first);
+		recmgr->deallocate_batch(tid, nodes.data(), (int)nodes.size());
+	}
+
+	// builds the subtree of keys [lo, hi) below parent. nodes at red_depth
+	// are colored red and all others black, see bulk_load.
+	rb_node<skey_t, sval_t> * build(const skey_t * keys, const sval_t * values, size_t lo, size_t hi,
+									rb_node<skey_t, sval_t> * parent, int depth, int red_depth)
+	{
+		if (lo >= hi)
+			return nullptr;
+
+#ifdef _OPENMP
+		const int tid = omp_get_thread_num();
+#else
+		const int tid = 0;
+#endif
+		size_t mid = lo + (hi - lo) / 2;
+		rb_node<skey_t, sval_t> * n = GetNode(tid);
+		n->k = keys[mid];
+		n->v = values[mid];
+		n->p = parent;
+		n->c = (depth == red_depth) ? RED : BLACK;
+
+		// the left half becomes a task while it is big enough to be worth one
+		#pragma omp task if (mid - lo > BULK_LOAD_TASK_MIN)
+		n->l = build(keys, values, lo, mid, n, depth + 1, red_depth);
+		n->r = build(keys, values, mid + 1, hi, n, depth + 1, red_depth);
+		#pragma omp taskwait
+
+		return n;
+	}
+
 public:
 	rb_tree(
 		const int _NUM_THREADS, 
@@ -837,7 +900,7 @@ public:
 
 		make_empty(t->get_child(LEFT));
 		make_empty(t->get_child(RIGHT));
-		delete t;
+		recmgr->deallocate(0, t);
 	}
 
 	RecMgr * debugGetRecMgr()
@@ -850,6 +913,21 @@ public:
 		return root;
 	}
 
+	// builds a balanced tree from n sorted keys. the tree must be empty, and
+	// all OpenMP threads must have been initialized (nodes are allocated by
+	// them). splitting at the midpoint fills depths 0..h-1 completely, where
+	// h is the largest integer with 2^h <= n + 1, so coloring the nodes at
+	// depth h red (if any) and all others black is a valid coloring.
+	void bulk_load(const skey_t * keys, const sval_t * values, size_t n)
+	{
+		int h = 0;
+		while (((size_t)2 << h) <= n + 1) ++h;
+
+		#pragma omp parallel
+		#pragma omp single
+		root = build(keys, values, 0, n, nullptr, 0, h);
+	}
+
 	sval_t rb_insert(const int & tid, skey_t Key, sval_t Val) {
 		rb_node<skey_t, sval_t> * node = GetNode(tid); 
 		rb_node<skey_t, sval_t> * ex; 
@@ -864,7 +942,24 @@ public:
 		}
 	}
 
-	sval_t rb_dup_insert(const int & tid, skey_t Key, sval_t Val) {
+	// insert-or-replace. A new value for an existing key changes no links or
+	// colors, so only the key's node is duplicated alone.
+	sval_t rb_upsert(const int & tid, skey_t Key, sval_t Val) {
+		rb_node<skey_t, sval_t> * n = _lookup(Key);
+		if (n == NULL)
+			return rb_insert(tid, Key, Val);
+
+		sval_t old = n->get_value();
+		auto n_dup = dup_prologue(tid, n);
+		if (n_dup != nullptr) {
+			n_dup->set_value(Val);
+			dup_epilogue(tid, n, n_dup);
+		}
+		return old;
+	}
+
+	// replace selects insert-or-replace (rb_upsert) over insert-if-absent
+	sval_t rb_dup_insert(const int & tid, skey_t Key, sval_t Val, bool replace = false) {
 		while (1)
         {
 			if (Key == -1)
@@ -877,16 +972,13 @@ public:
 			if (do_print) print_tree();
 			if (do_print) std::cout << "\n" << std::endl;
             locking_res = true;
-            auto insertion_res = rb_insert(tid, Key, Val);
+            auto insertion_res = (replace ? rb_upsert(tid, Key, Val) : rb_insert(tid, Key, Val));
             dup_paths_to_lca(tid);
 
             if (locking_res && dup_close<skey_t, sval_t>(tid, &root))
             {
 				if (do_print) print_tree();
-                for (auto& d : *duplications)
-                {
-					recmgr->retire(tid, d.first);
-                }
+                retire_replaced(tid);
                 
 				if (do_print)
 					exit(-1);
@@ -896,10 +988,7 @@ public:
             {
 				if (locking_res == false)
 					std::cout << "aaaa" << std::endl;
-                for (auto& d : *allocated)
-                {
-					recmgr->deallocate(tid, d.first);
-                }
+                deallocate_copies(tid);
             }
         }
 	}
@@ -931,19 +1020,13 @@ public:
 
 			if (locking_res && dup_close<skey_t, sval_t>(tid, &root))
 			{
-				for (auto& d : *duplications)
-				{
-					recmgr->retire(tid, d.first);
-				}
+				retire_replaced(tid);
 
 				return removal_res;
 			}
 			else
 			{
-				for (auto& d : *allocated)
-				{
-					recmgr->deallocate(tid, d.first);
-				}
+				deallocate_copies(tid);
 			}
 		}
 	}
@@ -12,6 +12,9 @@
 #include <csignal>
 #include "errors.h"
 #include "random_fnv1a.h"
+#ifdef _OPENMP
+#   include <omp.h>
+#endif
 #ifdef USE_TREE_STATS
 #   define TREE_STATS_BYTES_AT_DEPTH
 #   include "tree_stats.h"
@@ -36,6 +39,26 @@ public:
     : NO_VALUE(VALUE_RESERVED)
     , ds(new DATA_STRUCTURE_T(NUM_THREADS, KEY_MIN, KEY_MAX, NO_VALUE, 0 /* unused */))
     {}
+    // bulk loads the initNumKeys sorted keys in initKeys (see
+    // prefillWithArrayConstruction in microbench/main.cpp)
+    ds_adapter(const int NUM_THREADS,
+               const K& KEY_MIN,
+               const K& KEY_MAX,
+               const V& VALUE_RESERVED,
+               RandomFNV1A * const unused2,
+               const K * const initKeys,
+               const V * const initValues,
+               const size_t initNumKeys,
+               const size_t unused3)
+    : NO_VALUE(VALUE_RESERVED)
+    , ds(new DATA_STRUCTURE_T(NUM_THREADS, KEY_MIN, KEY_MAX, NO_VALUE, 0 /* unused */))
+    {
+#ifdef _OPENMP
+        #pragma omp parallel
+        ds->initThread(omp_get_thread_num());
+#endif
+        ds->bulk_load(initKeys, initValues, initNumKeys);
+    }
     ~ds_adapter() {
         delete ds;
     }
@@ -52,7 +75,7 @@ public:
     }
 
     V insert(const int tid, const K& key, const V& val) {
-        setbench_error("insert-replace functionality not implemented for this data structure");
+        return ds->rb_dup_insert(tid, key, val, true);
     }
     V insertIfAbsent(const int tid, const K& key, const V& val) {
         return ds->rb_dup_insert(tid, key, val);
@@ -76,7 +99,7 @@ public:
         recmgr->printStatus();
     }
     bool validateStructure() {
-        return true;
+        return ds->validate();
     }
     void printObjectSizes() {
         std::cout<<"sizes: node="
@@ -152,13 +152,17 @@ bool dup_open(int tid, node_t** root)
 template <typename skey_t, typename sval_t>
 void dup_unlock_duplications(int tid, bool all)
 {
-	for (auto& l : *locked)
+	for (auto it = locked->begin(); it != locked->end(); )
 	{
-		if (all || l.second)
+		if (all || it->second)
         {
-            locked->erase(l.first);
-			pthread_spin_unlock(&l.first->dup_lock);
+			pthread_spin_unlock(&it->first->dup_lock);
+            it = locked->erase(it);
         }
+		else
+		{
+			++it;
+		}
 	}
 }
 
@@ -257,7 +261,8 @@ end:
 template <typename skey_t, typename sval_t>
 rb_node<skey_t, sval_t>::rb_node()
 {
-	allocated->insert({this, true});
+	// new nodes are tracked by GetNode(): a pool constructs records a block
+	// at a time, not when the operation takes one
 }
 
 template <typename skey_t, typename sval_t>
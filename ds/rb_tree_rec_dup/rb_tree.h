@@ -1,11 +1,22 @@
 #pragma once
 
 #include "rb_node.h" 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include <mutex>
 
 std::mutex m_mutex;
 unsigned int recursive_counter;
 
+#ifdef RB_RELAXED_BALANCE
+#   ifndef RB_RELAXED_STEPS_PER_OP
+#       define RB_RELAXED_STEPS_PER_OP 2 // rebalancing steps run by each update
+#   endif
+#endif
+
+const size_t BULK_LOAD_TASK_MIN = 1 << 14;
+
 template <typename skey_t, typename sval_t, class RecMgr>
 class rb_tree {
 private:
@@ -18,6 +29,28 @@ private:
 	int init[MAX_THREADS_POW2] = {0,};
 	RecMgr* recmgr;
 
+	// nodes replaced or copied by the running operation, gathered so they
+	// are retired or freed with one call into the record manager
+	struct write_set_t {
+		PAD;
+		std::vector<rb_node<skey_t, sval_t>*> nodes;
+		PAD;
+	};
+	write_set_t write_set[MAX_THREADS_POW2];
+
+#ifdef RB_RELAXED_BALANCE
+	// Relaxed balance (chromatic-tree style): an insert only links a red leaf
+	// and records the key of that leaf if it created a red-red violation.
+	// The violations are repaired later, one local step per duplication.
+	struct relaxed_info_t {
+		PAD;
+		std::vector<skey_t> violations;
+		bool staged;
+		PAD;
+	};
+	relaxed_info_t relaxed[MAX_THREADS_POW2];
+#endif
+
 	rb_node<skey_t, sval_t> * _lookup (skey_t k) {
 		rb_node<skey_t, sval_t> * p = root; 
 		while (p != NULL) {
@@ -735,6 +768,184 @@ private:
 		}
 	}
 
+#ifdef RB_RELAXED_BALANCE
+	int insert_relaxed(const int & tid, skey_t k, sval_t v, rb_node<skey_t, sval_t>* n)
+	{
+		if (orig_root == NULL)
+			return insert_rec(tid, k, v, n);
+
+		rb_node<skey_t, sval_t>* t = orig_root;
+		unsigned int dir;
+		while (true)
+		{
+			skey_t cmp = k - t->get_key();
+			if (cmp == 0)
+				return 1338;
+
+			dir = (cmp < 0) ? LEFT : RIGHT;
+			rb_node<skey_t, sval_t>* tc = t->get_child(dir);
+			if (tc == NULL)
+				break;
+			t = tc;
+		}
+
+		auto n_dup = dup_prologue(tid, n);
+		if (n_dup != nullptr) {
+			n_dup->set_child(LEFT, NULL);
+			n_dup->set_child(RIGHT, NULL);
+			n_dup->set_key(k); 
+			n_dup->set_value(v); 
+			n_dup->set_color(RED);
+			dup_epilogue(tid, n, n_dup);
+		}
+
+		auto t_dup = dup_prologue(tid, t);
+		if (t_dup != nullptr) {
+			t_dup->set_child(dir, n); 
+			dup_epilogue(tid, t, t_dup);
+		}
+
+		// a red parent is left as a violation for rebalance_step()
+		return (colorOf(t) == RED) ? 1 : 0;
+	}
+
+	// Perform one rebalancing step for the violation recorded at key k.
+	// Descends to k and repairs the topmost red-red pair on the path, so the
+	// grandparent used by fix_rec_insert() is always black. Returns true if a
+	// violation may still remain on the path.
+	bool rebalance_step(const int & tid, skey_t k)
+	{
+		std::vector<rb_node<skey_t, sval_t>*> path;
+		rb_node<skey_t, sval_t>* t = orig_root;
+		while (t != NULL)
+		{
+			path.push_back(t);
+			skey_t cmp = k - t->get_key();
+			if (cmp == 0)
+				break;
+			t = (cmp < 0) ? t->get_child(LEFT) : t->get_child(RIGHT);
+		}
+
+		if (t == NULL)
+			return false;
+
+		bool more = false;
+		for (size_t i = 1; i < path.size(); i++)
+		{
+			if (colorOf(path[i]) != RED || colorOf(path[i - 1]) != RED)
+				continue;
+
+			if (i == 1)
+			{
+				// the parent is the root, recoloring it fixes the violation
+				setColor(tid, path[0], BLACK);
+				new_root = selfOf(path[0]);
+			}
+			else
+			{
+				auto xppp = (i >= 3) ? path[i - 3] : NULL;
+				fix_rec_insert(tid, xppp, path[i - 2], path[i - 1], path[i]);
+			}
+			more = true;
+			break;
+		}
+
+		rb_node<skey_t, sval_t>* ro = new_root;
+		if (colorOf(ro) != BLACK) {
+			auto ro_dup = dup_prologue(tid, ro);
+			if (ro_dup != nullptr) {
+				ro_dup->set_color(BLACK);
+				dup_epilogue(tid, ro, ro_dup);
+			}
+			new_root = ro_dup;
+		}
+		return more;
+	}
+
+	// Returns a red node in the subtree of n (down to depth levels below n)
+	// whose parent is red, or NULL. parent_red is the color of n's parent.
+	rb_node<skey_t, sval_t>* find_red_pair(rb_node<skey_t, sval_t>* n, bool parent_red, int depth)
+	{
+		if (n == NULL)
+			return NULL;
+		const bool red = (colorOf(n) == RED);
+		if (red && parent_red)
+			return n;
+		if (depth == 0)
+			return NULL;
+		rb_node<skey_t, sval_t>* res = find_red_pair(n->get_child(LEFT), red, depth - 1);
+		return res ? res : find_red_pair(n->get_child(RIGHT), red, depth - 1);
+	}
+
+	// fix_rec_delete() assumes a valid red-black tree around the node it
+	// unlinks: the path to that node (the successor, if k's node has two
+	// children), the siblings along the path and their children and
+	// grandchildren, which its rotations pull onto the path. Repairs the
+	// topmost red-red pair there with one rebalance_step() and returns true,
+	// or returns false if there is none and the delete may go ahead.
+	bool repair_before_delete(const int & tid, skey_t k)
+	{
+		std::vector<rb_node<skey_t, sval_t>*> path;
+		rb_node<skey_t, sval_t>* t = orig_root;
+		while (t != NULL)
+		{
+			path.push_back(t);
+			skey_t cmp = k - t->get_key();
+			if (cmp == 0)
+				break;
+			t = (cmp < 0) ? t->get_child(LEFT) : t->get_child(RIGHT);
+		}
+		if (t == NULL)
+			return false;
+		if (t->get_child(LEFT) != NULL && t->get_child(RIGHT) != NULL)
+		{
+			t = t->get_child(RIGHT);
+			while (t != NULL)
+			{
+				path.push_back(t);
+				t = t->get_child(LEFT);
+			}
+		}
+		for (size_t i = 0; i < path.size(); i++)
+		{
+			rb_node<skey_t, sval_t>* bad = NULL;
+			if (i > 0 && colorOf(path[i]) == RED && colorOf(path[i - 1]) == RED)
+				bad = path[i];
+			if (bad == NULL && i + 1 < path.size())
+			{
+				rb_node<skey_t, sval_t>* sib = (selfOf(path[i + 1]) == selfOf(path[i]->get_child(LEFT)))
+						? path[i]->get_child(RIGHT) : path[i]->get_child(LEFT);
+				bad = find_red_pair(sib, colorOf(path[i]) == RED, 3);
+			}
+			if (bad != NULL)
+			{
+				rebalance_step(tid, bad->get_key());
+				return true;
+			}
+		}
+		return false;
+	}
+#endif
+
+	// Returns the black height of the subtree of t, or -1 if it is not a
+	// red-black tree with keys in (lo, hi). lo and hi may be NULL (unbounded).
+	int validate_subtree(rb_node<skey_t, sval_t>* t, const skey_t* lo, const skey_t* hi, bool parent_red)
+	{
+		if (t == NULL)
+			return 1;
+		const skey_t k = t->get_key();
+		if ((lo && !(*lo < k)) || (hi && !(k < *hi)))
+			return -1;
+		const bool red = (t->get_color() == RED);
+		if (red && parent_red)
+			return -1;
+		int l = validate_subtree(t->get_child(LEFT), lo, &k, red);
+		int r = validate_subtree(t->get_child(RIGHT), &k, hi, red);
+		if (l < 0 || l != r)
+			return -1;
+		return l + (red ? 0 : 1);
+	}
+
 	void fixAfterInsertion(const int & tid, rb_node<skey_t, sval_t> * x) {
 		auto x_dup = dup_prologue(tid, x);
 		if (x_dup != nullptr) {
@@ -952,21 +1163,17 @@ private:
 				{
 					auto xpp_dup = dup_prologue(tid, xpp);
 					if (xpp_dup != nullptr) {
-						xpp_dup->set_child(LEFT, x);
+						xpp_dup->set_child(LEFT, selfOf(x));
 						dup_epilogue(tid, xpp, xpp_dup);
 					}
-					if (xppp == NULL)
-						new_root = selfOf(xpp);
 				}
 				else
 				{
 					auto xpp_dup = dup_prologue(tid, xpp);
 					if (xpp_dup != nullptr) {
-						xpp_dup->set_child(RIGHT, x);
+						xpp_dup->set_child(RIGHT, selfOf(x));
 						dup_epilogue(tid, xpp, xpp_dup);
 					}
-					if (xppp == NULL)
-						new_root = selfOf(xpp);
 				}
 
 				auto xp_dup = dup_prologue(tid, xp);
@@ -977,8 +1184,13 @@ private:
 					dup_epilogue(tid, xp, xp_dup);
 				}
 
-				// Fix replacement
-				if (xp->get_color() == BLACK)
+				// Fix replacement: a red replacement only needs to turn black
+				if (xp->get_color() == BLACK && colorOf(x) == RED)
+				{
+					setColor(tid, x, BLACK);
+					return 1337;
+				}
+				else if (xp->get_color() == BLACK)
 				{
 					return fix_rec_delete(tid, xppp, xpp, x);
 				}
@@ -1000,8 +1212,6 @@ private:
 							xpp_dup->set_child(LEFT, NULL);
 							dup_epilogue(tid, xpp, xpp_dup);
 						}
-						if (xppp == NULL)
-							new_root = selfOf(xpp);
 					}
 					else if (selfOf(xp) == selfOf(xpp->get_child(RIGHT)))
 					{
@@ -1010,8 +1220,6 @@ private:
 							xpp_dup->set_child(RIGHT, NULL);
 							dup_epilogue(tid, xpp, xpp_dup);
 						}
-						if (xppp == NULL)
-							new_root = selfOf(xpp);
 					}
 				}
 
@@ -1048,8 +1256,6 @@ private:
 				else
 				{
 					setColor(tid, xp, BLACK);
-					if (xpp == NULL)
-						new_root = selfOf(xp);
 					return 1337;
 				}
 			}
@@ -1180,8 +1386,6 @@ private:
 					t_dup->set_value((*deleted)->get_value());
 					dup_epilogue(tid, t, t_dup);
 				}
-				if (tp == NULL)
-					new_root = selfOf(t);
 
 				// (*deleted)->k = deleted_key;
 				// (*deleted)->v = deleted_val;
@@ -1208,7 +1412,7 @@ private:
 
 					if (xp->get_color() == BLACK)
 					{
-						return fix_rec_delete(tid, xppp, xpp, x);
+						return fix_rec_delete(tid, xppp, xpp, xp);
 					}
 					else
 					{
@@ -1246,21 +1450,17 @@ private:
 					{
 						auto xpp_dup = dup_prologue(tid, xpp);
 						if (xpp_dup != nullptr) {
-							xpp_dup->set_child(LEFT, x);
+							xpp_dup->set_child(LEFT, selfOf(x));
 							dup_epilogue(tid, xpp, xpp_dup);
 						}
-						if (xppp == NULL)
-							new_root = selfOf(xpp);
 					}
 					else
 					{
 						auto xpp_dup = dup_prologue(tid, xpp);
 						if (xpp_dup != nullptr) {
-							xpp_dup->set_child(RIGHT, x);
+							xpp_dup->set_child(RIGHT, selfOf(x));
 							dup_epilogue(tid, xpp, xpp_dup);
 						}
-						if (xppp == NULL)
-							new_root = selfOf(xpp);
 					}
 
 					auto xp_dup = dup_prologue(tid, xp);
@@ -1271,8 +1471,13 @@ private:
 						dup_epilogue(tid, xp, xp_dup);
 					}
 
-					// Fix replacement
-					if (xp->get_color() == BLACK)
+					// Fix replacement: a red replacement only needs to turn black
+					if (xp->get_color() == BLACK && colorOf(x) == RED)
+					{
+						setColor(tid, x, BLACK);
+						return 1337;
+					}
+					else if (xp->get_color() == BLACK)
 					{
 						return fix_rec_delete(tid, xppp, xpp, x);
 					}
@@ -1296,8 +1501,6 @@ private:
 								xpp_dup->set_child(LEFT, NULL);
 								dup_epilogue(tid, xpp, xpp_dup);
 							}
-							if (xppp == NULL)
-								new_root = selfOf(xpp);
 						}
 						else if (selfOf(xp) == selfOf(xpp->get_child(RIGHT)))
 						{
@@ -1306,8 +1509,6 @@ private:
 								xpp_dup->set_child(RIGHT, NULL);
 								dup_epilogue(tid, xpp, xpp_dup);
 							}
-							if (xppp == NULL)
-								new_root = selfOf(xpp);
 						}
 					}
 
@@ -1348,8 +1549,6 @@ private:
 					else
 					{
 						setColor(tid, xp, BLACK);
-						if (xpp == NULL)
-							new_root = selfOf(xp);
 						return 1337;
 					}
 				}
@@ -1392,8 +1591,6 @@ private:
 					else
 					{
 						setColor(tid, xp, BLACK);
-						if (xpp == NULL)
-							new_root = selfOf(xp);
 						return 1337;
 					}
 				}
@@ -1579,6 +1776,8 @@ private:
 	rb_node<skey_t, sval_t> * GetNode (const int & tid) {
 		rb_node<skey_t, sval_t> * result = 
 			(rb_node<skey_t, sval_t> *)recmgr->template allocate<rb_node<skey_t, sval_t>>(tid);
+		if (allocated)
+			allocated->insert({result, true});
 		pthread_spin_init(&result->dup_lock, PTHREAD_PROCESS_PRIVATE);
 		return result; 
 	}
@@ -1586,6 +1785,8 @@ private:
 	rb_node<skey_t, sval_t> * GetNode (const int & tid, rb_node<skey_t, sval_t> * node) {
 		rb_node<skey_t, sval_t> * result = 
 			(rb_node<skey_t, sval_t> *)recmgr->template allocate<rb_node<skey_t, sval_t>>(tid);
+		if (allocated)
+			allocated->insert({result, true});
 		std::memcpy((void *)result, (void *)node, sizeof(rb_node<skey_t, sval_t>));
 		pthread_spin_init(&result->dup_lock, PTHREAD_PROCESS_PRIVATE);
 		return result; 
@@ -1605,6 +1806,51 @@ private:
 		duplications->insert({n, {nullptr, nullptr, 0}});
 	}
 
+	void retire_replaced(const int tid) {
+		auto& nodes = write_set[tid].nodes;
+		nodes.clear();
+		for (auto& d : *duplications)
+			nodes.push_back(d.first);
+		recmgr->retire_batch(tid, nodes.data(), (int)nodes.size());
+	}
+
+	void deallocate_copies(const int tid) {
+		auto& nodes = write_set[tid].nodes;
+		nodes.clear();
+		for (auto& d : *allocated)
+			nodes.push_back(d.first);
+		recmgr->deallocate_batch(tid, nodes.data(), (int)nodes.size());
+	}
+
+	// builds the subtree of keys [lo, hi) below parent. nodes at red_depth
+	// are colored red and all others black, see bulk_load.
+	rb_node<skey_t, sval_t> * build(const skey_t * keys, const sval_t * values, size_t lo, size_t hi,
+									rb_node<skey_t, sval_t> * parent, int depth, int red_depth)
+	{
+		if (lo >= hi)
+			return nullptr;
+
+#ifdef _OPENMP
+		const int tid = omp_get_thread_num();
+#else
+		const int tid = 0;
+#endif
+		size_t mid = lo + (hi - lo) / 2;
+		rb_node<skey_t, sval_t> * n = GetNode(tid);
+		n->k = keys[mid];
+		n->v = values[mid];
+		n->p = parent;
+		n->c = (depth == red_depth) ? RED : BLACK;
+
+		// the left half becomes a task while it is big enough to be worth one
+		#pragma omp task if (mid - lo > BULK_LOAD_TASK_MIN)
+		n->l = build(keys, values, lo, mid, n, depth + 1, red_depth);
+		n->r = build(keys, values, mid + 1, hi, n, depth + 1, red_depth);
+		#pragma omp taskwait
+
+		return n;
+	}
+
 public:
 	rb_tree(
 		const int _NUM_THREADS, 
@@ -1641,6 +1887,10 @@ public:
 	{
 		if (!init[tid]) return;
 		else init[tid] = !init[tid];
+#ifdef RB_RELAXED_BALANCE
+		// no other thread repairs this thread's violations
+		rebalance(tid, -1);
+#endif
 		recmgr->deinitThread(tid);
 	}
 
@@ -1651,7 +1901,7 @@ public:
 
 		make_empty(t->get_child(LEFT));
 		make_empty(t->get_child(RIGHT));
-		delete t;
+		recmgr->deallocate(0, t);
 	}
 
 	RecMgr * debugGetRecMgr()
@@ -1664,11 +1914,31 @@ public:
 		return root;
 	}
 
+	// builds a balanced tree from n sorted keys. the tree must be empty, and
+	// all OpenMP threads must have been initialized (nodes are allocated by
+	// them). splitting at the midpoint fills depths 0..h-1 completely, where
+	// h is the largest integer with 2^h <= n + 1, so coloring the nodes at
+	// depth h red (if any) and all others black is a valid coloring.
+	void bulk_load(const skey_t * keys, const sval_t * values, size_t n)
+	{
+		int h = 0;
+		while (((size_t)2 << h) <= n + 1) ++h;
+
+		#pragma omp parallel
+		#pragma omp single
+		root = build(keys, values, 0, n, nullptr, 0, h);
+	}
+
 	sval_t rb_insert(const int & tid, skey_t Key, sval_t Val) {
 		rb_node<skey_t, sval_t> * node = GetNode(tid); 
 		// rb_node<skey_t, sval_t> * ex; 
 		// ex = _insert(tid, Key, Val, node);
+#ifdef RB_RELAXED_BALANCE
+		int res = insert_relaxed(tid, Key, Val, node);
+		relaxed[tid].staged = (res == 1);
+#else
 		int res = insert_rec(tid, Key, Val, node);
+#endif
 
 		// if (ex != NULL) {
 		if (res == 1338) {
@@ -1681,32 +1951,54 @@ public:
 		}
 	}
 
-	sval_t rb_dup_insert(const int & tid, skey_t Key, sval_t Val) {
+	// insert-or-replace. A new value for an existing key changes no links or
+	// colors, so only the key's node is duplicated alone.
+	sval_t rb_upsert(const int & tid, skey_t Key, sval_t Val) {
+		rb_node<skey_t, sval_t> * n = _lookup(Key);
+		if (n == NULL)
+			return rb_insert(tid, Key, Val);
+
+#ifdef RB_RELAXED_BALANCE
+		relaxed[tid].staged = false;
+#endif
+		sval_t old = n->get_value();
+		auto n_dup = dup_prologue(tid, n);
+		if (n_dup != nullptr) {
+			n_dup->set_value(Val);
+			dup_epilogue(tid, n, n_dup);
+		}
+		return old;
+	}
+
+	// replace selects insert-or-replace (rb_upsert) over insert-if-absent
+	sval_t rb_dup_insert(const int & tid, skey_t Key, sval_t Val, bool replace = false) {
+		sval_t insertion_res;
 		while (1)
         {
             auto guard = recmgr->getGuard(tid);
             dup_open<skey_t, sval_t>(tid, &root);
             locking_res = true;
-            auto insertion_res = rb_insert(tid, Key, Val);
+            insertion_res = (replace ? rb_upsert(tid, Key, Val) : rb_insert(tid, Key, Val));
             dup_paths_to_lca(tid);
 
             if (locking_res && dup_close<skey_t, sval_t>(tid, &root))
             {
-                for (auto& d : *duplications)
-                {
-					recmgr->retire(tid, d.first);
-                }
+                retire_replaced(tid);
                 
-                return insertion_res;
+                break;
             }
             else
             {
-                for (auto& d : *allocated)
-                {
-					recmgr->deallocate(tid, d.first);
-                }
+                deallocate_copies(tid);
             }
         }
+
+#ifdef RB_RELAXED_BALANCE
+		if (relaxed[tid].staged)
+			relaxed[tid].violations.push_back(Key);
+		rebalance(tid, RB_RELAXED_STEPS_PER_OP);
+#endif
+		return insertion_res;
 	}
 
 	sval_t rb_delete(const int & tid, skey_t Key) {
@@ -1725,32 +2017,94 @@ public:
 	}
 
 	sval_t rb_dup_delete(const int & tid, skey_t Key) {
+		sval_t removal_res;
 		while (1)
 		{
 			auto guard = recmgr->getGuard(tid);
 			dup_open<skey_t, sval_t>(tid, &root);
 			locking_res = true;
-			auto removal_res = rb_delete(tid, Key);
+#ifdef RB_RELAXED_BALANCE
+			// repair red-red pairs around the deleted node first, one per
+			// duplication, since the delete fix-up does not expect them
+			const bool repaired = repair_before_delete(tid, Key);
+			if (!repaired)
+#endif
+			removal_res = rb_delete(tid, Key);
 			dup_paths_to_lca(tid);
 
 			if (locking_res && dup_close<skey_t, sval_t>(tid, &root))
 			{
-				for (auto& d : *duplications)
-				{
-					recmgr->retire(tid, d.first);
-				}
-				return removal_res;
+				retire_replaced(tid);
+#ifdef RB_RELAXED_BALANCE
+				if (repaired)
+					continue;
+#endif
+				break;
 			}
 			else
 			{
-				for (auto& d : *allocated)
+				deallocate_copies(tid);
+			}
+		}
+
+#ifdef RB_RELAXED_BALANCE
+		rebalance(tid, RB_RELAXED_STEPS_PER_OP);
+#endif
+		return removal_res;
+	}
+
+#ifdef RB_RELAXED_BALANCE
+	// Run up to max_steps pending rebalancing steps of thread tid (all of
+	// them if max_steps < 0). Every step is its own duplication, so its write
+	// set is bounded by the rotation neighborhood of a single violation.
+	void rebalance(const int & tid, int max_steps = -1)
+	{
+		auto& violations = relaxed[tid].violations;
+		while (!violations.empty() && max_steps-- != 0)
+		{
+			skey_t k = violations.back();
+			violations.pop_back();
+
+			bool more;
+			while (1)
+			{
+				auto guard = recmgr->getGuard(tid);
+				dup_open<skey_t, sval_t>(tid, &root);
+				locking_res = true;
+				more = rebalance_step(tid, k);
+				dup_paths_to_lca(tid);
+
+				if (locking_res && dup_close<skey_t, sval_t>(tid, &root))
+				{
+					retire_replaced(tid);
+					break;
+				}
+				else
 				{
-					recmgr->deallocate(tid, d.first);
+					deallocate_copies(tid);
 				}
 			}
+
+			if (more)
+				violations.push_back(k);
 		}
 	}
 
+	size_t pending_violations(const int & tid)
+	{
+		return relaxed[tid].violations.size();
+	}
+#endif
+
+	// checks the search tree order and the red-black properties. Not safe
+	// against concurrent operations.
+	bool validate()
+	{
+		if (colorOf(root) != BLACK)
+			return false;
+		return validate_subtree(root, NULL, NULL, false) >= 0;
+	}
+
 	sval_t rb_contains (const int & tid, skey_t Key) {
 		rb_node<skey_t, sval_t> * n = _lookup(Key);
 		if (n != NULL) {
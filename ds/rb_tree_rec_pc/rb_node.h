@@ -159,7 +159,8 @@ bool pc_close(const int& tid, node_t** root)
 template <typename skey_t, typename sval_t>
 rb_node<skey_t, sval_t>::rb_node()
 {
-	allocated->insert({this, true});
+	// new nodes are tracked by GetNode(): a pool constructs records a block
+	// at a time, not when the operation takes one
 }
 
 template <typename skey_t, typename sval_t>
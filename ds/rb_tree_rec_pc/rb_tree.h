@@ -1,10 +1,15 @@
 #pragma once
 
 #include "rb_node.h" 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include <mutex>
 
 std::mutex g_mutex;
 
+const size_t BULK_LOAD_TASK_MIN = 1 << 14;
+
 template <typename skey_t, typename sval_t, class RecMgr>
 class rb_tree {
 private:
@@ -17,6 +22,15 @@ private:
 	int init[MAX_THREADS_POW2] = {0,};
 	RecMgr* recmgr;
 
+	// nodes replaced or copied by the running operation, gathered so they
+	// are retired or freed with one call into the record manager
+	struct write_set_t {
+		PAD;
+		std::vector<rb_node<skey_t, sval_t>*> nodes;
+		PAD;
+	};
+	write_set_t write_set[MAX_THREADS_POW2];
+
 	rb_node<skey_t, sval_t> * _lookup (skey_t k) {
 		rb_node<skey_t, sval_t> * p = root; 
 		while (p != NULL) {
@@ -1336,6 +1350,8 @@ private:
 	rb_node<skey_t, sval_t> * GetNode (const int & tid) {
 		rb_node<skey_t, sval_t> * result = 
 			(rb_node<skey_t, sval_t> *)recmgr->template allocate<rb_node<skey_t, sval_t>>(tid);
+		if (allocated)
+			allocated->insert({result, true});
 		pthread_spin_init(&result->dup_lock, PTHREAD_PROCESS_PRIVATE);
 		return result; 
 	}
@@ -1343,6 +1359,8 @@ private:
 	rb_node<skey_t, sval_t> * GetNode (const int & tid, rb_node<skey_t, sval_t> * node) {
 		rb_node<skey_t, sval_t> * result = 
 			(rb_node<skey_t, sval_t> *)recmgr->template allocate<rb_node<skey_t, sval_t>>(tid);
+		if (allocated)
+			allocated->insert({result, true});
 		std::memcpy((void *)result, (void *)node, sizeof(rb_node<skey_t, sval_t>));
 		pthread_spin_init(&result->dup_lock, PTHREAD_PROCESS_PRIVATE);
 		return result; 
@@ -1353,6 +1371,51 @@ private:
 		duplications->insert({n, nullptr});
 	}
 
+	void retire_replaced(const int tid) {
+		auto& nodes = write_set[tid].nodes;
+		nodes.clear();
+		for (auto& d : *duplications)
+			nodes.push_back(d.first);
+		recmgr->retire_batch(tid, nodes.data(), (int)nodes.size());
+	}
+
+	void deallocate_copies(const int tid) {
+		auto& nodes = write_set[tid].nodes;
+		nodes.clear();
+		for (auto& d : *allocated)
+			nodes.push_back(d.first);
+		recmgr->deallocate_batch(tid, nodes.data(), (int)nodes.size());
+	}
+
+	// builds the subtree of keys [lo, hi) below parent. nodes at red_depth
+	// are colored red and all others black, see bulk_load.
+	rb_node<skey_t, sval_t> * build(const skey_t * keys, const sval_t * values, size_t lo, size_t hi,
+									rb_node<skey_t, sval_t> * parent, int depth, int red_depth)
+	{
+		if (lo >= hi)
+			return nullptr;
+
+#ifdef _OPENMP
+		const int tid = omp_get_thread_num();
+#else
+		const int tid = 0;
+#endif
+		size_t mid = lo + (hi - lo) / 2;
+		rb_node<skey_t, sval_t> * n = GetNode(tid);
+		n->k = keys[mid];
+		n->v = values[mid];
+		n->p = parent;
+		n->c = (depth == red_depth) ? RED : BLACK;
+
+		// the left half becomes a task while it is big enough to be worth one
+		#pragma omp task if (mid - lo > BULK_LOAD_TASK_MIN)
+		n->l = build(keys, values, lo, mid, n, depth + 1, red_depth);
+		n->r = build(keys, values, mid + 1, hi, n, depth + 1, red_depth);
+		#pragma omp taskwait
+
+		return n;
+	}
+
 public:
 	rb_tree(
 		const int _NUM_THREADS, 
@@ -1399,7 +1462,7 @@ public:
 
 		make_empty(t->get_child(LEFT));
 		make_empty(t->get_child(RIGHT));
-		delete t;
+		recmgr->deallocate(0, t);
 	}
 
 	RecMgr * debugGetRecMgr()
@@ -1412,6 +1475,21 @@ public:
 		return root;
 	}
 
+	// builds a balanced tree from n sorted keys. the tree must be empty, and
+	// all OpenMP threads must have been initialized (nodes are allocated by
+	// them). splitting at the midpoint fills depths 0..h-1 completely, where
+	// h is the largest integer with 2^h <= n + 1, so coloring the nodes at
+	// depth h red (if any) and all others black is a valid coloring.
+	void bulk_load(const skey_t * keys, const sval_t * values, size_t n)
+	{
+		int h = 0;
+		while (((size_t)2 << h) <= n + 1) ++h;
+
+		#pragma omp parallel
+		#pragma omp single
+		root = build(keys, values, 0, n, nullptr, 0, h);
+	}
+
 	sval_t rb_insert(const int & tid, skey_t Key, sval_t Val) {
 		rb_node<skey_t, sval_t> * node = GetNode(tid); 
 		// rb_node<skey_t, sval_t> * ex; 
@@ -1429,23 +1507,36 @@ public:
 		}
 	}
 
+	// insert-or-replace. A new value for an existing key changes no links or
+	// colors, so only the path from the root to the key's node is copied.
+	sval_t rb_upsert(const int & tid, skey_t Key, sval_t Val) {
+		rb_node<skey_t, sval_t> * n = _lookup(Key);
+		if (n == NULL)
+			return rb_insert(tid, Key, Val);
+
+		sval_t old = n->get_value();
+		auto n_dup = path_copy(tid, n);
+		if (n_dup != nullptr) {
+			n_dup->set_value(Val);
+		}
+		return old;
+	}
+
 	unsigned int tries = 0;
 	unsigned int successfuls = 0;
-	sval_t rb_pc_insert(const int & tid, skey_t Key, sval_t Val) {
+	// replace selects insert-or-replace (rb_upsert) over insert-if-absent
+	sval_t rb_pc_insert(const int & tid, skey_t Key, sval_t Val, bool replace = false) {
 		// unsigned int temp = 0;
 		while (1)
         {
 			// temp++;
             auto guard = recmgr->getGuard(tid);
             pc_open<skey_t, sval_t>(tid, &root);
-            auto insertion_res = rb_insert(tid, Key, Val);
+            auto insertion_res = (replace ? rb_upsert(tid, Key, Val) : rb_insert(tid, Key, Val));
 			
             if (pc_close<skey_t, sval_t>(tid, &root))
             {
-                for (auto& d : *duplications)
-                {
-					recmgr->retire(tid, d.first);
-                }
+                retire_replaced(tid);
 
 				// if (insertion_res == NO_VALUE)
 				// {
@@ -1461,10 +1552,7 @@ public:
             }
             else
             {
-                for (auto& d : *allocated)
-                {
-					recmgr->deallocate(tid, d.first);
-                }
+                deallocate_copies(tid);
             }
         }
 	}
@@ -1493,19 +1581,13 @@ public:
 
 			if (pc_close<skey_t, sval_t>(tid, &root))
 			{
-				for (auto& d : *duplications)
-				{
-					recmgr->retire(tid, d.first);
-				}
+				retire_replaced(tid);
 
 				return removal_res;
 			}
 			else
 			{
-				for (auto& d : *allocated)
-				{
-					recmgr->deallocate(tid, d.first);
-				}
+				deallocate_copies(tid);
 			}
 		}
 	}
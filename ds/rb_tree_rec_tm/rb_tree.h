@@ -1,11 +1,16 @@
 #pragma once
 
 #include "rb_node.h" 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include <mutex>
 
 std::mutex g_mutex;
 unsigned int recursive_counter;
 
+const size_t BULK_LOAD_TASK_MIN = 1 << 14;
+
 template <typename skey_t, typename sval_t, class RecMgr>
 class rb_tree {
 private:
@@ -1330,6 +1335,35 @@ private:
 		recmgr->deallocate(tid, n);
 	}
 
+	// builds the subtree of keys [lo, hi) below parent. nodes at red_depth
+	// are colored red and all others black, see bulk_load.
+	rb_node<skey_t, sval_t> * build(const skey_t * keys, const sval_t * values, size_t lo, size_t hi,
+									rb_node<skey_t, sval_t> * parent, int depth, int red_depth)
+	{
+		if (lo >= hi)
+			return nullptr;
+
+#ifdef _OPENMP
+		const int tid = omp_get_thread_num();
+#else
+		const int tid = 0;
+#endif
+		size_t mid = lo + (hi - lo) / 2;
+		rb_node<skey_t, sval_t> * n = GetNode(tid);
+		n->k = keys[mid];
+		n->v = values[mid];
+		n->p = parent;
+		n->c = (depth == red_depth) ? RED : BLACK;
+
+		// the left half becomes a task while it is big enough to be worth one
+		#pragma omp task if (mid - lo > BULK_LOAD_TASK_MIN)
+		n->l = build(keys, values, lo, mid, n, depth + 1, red_depth);
+		n->r = build(keys, values, mid + 1, hi, n, depth + 1, red_depth);
+		#pragma omp taskwait
+
+		return n;
+	}
+
 public:
 	rb_tree(
 		const int _NUM_THREADS, 
@@ -1376,7 +1410,7 @@ public:
 
 		make_empty(t->get_child(LEFT));
 		make_empty(t->get_child(RIGHT));
-		delete t;
+		recmgr->deallocate(0, t);
 	}
 
 	RecMgr * debugGetRecMgr()
@@ -1389,6 +1423,21 @@ public:
 		return root;
 	}
 
+	// builds a balanced tree from n sorted keys. the tree must be empty, and
+	// all OpenMP threads must have been initialized (nodes are allocated by
+	// them). splitting at the midpoint fills depths 0..h-1 completely, where
+	// h is the largest integer with 2^h <= n + 1, so coloring the nodes at
+	// depth h red (if any) and all others black is a valid coloring.
+	void bulk_load(const skey_t * keys, const sval_t * values, size_t n)
+	{
+		int h = 0;
+		while (((size_t)2 << h) <= n + 1) ++h;
+
+		#pragma omp parallel
+		#pragma omp single
+		root = build(keys, values, 0, n, nullptr, 0, h);
+	}
+
 	sval_t rb_insert(const int & tid, skey_t Key, sval_t Val) {
 		rb_node<skey_t, sval_t> * node = GetNode(tid); 
 		__transaction_atomic { int res = insert_rec(tid, Key, Val, node);
@@ -1408,6 +1457,26 @@ public:
 		return insertion_res;
 	}
 
+	// insert-or-replace: the value of an existing key is overwritten in place
+	sval_t rb_upsert(const int & tid, skey_t Key, sval_t Val) {
+		rb_node<skey_t, sval_t> * node = GetNode(tid); 
+		__transaction_atomic { rb_node<skey_t, sval_t> * n = _lookup(Key);
+		if (n == NULL) {
+			insert_rec(tid, Key, Val, node);
+			return NO_VALUE;
+		}
+
+		ReleaseNode(tid, node);
+		sval_t old = n->v;
+		n->set_value(Val);
+		return old; }
+	}
+
+	sval_t rb_tm_upsert(const int & tid, skey_t Key, sval_t Val) {
+		auto guard = recmgr->getGuard(tid);
+		return rb_upsert(tid, Key, Val);
+	}
+
 	sval_t rb_delete(const int & tid, skey_t Key) {
 		rb_node<skey_t, sval_t> * node = NULL;
 
@@ -79,6 +79,12 @@
     gstats_handle_stat(LONG_LONG, move_block_node_to_cpu, 1, { \
             gstats_output_item(PRINT_RAW, SUM, TOTAL) \
     }) \
+    gstats_handle_stat(LONG_LONG, pool_numa_home_local, 1, { \
+            gstats_output_item(PRINT_RAW, SUM, TOTAL) \
+    }) \
+    gstats_handle_stat(LONG_LONG, pool_numa_home_remote, 1, { \
+            gstats_output_item(PRINT_RAW, SUM, TOTAL) \
+    }) \
     gstats_handle_stat(LONG_LONG, num_bail_from_addkv_at_depth, 10, { \
             gstats_output_item(PRINT_RAW, SUM, BY_INDEX) \
     }) \
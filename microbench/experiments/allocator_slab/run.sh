@@ -0,0 +1,35 @@
+#!/bin/bash
+# Throughput of the update heavy workload under each allocator: allocator_new
+# on glibc malloc, tcmalloc and hoard (preloaded from lib/), and allocator_slab.
+# Writes allocators.csv.
+
+cd "$(dirname "$0")"
+here=`pwd`
+
+algs="btree_duplication btree_path_copy rb_tree_rec_dup"
+threads="1 $(cd .. && ./get_thread_count_max.sh)"
+t=3000 k=2000000 reclaim=debra
+out=allocators.csv
+
+cd ../..
+for alg in $algs; do
+    make -j ALLOCATORS="new slab" bin_dir=$here/bin ubench_$alg.alloc_new.reclaim_$reclaim.pool_none.out ubench_$alg.alloc_slab.reclaim_$reclaim.pool_none.out || exit 1
+done
+cd $here
+
+echo "ds,allocator,nthreads,throughput" > $out
+for alg in $algs; do
+    for n in $threads; do
+        args="-nwork $n -nprefill $n -i 50 -d 50 -rq 0 -rqsize 1 -k $k -nrq 0 -t $t"
+        for malloc in glibc tcmalloc hoard slab; do
+            case $malloc in
+                slab)  preload= ; alloc=slab ;;
+                glibc) preload= ; alloc=new ;;
+                *)     preload=../../../lib/lib$malloc.so ; alloc=new ;;
+            esac
+            bin=bin/ubench_$alg.alloc_$alloc.reclaim_$reclaim.pool_none.out
+            tput=$(LD_PRELOAD=$preload $bin $args | grep "total_throughput=" | cut -d"=" -f2)
+            echo "$alg,$malloc,$n,$tput" | tee -a $out
+        done
+    done
+done
@@ -0,0 +1,82 @@
+/**
+ * Cost of duplicating a tlx B+ tree node against its fill factor: a copy of
+ * the whole node (what allocate_leaf/allocate_inner did before) versus
+ * copy_live(), which copies the header and the used slots only.
+ *
+ * Nodes are copied from a pool of npool source nodes into a pool of
+ * destinations, so a pool larger than the caches shows the memory bandwidth
+ * side and a small one the cache resident case (duplications copy a node the
+ * operation just traversed). Prints one CSV line per node kind and slotuse.
+ *
+ * usage: node_copy [npool] [copies per point]
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "btree_node.hpp"
+
+typedef long long key_t_;
+typedef std::pair<key_t_, void*> value_t_;
+typedef tlx::inner_node<key_t_, value_t_> inner_t;
+typedef tlx::leaf_node<key_t_, value_t_> leaf_t;
+
+template <typename Node>
+static void full_copy(Node* dst, const Node* src) {
+    std::memcpy((void*)dst, (const void*)src, sizeof(Node));
+}
+
+template <typename Node>
+static void live_copy(Node* dst, const Node* src) {
+    dst->copy_live(src);
+}
+
+//! Returns nanoseconds per copy of copy() over the pools.
+template <typename Node, typename Copy>
+static double time_copies(std::vector<Node*>& src, std::vector<Node*>& dst,
+                          size_t copies, Copy copy) {
+    size_t n = src.size();
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < copies; ++i)
+        copy(dst[i % n], src[(i * 7919) % n]);
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / copies;
+}
+
+template <typename Node>
+static void run(const char* kind, unsigned short slots, size_t npool, size_t copies) {
+    std::vector<Node*> src(npool), dst(npool);
+    for (size_t i = 0; i < npool; ++i) {
+        src[i] = new Node();
+        dst[i] = new Node();
+        std::memset((void*)src[i], 1, sizeof(Node));
+        std::memset((void*)dst[i], 0, sizeof(Node));
+    }
+
+    for (unsigned short use = 1; use <= slots; ++use) {
+        for (size_t i = 0; i < npool; ++i) src[i]->slotuse = use;
+        time_copies(src, dst, npool, full_copy<Node>);  // warm up
+        double full = time_copies(src, dst, copies, full_copy<Node>);
+        double live = time_copies(src, dst, copies, live_copy<Node>);
+        printf("%s,%u,%u,%.2f,%zu,%.2f,%.2f\n", kind, use, slots,
+               (double)use / slots, sizeof(Node), full, live);
+    }
+
+    for (size_t i = 0; i < npool; ++i) {
+        delete src[i];
+        delete dst[i];
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t npool = argc > 1 ? atol(argv[1]) : 1024;
+    size_t copies = argc > 2 ? atol(argv[2]) : 1000000;
+
+    printf("kind,slotuse,slots,fill,node_bytes,full_ns,live_ns\n");
+    run<leaf_t>("leaf", tlx::btree_default_traits<key_t_, value_t_>::leaf_slots, npool, copies);
+    run<inner_t>("inner", tlx::btree_default_traits<key_t_, value_t_>::inner_slots, npool, copies);
+    return 0;
+}
@@ -0,0 +1,12 @@
+#!/bin/bash
+# Duplication cost of btree_path_copy nodes against fill factor, for a cache
+# resident pool of nodes and one larger than the last level cache.
+# Writes node_copy_small.csv and node_copy_large.csv.
+
+cd "$(dirname "$0")"
+g++ -std=c++14 -O3 -DNDEBUG node_copy.cpp -o node_copy -I../../../ds/btree_path_copy -lpthread || exit 1
+
+./node_copy 64 10000000 > node_copy_small.csv
+cat node_copy_small.csv
+./node_copy 262144 10000000 > node_copy_large.csv
+cat node_copy_large.csv
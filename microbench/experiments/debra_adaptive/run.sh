@@ -0,0 +1,51 @@
+#!/bin/bash
+# Peak RSS against throughput for DEBRA with its usual scan (one announcement
+# every 10 operations) and with -DDEBRA_ADAPTIVE_SCAN at a few limbo byte
+# thresholds. Update heavy and read mostly workloads are both run, since the
+# adaptive scan should only kick in for threads that retire a lot.
+# peak_rss_kB is VmHWM of the benchmark process, sampled until it exits.
+# limbo_bytes_max is the largest limbo_bytes in the memory timeline.
+# Writes debra.csv.
+
+cd "$(dirname "$0")"
+here=`pwd`
+
+algs="btree_duplication btree_path_copy rb_tree_rec_dup bst_path_copy"
+configs="base adaptive_16k adaptive_64k adaptive_256k"
+n=`cd .. && ./get_thread_count_max.sh`
+t=5000 k=2000000
+
+cd ../..
+for alg in $algs; do
+    for config in $configs; do
+        case $config in
+            base)       x="-DMEASURE_MEMORY_TIMELINE" ;;
+            adaptive_*) bytes=${config#adaptive_} ; x="-DMEASURE_MEMORY_TIMELINE -DDEBRA_ADAPTIVE_SCAN -DDEBRA_ADAPTIVE_SCAN_BYTES=$(( ${bytes%k} * 1024 ))" ;;
+        esac
+        make -j bin_dir=$here/bin_$config xargs="$x" ubench_$alg.alloc_new.reclaim_debra.pool_none.out || exit 1
+    done
+done
+cd $here
+
+echo "ds,config,nthreads,updates,throughput,peak_rss_kB,limbo_bytes_max,memory_bytes_per_key" > debra.csv
+for alg in $algs; do
+    for u in 100 10; do
+        for config in $configs; do
+            half=$((u / 2))
+            bin_$config/ubench_$alg.alloc_new.reclaim_debra.pool_none.out -nwork $n -nprefill $n -i $half -d $half -rq 0 -rqsize 1 -k $k -nrq 0 -t $t > temp.txt &
+            pid=$!
+            rss=0
+            while kill -0 $pid 2>/dev/null; do
+                hwm=`grep VmHWM /proc/$pid/status 2>/dev/null | tr -s " " | cut -d" " -f2`
+                [ -n "$hwm" ] && rss=$hwm
+                sleep 0.2
+            done
+            wait $pid
+            tput=`grep "total_throughput=" temp.txt | cut -d"=" -f2`
+            limbo=`grep "^timeline_memory" temp.txt | sed 's/.*limbo_bytes=\([0-9-]*\).*/\1/' | sort -n | tail -1`
+            perkey=`grep "memory_bytes_per_key=" temp.txt | cut -d"=" -f2`
+            echo "$alg,$config,$n,$u,$tput,$rss,$limbo,$perkey" | tee -a debra.csv
+        done
+    done
+done
+rm -f temp.txt
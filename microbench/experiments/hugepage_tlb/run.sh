@@ -0,0 +1,43 @@
+#!/bin/bash
+# dTLB misses per operation with allocator_new, and with allocator_slab on
+# 4KB pages and on 2MB pages (-DSLAB_HUGEPAGES), for large trees.
+# Needs libpapi (the binaries are built with has_libpapi=1). For explicit 2MB
+# pages reserve some first (echo N > /proc/sys/vm/nr_hugepages), otherwise
+# transparent huge pages must be enabled or in madvise mode.
+# Writes tlb.csv.
+
+cd "$(dirname "$0")"
+here=`pwd`
+
+algs="btree_duplication btree_path_copy rb_tree_rec_dup"
+n=`cd .. && ./get_thread_count_max.sh`
+t=10000 k=100000000
+args="-nwork $n -nprefill $n -i 50 -d 50 -rq 0 -rqsize 1 -k $k -nrq 0 -t $t"
+
+cd ../..
+for alg in $algs; do
+    make -j has_libpapi=1 ALLOCATORS="new slab" bin_dir=$here/bin_4k ubench_$alg.alloc_new.reclaim_debra.pool_none.out ubench_$alg.alloc_slab.reclaim_debra.pool_none.out || exit 1
+    make -j has_libpapi=1 ALLOCATORS="new slab" bin_dir=$here/bin_2m xargs="-DSLAB_HUGEPAGES" ubench_$alg.alloc_slab.reclaim_debra.pool_none.out || exit 1
+done
+cd $here
+
+echo "ds,config,nthreads,throughput,PAPI_TLB_DM,PAPI_L3_TCM,AnonHugePages_kB" > tlb.csv
+for alg in $algs; do
+    for config in new slab slab_2m; do
+        case $config in
+            new)     bin=bin_4k/ubench_$alg.alloc_new.reclaim_debra.pool_none.out ;;
+            slab)    bin=bin_4k/ubench_$alg.alloc_slab.reclaim_debra.pool_none.out ;;
+            slab_2m) bin=bin_2m/ubench_$alg.alloc_slab.reclaim_debra.pool_none.out ;;
+        esac
+        $bin $args > temp.txt &
+        pid=$!
+        sleep $((t / 2000))
+        huge=`grep AnonHugePages /proc/$pid/smaps_rollup 2>/dev/null | tr -s " " | cut -d" " -f2`
+        wait $pid
+        tput=`grep "total_throughput=" temp.txt | cut -d"=" -f2`
+        tlb=`grep "PAPI_TLB_DM=" temp.txt | cut -d"=" -f2`
+        l3=`grep "PAPI_L3_TCM=" temp.txt | cut -d"=" -f2`
+        echo "$alg,$config,$n,$tput,$tlb,$l3,$huge" | tee -a tlb.csv
+    done
+done
+rm -f temp.txt
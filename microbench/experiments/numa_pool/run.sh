@@ -0,0 +1,40 @@
+#!/bin/bash
+# Remote memory accesses with pool_none (nodes come from allocator_new
+# wherever malloc finds them) and pool_numa (retired nodes go back to the pool
+# of their home node, so copies are made in memory local to the writer).
+# remote_access_ratio is node-load-misses / node-loads from perf, i.e. the
+# share of loads that missed the LLC and were served by another socket.
+# retired_remote_ratio is the share of retired nodes that pool_numa had to
+# send to another node. Threads are pinned one socket after the other.
+# Needs libnuma and perf. Writes numa.csv.
+
+cd "$(dirname "$0")"
+here=`pwd`
+
+algs="btree_duplication btree_path_copy rb_tree_rec_dup"
+n=`cd .. && ./get_thread_count_max.sh`
+pin=`cd .. && ./get_pinning_cluster.sh`
+t=5000 k=20000000
+args="-nwork $n -nprefill $n -i 50 -d 50 -rq 0 -rqsize 1 -k $k -nrq 0 -t $t -pin $pin"
+
+cd ../..
+for alg in $algs; do
+    make -j has_libnuma=1 bin_dir=$here/bin ubench_$alg.alloc_new.reclaim_debra.pool_none.out ubench_$alg.alloc_new.reclaim_debra.pool_numa.out || exit 1
+done
+cd $here
+
+echo "ds,pool,nthreads,throughput,node_loads,node_load_misses,remote_access_ratio,retired_remote_ratio" > numa.csv
+for alg in $algs; do
+    for pool in none numa; do
+        perf stat -x, -e node-loads,node-load-misses -o perf.txt bin/ubench_$alg.alloc_new.reclaim_debra.pool_$pool.out $args > temp.txt
+        tput=`grep "total_throughput=" temp.txt | cut -d"=" -f2`
+        loads=`grep ",node-loads," perf.txt | cut -d"," -f1`
+        misses=`grep ",node-load-misses," perf.txt | cut -d"," -f1`
+        ratio=`echo "$misses $loads" | awk '{ if ($2 > 0) printf "%.4f", $1/$2 }'`
+        local=`grep "sum_pool_numa_home_local_total=" temp.txt | cut -d"=" -f2 | awk '{ s += $1 } END { print s+0 }'`
+        remote=`grep "sum_pool_numa_home_remote_total=" temp.txt | cut -d"=" -f2 | awk '{ s += $1 } END { print s+0 }'`
+        retired=`echo "$remote $local" | awk '{ if ($1+$2 > 0) printf "%.4f", $1/($1+$2) }'`
+        echo "$alg,$pool,$n,$tput,$loads,$misses,$ratio,$retired" | tee -a numa.csv
+    done
+done
+rm -f temp.txt perf.txt
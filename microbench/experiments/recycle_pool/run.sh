@@ -0,0 +1,41 @@
+#!/bin/bash
+# Throughput of the copying trees when every node they allocate comes from
+# malloc (alloc_new with pool_none), when nodes freed by a thread's epoch bags
+# are popped by its next allocations (alloc_new with pool_recycle), and with
+# the bump allocator, which never frees and so bounds what allocation can cost.
+# pooled_bytes_max is the largest pooled_bytes in the memory timeline, i.e.
+# what the free bags of pool_recycle hold at most.
+# Writes recycle.csv.
+
+cd "$(dirname "$0")"
+here=`pwd`
+
+algs="btree_duplication btree_path_copy bst_duplication bst_path_copy rb_tree_rec_dup"
+configs="new.none new.recycle bump.none"
+n=`cd .. && ./get_thread_count_max.sh`
+t=5000 k=2000000
+
+cd ../..
+for alg in $algs; do
+    for config in $configs; do
+        alloc=${config%.*} pool=${config#*.}
+        make -j ALLOCATORS="new bump" POOLS="none recycle" bin_dir=$here/bin xargs="-DMEASURE_MEMORY_TIMELINE" ubench_$alg.alloc_$alloc.reclaim_debra.pool_$pool.out || exit 1
+    done
+done
+cd $here
+
+echo "ds,alloc,pool,nthreads,updates,throughput,pooled_bytes_max,memory_bytes_per_key" > recycle.csv
+for alg in $algs; do
+    for u in 100 20; do
+        for config in $configs; do
+            alloc=${config%.*} pool=${config#*.}
+            half=$((u / 2))
+            bin/ubench_$alg.alloc_$alloc.reclaim_debra.pool_$pool.out -nwork $n -nprefill $n -i $half -d $half -rq 0 -rqsize 1 -k $k -nrq 0 -t $t > temp.txt
+            tput=`grep "total_throughput=" temp.txt | cut -d"=" -f2`
+            pooled=`grep "^timeline_memory" temp.txt | sed 's/.*pooled_bytes=\([0-9-]*\).*/\1/' | sort -n | tail -1`
+            perkey=`grep "memory_bytes_per_key=" temp.txt | cut -d"=" -f2`
+            echo "$alg,$alloc,$pool,$n,$u,$tput,$pooled,$perkey" | tee -a recycle.csv
+        done
+    done
+done
+rm -f temp.txt
@@ -0,0 +1,47 @@
+#!/bin/bash
+# Throughput and memory of the duplication and path copy trees under DEBRA and
+# under interval-based reclamation (reclaim_ibr). Each tree is run with as many
+# threads as cores, and with four times as many, so that threads are regularly
+# descheduled in the middle of an operation. DEBRA cannot free anything while
+# such a thread is stalled; IBR only keeps what was alive during its interval.
+# peak_rss_kB is VmHWM of the benchmark process, sampled until it exits.
+# limbo_bytes_max is the largest limbo_bytes in the memory timeline.
+# Writes robust.csv.
+
+cd "$(dirname "$0")"
+here=`pwd`
+
+algs="btree_duplication btree_path_copy bst_duplication bst_path_copy"
+reclaimers="debra ibr"
+n=`cd .. && ./get_thread_count_max.sh`
+t=5000 k=2000000
+
+cd ../..
+for alg in $algs; do
+    for r in $reclaimers; do
+        make -j bin_dir=$here/bin xargs="-DMEASURE_MEMORY_TIMELINE" ubench_$alg.alloc_new.reclaim_$r.pool_none.out || exit 1
+    done
+done
+cd $here
+
+echo "ds,reclaimer,nthreads,throughput,peak_rss_kB,limbo_bytes_max,memory_bytes_per_key" > robust.csv
+for alg in $algs; do
+    for nthreads in $n $((4 * n)); do
+        for r in $reclaimers; do
+            bin/ubench_$alg.alloc_new.reclaim_$r.pool_none.out -nwork $nthreads -nprefill $n -i 50 -d 50 -rq 0 -rqsize 1 -k $k -nrq 0 -t $t > temp.txt &
+            pid=$!
+            rss=0
+            while kill -0 $pid 2>/dev/null; do
+                hwm=`grep VmHWM /proc/$pid/status 2>/dev/null | tr -s " " | cut -d" " -f2`
+                [ -n "$hwm" ] && rss=$hwm
+                sleep 0.2
+            done
+            wait $pid
+            tput=`grep "total_throughput=" temp.txt | cut -d"=" -f2`
+            limbo=`grep "^timeline_memory" temp.txt | sed 's/.*limbo_bytes=\([0-9-]*\).*/\1/' | sort -n | tail -1`
+            perkey=`grep "memory_bytes_per_key=" temp.txt | cut -d"=" -f2`
+            echo "$alg,$r,$nthreads,$tput,$rss,$limbo,$perkey" | tee -a robust.csv
+        done
+    done
+done
+rm -f temp.txt
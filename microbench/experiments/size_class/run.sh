@@ -0,0 +1,59 @@
+#!/bin/bash
+# Separate inner and leaf node record managers (per_type) against one shared
+# size class (-DRECORD_MANAGER_SIZE_CLASSES), with allocator_new and with the
+# thread caching allocator_slab, whose per-type caches are where memory freed
+# as one node type could not serve the other. Insert heavy, delete heavy and
+# balanced workloads are run, since they retire leaves and inner nodes in
+# different proportions.
+# peak_rss_kB is VmHWM of the benchmark process, sampled until it exits.
+# limbo_bytes_max and pooled_bytes_max are the largest values in the memory
+# timeline. Writes size_class.csv.
+
+cd "$(dirname "$0")"
+here=`pwd`
+
+algs="btree_duplication btree_path_copy"
+allocs="new slab"
+configs="per_type size_class"
+n=`cd .. && ./get_thread_count_max.sh`
+t=5000 k=2000000
+
+cd ../..
+for alg in $algs; do
+    for config in $configs; do
+        case $config in
+            per_type)   x="-DMEASURE_MEMORY_TIMELINE" ;;
+            size_class) x="-DMEASURE_MEMORY_TIMELINE -DRECORD_MANAGER_SIZE_CLASSES" ;;
+        esac
+        for alloc in $allocs; do
+            make -j ALLOCATORS="new slab" bin_dir=$here/bin_$config xargs="$x" ubench_$alg.alloc_$alloc.reclaim_debra.pool_none.out || exit 1
+        done
+    done
+done
+cd $here
+
+echo "ds,alloc,config,nthreads,ins,del,throughput,peak_rss_kB,limbo_bytes_max,pooled_bytes_max,memory_bytes_per_key" > size_class.csv
+for alg in $algs; do
+    for alloc in $allocs; do
+        for mix in "90 10" "50 50" "10 90"; do
+            set -- $mix
+            for config in $configs; do
+                bin_$config/ubench_$alg.alloc_$alloc.reclaim_debra.pool_none.out -nwork $n -nprefill $n -i $1 -d $2 -rq 0 -rqsize 1 -k $k -nrq 0 -t $t > temp.txt &
+                pid=$!
+                rss=0
+                while kill -0 $pid 2>/dev/null; do
+                    hwm=`grep VmHWM /proc/$pid/status 2>/dev/null | tr -s " " | cut -d" " -f2`
+                    [ -n "$hwm" ] && rss=$hwm
+                    sleep 0.2
+                done
+                wait $pid
+                tput=`grep "total_throughput=" temp.txt | cut -d"=" -f2`
+                limbo=`grep "^timeline_memory" temp.txt | sed 's/.*limbo_bytes=\([0-9-]*\).*/\1/' | sort -n | tail -1`
+                pooled=`grep "^timeline_memory" temp.txt | sed 's/.*pooled_bytes=\([0-9-]*\).*/\1/' | sort -n | tail -1`
+                perkey=`grep "memory_bytes_per_key=" temp.txt | cut -d"=" -f2`
+                echo "$alg,$alloc,$config,$n,$1,$2,$tput,$rss,$limbo,$pooled,$perkey" | tee -a size_class.csv
+            done
+        done
+    done
+done
+rm -f temp.txt
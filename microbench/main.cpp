@@ -71,11 +71,15 @@ PAD;
 
 #include "adapter.h" /* data structure adapter header (selected according to the "ds/..." subdirectory in the -I include paths */
 #include "tree_stats.h"
+#include "memory_footprint.h"
 #define DS_ADAPTER_T ds_adapter<test_type, VALUE_TYPE, RECLAIM<>, ALLOC<>, POOL<> >
 
 #ifndef INSERT_FUNC
     #define INSERT_FUNC insertIfAbsent
 #endif
+#ifndef MEMORY_TIMELINE_INTERVAL_MS
+    #define MEMORY_TIMELINE_INTERVAL_MS 100
+#endif
 
 #ifdef RQ_SNAPCOLLECTOR
     #define RQ_SNAPCOLLECTOR_OBJECT_TYPES , SnapCollector<node_t<test_type, test_type>, test_type>, SnapCollector<node_t<test_type, test_type>, test_type>::NodeWrapper, ReportItem, CompactReportItem
@@ -773,7 +777,25 @@ void trial(GlobalsT * g) {
     //      and exit(-1) if running doesn't hit 0.
 
     if (MILLIS_TO_RUN > 0) {
+#ifdef MEASURE_MEMORY_TIMELINE
+        // sleep in short intervals, and sample the memory footprint after each one
+        for (long ms = 0; ms < MILLIS_TO_RUN; ) {
+            const long interval = std::min((long) MEMORY_TIMELINE_INTERVAL_MS, MILLIS_TO_RUN - ms);
+            timespec tsInterval;
+            tsInterval.tv_sec = interval / 1000;
+            tsInterval.tv_nsec = (interval % 1000) * ((__syscall_slong_t) 1000000);
+            nanosleep(&tsInterval, NULL);
+            ms += interval;
+            memory_footprint m = getMemoryFootprint();
+            printf("timeline_memory ms=%ld live_bytes=%lld limbo_bytes=%lld pooled_bytes=%lld\n", ms, m.liveBytes, m.limboBytes, m.pooledBytes);
+            for (memory_footprint_source & s : memoryFootprintSources()) {
+                memory_footprint t = getMemoryFootprint(s);
+                printf("timeline_type_memory ms=%ld type=%s live_bytes=%lld limbo_bytes=%lld pooled_bytes=%lld\n", ms, s.name, t.liveBytes, t.limboBytes, t.pooledBytes);
+            }
+        }
+#else
         nanosleep(&tsExpected, NULL);
+#endif
         SOFTWARE_BARRIER;
         g->done = true;
         __sync_synchronize();
@@ -964,6 +986,20 @@ void printOutput(auto g) {
     }
 #endif
     
+    {
+        // taken after the workers have deinitialized, so limbo bags have been emptied into the pools
+        memory_footprint m = getMemoryFootprint();
+        COUTATOMIC("memory_live_bytes="<<m.liveBytes<<std::endl);
+        COUTATOMIC("memory_limbo_bytes="<<m.limboBytes<<std::endl);
+        COUTATOMIC("memory_pooled_bytes="<<m.pooledBytes<<std::endl);
+        COUTATOMIC("memory_bytes_per_key="<<(threadsSize > 0 ? (m.liveBytes + m.limboBytes + m.pooledBytes) / (double) threadsSize : 0)<<std::endl);
+        for (memory_footprint_source & s : memoryFootprintSources()) {
+            memory_footprint t = getMemoryFootprint(s);
+            COUTATOMIC("memory_type type="<<s.name<<" live_bytes="<<t.liveBytes<<" limbo_bytes="<<t.limboBytes<<" pooled_bytes="<<t.pooledBytes<<std::endl);
+        }
+        COUTATOMIC(std::endl);
+    }
+    
     COUTATOMIC("elapsed milliseconds          : "<<g->elapsedMillis<<std::endl);
     COUTATOMIC("napping milliseconds overtime : "<<g->elapsedMillisNapping<<std::endl);
     COUTATOMIC(std::endl);